@@ -8,9 +8,14 @@
 
 quint16 QAmqpChannelPrivate::nextChannelNumber = 0;
 QAmqpChannelPrivate::QAmqpChannelPrivate(QAmqpChannel *q)
-    : channelNumber(0),
+    : encodedName(1, '\0'),
+      channelNumber(0),
       opened(false),
       needOpen(true),
+      sharedChannel(false),
+      recovering(false),
+      qosRequested(false),
+      flowActive(true),
       prefetchSize(0),
       requestedPrefetchSize(0),
       prefetchCount(0),
@@ -32,6 +37,7 @@ void QAmqpChannelPrivate::init(int channel, QAmqpClient *c)
 {
     client = c;
     needOpen = (channel <= nextChannelNumber && channel != -1) ? false : true;
+    sharedChannel = !needOpen;
     channelNumber = channel == -1 ? ++nextChannelNumber : channel;
     nextChannelNumber = qMax(channelNumber, nextChannelNumber);
 }
@@ -75,6 +81,12 @@ bool QAmqpChannelPrivate::_q_method(const QAmqpMethodFrame &frame)
     return true;
 }
 
+void QAmqpChannelPrivate::setName(const QString &newName)
+{
+    name = newName;
+    encodedName = QAmqpFrame::encodeShortString(newName);
+}
+
 void QAmqpChannelPrivate::_q_open()
 {
     open();
@@ -90,11 +102,41 @@ void QAmqpChannelPrivate::sendFrame(const QAmqpFrame &frame)
     client->d_func()->sendFrame(frame);
 }
 
+QAmqpMetricsCounters *QAmqpChannelPrivate::metrics() const
+{
+    return client ? &client->d_func()->metrics : 0;
+}
+
 void QAmqpChannelPrivate::resetInternalState()
 {
     if (!opened) return;
     opened = false;
-    needOpen = true;
+
+    // only the object which originally opened the channel reopens it
+    needOpen = !sharedChannel;
+    recovering = topologyRecovery();
+}
+
+bool QAmqpChannelPrivate::topologyRecovery() const
+{
+    return client && client->d_func()->topologyRecovery;
+}
+
+bool QAmqpChannelPrivate::republishUnconfirmed() const
+{
+    return client && client->d_func()->topologyRecovery && client->d_func()->republishUnconfirmed;
+}
+
+/*!
+ * Replays what was set up on the channel before the connection was lost.
+ * Runs as soon as the channel is open again and sends everything back to
+ * back, the replies are handled as they come in like any others.
+ */
+void QAmqpChannelPrivate::recover()
+{
+    Q_Q(QAmqpChannel);
+    if (qosRequested)
+        q->qos(requestedPrefetchCount, requestedPrefetchSize);
 }
 
 void QAmqpChannelPrivate::open()
@@ -105,7 +147,7 @@ void QAmqpChannelPrivate::open()
     if (!client->isConnected())
         return;
 
-    qAmqpDebug("<- channel#open( channel=%d, name=%s )", channelNumber, qPrintable(name));
+    qAmqpProtocolDebug("<- channel#open( channel=%d, name=%s )", channelNumber, qPrintable(name));
     QAmqpMethodFrame frame(QAmqpFrame::Channel, miOpen);
     frame.setChannel(channelNumber);
 
@@ -129,24 +171,57 @@ void QAmqpChannelPrivate::flow(bool active)
     sendFrame(frame);
 }
 
-// NOTE: not implemented until I can figure out a good way to force the server
-//       to pause the channel in a test. It seems like RabbitMQ just doesn't
-//       care about flow control, preferring rather to use basic.qos
+/*!
+ * The broker asking us to stop or restart sending content on the channel.
+ * Newer RabbitMQ releases use connection.blocked instead, both end up
+ * holding back publishes, see QAmqpExchange::setMaxHeldBytes().
+ */
 void QAmqpChannelPrivate::flow(const QAmqpMethodFrame &frame)
 {
-    Q_UNUSED(frame);
-    qAmqpDebug("-> channel#flow( channel=%d, name=%s )", channelNumber, qPrintable(name));
+    Q_Q(QAmqpChannel);
+    QByteArray data = frame.arguments();
+    QDataStream stream(&data, QIODevice::ReadOnly);
+    const bool active = QAmqpFrame::readAmqpField(stream, QAmqpMetaType::Boolean).toBool();
+    qAmqpProtocolDebug("-> channel#flow( channel=%d, name=%s, active=%d )",
+                       channelNumber, qPrintable(name), active);
+
+    // objects borrowing the channel see the same frame, only the owner answers
+    if (!sharedChannel)
+        flowOk(active);
+    if (active == flowActive)
+        return;
+
+    flowActive = active;
+    if (active)
+        Q_EMIT q->resumed();
+    else
+        Q_EMIT q->paused();
+    flowChanged();
 }
 
-void QAmqpChannelPrivate::flowOk()
+void QAmqpChannelPrivate::flowOk(bool active)
+{
+    qAmqpProtocolDebug("<- channel#flowOk( channel=%d, name=%s, active=%d )",
+                       channelNumber, qPrintable(name), active);
+
+    QByteArray arguments;
+    QDataStream stream(&arguments, QIODevice::WriteOnly);
+    QAmqpFrame::writeAmqpField(stream, QAmqpMetaType::Boolean, active);
+
+    QAmqpMethodFrame frame(QAmqpFrame::Channel, miFlowOk);
+    frame.setChannel(channelNumber);
+    frame.setArguments(arguments);
+    sendFrame(frame);
+}
+
+void QAmqpChannelPrivate::flowChanged()
 {
-    qAmqpDebug("<- channel#flowOk( channel=%d, name=%s )", channelNumber, qPrintable(name));
 }
 
 void QAmqpChannelPrivate::flowOk(const QAmqpMethodFrame &frame)
 {
     Q_Q(QAmqpChannel);
-    qAmqpDebug("-> channel#flowOk( channel=%d, name=%s )", channelNumber, qPrintable(name));
+    qAmqpProtocolDebug("-> channel#flowOk( channel=%d, name=%s )", channelNumber, qPrintable(name));
 
     QByteArray data = frame.arguments();
     QDataStream stream(&data, QIODevice::ReadOnly);
@@ -159,8 +234,8 @@ void QAmqpChannelPrivate::flowOk(const QAmqpMethodFrame &frame)
 
 void QAmqpChannelPrivate::close(int code, const QString &text, int classId, int methodId)
 {
-    qAmqpDebug("<- channel#close( channel=%d, name=%s, reply-code=%d, text=%s class-id=%d, method-id:%d, )",
-               channelNumber, qPrintable(name), code, qPrintable(text), classId, methodId);
+    qAmqpProtocolDebug("<- channel#close( channel=%d, name=%s, reply-code=%d, text=%s class-id=%d, method-id:%d, )",
+                       channelNumber, qPrintable(name), code, qPrintable(text), classId, methodId);
 
     QByteArray arguments;
     QDataStream stream(&arguments, QIODevice::WriteOnly);
@@ -202,8 +277,8 @@ void QAmqpChannelPrivate::close(const QAmqpMethodFrame &frame)
         Q_EMIT q->error(error);
     }
 
-    qAmqpDebug("-> channel#close( channel=%d, name=%s, reply-code=%d, reply-text=%s, class-id=%d, method-id=%d, )",
-               channelNumber, qPrintable(name), code, qPrintable(text), classId, methodId);
+    qAmqpProtocolDebug("-> channel#close( channel=%d, name=%s, reply-code=%d, reply-text=%s, class-id=%d, method-id=%d, )",
+                       channelNumber, qPrintable(name), code, qPrintable(text), classId, methodId);
 
     // complete handshake
     QAmqpMethodFrame closeOkFrame(QAmqpFrame::Channel, miCloseOk);
@@ -216,7 +291,7 @@ void QAmqpChannelPrivate::close(const QAmqpMethodFrame &frame)
 
 void QAmqpChannelPrivate::closeOk(const QAmqpMethodFrame &)
 {
-    qAmqpDebug("-> channel#closeOk( channel=%d, name=%s )", channelNumber, qPrintable(name));
+    qAmqpProtocolDebug("-> channel#closeOk( channel=%d, name=%s )", channelNumber, qPrintable(name));
     notifyClosed();
 }
 
@@ -231,8 +306,13 @@ void QAmqpChannelPrivate::notifyClosed()
 void QAmqpChannelPrivate::openOk(const QAmqpMethodFrame &)
 {
     Q_Q(QAmqpChannel);
-    qAmqpDebug("-> channel#openOk( channel=%d, name=%s )", channelNumber, qPrintable(name));
+    qAmqpProtocolDebug("-> channel#openOk( channel=%d, name=%s )", channelNumber, qPrintable(name));
     opened = true;
+    if (recovering) {
+        recovering = false;
+        recover();
+    }
+
     Q_EMIT q->opened();
     q->channelOpened();
 }
@@ -241,13 +321,16 @@ void QAmqpChannelPrivate::_q_disconnected()
 {
     nextChannelNumber = 0;
     opened = false;
+
+    // the channel is opened afresh, and a new channel starts out flowing
+    flowActive = true;
 }
 
 void QAmqpChannelPrivate::qosOk(const QAmqpMethodFrame &frame)
 {
     Q_Q(QAmqpChannel);
     Q_UNUSED(frame)
-    qAmqpDebug("-> basic#qosOk( channel=%d, name=%s )", channelNumber, qPrintable(name));
+    qAmqpProtocolDebug("-> basic#qosOk( channel=%d, name=%s )", channelNumber, qPrintable(name));
 
     prefetchCount = requestedPrefetchCount;
     prefetchSize = requestedPrefetchSize;
@@ -297,7 +380,7 @@ int QAmqpChannel::channelNumber() const
 void QAmqpChannel::setName(const QString &name)
 {
     Q_D(QAmqpChannel);
-    d->name = name;
+    d->setName(name);
 }
 
 bool QAmqpChannel::isOpen() const
@@ -317,13 +400,14 @@ void QAmqpChannel::qos(qint16 prefetchCount, qint32 prefetchSize)
 
     d->requestedPrefetchSize = prefetchSize;
     d->requestedPrefetchCount = prefetchCount;
+    d->qosRequested = true;
 
     stream << qint32(prefetchSize);
     stream << qint16(prefetchCount);
     stream << qint8(0x0);   // global
 
-    qAmqpDebug("<- basic#qos( channel=%d, name=%s, prefetch-size=%d, prefetch-count=%d, global=%d )",
-               d->channelNumber, qPrintable(d->name), prefetchSize, prefetchCount, 0);
+    qAmqpProtocolDebug("<- basic#qos( channel=%d, name=%s, prefetch-size=%d, prefetch-count=%d, global=%d )",
+                       d->channelNumber, qPrintable(d->name), prefetchSize, prefetchCount, 0);
 
     frame.setArguments(arguments);
     d->sendFrame(frame);
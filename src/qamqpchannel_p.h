@@ -5,6 +5,8 @@
 #include "qamqpframe_p.h"
 #include "qamqptable.h"
 
+class QAmqpMetricsCounters;
+
 #define METHOD_ID_ENUM(name, id) name = id, name ## Ok
 
 class QAmqpChannel;
@@ -40,11 +42,18 @@ public:
 
     void init(int channel, QAmqpClient *client);
     void sendFrame(const QAmqpFrame &frame);
+    QAmqpMetricsCounters *metrics() const;
     virtual void resetInternalState();
 
+    // topology recovery, see QAmqpClient::setTopologyRecovery
+    bool topologyRecovery() const;
+    bool republishUnconfirmed() const;
+    virtual void recover();
+
     void open();
     void flow(bool active);
-    void flowOk();
+    void flowOk(bool active);
+    virtual void flowChanged();
     void close(int code, const QString &text, int classId, int methodId);
     void notifyClosed();
 
@@ -61,12 +70,20 @@ public:
     virtual void _q_disconnected();
     void _q_open();
 
+    // the name and its shortstr encoding always change together
+    void setName(const QString &newName);
+
     QPointer<QAmqpClient> client;
     QString name;
+    QByteArray encodedName;
     quint16 channelNumber;
     static quint16 nextChannelNumber;
     bool opened;
     bool needOpen;
+    bool sharedChannel;
+    bool recovering;
+    bool qosRequested;
+    bool flowActive;
 
     qint32 prefetchSize;
     qint32 requestedPrefetchSize;
@@ -1,8 +1,15 @@
 #include <QTimer>
 #include <QTextStream>
 #include <QStringList>
-#include <QSslSocket>
+#include <QIODevice>
 #include <QtEndian>
+#include <QVector>
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
+#include <QRandomGenerator>
+#endif
+
+#include <algorithm>
+#include <limits>
 
 #include "qamqpglobal.h"
 #include "qamqpexchange.h"
@@ -11,28 +18,59 @@
 #include "qamqpqueue_p.h"
 #include "qamqpauthenticator.h"
 #include "qamqptable.h"
+#include "qamqpmetrics.h"
+#include "qamqptracer.h"
+#include "qamqptransport.h"
 #include "qamqpclient_p.h"
 #include "qamqpclient.h"
 
+QAmqpReadArena::QAmqpReadArena(QByteArray *buffer)
+    : device(buffer),
+      stream(&device),
+      busy(false)
+{
+    device.open(QIODevice::ReadOnly);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
 QAmqpClientPrivate::QAmqpClientPrivate(QAmqpClient *q)
     : port(AMQP_PORT),
       host(AMQP_HOST),
       virtualHost(AMQP_VHOST),
+      currentEndpoint(-1),
+      failoverStrategy(QAmqpClient::OrderedFailover),
+      connectTimeout(0),
+      readArena(&buffer),
+      readFrameBudget(0),
+      readByteBudget(0),
+      readResumePending(false),
+      writeBatchDepth(0),
       autoReconnect(false),
       reconnectFixedTimeout(false),
-      timeout(0),
+      reconnectAttempt(0),
+      topologyRecovery(false),
+      republishUnconfirmed(false),
       connecting(false),
       useSsl(false),
-      socket(0),
+      transport(0),
       closed(false),
       connected(false),
+      frameSent(false),
       channelMax(0),
       heartbeatDelay(0),
       frameMax(AMQP_FRAME_MAX),
+      connectionBlocked(false),
+      autoTuneFrameMax(false),
+      messageSizeCount(0),
       error(QAMQP::NoError),
+      tracer(0),
       q_ptr(q)
 {
     qRegisterMetaType<QAmqpMessage::PropertyHash>();
+    qRegisterMetaType<QAmqpMessage>();
+    partialBody.channel = 0;
+    std::fill(messageSizes, messageSizes + 33, 0);
 }
 
 QAmqpClientPrivate::~QAmqpClientPrivate()
@@ -47,7 +85,10 @@ void QAmqpClientPrivate::init()
     QObject::connect(heartbeatTimer, SIGNAL(timeout()), q, SLOT(_q_heartbeat()));
     reconnectTimer = new QTimer(q);
     reconnectTimer->setSingleShot(true);
-    QObject::connect(reconnectTimer, SIGNAL(timeout()), q, SLOT(_q_connect()));
+    QObject::connect(reconnectTimer, SIGNAL(timeout()), q, SLOT(_q_reconnect()));
+    connectTimer = new QTimer(q);
+    connectTimer->setSingleShot(true);
+    QObject::connect(connectTimer, SIGNAL(timeout()), q, SLOT(_q_connectTimeout()));
 
     authenticator = QSharedPointer<QAmqpAuthenticator>(
         new QAmqpPlainAuthenticator(QString::fromLatin1(AMQP_LOGIN), QString::fromLatin1(AMQP_PSWD)));
@@ -56,49 +97,48 @@ void QAmqpClientPrivate::init()
 void QAmqpClientPrivate::initSocket()
 {
     Q_Q(QAmqpClient);
-    socket = new QSslSocket(q);
-    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
-    socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
-    QObject::connect(socket, SIGNAL(connected()), q, SLOT(_q_socketConnected()));
-    QObject::connect(socket, SIGNAL(disconnected()), q, SLOT(_q_socketDisconnected()));
-    QObject::connect(socket, SIGNAL(readyRead()), q, SLOT(_q_readyRead()));
-#if QT_VERSION >= 0x060000
-    QObject::connect(socket,
-                     SIGNAL(errorOccurred(QAbstractSocket::SocketError)),
-                     q,
-                     SLOT(_q_socketError(QAbstractSocket::SocketError)));
-    QObject::connect(socket,
-                     SIGNAL(errorOccurred(QAbstractSocket::SocketError)),
-                     q,
-                     SIGNAL(socketErrorOccurred(QAbstractSocket::SocketError)));
-#else
-    QObject::connect(socket,
-                     SIGNAL(error(QAbstractSocket::SocketError)),
-                     q,
-                     SLOT(_q_socketError(QAbstractSocket::SocketError)));
-    QObject::connect(socket,
-                     SIGNAL(error(QAbstractSocket::SocketError)),
-                     q,
-                     SIGNAL(socketErrorOccurred(QAbstractSocket::SocketError)));
-#endif
-    QObject::connect(socket, SIGNAL(stateChanged(QAbstractSocket::SocketState)),
-                          q, SIGNAL(socketStateChanged(QAbstractSocket::SocketState)));
-    QObject::connect(socket, SIGNAL(sslErrors(QList<QSslError>)),
-                          q, SIGNAL(sslErrors(QList<QSslError>)));
+    setTransport(new QAmqpSocketTransport(q));
 }
 
-void QAmqpClientPrivate::resetChannelState()
+void QAmqpClientPrivate::setTransport(QAmqpTransport *newTransport)
 {
-    foreach (QString exchangeName, exchanges.channels()) {
-      QAmqpExchange *exchange =
-        qobject_cast<QAmqpExchange*>(exchanges.get(exchangeName));
-      if (exchange) exchange->d_ptr->resetInternalState();
+    Q_Q(QAmqpClient);
+    if (transport) {
+        QObject::disconnect(transport, 0, q, 0);
+        QObject::disconnect(transport->device(), 0, q, 0);
+        transport->abort();
+        if (transport->parent() == q)
+            transport->deleteLater();
+    }
+
+    transport = newTransport;
+    if (!transport)
+        return;
+
+    QObject::connect(transport, SIGNAL(connected()), q, SLOT(_q_socketConnected()));
+    QObject::connect(transport, SIGNAL(disconnected()), q, SLOT(_q_socketDisconnected()));
+    QObject::connect(transport, SIGNAL(readyRead()), q, SLOT(_q_readyRead()));
+    QObject::connect(transport, SIGNAL(errorOccurred(QAbstractSocket::SocketError)),
+                     q, SLOT(_q_socketError(QAbstractSocket::SocketError)));
+    QObject::connect(transport, SIGNAL(errorOccurred(QAbstractSocket::SocketError)),
+                     q, SIGNAL(socketErrorOccurred(QAbstractSocket::SocketError)));
+    QObject::connect(transport, SIGNAL(stateChanged(QAbstractSocket::SocketState)),
+                     q, SIGNAL(socketStateChanged(QAbstractSocket::SocketState)));
+    QObject::connect(transport->device(), SIGNAL(bytesWritten(qint64)), q, SLOT(_q_bytesWritten()));
+    if (qobject_cast<QAmqpSocketTransport*>(transport)) {
+        QObject::connect(transport, SIGNAL(sslErrors(QList<QSslError>)),
+                         q, SIGNAL(sslErrors(QList<QSslError>)));
     }
+}
 
-    foreach (QString queueName, queues.channels()) {
-      QAmqpQueue *queue =
-        qobject_cast<QAmqpQueue*>(queues.get(queueName));
-      if (queue) queue->d_ptr->resetInternalState();
+void QAmqpClientPrivate::resetChannelState()
+{
+    // every channel object registers as a method handler, which also covers
+    // those never stored by name: unnamed queues and exchanges riding on
+    // another object's channel
+    foreach (const QList<QAmqpMethodFrameHandler*> &handlers, methodHandlersByChannel) {
+        foreach (QAmqpMethodFrameHandler *handler, handlers)
+            static_cast<QAmqpChannelPrivate*>(handler)->resetInternalState();
     }
 }
 
@@ -122,6 +162,12 @@ void QAmqpClientPrivate::setPassword(const QString &password)
 
 void QAmqpClientPrivate::parseConnectionString(const QString &uri)
 {
+    if (uri.contains(QLatin1Char(','))) {
+        parseEndpoints(uri.split(QLatin1Char(',')));
+        return;
+    }
+
+    endpoints.clear();
     QUrl connectionString = QUrl::fromUserInput(uri);
 
     if (connectionString.scheme() != AMQP_SCHEME &&
@@ -142,11 +188,120 @@ void QAmqpClientPrivate::parseConnectionString(const QString &uri)
     setUsername(connectionString.userName());
 }
 
+static int randomIndex(int bound)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
+    return int(QRandomGenerator::global()->bounded(bound));
+#else
+    return qrand() % bound;
+#endif
+}
+
+/*
+ * The first uri sets the credentials and the virtual host, the others only
+ * add a host, port and scheme to fail over to. Those may be bare host:port
+ * pairs, in which case they share the first one's scheme.
+ */
+void QAmqpClientPrivate::parseEndpoints(const QStringList &uris)
+{
+    endpoints.clear();
+    untriedEndpoints.clear();
+    currentEndpoint = -1;
+
+    QString scheme;
+    foreach (QString uri, uris) {
+        uri = uri.trimmed();
+        if (uri.isEmpty())
+            continue;
+
+        if (scheme.isEmpty()) {
+            parseConnectionString(uri);
+            scheme = useSsl ? AMQP_SSL_SCHEME : AMQP_SCHEME;
+        } else if (!uri.contains(QLatin1String("://"))) {
+            uri.prepend(scheme + QLatin1String("://"));
+        }
+
+        QUrl url(uri);
+        if (url.scheme() != AMQP_SCHEME && url.scheme() != AMQP_SSL_SCHEME) {
+            qAmqpDebug() << Q_FUNC_INFO << "invalid scheme: " << url.scheme();
+            continue;
+        }
+
+        Endpoint endpoint;
+        endpoint.useSsl = (url.scheme() == AMQP_SSL_SCHEME);
+        endpoint.host = url.host();
+        endpoint.port = url.port((endpoint.useSsl ? AMQP_SSL_PORT : AMQP_PORT));
+        endpoint.connectLatency = -1;
+        endpoint.failed = false;
+        endpoints.append(endpoint);
+
+        // "amqp://user@a,b/vhost" puts the virtual host on the last one
+        if (virtualHost.isEmpty() && !url.path().isEmpty()) {
+            QString vhost = url.path();
+            if (vhost.startsWith("/") && vhost.size() > 1)
+                vhost = vhost.mid(1);
+            virtualHost = vhost;
+        }
+    }
+
+    if (endpoints.size() < 2)
+        endpoints.clear();
+}
+
+void QAmqpClientPrivate::startFailoverRound()
+{
+    untriedEndpoints.clear();
+    for (int i = 0; i < endpoints.size(); ++i)
+        untriedEndpoints.append(i);
+
+    switch (failoverStrategy) {
+    case QAmqpClient::OrderedFailover:
+        break;
+    case QAmqpClient::RandomFailover:
+        for (int i = untriedEndpoints.size() - 1; i > 0; --i)
+            std::swap(untriedEndpoints[i], untriedEndpoints[randomIndex(i + 1)]);
+        break;
+    case QAmqpClient::LowestLatencyFailover:
+    {
+        // measured ones fastest first, then the unknown, then the ones that failed
+        QVector<QPair<qint64, int> > order;
+        for (int i = 0; i < endpoints.size(); ++i) {
+            const Endpoint &endpoint = endpoints.at(i);
+            qint64 key = endpoint.connectLatency;
+            if (endpoint.failed)
+                key = std::numeric_limits<qint64>::max();
+            else if (key < 0)
+                key = std::numeric_limits<qint64>::max() - 1;
+            order.append(qMakePair(key, i));
+        }
+
+        std::sort(order.begin(), order.end());
+        untriedEndpoints.clear();
+        for (int i = 0; i < order.size(); ++i)
+            untriedEndpoints.append(order.at(i).second);
+        break;
+    }
+    }
+}
+
+bool QAmqpClientPrivate::nextEndpoint()
+{
+    if (untriedEndpoints.isEmpty())
+        return false;
+
+    currentEndpoint = untriedEndpoints.takeFirst();
+    const Endpoint &endpoint = endpoints.at(currentEndpoint);
+    host = endpoint.host;
+    port = endpoint.port;
+    useSsl = endpoint.useSsl;
+    return true;
+}
+
 void QAmqpClientPrivate::_q_connect()
 {
     if (reconnectTimer)
         reconnectTimer->stop();
-    if (socket->state() != QAbstractSocket::UnconnectedState) {
+    if (transport->state() != QAbstractSocket::UnconnectedState) {
         qAmqpDebug() << Q_FUNC_INFO << "socket already connected, disconnecting..";
         _q_disconnect();
         // We need to explicitly close connection here because either way it will not be closed until we receive closeOk
@@ -154,22 +309,52 @@ void QAmqpClientPrivate::_q_connect()
     }
 
     qAmqpDebug() << "connecting to host: " << host << ", port: " << port;
-    if (useSsl)
-        socket->connectToHostEncrypted(host, port);
-    else
-        socket->connectToHost(host, port);
+    connectClock.start();
+    if (connectTimer && connectTimeout > 0)
+        connectTimer->start(connectTimeout);
+    transport->connectToHost(host, port, useSsl);
+}
+
+void QAmqpClientPrivate::_q_reconnect()
+{
+    metrics.reconnectCount.fetchAndAddRelaxed(1);
+    if (!endpoints.isEmpty()) {
+        if (untriedEndpoints.isEmpty())
+            startFailoverRound();
+        nextEndpoint();
+    }
+
+    _q_connect();
+}
+
+void QAmqpClientPrivate::_q_connectTimeout()
+{
+    Q_Q(QAmqpClient);
+    if (connected)
+        return;
+
+    qAmqpDebug() << "no connection to" << host << "after" << connectTimeout << "ms";
+
+    // in place before anything connected to the signals below reads it
+    const QString reason = QLatin1String("connection timed out");
+    errorString = reason;
+    Q_EMIT q->socketErrorOccurred(QAbstractSocket::SocketTimeoutError);
+    connectionFailed(reason);
 }
 
 void QAmqpClientPrivate::_q_disconnect()
 {
     if (reconnectTimer)
         reconnectTimer->stop();
-    if (socket->state() == QAbstractSocket::UnconnectedState) {
+    if (connectTimer)
+        connectTimer->stop();
+    if (transport->state() == QAbstractSocket::UnconnectedState) {
         qAmqpDebug() << Q_FUNC_INFO << "already disconnected";
         return;
     }
 
     buffer.clear();
+    partialBody.channel = 0;
     close(200, "client disconnect");
 }
 
@@ -178,40 +363,100 @@ void QAmqpClientPrivate::_q_socketConnected()
 {
     if (reconnectTimer)
         reconnectTimer->stop();
-    if(reconnectFixedTimeout == false)
-        timeout = 0;
+    if (currentEndpoint >= 0 && currentEndpoint < endpoints.size()) {
+        Endpoint &endpoint = endpoints[currentEndpoint];
+        endpoint.connectLatency = connectClock.elapsed();
+        endpoint.failed = false;
+    }
+    lastReceived.start();
     char header[8] = {'A', 'M', 'Q', 'P', 0, 0, 9, 1};
-    socket->write(header, 8);
+    transport->device()->write(header, 8);
 }
 
 void QAmqpClientPrivate::_q_socketDisconnected()
 {
     Q_Q(QAmqpClient);
     buffer.clear();
+    writeBatch.clear();
+    partialBody.channel = 0;
     resetChannelState();
+    metrics.clearRoundTrips();
+    qAmqpStoreRelaxed(metrics.outgoingBufferSize, qint64(0));
+    if (heartbeatTimer)
+        heartbeatTimer->stop();
+    if (connectTimer)
+        connectTimer->stop();
+    lastReceived.invalidate();
     if (connected)
         connected = false;
+
+    // a broker still short on resources blocks the next connection again
+    connectionBlocked = false;
+    blockedReason.clear();
     Q_EMIT q->disconnected();
 }
 
+/*
+ * Ticks at half the negotiated interval. A heartbeat only goes out when
+ * nothing else was sent since the previous tick, and the peer is given up
+ * on once two full intervals passed without a single byte from it.
+ */
 void QAmqpClientPrivate::_q_heartbeat()
 {
-    QAmqpHeartbeatFrame frame;
-    sendFrame(frame);
+    if (lastReceived.isValid() && lastReceived.elapsed() >= 2000 * qint64(heartbeatDelay)) {
+        heartbeatTimedOut();
+        return;
+    }
+
+    const bool idle = !frameSent;
+    frameSent = false;
+    if (idle) {
+        QAmqpHeartbeatFrame frame;
+        sendFrame(frame);
+    }
 }
 
-void QAmqpClientPrivate::_q_socketError(QAbstractSocket::SocketError error)
+void QAmqpClientPrivate::heartbeatTimedOut()
 {
-    if(reconnectFixedTimeout == false)
-    {
-        if (timeout <= 0) {
-            timeout = 1000;
-        } else {
-            if (timeout < 120000)
-                timeout *= 5;
-        }
+    Q_Q(QAmqpClient);
+    qAmqpDebug() << "no traffic from the peer for" << lastReceived.elapsed() << "ms, dropping the connection";
+
+    // a half-open connection can't carry a close, so skip the handshake and
+    // reconnect right away rather than after the error backoff
+    if (heartbeatTimer)
+        heartbeatTimer->stop();
+    errorString = QLatin1String("missed heartbeats from the peer");
+    Q_EMIT q->socketErrorOccurred(QAbstractSocket::SocketTimeoutError);
+    transport->abort();
+
+    scheduleReconnect(true);
+}
+
+void QAmqpClientPrivate::scheduleReconnect(bool immediately)
+{
+    Q_Q(QAmqpClient);
+    if (!autoReconnect || !reconnectTimer)
+        return;
+
+    ++reconnectAttempt;
+    if (!reconnectPolicy.canRetry(reconnectAttempt)) {
+        qAmqpDebug() << "giving up reconnecting after" << reconnectAttempt - 1 << "attempts";
+        return;
     }
 
+    const int delay = immediately ? 0 : reconnectPolicy.delay(reconnectAttempt);
+    qAmqpDebug() << "reconnect attempt" << reconnectAttempt << "after:" << delay << "ms";
+    Q_EMIT q->reconnecting(reconnectAttempt, delay);
+    reconnectTimer->start(delay);
+}
+
+void QAmqpClientPrivate::_q_bytesWritten()
+{
+    qAmqpStoreRelaxed(metrics.outgoingBufferSize, transport->device()->bytesToWrite());
+}
+
+void QAmqpClientPrivate::_q_socketError(QAbstractSocket::SocketError error)
+{
     switch (error) {
     case QAbstractSocket::ConnectionRefusedError:
     case QAbstractSocket::RemoteHostClosedError:
@@ -222,41 +467,213 @@ void QAmqpClientPrivate::_q_socketError(QAbstractSocket::SocketError error)
     case QAbstractSocket::ProxyConnectionTimeoutError:
 
     default:
-        qAmqpDebug() << "socket error: " << socket->errorString();
+        qAmqpDebug() << "socket error: " << transport->errorString();
         break;
     }
 
+    connectionFailed(transport->errorString());
+}
+
+void QAmqpClientPrivate::connectionFailed(const QString &reason)
+{
     // per spec, on any error we need to close the socket immediately
     // and send no more data. only try to send the close message if we
     // are actively connected
-    if (socket->state() == QAbstractSocket::ConnectedState ||
-        socket->state() == QAbstractSocket::ConnectingState) {
-        socket->abort();
+    if (transport->state() == QAbstractSocket::ConnectedState ||
+        transport->state() == QAbstractSocket::ConnectingState) {
+        transport->abort();
     }
 
-    errorString = socket->errorString();
+    errorString = reason;
 
-    if (autoReconnect && reconnectTimer) {
-        qAmqpDebug() << "trying to reconnect after: " << timeout << "ms";
-        reconnectTimer->start(timeout);
+    // a broker that never let us in, go straight on to the next one
+    if (!connected && currentEndpoint >= 0 && currentEndpoint < endpoints.size()) {
+        endpoints[currentEndpoint].failed = true;
+        if (!untriedEndpoints.isEmpty() && reconnectTimer) {
+            qAmqpDebug() << "failing over from" << host << "port" << port;
+            if (connectTimer)
+                connectTimer->stop();
+            reconnectTimer->start(0);
+            return;
+        }
     }
+
+    scheduleReconnect();
 }
 
 void QAmqpClientPrivate::_q_readyRead()
+{
+    lastReceived.start();
+    readFrames(transport->device());
+}
+
+void QAmqpClientPrivate::_q_resumeRead()
+{
+    readResumePending = false;
+    if (transport)
+        readFrames(transport->device());
+}
+
+void QAmqpClientPrivate::readFrames(QIODevice *device)
+{
+    // a handler that spins an event loop can bring us back in here while the
+    // connection's arena is still in use, the nested read gets its own
+    if (Q_UNLIKELY(readArena.busy)) {
+        QAmqpReadArena nested(&buffer);
+        readFrames(device, &nested);
+    } else {
+        readArena.busy = true;
+        readFrames(device, &readArena);
+        readArena.busy = false;
+    }
+
+    flushBatches();
+}
+
+void QAmqpClientPrivate::flushBatches()
+{
+    if (pendingBatches.isEmpty())
+        return;
+
+    QList<QPointer<QAmqpQueue> > batches;
+    batches.swap(pendingBatches);
+    foreach (const QPointer<QAmqpQueue> &queue, batches) {
+        if (queue)
+            queue->d_func()->flushBatch();
+    }
+}
+
+// body frames at least this large are read as their bytes arrive
+static const quint32 minPartialBodySize = 16384;
+
+bool QAmqpClientPrivate::beginPartialBody(QIODevice *device, quint16 channel, quint32 payloadSize)
+{
+    // anything out of the ordinary is left to the whole frame checks
+    if (payloadSize < minPartialBodySize || channel == 0 || qint64(payloadSize) > frameMax)
+        return false;
+
+    const QList<QAmqpContentBodyFrameHandler*> handlers = bodyHandlersByChannel.value(channel);
+    if (handlers.size() != 1 || !handlers.first()->_q_bodyBuffer(channel))
+        return false;
+
+    char header[QAmqpFrame::HEADER_SIZE];
+    device->read(header, QAmqpFrame::HEADER_SIZE);
+    partialBody.channel = channel;
+    partialBody.size = payloadSize;
+    partialBody.remaining = payloadSize;
+    partialBody.dropped = false;
+    partialBody.traceStart = Q_UNLIKELY(tracer) ? QAmqpTracer::now() : 0;
+    return true;
+}
+
+bool QAmqpClientPrivate::readPartialBody(QIODevice *device)
+{
+    const quint16 channel = partialBody.channel;
+    QAmqpContentBodyFrameHandler *handler = bodyHandlersByChannel.value(channel).value(0);
+    if (partialBody.remaining > 0) {
+        const qint32 available = qMin<qint64>(device->bytesAvailable(), partialBody.remaining);
+        if (available <= 0)
+            return false;
+
+        QByteArray *target = (handler && !partialBody.dropped) ? handler->_q_bodyBuffer(channel) : 0;
+        if (target) {
+            const int offset = target->size();
+            target->resize(offset + available);
+            device->read(target->data() + offset, available);
+        } else {
+            // the consumer went away halfway, the rest of the frame is dropped
+            partialBody.dropped = true;
+            buffer.resize(available);
+            device->read(buffer.data(), available);
+        }
+
+        partialBody.remaining -= available;
+        if (partialBody.remaining > 0)
+            return false;
+    }
+
+    char magic = 0;
+    if (!device->getChar(&magic))
+        return false;
+
+    partialBody.channel = 0;
+    if (Q_UNLIKELY(quint8(magic) != QAmqpFrame::FRAME_END)) {
+        close(QAMQP::UnexpectedFrameError, "wrong end of frame");
+        return false;
+    }
+
+    const qint64 frameSize = QAmqpFrame::HEADER_SIZE + partialBody.size + QAmqpFrame::FRAME_END_SIZE;
+    metrics.countFrame(QAmqpMetricsCounters::Received, QAmqpFrame::Body, channel, frameSize);
+    if (handler && !partialBody.dropped)
+        handler->_q_bodyReceived(channel, partialBody.size);
+
+    if (Q_UNLIKELY(tracer && partialBody.traceStart)) {
+        QAmqpTracer::FrameEvent trace;
+        trace.direction = QAmqpTracer::Received;
+        trace.frameType = QAmqpTracer::BodyFrame;
+        trace.channel = channel;
+        trace.classId = 0;
+        trace.methodId = 0;
+        trace.size = frameSize;
+        trace.startTime = partialBody.traceStart;
+        trace.endTime = QAmqpTracer::now();
+        tracer->frameEvent(trace);
+    }
+
+    return true;
+}
+
+void QAmqpClientPrivate::readFrames(QIODevice *device, QAmqpReadArena *arena)
 {
     Q_Q(QAmqpClient);
-    
-    while (socket->bytesAvailable() >= QAmqpFrame::HEADER_SIZE) {
+
+    const qint64 startAvailable = device->bytesAvailable();
+    int frames = 0;
+    for (;;) {
+        // past the budget whatever is left waits for the next event loop
+        // iteration, so timers and other sockets on this thread get a turn
+        if (Q_UNLIKELY(readFrameBudget || readByteBudget) && frames > 0 &&
+            ((readFrameBudget && frames >= readFrameBudget) ||
+             (readByteBudget && startAvailable - device->bytesAvailable() >= readByteBudget)) &&
+            device->bytesAvailable() > 0) {
+            metrics.readBudgetExhausted.fetchAndAddRelaxed(1);
+            if (!readResumePending) {
+                readResumePending = true;
+                QMetaObject::invokeMethod(q, "_q_resumeRead", Qt::QueuedConnection);
+            }
+            return;
+        }
+
+        if (Q_UNLIKELY(partialBody.channel)) {
+            if (!readPartialBody(device))
+                return;
+            ++frames;
+        }
+
+        if (device->bytesAvailable() < QAmqpFrame::HEADER_SIZE)
+            return;
+
         unsigned char headerData[QAmqpFrame::HEADER_SIZE];
-        socket->peek((char*)headerData, QAmqpFrame::HEADER_SIZE);
+        device->peek((char*)headerData, QAmqpFrame::HEADER_SIZE);
         const quint32 payloadSize = qFromBigEndian<quint32>(headerData + 3);
         const qint64 readSize = QAmqpFrame::HEADER_SIZE + payloadSize + QAmqpFrame::FRAME_END_SIZE;
 
-        if (socket->bytesAvailable() < readSize)
+        if (device->bytesAvailable() < readSize) {
+            // rather than letting a large body pile up in the transport and
+            // copying it out in one go, take what is there straight into the
+            // message it belongs to
+            if (headerData[0] == QAmqpFrame::Body &&
+                beginPartialBody(device, qFromBigEndian<quint16>(headerData + 1), payloadSize))
+                continue;
             return;
+        }
 
+        // reserved capacity is never given back, so a small method frame
+        // after a large body frame doesn't reallocate; frameMax bounds it
+        if (buffer.capacity() < readSize)
+            buffer.reserve(readSize);
         buffer.resize(readSize);
-        socket->read(buffer.data(), readSize);
+        device->read(buffer.data(), readSize);
         const char *bufferData = buffer.constData();
         const quint8 type = *(quint8*)&bufferData[0];
         const quint8 magic = *(quint8*)&bufferData[QAmqpFrame::HEADER_SIZE + payloadSize];
@@ -265,11 +682,32 @@ void QAmqpClientPrivate::_q_readyRead()
             return;
         }
 
-        QDataStream streamB(&buffer, QIODevice::ReadOnly);
+        metrics.countFrame(QAmqpMetricsCounters::Received, type,
+                           qFromBigEndian<quint16>(headerData + 1), readSize);
+
+        QAmqpTracer::FrameEvent trace;
+        trace.startTime = 0;
+        if (Q_UNLIKELY(tracer)) {
+            // ids are read off the wire image so tracing never decodes twice
+            const uchar *payload = reinterpret_cast<const uchar*>(bufferData) + QAmqpFrame::HEADER_SIZE;
+            const bool hasClass = (type == QAmqpFrame::Method && payloadSize >= 4) ||
+                                  (type == QAmqpFrame::Header && payloadSize >= 2);
+            trace.direction = QAmqpTracer::Received;
+            trace.frameType = static_cast<QAmqpTracer::FrameType>(type);
+            trace.channel = qFromBigEndian<quint16>(headerData + 1);
+            trace.classId = hasClass ? qFromBigEndian<quint16>(payload) : 0;
+            trace.methodId = (hasClass && type == QAmqpFrame::Method) ? qFromBigEndian<quint16>(payload + 2) : 0;
+            trace.size = readSize;
+            trace.startTime = QAmqpTracer::now();
+        }
+
+        QDataStream &streamB = arena->stream;
+        arena->device.seek(0);
+        streamB.resetStatus();
         switch (static_cast<QAmqpFrame::FrameType>(type)) {
         case QAmqpFrame::Method:
         {
-            QAmqpMethodFrame frame;
+            QAmqpMethodFrame &frame = arena->method;
             streamB >> frame;
 
             if (Q_UNLIKELY(frame.size() > frameMax)) {
@@ -277,6 +715,7 @@ void QAmqpClientPrivate::_q_readyRead()
                 return;
             }
 
+            metrics.replyReceived(frame.channel(), frame.methodClass(), frame.id());
             if (frame.methodClass() == QAmqpFrame::Connection) {
                 _q_method(frame);
             } else {
@@ -287,10 +726,11 @@ void QAmqpClientPrivate::_q_readyRead()
             break;
         case QAmqpFrame::Header:
         {
-            QAmqpContentFrame frame;
+            QAmqpContentFrame &frame = arena->content;
             streamB >> frame;
 
-            if (Q_UNLIKELY(frame.size() > frameMax)) {
+            // size() would encode the properties all over again
+            if (Q_UNLIKELY(qint64(payloadSize) > frameMax)) {
                 close(QAMQP::FrameError, "frame size too large");
                 return;
             } else if (Q_UNLIKELY(frame.channel() <= 0)) {
@@ -298,13 +738,15 @@ void QAmqpClientPrivate::_q_readyRead()
                 return;
             }
 
+            if (autoTuneFrameMax)
+                sampleMessageSize(frame.bodySize());
             foreach (QAmqpContentFrameHandler *methodHandler, contentHandlerByChannel[frame.channel()])
                 methodHandler->_q_content(frame);
         }
             break;
         case QAmqpFrame::Body:
         {
-            QAmqpContentBodyFrame frame;
+            QAmqpContentBodyFrame &frame = arena->body;
             streamB >> frame;
 
             if (Q_UNLIKELY(frame.size() > frameMax)) {
@@ -329,7 +771,7 @@ void QAmqpClientPrivate::_q_readyRead()
                 return;
             }
 
-            qAmqpDebug("AMQP: Heartbeat");
+            qAmqpProtocolDebug("AMQP: Heartbeat");
             Q_EMIT q->heartbeat();
         }
             break;
@@ -338,18 +780,125 @@ void QAmqpClientPrivate::_q_readyRead()
             close(QAMQP::FrameError, "invalid frame type");
             return;
         }
+
+        // a tracer installed while dispatching starts with the next frame
+        if (Q_UNLIKELY(tracer && trace.startTime)) {
+            trace.endTime = QAmqpTracer::now();
+            tracer->frameEvent(trace);
+        }
+        ++frames;
     }
 }
 
 void QAmqpClientPrivate::sendFrame(const QAmqpFrame &frame)
 {
-    if (socket->state() != QAbstractSocket::ConnectedState) {
-        qAmqpDebug() << Q_FUNC_INFO << "socket not connected: " << socket->state();
+    if (transport->state() != QAbstractSocket::ConnectedState) {
+        qAmqpDebug() << Q_FUNC_INFO << "socket not connected: " << transport->state();
+        return;
+    }
+
+    const qint64 traceStart = Q_UNLIKELY(tracer) ? QAmqpTracer::now() : 0;
+    if (writeBatchDepth) {
+        QDataStream stream(&writeBatch, QIODevice::WriteOnly | QIODevice::Append);
+        stream << frame;
+    } else {
+        QDataStream stream(transport->device());
+        stream << frame;
+    }
+    frameSent = true;
+    if (Q_UNLIKELY(tracer))
+        traceSentFrame(frame, traceStart);
+
+    metrics.countFrame(QAmqpMetricsCounters::Sent, frame.type(), frame.channel(), frame.wireSize());
+    if (frame.type() == QAmqpFrame::Method) {
+        const QAmqpMethodFrame &method = static_cast<const QAmqpMethodFrame&>(frame);
+        metrics.requestSent(frame.channel(), method.methodClass(), method.id());
+    } else if (frame.type() == QAmqpFrame::Header && autoTuneFrameMax) {
+        sampleMessageSize(static_cast<const QAmqpContentFrame&>(frame).bodySize());
+    }
+    qAmqpStoreRelaxed(metrics.outgoingBufferSize, transport->device()->bytesToWrite());
+}
+
+/*
+ * Batches nest, the frames collected are written when the outermost one
+ * ends. Anything still collected when the socket went away is dropped.
+ */
+void QAmqpClientPrivate::beginWriteBatch()
+{
+    ++writeBatchDepth;
+}
+
+void QAmqpClientPrivate::endWriteBatch()
+{
+    if (!writeBatchDepth || --writeBatchDepth)
         return;
+
+    if (!writeBatch.isEmpty() && transport->state() == QAbstractSocket::ConnectedState) {
+        transport->device()->write(writeBatch);
+        qAmqpStoreRelaxed(metrics.outgoingBufferSize, transport->device()->bytesToWrite());
+    }
+    writeBatch.clear();
+}
+
+void QAmqpClientPrivate::traceSentFrame(const QAmqpFrame &frame, qint64 startTime)
+{
+    QAmqpTracer::FrameEvent event;
+    event.direction = QAmqpTracer::Sent;
+    event.frameType = static_cast<QAmqpTracer::FrameType>(frame.type());
+    event.channel = frame.channel();
+    event.classId = 0;
+    event.methodId = 0;
+    if (frame.type() == QAmqpFrame::Method) {
+        const QAmqpMethodFrame &method = static_cast<const QAmqpMethodFrame&>(frame);
+        event.classId = method.methodClass();
+        event.methodId = method.id();
+    } else if (frame.type() == QAmqpFrame::Header) {
+        event.classId = static_cast<const QAmqpContentFrame&>(frame).methodClass();
+    }
+    event.size = frame.wireSize();
+    event.startTime = startTime;
+    event.endTime = QAmqpTracer::now();
+    tracer->frameEvent(event);
+}
+
+void QAmqpClientPrivate::sampleMessageSize(qint64 size)
+{
+    int bits = 0;
+    while (bits < 32 && (size >> bits))
+        ++bits;
+
+    // older samples fade out so the estimate follows what is sent now
+    if (messageSizeCount >= 65536) {
+        messageSizeCount = 0;
+        for (int i = 0; i < 33; ++i) {
+            messageSizes[i] /= 2;
+            messageSizeCount += messageSizes[i];
+        }
     }
+    ++messageSizes[bits];
+    ++messageSizeCount;
+}
+
+// auto tuned frames stay within these, frames larger than the messages
+// gain nothing and hold up other channels' frames queued behind them
+static const qint32 minTunedFrameMax = AMQP_FRAME_MAX;
+static const qint32 maxTunedFrameMax = 1024 * 1024;
 
-    QDataStream stream(socket);
-    stream << frame;
+qint32 QAmqpClientPrivate::tunedFrameMax(qint32 offered) const
+{
+    const qint32 ceiling = offered > 0 ? qMin(offered, maxTunedFrameMax) : maxTunedFrameMax;
+    const qint32 smallest = qMin(minTunedFrameMax, ceiling);
+    if (!messageSizeCount)
+        return smallest;
+
+    // big enough to carry nine in ten messages in a single body frame
+    quint32 seen = 0;
+    int bits = 0;
+    while (bits < 32 && (seen += messageSizes[bits]) < messageSizeCount - messageSizeCount / 10)
+        ++bits;
+
+    const qint64 wanted = (qint64(1) << bits) + QAmqpFrame::HEADER_SIZE + QAmqpFrame::FRAME_END_SIZE;
+    return qMin<qint64>(ceiling, qMax<qint64>(smallest, wanted));
 }
 
 void QAmqpClientPrivate::closeConnection()
@@ -361,7 +910,7 @@ void QAmqpClientPrivate::closeConnection()
         reconnectTimer->stop();
     if (heartbeatTimer)
         heartbeatTimer->stop();
-    socket->disconnectFromHost();
+    transport->disconnectFromHost();
 }
 
 bool QAmqpClientPrivate::_q_method(const QAmqpMethodFrame &frame)
@@ -395,6 +944,12 @@ bool QAmqpClientPrivate::_q_method(const QAmqpMethodFrame &frame)
     case QAmqpClientPrivate::miCloseOk:
         closeOk(frame);
         break;
+    case QAmqpClientPrivate::miBlocked:
+        blocked(frame);
+        break;
+    case QAmqpClientPrivate::miUnblocked:
+        unblocked(frame);
+        break;
     default:
         qAmqpDebug("Unknown method-id %d", frame.id());
     }
@@ -418,11 +973,11 @@ void QAmqpClientPrivate::start(const QAmqpMethodFrame &frame)
         QAmqpFrame::readAmqpField(stream, QAmqpMetaType::LongString).toString().split(' ');
     QString locales = QAmqpFrame::readAmqpField(stream, QAmqpMetaType::LongString).toString();
 
-    qAmqpDebug("-> connection#start( version_major=%d, version_minor=%d, mechanisms=(%s), locales=%s )",
-           version_major, version_minor, qPrintable(mechanisms.join(",")), qPrintable(locales));
+    qAmqpProtocolDebug("-> connection#start( version_major=%d, version_minor=%d, mechanisms=(%s), locales=%s )",
+                   version_major, version_minor, qPrintable(mechanisms.join(",")), qPrintable(locales));
 
     if (!mechanisms.contains(authenticator->type())) {
-        socket->disconnectFromHost();
+        transport->disconnectFromHost();
         return;
     }
 
@@ -432,7 +987,7 @@ void QAmqpClientPrivate::start(const QAmqpMethodFrame &frame)
 void QAmqpClientPrivate::secure(const QAmqpMethodFrame &frame)
 {
     Q_UNUSED(frame)
-    qAmqpDebug("-> connection#secure()");
+    qAmqpProtocolDebug("-> connection#secure()");
 }
 
 void QAmqpClientPrivate::tune(const QAmqpMethodFrame &frame)
@@ -448,16 +1003,27 @@ void QAmqpClientPrivate::tune(const QAmqpMethodFrame &frame)
     stream >> frame_max;
     stream >> heartbeat_delay;
 
-    if (!frameMax)
+    if (autoTuneFrameMax) {
+        frameMax = tunedFrameMax(frame_max);
+
+        // room for a few frames in flight each way
+        if (transport) {
+            transport->setSocketBufferSizes(4 * qint64(frameMax), 4 * qint64(frameMax));
+            qAmqpDebug() << "AMQP: tuned frameMax to" << frameMax << "of" << frame_max << "offered,"
+                         << "socket buffers" << transport->sendBufferSize()
+                         << "/" << transport->receiveBufferSize();
+        }
+    } else if (!frameMax) {
         frameMax = frame_max;
+    }
     channelMax = !channelMax ? channel_max : qMax(channel_max, channelMax);
     heartbeatDelay = !heartbeatDelay ? heartbeat_delay: heartbeatDelay;
 
-    qAmqpDebug("-> connection#tune( channel_max=%d, frame_max=%d, heartbeat=%d )",
-               channelMax, frameMax, heartbeatDelay);
+    qAmqpProtocolDebug("-> connection#tune( channel_max=%d, frame_max=%d, heartbeat=%d )",
+                       channelMax, frameMax, heartbeatDelay);
 
     if (heartbeatTimer) {
-        heartbeatTimer->setInterval(heartbeatDelay * 1000);
+        heartbeatTimer->setInterval(heartbeatDelay * 500);
         if (heartbeatTimer->interval())
             heartbeatTimer->start();
         else
@@ -472,18 +1038,53 @@ void QAmqpClientPrivate::openOk(const QAmqpMethodFrame &frame)
 {
     Q_Q(QAmqpClient);
     Q_UNUSED(frame)
-    qAmqpDebug("-> connection#openOk()");
+    qAmqpProtocolDebug("-> connection#openOk()");
     connected = true;
+    reconnectAttempt = 0;
+    untriedEndpoints.clear();
+    if (connectTimer)
+        connectTimer->stop();
     Q_EMIT q->connected();
 }
 
 void QAmqpClientPrivate::closeOk(const QAmqpMethodFrame &frame)
 {
     Q_UNUSED(frame)
-    qAmqpDebug("-> connection#closeOk()");
+    qAmqpProtocolDebug("-> connection#closeOk()");
     closeConnection();
 }
 
+/*!
+ * RabbitMQ stops reading from a connection that publishes while one of its
+ * resource alarms is on and says so with connection.blocked, sent only to
+ * clients that announce the capability in start-ok.
+ */
+void QAmqpClientPrivate::blocked(const QAmqpMethodFrame &frame)
+{
+    Q_Q(QAmqpClient);
+    QByteArray data = frame.arguments();
+    QDataStream stream(&data, QIODevice::ReadOnly);
+    const QString reason = QAmqpFrame::readAmqpField(stream, QAmqpMetaType::ShortString).toString();
+    qAmqpProtocolDebug("-> connection#blocked( reason=%s )", qPrintable(reason));
+
+    connectionBlocked = true;
+    blockedReason = reason;
+    Q_EMIT q->blocked(reason);
+}
+
+void QAmqpClientPrivate::unblocked(const QAmqpMethodFrame &frame)
+{
+    Q_Q(QAmqpClient);
+    Q_UNUSED(frame)
+    qAmqpProtocolDebug("-> connection#unblocked()");
+
+    if (!connectionBlocked)
+        return;
+    connectionBlocked = false;
+    blockedReason.clear();
+    Q_EMIT q->unblocked();
+}
+
 void QAmqpClientPrivate::close(const QAmqpMethodFrame &frame)
 {
     Q_Q(QAmqpClient);
@@ -495,8 +1096,8 @@ void QAmqpClientPrivate::close(const QAmqpMethodFrame &frame)
     stream >> classId;
     stream >> methodId;
 
-    qAmqpDebug("-> connection#close( reply-code=%d, reply-text=%s, class-id=%d, method-id:%d )",
-               code, qPrintable(text), classId, methodId);
+    qAmqpProtocolDebug("-> connection#close( reply-code=%d, reply-text=%s, class-id=%d, method-id:%d )",
+                       code, qPrintable(text), classId, methodId);
 
     QAMQP::Error checkError = static_cast<QAMQP::Error>(code);
     if (checkError != QAMQP::NoError) {
@@ -507,10 +1108,7 @@ void QAmqpClientPrivate::close(const QAmqpMethodFrame &frame)
         // if it was a force disconnect, simulate receiving a closeOk
         if (checkError == QAMQP::ConnectionForcedError) {
           closeConnection();
-          if (autoReconnect) {
-            qAmqpDebug() << "trying to reconnect after: " << timeout << "ms";
-            QTimer::singleShot(timeout, q, SLOT(_q_connect()));
-          }
+          scheduleReconnect();
 
           return;
         }
@@ -521,7 +1119,7 @@ void QAmqpClientPrivate::close(const QAmqpMethodFrame &frame)
 
     // complete handshake
     QAmqpMethodFrame closeOkFrame(QAmqpFrame::Connection, QAmqpClientPrivate::miCloseOk);
-    qAmqpDebug("<- connection#closeOk()");
+    qAmqpProtocolDebug("<- connection#closeOk()");
     sendFrame(closeOkFrame);
     closeConnection();
 }
@@ -536,6 +1134,10 @@ void QAmqpClientPrivate::startOk()
     clientProperties["version"] = QString(QAMQP_VERSION);
     clientProperties["platform"] = QString("Qt %1").arg(qVersion());
     clientProperties["product"] = QString("QAMQP");
+
+    QAmqpTable capabilities;
+    capabilities["connection.blocked"] = true;
+    clientProperties["capabilities"] = capabilities;
 #if QT_VERSION >= 0x060000
     clientProperties.insert(customProperties);
 #else
@@ -547,13 +1149,13 @@ void QAmqpClientPrivate::startOk()
     QAmqpFrame::writeAmqpField(stream, QAmqpMetaType::ShortString, QLatin1String("en_US"));
     frame.setArguments(arguments);
 
-    qAmqpDebug("<- connection#startOk()");  // @todo: fill this out
+    qAmqpProtocolDebug("<- connection#startOk()");  // @todo: fill this out
     sendFrame(frame);
 }
 
 void QAmqpClientPrivate::secureOk()
 {
-    qAmqpDebug("-> connection#secureOk()");
+    qAmqpProtocolDebug("-> connection#secureOk()");
 }
 
 void QAmqpClientPrivate::tuneOk()
@@ -566,8 +1168,8 @@ void QAmqpClientPrivate::tuneOk()
     stream << qint32(frameMax);
     stream << qint16(heartbeatDelay);
 
-    qAmqpDebug("<- connection#tuneOk( channelMax=%d, frameMax=%d, heartbeatDelay=%d )",
-               channelMax, frameMax, heartbeatDelay);
+    qAmqpProtocolDebug("<- connection#tuneOk( channelMax=%d, frameMax=%d, heartbeatDelay=%d )",
+                       channelMax, frameMax, heartbeatDelay);
 
     frame.setArguments(arguments);
     sendFrame(frame);
@@ -584,8 +1186,8 @@ void QAmqpClientPrivate::open()
     stream << qint8(0);
     stream << qint8(0);
 
-    qAmqpDebug("<- connection#open( virtualHost=%s, reserved-1=%d, reserved-2=%d )",
-               qPrintable(virtualHost), 0, 0);
+    qAmqpProtocolDebug("<- connection#open( virtualHost=%s, reserved-1=%d, reserved-2=%d )",
+                       qPrintable(virtualHost), 0, 0);
 
     frame.setArguments(arguments);
     sendFrame(frame);
@@ -600,8 +1202,8 @@ void QAmqpClientPrivate::close(int code, const QString &text, int classId, int m
     stream << qint16(classId);
     stream << qint16(methodId);
 
-    qAmqpDebug("<- connection#close( reply-code=%d, reply-text=%s, class-id=%d, method-id:%d )",
-               code, qPrintable(text), classId, methodId);
+    qAmqpProtocolDebug("<- connection#close( reply-code=%d, reply-text=%s, class-id=%d, method-id:%d )",
+                       code, qPrintable(text), classId, methodId);
 
     QAmqpMethodFrame frame(QAmqpFrame::Connection, QAmqpClientPrivate::miClose);
     frame.setArguments(arguments);
@@ -637,6 +1239,23 @@ bool QAmqpClient::isConnected() const
     return d->connected;
 }
 
+/*!
+ * Whether the broker stopped taking publishes on this connection with
+ * connection.blocked, until it sends connection.unblocked. Exchanges hold
+ * publishes back locally in the meantime, see QAmqpExchange::setMaxHeldBytes().
+ */
+bool QAmqpClient::isBlocked() const
+{
+    Q_D(const QAmqpClient);
+    return d->connectionBlocked;
+}
+
+QString QAmqpClient::blockedReason() const
+{
+    Q_D(const QAmqpClient);
+    return d->blockedReason;
+}
+
 quint16 QAmqpClient::port() const
 {
     Q_D(const QAmqpClient);
@@ -646,6 +1265,7 @@ quint16 QAmqpClient::port() const
 void QAmqpClient::setPort(quint16 port)
 {
     Q_D(QAmqpClient);
+    d->endpoints.clear();
     d->port = port;
 }
 
@@ -658,6 +1278,7 @@ QString QAmqpClient::host() const
 void QAmqpClient::setHost(const QString &host)
 {
     Q_D(QAmqpClient);
+    d->endpoints.clear();
     d->host = host;
 }
 
@@ -718,9 +1339,10 @@ QAmqpExchange *QAmqpClient::createExchange(const QString &name, int channelNumbe
 {
     Q_D(QAmqpClient);
     QAmqpExchange *exchange;
-    if (d->exchanges.contains(name)) {
+    bool known = d->exchanges.contains(name);
+    if (known) {
         exchange = qobject_cast<QAmqpExchange*>(d->exchanges.get(name));
-        if (exchange)
+        if (exchange && (channelNumber == -1 || exchange->channelNumber() == channelNumber))
             return exchange;
     }
 
@@ -728,11 +1350,17 @@ QAmqpExchange *QAmqpClient::createExchange(const QString &name, int channelNumbe
     d->methodHandlersByChannel[exchange->channelNumber()].append(exchange->d_func());
     connect(this, SIGNAL(connected()), exchange, SLOT(_q_open()));
     connect(this, SIGNAL(disconnected()), exchange, SLOT(_q_disconnected()));
+    connect(this, SIGNAL(blocked(QString)), exchange, SLOT(_q_blockedChanged()));
+    connect(this, SIGNAL(unblocked()), exchange, SLOT(_q_blockedChanged()));
     exchange->d_func()->open();
 
     if (!name.isEmpty())
         exchange->setName(name);
-    d->exchanges.put(exchange);
+
+    // an exchange piggybacking on another object's channel is private to its
+    // creator, and is never handed out as the shared instance for this name
+    if (!known && !exchange->d_func()->sharedChannel)
+        d->exchanges.put(exchange);
     return exchange;
 }
 
@@ -790,16 +1418,132 @@ void QAmqpClient::setAutoReconnect(bool value, int timeout)
 
     if((value == true) && (timeout > 0))
     {
-        d->timeout = timeout;
+        d->reconnectPolicy = QAmqpReconnectPolicy::fixed(timeout);
         d->reconnectFixedTimeout = true;
     }
-    else
+    else if (d->reconnectFixedTimeout)
     {
-        d->timeout = 0;
+        d->reconnectPolicy = QAmqpReconnectPolicy();
         d->reconnectFixedTimeout = false;
     }
 }
 
+QAmqpReconnectPolicy QAmqpClient::reconnectPolicy() const
+{
+    Q_D(const QAmqpClient);
+    return d->reconnectPolicy;
+}
+
+/*!
+ * Sets how auto reconnect spaces out its attempts, see QAmqpReconnectPolicy.
+ * Every scheduled attempt is announced with reconnecting(), the count
+ * starts over once a connection is fully open again. Passing a timeout to
+ * setAutoReconnect() is a shorthand for QAmqpReconnectPolicy::fixed().
+ */
+void QAmqpClient::setReconnectPolicy(const QAmqpReconnectPolicy &policy)
+{
+    Q_D(QAmqpClient);
+    d->reconnectPolicy = policy;
+    d->reconnectFixedTimeout = false;
+}
+
+QAmqpClient::FailoverStrategy QAmqpClient::failoverStrategy() const
+{
+    Q_D(const QAmqpClient);
+    return d->failoverStrategy;
+}
+
+/*!
+ * Picks the order brokers are tried in when connecting to more than one.
+ * Every round starts over from the strategy's first pick, a broker that
+ * can't be reached is left for the next one straight away and only a
+ * round where none answered waits on the reconnect policy.
+ * LowestLatencyFailover goes by the connect time measured on the last
+ * successful connection to each broker.
+ */
+void QAmqpClient::setFailoverStrategy(FailoverStrategy strategy)
+{
+    Q_D(QAmqpClient);
+    d->failoverStrategy = strategy;
+}
+
+int QAmqpClient::connectTimeout() const
+{
+    Q_D(const QAmqpClient);
+    return d->connectTimeout;
+}
+
+/*!
+ * Gives up on a broker that didn't complete the handshake in time, so an
+ * unreachable address fails over instead of waiting on the system's
+ * connect timeout. 0, the default, leaves it to the transport.
+ */
+void QAmqpClient::setConnectTimeout(int msecs)
+{
+    Q_D(QAmqpClient);
+    d->connectTimeout = qMax(0, msecs);
+}
+
+int QAmqpClient::readFrameBudget() const
+{
+    Q_D(const QAmqpClient);
+    return d->readFrameBudget;
+}
+
+/*!
+ * Caps the frames handled for one readyRead() of the transport. A fast
+ * broker can otherwise keep the client's thread busy for as long as it
+ * keeps the socket full, the rest is picked up on the next event loop
+ * iteration instead. 0, the default, reads everything available.
+ */
+void QAmqpClient::setReadFrameBudget(int frames)
+{
+    Q_D(QAmqpClient);
+    d->readFrameBudget = qMax(0, frames);
+}
+
+qint64 QAmqpClient::readByteBudget() const
+{
+    Q_D(const QAmqpClient);
+    return d->readByteBudget;
+}
+
+/*!
+ * Like setReadFrameBudget(), in bytes taken off the transport. At least
+ * one frame is always read, however large.
+ */
+void QAmqpClient::setReadByteBudget(qint64 bytes)
+{
+    Q_D(QAmqpClient);
+    d->readByteBudget = qMax<qint64>(0, bytes);
+}
+
+bool QAmqpClient::topologyRecovery() const
+{
+    Q_D(const QAmqpClient);
+    return d->topologyRecovery;
+}
+
+bool QAmqpClient::republishUnconfirmed() const
+{
+    Q_D(const QAmqpClient);
+    return d->republishUnconfirmed;
+}
+
+/*!
+ * Whenever the connection is established again, every exchange and queue
+ * replays what was set up on its channel: qos, exchange and queue
+ * declarations, bindings, publisher confirms and consumers. With
+ * \a republishUnconfirmed, messages published in confirm mode that the
+ * broker had not confirmed yet are published again as well.
+ */
+void QAmqpClient::setTopologyRecovery(bool value, bool republishUnconfirmed)
+{
+    Q_D(QAmqpClient);
+    d->topologyRecovery = value;
+    d->republishUnconfirmed = value && republishUnconfirmed;
+}
+
 qint16 QAmqpClient::channelMax() const
 {
     Q_D(const QAmqpClient);
@@ -834,6 +1578,27 @@ void QAmqpClient::setFrameMax(qint32 frameMax)
     d->frameMax = qMax(frameMax, AMQP_FRAME_MIN_SIZE);
 }
 
+bool QAmqpClient::autoTuneFrameMax() const
+{
+    Q_D(const QAmqpClient);
+    return d->autoTuneFrameMax;
+}
+
+/*!
+ * Lets the client pick frameMax itself on every connect, in place of the
+ * value given to setFrameMax(): large enough to carry most of the message
+ * bodies seen so far in a single frame, up to 1 MiB and within what the
+ * broker offers, and never below the default until bodies have been seen
+ * to call for more. The transport's socket buffers are sized to match.
+ * frameMax() and the transport's sendBufferSize() and receiveBufferSize()
+ * report what was settled on once connected.
+ */
+void QAmqpClient::setAutoTuneFrameMax(bool enabled)
+{
+    Q_D(QAmqpClient);
+    d->autoTuneFrameMax = enabled;
+}
+
 qint16 QAmqpClient::heartbeatDelay() const
 {
     Q_D(const QAmqpClient);
@@ -876,13 +1641,13 @@ QString QAmqpClient::customProperty(const QString &name) const
 QAbstractSocket::SocketError QAmqpClient::socketError() const
 {
     Q_D(const QAmqpClient);
-    return d->socket->error();
+    return d->transport->error();
 }
 
 QAbstractSocket::SocketState QAmqpClient::socketState() const
 {
     Q_D(const QAmqpClient);
-    return d->socket->state();
+    return d->transport->state();
 }
 
 QAMQP::Error QAmqpClient::error() const
@@ -900,16 +1665,23 @@ QString QAmqpClient::errorString() const
 QSslConfiguration QAmqpClient::sslConfiguration() const
 {
     Q_D(const QAmqpClient);
-    return d->socket->sslConfiguration();
+    QAmqpSocketTransport *socketTransport = qobject_cast<QAmqpSocketTransport*>(d->transport);
+    return socketTransport ? socketTransport->sslConfiguration() : QSslConfiguration();
 }
 
 void QAmqpClient::setSslConfiguration(const QSslConfiguration &config)
 {
     Q_D(QAmqpClient);
+    QAmqpSocketTransport *socketTransport = qobject_cast<QAmqpSocketTransport*>(d->transport);
+    if (!socketTransport) {
+        qAmqpDebug() << Q_FUNC_INFO << "transport does not support ssl";
+        return;
+    }
+
     if (!config.isNull()) {
         d->useSsl = true;
         d->port = AMQP_SSL_PORT;
-        d->socket->setSslConfiguration(config);
+        socketTransport->setSslConfiguration(config);
     }
 }
 
@@ -921,26 +1693,104 @@ QString QAmqpClient::gitVersion()
 void QAmqpClient::ignoreSslErrors(const QList<QSslError> &errors)
 {
     Q_D(QAmqpClient);
-    d->socket->ignoreSslErrors(errors);
+    QAmqpSocketTransport *socketTransport = qobject_cast<QAmqpSocketTransport*>(d->transport);
+    if (socketTransport)
+        socketTransport->ignoreSslErrors(errors);
+}
+
+/*!
+ * A snapshot of the connection's counters and gauges, safe to take from
+ * any thread.
+ */
+QAmqpMetrics QAmqpClient::metrics() const
+{
+    Q_D(const QAmqpClient);
+    return d->metrics.snapshot();
+}
+
+QAmqpTracer *QAmqpClient::tracer() const
+{
+    Q_D(const QAmqpClient);
+    return d->tracer;
+}
+
+/*!
+ * Installs a tracer that is told about every frame sent and received, or
+ * removes it when \a tracer is null. The client does not take ownership.
+ * Without a tracer the frame paths pay a single pointer test.
+ */
+void QAmqpClient::setTracer(QAmqpTracer *tracer)
+{
+    Q_D(QAmqpClient);
+    d->tracer = tracer;
+}
+
+QAmqpTransport *QAmqpClient::transport() const
+{
+    Q_D(const QAmqpClient);
+    return d->transport;
+}
+
+/*!
+ * Replaces the transport the connection is carried over. The client takes
+ * ownership of \a transport, it is reparented to the client, and the
+ * transport it replaces is deleted if the client owned it. This only works
+ * while the client is unconnected; otherwise, or when \a transport is null,
+ * nothing changes and false is returned.
+ */
+bool QAmqpClient::setTransport(QAmqpTransport *transport)
+{
+    Q_D(QAmqpClient);
+    if (!transport)
+        return false;
+    if (transport == d->transport)
+        return true;
+
+    if (d->transport->state() != QAbstractSocket::UnconnectedState) {
+        qWarning("QAmqpClient::setTransport: cannot replace the transport of an open connection");
+        return false;
+    }
+
+    transport->setParent(this);
+    d->setTransport(transport);
+    return true;
 }
 
 void QAmqpClient::connectToHost(const QString &uri)
 {
     Q_D(QAmqpClient);
-    if (uri.isEmpty()) {
-        d->_q_connect();
-        return;
+    if (!uri.isEmpty())
+        d->parseConnectionString(uri);
+
+    d->reconnectAttempt = 0;
+    if (!d->endpoints.isEmpty()) {
+        d->startFailoverRound();
+        d->nextEndpoint();
     }
 
-    d->parseConnectionString(uri);
     d->_q_connect();
 }
 
+/*!
+ * Connects to the first broker it can reach out of the given uris, and
+ * fails over between them on every reconnect, see setFailoverStrategy().
+ * The credentials and virtual host are taken from the first uri. A
+ * single uri with comma separated brokers does the same.
+ */
+void QAmqpClient::connectToHost(const QStringList &uris)
+{
+    Q_D(QAmqpClient);
+    d->parseEndpoints(uris);
+    connectToHost();
+}
+
 void QAmqpClient::connectToHost(const QHostAddress &address, quint16 port)
 {
     Q_D(QAmqpClient);
+    d->endpoints.clear();
     d->host = address.toString();
     d->port = port;
+    d->reconnectAttempt = 0;
     d->_q_connect();
 }
 
@@ -23,12 +23,17 @@
 #include <QHostAddress>
 #include <QSslConfiguration>
 #include <QSslError>
+#include <QStringList>
 
 #include "qamqpglobal.h"
+#include "qamqpreconnectpolicy.h"
 
 class QAmqpExchange;
 class QAmqpQueue;
 class QAmqpAuthenticator;
+class QAmqpMetrics;
+class QAmqpTracer;
+class QAmqpTransport;
 class QAmqpClientPrivate;
 class QAMQP_EXPORT QAmqpClient : public QObject
 {
@@ -39,11 +44,19 @@ class QAMQP_EXPORT QAmqpClient : public QObject
     Q_PROPERTY(QString user READ username WRITE setUsername)
     Q_PROPERTY(QString password READ password WRITE setPassword)
     Q_PROPERTY(bool autoReconnect READ autoReconnect WRITE setAutoReconnect)
+    Q_PROPERTY(bool topologyRecovery READ topologyRecovery WRITE setTopologyRecovery)
     Q_PROPERTY(qint16 channelMax READ channelMax WRITE setChannelMax)
     Q_PROPERTY(qint32 frameMax READ frameMax WRITE setFrameMax)
     Q_PROPERTY(qint16 heartbeatDelay READ heartbeatDelay() WRITE setHeartbeatDelay)
 
 public:
+    enum FailoverStrategy {
+        OrderedFailover,
+        RandomFailover,
+        LowestLatencyFailover
+    };
+    Q_ENUM(FailoverStrategy)
+
     explicit QAmqpClient(QObject *parent = 0);
     ~QAmqpClient();
 
@@ -69,13 +82,35 @@ public:
     bool autoReconnect() const;
     void setAutoReconnect(bool value, int timeout = 0);
 
+    QAmqpReconnectPolicy reconnectPolicy() const;
+    void setReconnectPolicy(const QAmqpReconnectPolicy &policy);
+
+    FailoverStrategy failoverStrategy() const;
+    void setFailoverStrategy(FailoverStrategy strategy);
+
+    int connectTimeout() const;
+    void setConnectTimeout(int msecs);
+
+    int readFrameBudget() const;
+    void setReadFrameBudget(int frames);
+    qint64 readByteBudget() const;
+    void setReadByteBudget(qint64 bytes);
+
+    bool topologyRecovery() const;
+    bool republishUnconfirmed() const;
+    void setTopologyRecovery(bool value, bool republishUnconfirmed = false);
+
     bool isConnected() const;
+    bool isBlocked() const;
+    QString blockedReason() const;
 
     qint16 channelMax() const;
     void setChannelMax(qint16 channelMax);
 
     qint32 frameMax() const;
     void setFrameMax(qint32 frameMax);
+    bool autoTuneFrameMax() const;
+    void setAutoTuneFrameMax(bool enabled);
 
     qint16 heartbeatDelay() const;
     void setHeartbeatDelay(qint16 delay);
@@ -95,6 +130,14 @@ public:
     QSslConfiguration sslConfiguration() const;
     void setSslConfiguration(const QSslConfiguration &config);
 
+    QAmqpTransport *transport() const;
+    bool setTransport(QAmqpTransport *transport);
+
+    QAmqpMetrics metrics() const;
+
+    QAmqpTracer *tracer() const;
+    void setTracer(QAmqpTracer *tracer);
+
     static QString gitVersion();
 
     // channels
@@ -106,6 +149,7 @@ public:
 
     // methods
     void connectToHost(const QString &uri = QString());
+    void connectToHost(const QStringList &uris);
     void connectToHost(const QHostAddress &address, quint16 port = AMQP_PORT);
     void disconnectFromHost();
     void abort();
@@ -113,7 +157,10 @@ public:
 Q_SIGNALS:
     void connected();
     void disconnected();
+    void reconnecting(int attempt, int delay);
     void heartbeat();
+    void blocked(const QString &reason);
+    void unblocked();
     void error(QAMQP::Error error);
     void socketErrorOccurred(QAbstractSocket::SocketError error);
     void socketStateChanged(QAbstractSocket::SocketState state);
@@ -133,13 +180,18 @@ private:
     Q_PRIVATE_SLOT(d_func(), void _q_socketConnected())
     Q_PRIVATE_SLOT(d_func(), void _q_socketDisconnected())
     Q_PRIVATE_SLOT(d_func(), void _q_readyRead())
+    Q_PRIVATE_SLOT(d_func(), void _q_resumeRead())
     Q_PRIVATE_SLOT(d_func(), void _q_socketError(QAbstractSocket::SocketError error))
     Q_PRIVATE_SLOT(d_func(), void _q_heartbeat())
+    Q_PRIVATE_SLOT(d_func(), void _q_bytesWritten())
+    Q_PRIVATE_SLOT(d_func(), void _q_reconnect())
+    Q_PRIVATE_SLOT(d_func(), void _q_connectTimeout())
     Q_PRIVATE_SLOT(d_func(), void _q_connect())
     Q_PRIVATE_SLOT(d_func(), void _q_disconnect())
 
     friend class QAmqpChannelPrivate;
     friend class QAmqpQueuePrivate;
+    friend class QAmqpRpcServerPrivate;
 
 };
 
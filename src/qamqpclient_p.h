@@ -1,22 +1,48 @@
 #ifndef QAMQPCLIENT_P_H
 #define QAMQPCLIENT_P_H
 
+#include <QElapsedTimer>
 #include <QHash>
 #include <QSharedPointer>
 #include <QPointer>
 #include <QAbstractSocket>
+#include <QBuffer>
+#include <QDataStream>
 #include <QSslError>
+#include <QStringList>
 
 #include "qamqpchannelhash_p.h"
 #include "qamqpglobal.h"
+#include "qamqpclient.h"
 #include "qamqpauthenticator.h"
 #include "qamqptable.h"
 #include "qamqpframe_p.h"
+#include "qamqpmetrics_p.h"
+#include "qamqpreconnectpolicy.h"
 
 #define METHOD_ID_ENUM(name, id) name = id, name ## Ok
 
+/*
+ * The stream and frames incoming data is parsed into. One is kept for the
+ * life of the connection so that a steady run of deliveries reuses the same
+ * buffers instead of allocating them for every frame.
+ */
+struct QAmqpReadArena
+{
+    explicit QAmqpReadArena(QByteArray *buffer);
+
+    QBuffer device;
+    QDataStream stream;
+    QAmqpMethodFrame method;
+    QAmqpContentFrame content;
+    QAmqpContentBodyFrame body;
+    bool busy;
+
+};
+
 class QTimer;
-class QSslSocket;
+class QAmqpTracer;
+class QAmqpTransport;
 class QAmqpClient;
 class QAmqpQueue;
 class QAmqpExchange;
@@ -30,7 +56,9 @@ public:
         METHOD_ID_ENUM(miSecure, 20),
         METHOD_ID_ENUM(miTune, 30),
         METHOD_ID_ENUM(miOpen, 40),
-        METHOD_ID_ENUM(miClose, 50)
+        METHOD_ID_ENUM(miClose, 50),
+        miBlocked = 60,
+        miUnblocked = 61
     };
 
     QAmqpClientPrivate(QAmqpClient *q);
@@ -38,20 +66,41 @@ public:
 
     virtual void init();
     virtual void initSocket();
+    void setTransport(QAmqpTransport *transport);
     void resetChannelState();
     void setUsername(const QString &username);
     void setPassword(const QString &password);
     void parseConnectionString(const QString &uri);
+    void parseEndpoints(const QStringList &uris);
+    void startFailoverRound();
+    bool nextEndpoint();
     void sendFrame(const QAmqpFrame &frame);
+    void beginWriteBatch();
+    void endWriteBatch();
+    void readFrames(QIODevice *device);
+    void readFrames(QIODevice *device, QAmqpReadArena *arena);
+    void flushBatches();
+    bool beginPartialBody(QIODevice *device, quint16 channel, quint32 payloadSize);
+    bool readPartialBody(QIODevice *device);
+    void traceSentFrame(const QAmqpFrame &frame, qint64 startTime);
+    void sampleMessageSize(qint64 size);
+    qint32 tunedFrameMax(qint32 offered) const;
 
     void closeConnection();
+    void heartbeatTimedOut();
+    void scheduleReconnect(bool immediately = false);
+    void connectionFailed(const QString &reason);
 
     // private slots
     void _q_socketConnected();
     void _q_socketDisconnected();
     void _q_readyRead();
+    void _q_resumeRead();
     void _q_socketError(QAbstractSocket::SocketError error);
     void _q_heartbeat();
+    void _q_bytesWritten();
+    void _q_reconnect();
+    void _q_connectTimeout();
     virtual void _q_connect();
     void _q_disconnect();
 
@@ -63,6 +112,8 @@ public:
     void tune(const QAmqpMethodFrame &frame);
     void openOk(const QAmqpMethodFrame &frame);
     void closeOk(const QAmqpMethodFrame &frame);
+    void blocked(const QAmqpMethodFrame &frame);
+    void unblocked(const QAmqpMethodFrame &frame);
 
     // method handlers, TO server
     void startOk();
@@ -78,17 +129,58 @@ public:
     QString host;
     QString virtualHost;
 
+    // brokers to fail over between, only used with more than one
+    struct Endpoint
+    {
+        QString host;
+        quint16 port;
+        bool useSsl;
+        qint64 connectLatency;      // ms, -1 until measured
+        bool failed;
+    };
+    QList<Endpoint> endpoints;
+    QList<int> untriedEndpoints;
+    int currentEndpoint;
+    QAmqpClient::FailoverStrategy failoverStrategy;
+    QElapsedTimer connectClock;
+    QPointer<QTimer> connectTimer;
+    int connectTimeout;
+
     QSharedPointer<QAmqpAuthenticator> authenticator;
 
     // Network
     QByteArray buffer;
+    QAmqpReadArena readArena;
+
+    // how much one readyRead() may take before yielding, 0 for no limit
+    int readFrameBudget;
+    qint64 readByteBudget;
+    bool readResumePending;
+
+    // frames sent while a write batch is open go out in one write
+    int writeBatchDepth;
+    QByteArray writeBatch;
+
+    // a body frame being read as its bytes arrive, channel 0 when none
+    struct PartialBody
+    {
+        quint16 channel;
+        qint32 size;
+        qint32 remaining;
+        bool dropped;
+        qint64 traceStart;
+    };
+    PartialBody partialBody;
     bool autoReconnect;
     bool reconnectFixedTimeout;
-    int timeout;
+    QAmqpReconnectPolicy reconnectPolicy;
+    int reconnectAttempt;
+    bool topologyRecovery;
+    bool republishUnconfirmed;
     bool connecting;
     bool useSsl;
 
-    QSslSocket *socket;
+    QAmqpTransport *transport;
     QHash<quint16, QList<QAmqpMethodFrameHandler*> > methodHandlersByChannel;
     QHash<quint16, QList<QAmqpContentFrameHandler*> > contentHandlerByChannel;
     QHash<quint16, QList<QAmqpContentBodyFrameHandler*> > bodyHandlersByChannel;
@@ -97,21 +189,38 @@ public:
     bool closed;
     bool connected;
     QPointer<QTimer> heartbeatTimer;
+    QElapsedTimer lastReceived;
+    bool frameSent;
     QPointer<QTimer> reconnectTimer;
     QAmqpTable customProperties;
     qint16 channelMax;
     qint16 heartbeatDelay;
     qint32 frameMax;
 
+    // connection.blocked from the broker, cleared with the connection
+    bool connectionBlocked;
+    QString blockedReason;
+
+    // body sizes seen both ways by bit length, for auto tuning frameMax
+    bool autoTuneFrameMax;
+    quint32 messageSizes[33];
+    quint32 messageSizeCount;
+
     QAMQP::Error error;
     QString errorString;
 
+    QAmqpMetricsCounters metrics;
+    QAmqpTracer *tracer;
+
     /*! Exchange objects */
     QAmqpChannelHash exchanges;
 
     /*! Named queue objects */
     QAmqpChannelHash queues;
 
+    /*! Queues in batch mode with messages not announced yet */
+    QList<QPointer<QAmqpQueue> > pendingBatches;
+
     QAmqpClient * const q_ptr;
     Q_DECLARE_PUBLIC(QAmqpClient)
 
@@ -0,0 +1,213 @@
+#include <QThread>
+#include <QMutexLocker>
+#include <QDebug>
+
+#include "qamqpconsumerpool_p.h"
+
+class QAmqpConsumerWorker : public QThread
+{
+public:
+    QAmqpConsumerWorker(QAmqpConsumerPool *pool, int lane)
+        : pool_(pool),
+          lane_(lane)
+    {
+    }
+
+protected:
+    void run()
+    {
+        QAmqpConsumerPool::Task task;
+        while (pool_->next(lane_, &task)) {
+            QAmqpConsumerPool::Result result;
+            result.deliveryTag = task.message.deliveryTag();
+            result.disposition = pool_->handler(task.message);
+            result.generation = task.generation;
+            result.noAck = task.noAck;
+            pool_->finished(result);
+        }
+
+        pool_->workerExited();
+    }
+
+private:
+    QAmqpConsumerPool *pool_;
+    int lane_;
+};
+
+//////////////////////////////////////////////////////////////////////////
+
+QAmqpConsumerPool::QAmqpConsumerPool(QObject *r, const QAmqpQueue::MessageHandler &h,
+                                     int workerCount, QAmqpQueue::ShardingKey key,
+                                     const QString &header)
+    : handler(h),
+      shardingKey(key),
+      shardingHeader(header),
+      receiver(r),
+      stopping(false),
+      abandoned(false),
+      wakeupPending(false),
+      runningWorkers(workerCount)
+{
+    // unsharded workers all pull from a single lane, sharded workers each
+    // own a lane so messages with the same key are processed serially
+    int laneCount = (shardingKey == QAmqpQueue::NoSharding) ? 1 : workerCount;
+    for (int i = 0; i < laneCount; ++i)
+        lanes.append(new Lane);
+
+    // the threads are never joined, each one cleans up after itself
+    for (int i = 0; i < workerCount; ++i) {
+        QThread *worker = new QAmqpConsumerWorker(this, laneCount == 1 ? 0 : i);
+        QObject::connect(worker, SIGNAL(finished()), worker, SLOT(deleteLater()));
+        workers.append(worker);
+        worker->start();
+    }
+}
+
+/*!
+ * Only once every worker has exited, see hasStopped() and abandon().
+ */
+QAmqpConsumerPool::~QAmqpConsumerPool()
+{
+    qDeleteAll(lanes);
+}
+
+int QAmqpConsumerPool::workerCount() const
+{
+    return workers.size();
+}
+
+int QAmqpConsumerPool::laneFor(const QAmqpMessage &message) const
+{
+    if (lanes.size() == 1)
+        return 0;
+
+    uint hash = 0;
+    switch (shardingKey) {
+    case QAmqpQueue::ShardByRoutingKey:
+        hash = qHash(message.rawRoutingKey());
+        break;
+    case QAmqpQueue::ShardByHeader:
+        hash = qHash(message.header(shardingHeader).toString());
+        break;
+    case QAmqpQueue::ShardByMessageId:
+        hash = qHash(message.property(QAmqpMessage::MessageId).toString());
+        break;
+    default:
+        break;
+    }
+
+    return hash % uint(lanes.size());
+}
+
+void QAmqpConsumerPool::post(const QAmqpMessage &message, int generation, bool noAck)
+{
+    Task task;
+    task.message = message;
+    task.generation = generation;
+    task.noAck = noAck;
+
+    QMutexLocker locker(&mutex);
+    Lane *lane = lanes.at(laneFor(message));
+    lane->tasks.enqueue(task);
+    lane->ready.wakeOne();
+}
+
+QList<QAmqpConsumerPool::Result> QAmqpConsumerPool::takeResults()
+{
+    QList<Result> taken;
+    QMutexLocker locker(&mutex);
+    taken.swap(results);
+    wakeupPending = false;
+    return taken;
+}
+
+void QAmqpConsumerPool::discardStale(int generation)
+{
+    QMutexLocker locker(&mutex);
+    foreach (Lane *lane, lanes) {
+        QMutableListIterator<Task> it(lane->tasks);
+        while (it.hasNext()) {
+            if (it.next().generation < generation)
+                it.remove();
+        }
+    }
+}
+
+QList<QAmqpConsumerPool::Task> QAmqpConsumerPool::retire()
+{
+    QList<Task> dropped;
+    QMutexLocker locker(&mutex);
+    stopping = true;
+    foreach (Lane *lane, lanes) {
+        dropped.append(lane->tasks);
+        lane->tasks.clear();
+        lane->ready.wakeAll();
+    }
+    return dropped;
+}
+
+bool QAmqpConsumerPool::hasStopped()
+{
+    QMutexLocker locker(&mutex);
+    return runningWorkers == 0;
+}
+
+void QAmqpConsumerPool::abandon()
+{
+    retire();
+
+    bool stopped;
+    {
+        QMutexLocker locker(&mutex);
+        receiver = 0;
+        abandoned = true;
+        stopped = runningWorkers == 0;
+    }
+
+    if (stopped)
+        delete this;
+}
+
+bool QAmqpConsumerPool::next(int lane, Task *task)
+{
+    QMutexLocker locker(&mutex);
+    Lane *l = lanes.at(lane);
+    while (l->tasks.isEmpty()) {
+        if (stopping)
+            return false;
+        l->ready.wait(&mutex);
+    }
+
+    *task = l->tasks.dequeue();
+    return true;
+}
+
+void QAmqpConsumerPool::workerExited()
+{
+    bool orphaned;
+    {
+        QMutexLocker locker(&mutex);
+        orphaned = --runningWorkers == 0 && abandoned;
+        if (!runningWorkers && receiver && !wakeupPending) {
+            wakeupPending = true;
+            QMetaObject::invokeMethod(receiver, "_q_settle", Qt::QueuedConnection);
+        }
+    }
+
+    // nobody else is left to delete an abandoned pool
+    if (orphaned)
+        delete this;
+}
+
+void QAmqpConsumerPool::finished(const Result &result)
+{
+    QMutexLocker locker(&mutex);
+    results.append(result);
+
+    // a single wakeup settles everything finished until the queue's thread
+    // gets around to it, which is what lets acks be coalesced
+    if (receiver && !wakeupPending) {
+        wakeupPending = true;
+        QMetaObject::invokeMethod(receiver, "_q_settle", Qt::QueuedConnection);
+    }
+}
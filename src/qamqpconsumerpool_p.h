@@ -0,0 +1,84 @@
+#ifndef QAMQPCONSUMERPOOL_P_H
+#define QAMQPCONSUMERPOOL_P_H
+
+#include <QList>
+#include <QMutex>
+#include <QQueue>
+#include <QWaitCondition>
+
+#include "qamqpqueue.h"
+
+class QThread;
+class QAmqpConsumerPool
+{
+public:
+    struct Task
+    {
+        QAmqpMessage message;
+        int generation;
+        bool noAck;
+    };
+
+    struct Result
+    {
+        qlonglong deliveryTag;
+        QAmqpQueue::MessageDisposition disposition;
+        int generation;
+        bool noAck;
+    };
+
+    QAmqpConsumerPool(QObject *receiver, const QAmqpQueue::MessageHandler &handler, int workerCount,
+                      QAmqpQueue::ShardingKey shardingKey, const QString &shardingHeader);
+    ~QAmqpConsumerPool();
+
+    int workerCount() const;
+    void post(const QAmqpMessage &message, int generation, bool noAck);
+    QList<Result> takeResults();
+
+    /*! Drop queued work delivered before the given generation */
+    void discardStale(int generation);
+
+    /*!
+     * Drop everything still queued and let the workers exit once they are
+     * done with the message in hand, without waiting for them. Returns the
+     * dropped work, the receiver is woken up when the last worker is gone.
+     */
+    QList<Task> retire();
+    bool hasStopped();
+
+    /*!
+     * Retire the pool for good, it no longer reports back and deletes
+     * itself once the last worker is gone. The pool must not be touched
+     * after this.
+     */
+    void abandon();
+
+private:
+    struct Lane
+    {
+        QQueue<Task> tasks;
+        QWaitCondition ready;
+    };
+
+    int laneFor(const QAmqpMessage &message) const;
+    bool next(int lane, Task *task);
+    void finished(const Result &result);
+    void workerExited();
+    friend class QAmqpConsumerWorker;
+
+    QAmqpQueue::MessageHandler handler;
+    QAmqpQueue::ShardingKey shardingKey;
+    QString shardingHeader;
+    QList<Lane*> lanes;
+    QList<QThread*> workers;
+
+    QMutex mutex;
+    QObject *receiver;
+    bool stopping;
+    bool abandoned;
+    bool wakeupPending;
+    int runningWorkers;
+    QList<Result> results;
+};
+
+#endif // QAMQPCONSUMERPOOL_P_H
@@ -5,6 +5,7 @@
 
 #include "qamqpexchange.h"
 #include "qamqpexchange_p.h"
+#include "qamqpmetrics_p.h"
 #include "qamqpqueue.h"
 #include "qamqpglobal.h"
 #include "qamqpclient.h"
@@ -25,8 +26,16 @@ QAmqpExchangePrivate::QAmqpExchangePrivate(QAmqpExchange *q)
     : QAmqpChannelPrivate(q),
       delayedDeclare(false),
       declared(false),
-      nextDeliveryTag(0)
+      nextDeliveryTag(0),
+      declareRequested(false),
+      confirmsRequested(false),
+      confirmsNoWait(false),
+      heldBytes(0),
+      maxHeldBytes(16 * 1024 * 1024),
+      backpressure(false),
+      trackConfirmLatency(false)
 {
+    latencyClock.start();
 }
 
 void QAmqpExchangePrivate::resetInternalState()
@@ -37,6 +46,29 @@ void QAmqpExchangePrivate::resetInternalState()
     nextDeliveryTag = 0;
 }
 
+void QAmqpExchangePrivate::recover()
+{
+    Q_Q(QAmqpExchange);
+    QAmqpChannelPrivate::recover();
+    if (declareRequested && !name.isEmpty())
+        declare();
+    if (confirmsRequested)
+        q->enableConfirms(confirmsNoWait);
+
+    // in their original order, each under a new delivery tag. They were
+    // accepted before anything still held, so they go out first and never
+    // pass through the hold buffer, channelOpened() releases that after
+    QMap<qlonglong, PendingMessage> messages;
+    messages.swap(unconfirmedMessages);
+    if (!republishUnconfirmed() || !confirmsRequested)
+        return;
+
+    foreach (const PendingMessage &message, messages) {
+        publish(message.message, message.routingKey, message.mimeType,
+                message.headers, message.properties, message.publishOptions);
+    }
+}
+
 void QAmqpExchangePrivate::declare()
 {
     if (!opened) {
@@ -56,16 +88,16 @@ void QAmqpExchangePrivate::declare()
     QDataStream stream(&args, QIODevice::WriteOnly);
 
     stream << qint16(0);    //reserved 1
-    QAmqpFrame::writeAmqpField(stream, QAmqpMetaType::ShortString, name);
+    QAmqpFrame::writeEncoded(stream, encodedName);
     QAmqpFrame::writeAmqpField(stream, QAmqpMetaType::ShortString, type);
 
     stream << qint8(options);
     QAmqpFrame::writeAmqpField(stream, QAmqpMetaType::Hash, arguments);
 
-    qAmqpDebug("<- exchange#declare( name=%s, type=%s, passive=%d, durable=%d, no-wait=%d )",
-               qPrintable(name), qPrintable(type),
-               options.testFlag(QAmqpExchange::Passive), options.testFlag(QAmqpExchange::Durable),
-               options.testFlag(QAmqpExchange::NoWait));
+    qAmqpProtocolDebug("<- exchange#declare( name=%s, type=%s, passive=%d, durable=%d, no-wait=%d )",
+                       qPrintable(name), qPrintable(type),
+                       options.testFlag(QAmqpExchange::Passive), options.testFlag(QAmqpExchange::Durable),
+                       options.testFlag(QAmqpExchange::NoWait));
 
     frame.setArguments(args);
     sendFrame(frame);
@@ -119,7 +151,7 @@ void QAmqpExchangePrivate::declareOk(const QAmqpMethodFrame &frame)
 {
     Q_UNUSED(frame)
     Q_Q(QAmqpExchange);
-    qAmqpDebug("-> exchange[ %s ]#declareOk()", qPrintable(name));
+    qAmqpProtocolDebug("-> exchange[ %s ]#declareOk()", qPrintable(name));
     declared = true;
     Q_EMIT q->declared();
 }
@@ -128,8 +160,9 @@ void QAmqpExchangePrivate::deleteOk(const QAmqpMethodFrame &frame)
 {
     Q_UNUSED(frame)
     Q_Q(QAmqpExchange);
-    qAmqpDebug("-> exchange#deleteOk[ %s ]()", qPrintable(name));
+    qAmqpProtocolDebug("-> exchange#deleteOk[ %s ]()", qPrintable(name));
     declared = false;
+    declareRequested = false;
     Q_EMIT q->removed();
 }
 
@@ -139,7 +172,144 @@ void QAmqpExchangePrivate::_q_disconnected()
     qAmqpDebug() << "exchange disconnected: " << name;
     delayedDeclare = false;
     declared = false;
+    const int unconfirmed = unconfirmedDeliveryTags.size();
     unconfirmedDeliveryTags.clear();
+    unconfirmedChanged(unconfirmed);
+    publishTimes.clear();
+
+    // held publishes wait for the channel to open again
+    updateBackpressure();
+}
+
+void QAmqpExchangePrivate::unconfirmedChanged(int previousCount)
+{
+    QAmqpMetricsCounters *counters = metrics();
+    if (counters && previousCount != unconfirmedDeliveryTags.size())
+        counters->unconfirmedPublishes.fetchAndAddRelaxed(unconfirmedDeliveryTags.size() - previousCount);
+}
+
+void QAmqpExchangePrivate::flowChanged()
+{
+    releaseHeld();
+}
+
+void QAmqpExchangePrivate::_q_blockedChanged()
+{
+    releaseHeld();
+}
+
+/*!
+ * Publishes queue up behind any that are already held, so they reach the
+ * broker in the order they were made.
+ */
+bool QAmqpExchangePrivate::holdingPublishes() const
+{
+    if (!heldMessages.isEmpty())
+        return true;
+    return maxHeldBytes > 0 && (!flowActive || (client && client->isBlocked()));
+}
+
+void QAmqpExchangePrivate::releaseHeld()
+{
+    // with holding turned off, what is left goes out as soon as it can
+    const bool pushedBack = !flowActive || (client && client->isBlocked());
+    if (heldMessages.isEmpty() || !opened || (pushedBack && maxHeldBytes > 0)) {
+        updateBackpressure();
+        return;
+    }
+
+    QList<PendingMessage> messages;
+    messages.swap(heldMessages);
+    heldBytes = 0;
+    foreach (const PendingMessage &message, messages) {
+        publish(message.message, message.routingKey, message.mimeType,
+                message.headers, message.properties, message.publishOptions);
+    }
+
+    updateBackpressure();
+}
+
+/*!
+ * Writes a publish to the channel, the public publish() has already
+ * decided it isn't held.
+ */
+void QAmqpExchangePrivate::publish(const QByteArray &message, const QAmqpRoutingKey &routingKey,
+                                   const QString &mimeType, const QAmqpTable &headers,
+                                   const QAmqpMessage::PropertyHash &properties, int publishOptions)
+{
+    if (nextDeliveryTag > 0) {
+        unconfirmedDeliveryTags.append(nextDeliveryTag);
+        if (trackConfirmLatency)
+            publishTimes.insert(nextDeliveryTag, latencyClock.nsecsElapsed() / 1000);
+        if (republishUnconfirmed()) {
+            PendingMessage unconfirmed;
+            unconfirmed.message = message;
+            unconfirmed.routingKey = routingKey;
+            unconfirmed.mimeType = mimeType;
+            unconfirmed.headers = headers;
+            unconfirmed.properties = properties;
+            unconfirmed.publishOptions = publishOptions;
+            unconfirmedMessages.insert(nextDeliveryTag, unconfirmed);
+        }
+        nextDeliveryTag++;
+        unconfirmedChanged(unconfirmedDeliveryTags.size() - 1);
+    }
+
+    if (QAmqpMetricsCounters *counters = metrics())
+        counters->messagesPublished.fetchAndAddRelaxed(1);
+
+    QAmqpMethodFrame frame(QAmqpFrame::Basic, bmPublish);
+    frame.setChannel(channelNumber);
+
+    QByteArray arguments;
+    QDataStream out(&arguments, QIODevice::WriteOnly);
+
+    out << qint16(0);   //reserved 1
+    QAmqpFrame::writeEncoded(out, encodedName);
+    QAmqpFrame::writeEncoded(out, routingKey.encoded());
+    out << qint8(publishOptions);
+
+    qAmqpProtocolDebug("<- basic#publish( exchange=%s, routing-key=%s, mandatory=%d, immediate=%d )",
+                       qPrintable(name), qPrintable(routingKey.toString()),
+                       publishOptions & QAmqpExchange::poMandatory, publishOptions & QAmqpExchange::poImmediate);
+
+    frame.setArguments(arguments);
+    sendFrame(frame);
+
+    QAmqpContentFrame content(QAmqpFrame::Basic);
+    content.setChannel(channelNumber);
+    content.setProperty(QAmqpMessage::ContentType, mimeType);
+    content.setProperty(QAmqpMessage::ContentEncoding, "utf-8");
+    content.setProperty(QAmqpMessage::Headers, headers);
+
+    QAmqpMessage::PropertyHash::ConstIterator it;
+    QAmqpMessage::PropertyHash::ConstIterator itEnd = properties.constEnd();
+    for (it = properties.constBegin(); it != itEnd; ++it)
+        content.setProperty(it.key(), it.value());
+    content.setBodySize(message.size());
+    sendFrame(content);
+
+    // frameMax counts the frame header and end marker too
+    const int chunkSize = client->frameMax() - int(QAmqpFrame::HEADER_SIZE + QAmqpFrame::FRAME_END_SIZE);
+    int fullSize = message.size();
+    for (int sent = 0; sent < fullSize; sent += chunkSize) {
+        QAmqpContentBodyFrame body;
+        QByteArray partition = message.mid(sent, chunkSize);
+        body.setChannel(channelNumber);
+        body.setBody(partition);
+        sendFrame(body);
+    }
+}
+
+void QAmqpExchangePrivate::updateBackpressure()
+{
+    Q_Q(QAmqpExchange);
+    const bool active = !heldMessages.isEmpty() || !flowActive || (client && client->isBlocked());
+    if (active == backpressure)
+        return;
+
+    backpressure = active;
+    Q_EMIT q->backpressureChanged(active);
 }
 
 void QAmqpExchangePrivate::basicReturn(const QAmqpMethodFrame &frame)
@@ -161,8 +331,8 @@ void QAmqpExchangePrivate::basicReturn(const QAmqpMethodFrame &frame)
         Q_EMIT q->error(error);
     }
 
-    qAmqpDebug("-> basic#return( reply-code=%d, reply-text=%s, exchange=%s, routing-key=%s )",
-               replyCode, qPrintable(replyText), qPrintable(exchangeName), qPrintable(routingKey));
+    qAmqpProtocolDebug("-> basic#return( reply-code=%d, reply-text=%s, exchange=%s, routing-key=%s )",
+                       replyCode, qPrintable(replyText), qPrintable(exchangeName), qPrintable(routingKey));
 }
 
 void QAmqpExchangePrivate::handleAckOrNack(const QAmqpMethodFrame &frame)
@@ -175,21 +345,27 @@ void QAmqpExchangePrivate::handleAckOrNack(const QAmqpMethodFrame &frame)
         QAmqpFrame::readAmqpField(stream, QAmqpMetaType::LongLongUint).toLongLong();
     bool multiple = QAmqpFrame::readAmqpField(stream, QAmqpMetaType::Boolean).toBool();
     if (frame.id() == QAmqpExchangePrivate::bmAck) {
-        if (deliveryTag == 0) {
-            unconfirmedDeliveryTags.clear();
-        } else {
-            int idx = unconfirmedDeliveryTags.indexOf(deliveryTag);
-            if (idx == -1) {
+        const int unconfirmed = unconfirmedDeliveryTags.size();
+        int first = 0;
+        int last = unconfirmed - 1;
+        if (deliveryTag != 0) {
+            last = unconfirmedDeliveryTags.indexOf(deliveryTag);
+            if (last == -1) {
                 return;
             }
 
-            if (multiple) {
-                unconfirmedDeliveryTags.remove(0, idx + 1);
-            } else {
-                unconfirmedDeliveryTags.remove(idx);
-            }
+            if (!multiple)
+                first = last;
         }
 
+        if (trackConfirmLatency)
+            recordConfirmLatency(first, last);
+        if (!unconfirmedMessages.isEmpty()) {
+            for (int i = first; i <= last; ++i)
+                unconfirmedMessages.remove(unconfirmedDeliveryTags.at(i));
+        }
+        unconfirmedDeliveryTags.remove(first, last - first + 1);
+        unconfirmedChanged(unconfirmed);
         if (unconfirmedDeliveryTags.isEmpty())
             Q_EMIT q->allMessagesDelivered();
 
@@ -198,6 +374,19 @@ void QAmqpExchangePrivate::handleAckOrNack(const QAmqpMethodFrame &frame)
     }
 }
 
+void QAmqpExchangePrivate::recordConfirmLatency(int first, int last)
+{
+    const qint64 now = latencyClock.nsecsElapsed() / 1000;
+    for (int i = first; i <= last; ++i) {
+        QHash<qlonglong, qint64>::iterator it = publishTimes.find(unconfirmedDeliveryTags.at(i));
+        if (it == publishTimes.end())
+            continue;
+
+        confirmLatency.record(now - it.value());
+        publishTimes.erase(it);
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////
 
 QAmqpExchange::QAmqpExchange(int channelNumber, QAmqpClient *parent)
@@ -209,6 +398,10 @@ QAmqpExchange::QAmqpExchange(int channelNumber, QAmqpClient *parent)
 
 QAmqpExchange::~QAmqpExchange()
 {
+    Q_D(QAmqpExchange);
+    const int unconfirmed = d->unconfirmedDeliveryTags.size();
+    d->unconfirmedDeliveryTags.clear();
+    d->unconfirmedChanged(unconfirmed);
 }
 
 void QAmqpExchange::channelOpened()
@@ -216,6 +409,7 @@ void QAmqpExchange::channelOpened()
     Q_D(QAmqpExchange);
     if (d->delayedDeclare)
         d->declare();
+    d->releaseHeld();
 }
 
 void QAmqpExchange::channelClosed()
@@ -251,6 +445,7 @@ void QAmqpExchange::declare(const QString &type, ExchangeOptions options, const
     d->type = type;
     d->options = options;
     d->arguments = args;
+    d->declareRequested = true;
     d->declare();
 }
 
@@ -264,11 +459,11 @@ void QAmqpExchange::remove(int options)
     QDataStream stream(&arguments, QIODevice::WriteOnly);
 
     stream << qint16(0);    //reserved 1
-    QAmqpFrame::writeAmqpField(stream, QAmqpMetaType::ShortString, d->name);
+    QAmqpFrame::writeEncoded(stream, d->encodedName);
     stream << qint8(options);
 
-    qAmqpDebug("<- exchange#delete( exchange=%s, if-unused=%d, no-wait=%d )",
-               qPrintable(d->name), options & QAmqpExchange::roIfUnused, options & QAmqpExchange::roNoWait);
+    qAmqpProtocolDebug("<- exchange#delete( exchange=%s, if-unused=%d, no-wait=%d )",
+                       qPrintable(d->name), options & QAmqpExchange::roIfUnused, options & QAmqpExchange::roNoWait);
 
     frame.setArguments(arguments);
     d->sendFrame(frame);
@@ -277,7 +472,7 @@ void QAmqpExchange::remove(int options)
 void QAmqpExchange::publish(const QString &message, const QString &routingKey,
                             const QAmqpMessage::PropertyHash &properties, int publishOptions)
 {
-    publish(message.toUtf8(), routingKey, QLatin1String("text.plain"),
+    publish(message.toUtf8(), QAmqpRoutingKey(routingKey), QLatin1String("text.plain"),
             QAmqpTable(), properties, publishOptions);
 }
 
@@ -285,58 +480,62 @@ void QAmqpExchange::publish(const QByteArray &message, const QString &routingKey
                             const QString &mimeType, const QAmqpMessage::PropertyHash &properties,
                             int publishOptions)
 {
-    publish(message, routingKey, mimeType, QAmqpTable(), properties, publishOptions);
+    publish(message, QAmqpRoutingKey(routingKey), mimeType, QAmqpTable(), properties, publishOptions);
 }
 
 void QAmqpExchange::publish(const QByteArray &message, const QString &routingKey,
                             const QString &mimeType, const QAmqpTable &headers,
                             const QAmqpMessage::PropertyHash &properties, int publishOptions)
 {
-    Q_D(QAmqpExchange);
-    if (d->nextDeliveryTag > 0) {
-        d->unconfirmedDeliveryTags.append(d->nextDeliveryTag);
-        d->nextDeliveryTag++;
-    }
-
-    QAmqpMethodFrame frame(QAmqpFrame::Basic, QAmqpExchangePrivate::bmPublish);
-    frame.setChannel(d->channelNumber);
-
-    QByteArray arguments;
-    QDataStream out(&arguments, QIODevice::WriteOnly);
-
-    out << qint16(0);   //reserved 1
-    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, d->name);
-    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, routingKey);
-    out << qint8(publishOptions);
-
-    qAmqpDebug("<- basic#publish( exchange=%s, routing-key=%s, mandatory=%d, immediate=%d )",
-               qPrintable(d->name), qPrintable(routingKey),
-               publishOptions & QAmqpExchange::poMandatory, publishOptions & QAmqpExchange::poImmediate);
+    publish(message, QAmqpRoutingKey(routingKey), mimeType, headers, properties, publishOptions);
+}
 
-    frame.setArguments(arguments);
-    d->sendFrame(frame);
+void QAmqpExchange::publish(const QString &message, const QAmqpRoutingKey &routingKey,
+                            const QAmqpMessage::PropertyHash &properties, int publishOptions)
+{
+    publish(message.toUtf8(), routingKey, QLatin1String("text.plain"),
+            QAmqpTable(), properties, publishOptions);
+}
 
-    QAmqpContentFrame content(QAmqpFrame::Basic);
-    content.setChannel(d->channelNumber);
-    content.setProperty(QAmqpMessage::ContentType, mimeType);
-    content.setProperty(QAmqpMessage::ContentEncoding, "utf-8");
-    content.setProperty(QAmqpMessage::Headers, headers);
+void QAmqpExchange::publish(const QByteArray &message, const QAmqpRoutingKey &routingKey,
+                            const QString &mimeType, const QAmqpMessage::PropertyHash &properties,
+                            int publishOptions)
+{
+    publish(message, routingKey, mimeType, QAmqpTable(), properties, publishOptions);
+}
 
-    QAmqpMessage::PropertyHash::ConstIterator it;
-    QAmqpMessage::PropertyHash::ConstIterator itEnd = properties.constEnd();
-    for (it = properties.constBegin(); it != itEnd; ++it)
-        content.setProperty(it.key(), it.value());
-    content.setBodySize(message.size());
-    d->sendFrame(content);
+/*!
+ * The exchange name and the routing key go out already encoded, reusing
+ * the same QAmqpRoutingKey for every message to a key saves converting it
+ * each time.
+ */
+void QAmqpExchange::publish(const QByteArray &message, const QAmqpRoutingKey &routingKey,
+                            const QString &mimeType, const QAmqpTable &headers,
+                            const QAmqpMessage::PropertyHash &properties, int publishOptions)
+{
+    Q_D(QAmqpExchange);
+    if (Q_UNLIKELY(d->holdingPublishes())) {
+        // a limit of 0 only keeps order behind what is still held
+        if (d->maxHeldBytes > 0 && d->heldBytes + message.size() > d->maxHeldBytes) {
+            qAmqpDebug() << "exchange" << d->name << "dropped a publish, the hold buffer is full";
+            Q_EMIT publishDropped();
+            return;
+        }
 
-    int fullSize = message.size();
-    for (int sent = 0; sent < fullSize; sent += (d->client->frameMax() - 7)) {
-        QAmqpContentBodyFrame body;
-        QByteArray partition = message.mid(sent, (d->client->frameMax() - 7));
-        body.setChannel(d->channelNumber);
-        body.setBody(partition);
-        d->sendFrame(body);
+        QAmqpExchangePrivate::PendingMessage held;
+        held.message = message;
+        held.routingKey = routingKey;
+        held.mimeType = mimeType;
+        held.headers = headers;
+        held.properties = properties;
+        held.publishOptions = publishOptions;
+        d->heldMessages.append(held);
+        d->heldBytes += message.size();
+        d->updateBackpressure();
+        return;
     }
+
+    d->publish(message, routingKey, mimeType, headers, properties, publishOptions);
 }
 
 void QAmqpExchange::enableConfirms(bool noWait)
@@ -351,6 +550,8 @@ void QAmqpExchange::enableConfirms(bool noWait)
 
     frame.setArguments(arguments);
     d->sendFrame(frame);
+    d->confirmsRequested = true;
+    d->confirmsNoWait = noWait;
 
     // for tracking acks and nacks
     if (d->nextDeliveryTag == 0) d->nextDeliveryTag = 1;
@@ -367,3 +568,76 @@ bool QAmqpExchange::waitForConfirms(int msecs)
 
     return (d->unconfirmedDeliveryTags.isEmpty());
 }
+
+/*!
+ * Record the time from publish until the broker confirms each message.
+ * Only takes effect once confirms are enabled on the channel.
+ */
+void QAmqpExchange::setConfirmLatencyTracking(bool enabled)
+{
+    Q_D(QAmqpExchange);
+    d->trackConfirmLatency = enabled;
+    if (!enabled)
+        d->publishTimes.clear();
+}
+
+bool QAmqpExchange::isConfirmLatencyTracking() const
+{
+    Q_D(const QAmqpExchange);
+    return d->trackConfirmLatency;
+}
+
+QAmqpLatencyHistogram QAmqpExchange::confirmLatency() const
+{
+    Q_D(const QAmqpExchange);
+    return d->confirmLatency;
+}
+
+void QAmqpExchange::resetConfirmLatency()
+{
+    Q_D(QAmqpExchange);
+    d->confirmLatency.reset();
+}
+
+bool QAmqpExchange::hasBackpressure() const
+{
+    Q_D(const QAmqpExchange);
+    return d->backpressure;
+}
+
+qint64 QAmqpExchange::maxHeldBytes() const
+{
+    Q_D(const QAmqpExchange);
+    return d->maxHeldBytes;
+}
+
+/*!
+ * While the broker pauses the channel with channel.flow or blocks the
+ * connection with connection.blocked, publishes are held here instead of
+ * piling up in the socket, and sent on in order once it lets go. This caps
+ * the bodies held at once, publishes that don't fit any more are dropped
+ * with publishDropped(). 16 MiB by default, 0 writes publishes straight
+ * through regardless, the way it always used to. Setting 0 sends anything
+ * already held right away, or once the channel is open again if it isn't,
+ * and later publishes keep queuing behind those until then.
+ */
+void QAmqpExchange::setMaxHeldBytes(qint64 bytes)
+{
+    Q_D(QAmqpExchange);
+    d->maxHeldBytes = qMax<qint64>(0, bytes);
+    d->releaseHeld();
+}
+
+int QAmqpExchange::heldPublishes() const
+{
+    Q_D(const QAmqpExchange);
+    return d->heldMessages.size();
+}
+
+qint64 QAmqpExchange::heldBytes() const
+{
+    Q_D(const QAmqpExchange);
+    return d->heldBytes;
+}
+
+#include "moc_qamqpexchange.cpp"
@@ -20,7 +20,9 @@
 
 #include "qamqptable.h"
 #include "qamqpchannel.h"
+#include "qamqplatencyhistogram.h"
 #include "qamqpmessage.h"
+#include "qamqproutingkey.h"
 
 class QAmqpClient;
 class QAmqpQueue;
@@ -74,6 +76,31 @@ public:
     void enableConfirms(bool noWait = false);
     bool waitForConfirms(int msecs = 30000);
 
+    // publish to broker confirm latency, off by default
+    void setConfirmLatencyTracking(bool enabled);
+    bool isConfirmLatencyTracking() const;
+    QAmqpLatencyHistogram confirmLatency() const;
+    void resetConfirmLatency();
+
+    // flow control, publishes held while the broker pushes back
+    bool hasBackpressure() const;
+    qint64 maxHeldBytes() const;
+    void setMaxHeldBytes(qint64 bytes);
+    int heldPublishes() const;
+    qint64 heldBytes() const;
+
+    // publish with a routing key encoded ahead of time
+    void publish(const QString &message, const QAmqpRoutingKey &routingKey,
+                 const QAmqpMessage::PropertyHash &properties = QAmqpMessage::PropertyHash(),
+                 int publishOptions = poNoOptions);
+    void publish(const QByteArray &message, const QAmqpRoutingKey &routingKey, const QString &mimeType,
+                 const QAmqpMessage::PropertyHash &properties = QAmqpMessage::PropertyHash(),
+                 int publishOptions = poNoOptions);
+    void publish(const QByteArray &message, const QAmqpRoutingKey &routingKey,
+                 const QString &mimeType, const QAmqpTable &headers,
+                 const QAmqpMessage::PropertyHash &properties = QAmqpMessage::PropertyHash(),
+                 int publishOptions = poNoOptions);
+
 Q_SIGNALS:
     void declared();
     void removed();
@@ -81,6 +108,9 @@ Q_SIGNALS:
     void confirmsEnabled();
     void allMessagesDelivered();
 
+    void backpressureChanged(bool active);
+    void publishDropped();
+
 public Q_SLOTS:
     // AMQP Exchange
     void declare(QAmqpExchange::ExchangeType type = Direct,
@@ -112,6 +142,7 @@ private:
 
     Q_DISABLE_COPY(QAmqpExchange)
     Q_DECLARE_PRIVATE(QAmqpExchange)
+    Q_PRIVATE_SLOT(d_func(), void _q_blockedChanged())
     friend class QAmqpClient;
     friend class QAmqpClientPrivate;
 
@@ -1,7 +1,12 @@
 #ifndef QAMQPEXCHANGE_P_H
 #define QAMQPEXCHANGE_P_H
 
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+
 #include "qamqptable.h"
+#include "qamqplatencyhistogram.h"
 #include "qamqpexchange.h"
 #include "qamqpchannel_p.h"
 
@@ -21,6 +26,7 @@ public:
     static QString typeToString(QAmqpExchange::ExchangeType type);
 
     virtual void resetInternalState();
+    virtual void recover();
 
     void declare();
 
@@ -31,6 +37,18 @@ public:
     void deleteOk(const QAmqpMethodFrame &frame);
     void basicReturn(const QAmqpMethodFrame &frame);
     void handleAckOrNack(const QAmqpMethodFrame &frame);
+    void unconfirmedChanged(int previousCount);
+    void publish(const QByteArray &message, const QAmqpRoutingKey &routingKey,
+                 const QString &mimeType, const QAmqpTable &headers,
+                 const QAmqpMessage::PropertyHash &properties, int publishOptions);
+    void recordConfirmLatency(int first, int last);
+
+    // flow control
+    virtual void flowChanged();
+    bool holdingPublishes() const;
+    void releaseHeld();
+    void updateBackpressure();
+    void _q_blockedChanged();
 
     QString type;
     QAmqpExchange::ExchangeOptions options;
@@ -39,6 +57,37 @@ public:
     qlonglong nextDeliveryTag;
     QVector<qlonglong> unconfirmedDeliveryTags;
 
+    // replayed by recover()
+    bool declareRequested;
+    bool confirmsRequested;
+    bool confirmsNoWait;
+
+    /*! a publish kept to be sent later */
+    struct PendingMessage
+    {
+        QByteArray message;
+        QAmqpRoutingKey routingKey;
+        QString mimeType;
+        QAmqpTable headers;
+        QAmqpMessage::PropertyHash properties;
+        int publishOptions;
+    };
+
+    /*! kept until confirmed when republishing is on, by delivery tag */
+    QMap<qlonglong, PendingMessage> unconfirmedMessages;
+
+    /*! publishes held back by channel.flow or connection.blocked, in order */
+    QList<PendingMessage> heldMessages;
+    qint64 heldBytes;
+    qint64 maxHeldBytes;
+    bool backpressure;
+
+    /*! publish times in microseconds on latencyClock, by delivery tag */
+    bool trackConfirmLatency;
+    QElapsedTimer latencyClock;
+    QHash<qlonglong, qint64> publishTimes;
+    QAmqpLatencyHistogram confirmLatency;
+
     Q_DECLARE_PUBLIC(QAmqpExchange)
 };
 
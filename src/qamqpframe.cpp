@@ -53,6 +53,11 @@ qint32 QAmqpFrame::size() const
     return 0;
 }
 
+qint64 QAmqpFrame::wireSize() const
+{
+    return HEADER_SIZE + size_ + FRAME_END_SIZE;
+}
+
 /*
 void QAmqpFrame::readEnd(QDataStream &stream)
 {
@@ -68,7 +73,8 @@ QDataStream &operator<<(QDataStream &stream, const QAmqpFrame &frame)
     // write header
     stream << frame.type_;
     stream << frame.channel_;
-    stream << frame.size();
+    frame.size_ = frame.size();
+    stream << frame.size_;
 
     frame.writePayload(stream);
 
@@ -186,15 +192,7 @@ QVariant QAmqpFrame::readAmqpField(QDataStream &s, QAmqpMetaType::ValueType type
         return v;
     }
     case QAmqpMetaType::ShortString:
-    {
-        qint8 size = 0;
-        QByteArray buffer;
-
-        s >> size;
-        buffer.resize(size);
-        s.readRawData(buffer.data(), buffer.size());
-        return QString::fromLatin1(buffer.data(), size);
-    }
+        return QString::fromUtf8(readShortString(s));
     case QAmqpMetaType::LongString:
     {
         quint32 size = 0;
@@ -249,21 +247,13 @@ void QAmqpFrame::writeAmqpField(QDataStream &s, QAmqpMetaType::ValueType type, c
         s << qulonglong(value.toULongLong());
         break;
     case QAmqpMetaType::ShortString:
-    {
-        QString str = value.toString();
-        if (str.length() >= 256) {
-            qAmqpDebug() << Q_FUNC_INFO << "invalid shortstr length: " << str.length();
-        }
-
-        s << quint8(str.length());
-        s.writeRawData(str.toUtf8().data(), str.length());
-    }
+        writeEncoded(s, encodeShortString(value.toString()));
         break;
     case QAmqpMetaType::LongString:
     {
-        QString str = value.toString();
-        s << quint32(str.length());
-        s.writeRawData(str.toLatin1().data(), str.length());
+        const QByteArray str = value.toString().toUtf8();
+        s << quint32(str.size());
+        s.writeRawData(str.constData(), str.size());
     }
         break;
     case QAmqpMetaType::Timestamp:
@@ -284,6 +274,36 @@ void QAmqpFrame::writeAmqpField(QDataStream &s, QAmqpMetaType::ValueType type, c
     }
 }
 
+QByteArray QAmqpFrame::readShortString(QDataStream &s)
+{
+    quint8 size = 0;
+    s >> size;
+    if (!size)
+        return QByteArray("", 0);
+
+    QByteArray buffer(size, Qt::Uninitialized);
+    if (s.readRawData(buffer.data(), size) < size)
+        buffer.clear();
+    return buffer;
+}
+
+QByteArray QAmqpFrame::encodeShortString(const QString &value)
+{
+    return encodeShortString(value.toUtf8());
+}
+
+QByteArray QAmqpFrame::encodeShortString(const QByteArray &utf8)
+{
+    if (utf8.size() > 255)
+        qAmqpDebug() << Q_FUNC_INFO << "invalid shortstr length: " << utf8.size();
+
+    const int size = qMin(utf8.size(), 255);
+    QByteArray encoded(size + 1, Qt::Uninitialized);
+    encoded[0] = char(size);
+    memcpy(encoded.data() + 1, utf8.constData(), size);
+    return encoded;
+}
+
 //////////////////////////////////////////////////////////////////////////
 
 QAmqpContentFrame::QAmqpContentFrame()
@@ -302,6 +322,29 @@ QAmqpFrame::MethodClass QAmqpContentFrame::methodClass() const
     return MethodClass(methodClass_);
 }
 
+// basic properties in the order of their flag bits on the wire
+static const struct {
+    QAmqpMessage::Property property;
+    QAmqpMetaType::ValueType type;
+} basicProperties[] = {
+    { QAmqpMessage::ContentType, QAmqpMetaType::ShortString },
+    { QAmqpMessage::ContentEncoding, QAmqpMetaType::ShortString },
+    { QAmqpMessage::Headers, QAmqpMetaType::Hash },
+    { QAmqpMessage::DeliveryMode, QAmqpMetaType::ShortShortUint },
+    { QAmqpMessage::Priority, QAmqpMetaType::ShortShortUint },
+    { QAmqpMessage::CorrelationId, QAmqpMetaType::ShortString },
+    { QAmqpMessage::ReplyTo, QAmqpMetaType::ShortString },
+    { QAmqpMessage::Expiration, QAmqpMetaType::ShortString },
+    { QAmqpMessage::MessageId, QAmqpMetaType::ShortString },
+    { QAmqpMessage::Timestamp, QAmqpMetaType::Timestamp },
+    { QAmqpMessage::Type, QAmqpMetaType::ShortString },
+    { QAmqpMessage::UserId, QAmqpMetaType::ShortString },
+    { QAmqpMessage::AppId, QAmqpMetaType::ShortString },
+    { QAmqpMessage::ClusterID, QAmqpMetaType::ShortString }
+};
+
+static const int basicPropertyCount = sizeof(basicProperties) / sizeof(basicProperties[0]);
+
 qint32 QAmqpContentFrame::size() const
 {
     QDataStream out(&buffer_, QIODevice::WriteOnly);
@@ -315,47 +358,10 @@ qint32 QAmqpContentFrame::size() const
         prop_ |= p;
     out << prop_;
 
-    if (prop_ & QAmqpMessage::ContentType)
-        writeAmqpField(out, QAmqpMetaType::ShortString, properties_[QAmqpMessage::ContentType]);
-
-    if (prop_ & QAmqpMessage::ContentEncoding)
-        writeAmqpField(out, QAmqpMetaType::ShortString, properties_[QAmqpMessage::ContentEncoding]);
-
-    if (prop_ & QAmqpMessage::Headers)
-        writeAmqpField(out, QAmqpMetaType::Hash, properties_[QAmqpMessage::Headers]);
-
-    if (prop_ & QAmqpMessage::DeliveryMode)
-        writeAmqpField(out, QAmqpMetaType::ShortShortUint, properties_[QAmqpMessage::DeliveryMode]);
-
-    if (prop_ & QAmqpMessage::Priority)
-        writeAmqpField(out, QAmqpMetaType::ShortShortUint, properties_[QAmqpMessage::Priority]);
-
-    if (prop_ & QAmqpMessage::CorrelationId)
-        writeAmqpField(out, QAmqpMetaType::ShortString, properties_[QAmqpMessage::CorrelationId]);
-
-    if (prop_ & QAmqpMessage::ReplyTo)
-        writeAmqpField(out, QAmqpMetaType::ShortString, properties_[QAmqpMessage::ReplyTo]);
-
-    if (prop_ & QAmqpMessage::Expiration)
-        writeAmqpField(out, QAmqpMetaType::ShortString, properties_[QAmqpMessage::Expiration]);
-
-    if (prop_ & QAmqpMessage::MessageId)
-        writeAmqpField(out, QAmqpMetaType::ShortString, properties_[QAmqpMessage::MessageId]);
-
-    if (prop_ & QAmqpMessage::Timestamp)
-        writeAmqpField(out, QAmqpMetaType::Timestamp, properties_[QAmqpMessage::Timestamp]);
-
-    if (prop_ & QAmqpMessage::Type)
-        writeAmqpField(out, QAmqpMetaType::ShortString, properties_[QAmqpMessage::Type]);
-
-    if (prop_ & QAmqpMessage::UserId)
-        writeAmqpField(out, QAmqpMetaType::ShortString, properties_[QAmqpMessage::UserId]);
-
-    if (prop_ & QAmqpMessage::AppId)
-        writeAmqpField(out, QAmqpMetaType::ShortString, properties_[QAmqpMessage::AppId]);
-
-    if (prop_ & QAmqpMessage::ClusterID)
-        writeAmqpField(out, QAmqpMetaType::ShortString, properties_[QAmqpMessage::ClusterID]);
+    for (int i = 0; i < basicPropertyCount; ++i) {
+        if (prop_ & basicProperties[i].property)
+            writeAmqpField(out, basicProperties[i].type, properties_.value(basicProperties[i].property));
+    }
 
     return buffer_.size();
 }
@@ -392,47 +398,16 @@ void QAmqpContentFrame::readPayload(QDataStream &in)
     in >> bodySize_;
     qint16 flags_ = 0;
     in >> flags_;
-    if (flags_ & QAmqpMessage::ContentType)
-        properties_[QAmqpMessage::ContentType] = readAmqpField(in, QAmqpMetaType::ShortString);
 
-    if (flags_ & QAmqpMessage::ContentEncoding)
-        properties_[QAmqpMessage::ContentEncoding] = readAmqpField(in, QAmqpMetaType::ShortString);
-
-    if (flags_ & QAmqpMessage::Headers)
-        properties_[QAmqpMessage::Headers] = readAmqpField(in, QAmqpMetaType::Hash);
-
-    if (flags_ & QAmqpMessage::DeliveryMode)
-        properties_[QAmqpMessage::DeliveryMode] = readAmqpField(in, QAmqpMetaType::ShortShortUint);
-
-    if (flags_ & QAmqpMessage::Priority)
-        properties_[QAmqpMessage::Priority] = readAmqpField(in, QAmqpMetaType::ShortShortUint);
-
-    if (flags_ & QAmqpMessage::CorrelationId)
-        properties_[QAmqpMessage::CorrelationId] = readAmqpField(in, QAmqpMetaType::ShortString);
-
-    if (flags_ & QAmqpMessage::ReplyTo)
-        properties_[QAmqpMessage::ReplyTo] = readAmqpField(in, QAmqpMetaType::ShortString);
-
-    if (flags_ & QAmqpMessage::Expiration)
-        properties_[QAmqpMessage::Expiration] = readAmqpField(in, QAmqpMetaType::ShortString);
-
-    if (flags_ & QAmqpMessage::MessageId)
-        properties_[QAmqpMessage::MessageId] = readAmqpField(in, QAmqpMetaType::ShortString);
-
-    if (flags_ & QAmqpMessage::Timestamp)
-        properties_[QAmqpMessage::Timestamp] = readAmqpField(in, QAmqpMetaType::Timestamp);
-
-    if (flags_ & QAmqpMessage::Type)
-        properties_[QAmqpMessage::Type] = readAmqpField(in, QAmqpMetaType::ShortString);
-
-    if (flags_ & QAmqpMessage::UserId)
-        properties_[QAmqpMessage::UserId] = readAmqpField(in, QAmqpMetaType::ShortString);
-
-    if (flags_ & QAmqpMessage::AppId)
-        properties_[QAmqpMessage::AppId] = readAmqpField(in, QAmqpMetaType::ShortString);
-
-    if (flags_ & QAmqpMessage::ClusterID)
-        properties_[QAmqpMessage::ClusterID] = readAmqpField(in, QAmqpMetaType::ShortString);
+    // the frame may be read into again and again, it keeps its hash and
+    // only drops the properties this header doesn't carry
+    for (int i = 0; i < basicPropertyCount; ++i) {
+        const QAmqpMessage::Property property = basicProperties[i].property;
+        if (flags_ & property)
+            properties_[property] = readAmqpField(in, basicProperties[i].type);
+        else if (!properties_.isEmpty())
+            properties_.remove(property);
+    }
 }
 
 //////////////////////////////////////////////////////////////////////////
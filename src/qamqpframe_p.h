@@ -10,7 +10,7 @@
 #include "qamqpmessage.h"
 
 class QAmqpFramePrivate;
-class QAmqpFrame
+class QAMQP_EXPORT QAmqpFrame
 {
 public:
     static const qint64 HEADER_SIZE = 7;
@@ -48,15 +48,29 @@ public:
 
     virtual qint32 size() const;
 
+    /*! header, payload and frame end, valid once the frame was written or read */
+    qint64 wireSize() const;
+
     static QVariant readAmqpField(QDataStream &s, QAmqpMetaType::ValueType type);
     static void writeAmqpField(QDataStream &s, QAmqpMetaType::ValueType type, const QVariant &value);
 
+    /*! the raw UTF-8 bytes of a shortstr, never null even when empty */
+    static QByteArray readShortString(QDataStream &s);
+
+    /*! a shortstr as it goes on the wire, length octet included */
+    static QByteArray encodeShortString(const QString &value);
+    static QByteArray encodeShortString(const QByteArray &utf8);
+    static inline void writeEncoded(QDataStream &s, const QByteArray &encoded)
+    {
+        s.writeRawData(encoded.constData(), encoded.size());
+    }
+
 protected:
     explicit QAmqpFrame(FrameType type);
     virtual void writePayload(QDataStream &stream) const = 0;
     virtual void readPayload(QDataStream &stream) = 0;
 
-    qint32 size_;
+    mutable qint32 size_;
 
 private:
     qint8 type_;
@@ -69,8 +83,8 @@ private:
     friend QDataStream &operator>>(QDataStream &stream, QAmqpFrame &frame);
 };
 
-QDataStream &operator<<(QDataStream &, const QAmqpFrame &frame);
-QDataStream &operator>>(QDataStream &, QAmqpFrame &frame);
+QAMQP_EXPORT QDataStream &operator<<(QDataStream &, const QAmqpFrame &frame);
+QAMQP_EXPORT QDataStream &operator>>(QDataStream &, QAmqpFrame &frame);
 
 class QAMQP_EXPORT QAmqpMethodFrame : public QAmqpFrame
 {
@@ -95,7 +109,7 @@ private:
     QByteArray arguments_;
 };
 
-class QAmqpContentFrame : public QAmqpFrame
+class QAMQP_EXPORT QAmqpContentFrame : public QAmqpFrame
 {
 public:
     QAmqpContentFrame();
@@ -123,7 +137,7 @@ private:
     qlonglong bodySize_;
 };
 
-class QAmqpContentBodyFrame : public QAmqpFrame
+class QAMQP_EXPORT QAmqpContentBodyFrame : public QAmqpFrame
 {
 public:
     QAmqpContentBodyFrame();
@@ -140,7 +154,7 @@ private:
     QByteArray body_;
 };
 
-class QAmqpHeartbeatFrame : public QAmqpFrame
+class QAMQP_EXPORT QAmqpHeartbeatFrame : public QAmqpFrame
 {
 public:
     QAmqpHeartbeatFrame();
@@ -166,6 +180,15 @@ class QAmqpContentBodyFrameHandler
 {
 public:
     virtual void _q_body(const QAmqpContentBodyFrame &frame) = 0;
+
+    /*
+     * A large body frame can be read a piece at a time as its bytes arrive
+     * rather than once all of it is in. The pieces are appended to the
+     * buffer returned here, or the handler gets whole frames when it is 0,
+     * and _q_bodyReceived() follows once the frame is complete.
+     */
+    virtual QByteArray *_q_bodyBuffer(quint16 channel) { Q_UNUSED(channel); return 0; }
+    virtual void _q_bodyReceived(quint16 channel, qint32 size) { Q_UNUSED(channel); Q_UNUSED(size); }
 };
 
 #endif // QAMQPFRAME_P_H
@@ -18,6 +18,7 @@
 #ifndef QAMQPGLOBAL_H
 #define QAMQPGLOBAL_H
 
+#include <QLoggingCategory>
 #include <QMetaType>
 
 #define AMQP_SCHEME             "amqp"
@@ -28,6 +29,7 @@
 #define AMQP_VHOST              "/"
 #define AMQP_LOGIN              "guest"
 #define AMQP_PSWD               "guest"
+#define AMQP_DIRECT_REPLY_TO    "amq.rabbitmq.reply-to"
 
 #define AMQP_FRAME_MAX 131072
 #define AMQP_FRAME_MIN_SIZE 4096
@@ -61,7 +63,23 @@
 #   define QAMQP_EXPORT
 #endif
 
-#define qAmqpDebug if (qEnvironmentVariableIsEmpty("QAMQP_DEBUG")); else qDebug
+/*
+ * Diagnostics go to the "qamqp" logging category, the "<- class#method(...)"
+ * protocol trace to "qamqp.protocol". Both are off unless QAMQP_DEBUG is set
+ * or logging rules enable them (QT_LOGGING_RULES="qamqp.*.debug=true"). A
+ * disabled statement is one relaxed load, its arguments are not evaluated.
+ * Building the library with QAMQP_NO_PROTOCOL_TRACE compiles the protocol
+ * trace out altogether.
+ */
+QAMQP_EXPORT const QLoggingCategory &qAmqpLog();
+QAMQP_EXPORT const QLoggingCategory &qAmqpProtocolLog();
+
+#define qAmqpDebug(...) qCDebug(qAmqpLog, __VA_ARGS__)
+#ifdef QAMQP_NO_PROTOCOL_TRACE
+#   define qAmqpProtocolDebug(...) while (false) QMessageLogger().noDebug(__VA_ARGS__)
+#else
+#   define qAmqpProtocolDebug(...) qCDebug(qAmqpProtocolLog, __VA_ARGS__)
+#endif
 
 namespace QAmqpMetaType {
 
@@ -0,0 +1,145 @@
+#include <QtAlgorithms>
+#include <qmath.h>
+
+#include "qamqplatencyhistogram.h"
+#include "qamqplatencyhistogram_p.h"
+
+QAmqpLatencyHistogramPrivate::QAmqpLatencyHistogramPrivate()
+    : counts(BucketCount, 0),
+      total(0),
+      min(0),
+      max(0),
+      sum(0)
+{
+}
+
+int QAmqpLatencyHistogramPrivate::indexOf(quint64 value)
+{
+    // values below two sub bucket ranges map one to one, above that each
+    // power of two is split into SubBucketCount linear steps
+    if (value < 2 * SubBucketCount)
+        return int(value);
+
+    const int shift = 63 - qCountLeadingZeroBits(value) - SubBucketBits;
+    if (shift > MaxShift)
+        return BucketCount - 1;
+
+    return (shift + 1) * SubBucketCount + int(value >> shift) - SubBucketCount;
+}
+
+quint64 QAmqpLatencyHistogramPrivate::highestEquivalent(int index)
+{
+    if (index < 2 * SubBucketCount)
+        return index;
+
+    const int shift = index / SubBucketCount - 1;
+    const quint64 subBucket = index % SubBucketCount + SubBucketCount;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+QAmqpLatencyHistogram::QAmqpLatencyHistogram()
+    : d(new QAmqpLatencyHistogramPrivate)
+{
+}
+
+QAmqpLatencyHistogram::QAmqpLatencyHistogram(const QAmqpLatencyHistogram &other)
+    : d(other.d)
+{
+}
+
+QAmqpLatencyHistogram::~QAmqpLatencyHistogram()
+{
+}
+
+QAmqpLatencyHistogram &QAmqpLatencyHistogram::operator=(const QAmqpLatencyHistogram &other)
+{
+    d = other.d;
+    return *this;
+}
+
+void QAmqpLatencyHistogram::record(qint64 usecs)
+{
+    if (usecs < 0)
+        usecs = 0;
+
+    d->counts[QAmqpLatencyHistogramPrivate::indexOf(usecs)]++;
+    d->min = d->total ? qMin(d->min, usecs) : usecs;
+    d->max = d->total ? qMax(d->max, usecs) : usecs;
+    d->total++;
+    d->sum += usecs;
+}
+
+void QAmqpLatencyHistogram::add(const QAmqpLatencyHistogram &other)
+{
+    if (!other.d->total)
+        return;
+
+    for (int i = 0; i < QAmqpLatencyHistogramPrivate::BucketCount; ++i)
+        d->counts[i] += other.d->counts.at(i);
+    d->min = d->total ? qMin(d->min, other.d->min) : other.d->min;
+    d->max = d->total ? qMax(d->max, other.d->max) : other.d->max;
+    d->total += other.d->total;
+    d->sum += other.d->sum;
+}
+
+void QAmqpLatencyHistogram::reset()
+{
+    d->counts.fill(0);
+    d->total = 0;
+    d->min = d->max = 0;
+    d->sum = 0;
+}
+
+quint64 QAmqpLatencyHistogram::count() const
+{
+    return d->total;
+}
+
+qint64 QAmqpLatencyHistogram::min() const
+{
+    return d->min;
+}
+
+qint64 QAmqpLatencyHistogram::max() const
+{
+    return d->max;
+}
+
+double QAmqpLatencyHistogram::mean() const
+{
+    return d->total ? d->sum / d->total : 0;
+}
+
+qint64 QAmqpLatencyHistogram::valueAtPercentile(double percentile) const
+{
+    if (!d->total)
+        return 0;
+    if (percentile <= 0)
+        return d->min;
+
+    const quint64 target =
+        qMax<quint64>(1, quint64(qCeil(qMin(percentile, 100.0) / 100.0 * d->total)));
+    quint64 seen = 0;
+    for (int i = 0; i < QAmqpLatencyHistogramPrivate::BucketCount; ++i) {
+        seen += d->counts.at(i);
+        if (seen < target)
+            continue;
+
+        // the last bucket also holds everything clamped into it
+        if (i == QAmqpLatencyHistogramPrivate::BucketCount - 1)
+            return d->max;
+        return qMin<qint64>(QAmqpLatencyHistogramPrivate::highestEquivalent(i), d->max);
+    }
+
+    return d->max;
+}
+
+QMap<double, qint64> QAmqpLatencyHistogram::percentiles(const QList<double> &points) const
+{
+    QMap<double, qint64> values;
+    foreach (double point, points)
+        values.insert(point, valueAtPercentile(point));
+    return values;
+}
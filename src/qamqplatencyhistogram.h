@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2012-2014 Alexey Shcherbakov
+ * Copyright (C) 2014-2015 Matt Broadstone
+ * Contact: https://github.com/mbroadst/qamqp
+ *
+ * This file is part of the QAMQP Library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+#ifndef QAMQPLATENCYHISTOGRAM_H
+#define QAMQPLATENCYHISTOGRAM_H
+
+#include <QList>
+#include <QMap>
+#include <QSharedDataPointer>
+
+#include "qamqpglobal.h"
+
+/*!
+ * A latency histogram in microseconds with HDR style log-linear buckets:
+ * every power of two range is split into 64 linear buckets, so any value
+ * up to an hour is kept within 1.6% and recording never allocates.
+ */
+class QAmqpLatencyHistogramPrivate;
+class QAMQP_EXPORT QAmqpLatencyHistogram
+{
+public:
+    QAmqpLatencyHistogram();
+    QAmqpLatencyHistogram(const QAmqpLatencyHistogram &other);
+    QAmqpLatencyHistogram &operator=(const QAmqpLatencyHistogram &other);
+    ~QAmqpLatencyHistogram();
+
+    inline void swap(QAmqpLatencyHistogram &other) { qSwap(d, other.d); }
+
+    void record(qint64 usecs);
+    void add(const QAmqpLatencyHistogram &other);
+    void reset();
+
+    quint64 count() const;
+    qint64 min() const;
+    qint64 max() const;
+    double mean() const;
+
+    /*! upper bound of the bucket holding the given percentile, 0 to 100 */
+    qint64 valueAtPercentile(double percentile) const;
+    QMap<double, qint64> percentiles(const QList<double> &points =
+                                     QList<double>() << 50 << 90 << 99 << 99.9 << 100) const;
+
+private:
+    QSharedDataPointer<QAmqpLatencyHistogramPrivate> d;
+
+};
+
+Q_DECLARE_SHARED(QAmqpLatencyHistogram)
+
+#endif  // QAMQPLATENCYHISTOGRAM_H
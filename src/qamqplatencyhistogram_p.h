@@ -0,0 +1,32 @@
+#ifndef QAMQPLATENCYHISTOGRAM_P_H
+#define QAMQPLATENCYHISTOGRAM_P_H
+
+#include <QSharedData>
+#include <QVector>
+
+#include "qamqplatencyhistogram.h"
+
+class QAmqpLatencyHistogramPrivate : public QSharedData
+{
+public:
+    enum {
+        SubBucketBits = 6,
+        SubBucketCount = 1 << SubBucketBits,
+        MaxShift = 26,      // 64 << 26 microseconds is a little over an hour
+        BucketCount = (MaxShift + 2) * SubBucketCount
+    };
+
+    QAmqpLatencyHistogramPrivate();
+
+    static int indexOf(quint64 value);
+    static quint64 highestEquivalent(int index);
+
+    QVector<quint64> counts;
+    quint64 total;
+    qint64 min;
+    qint64 max;
+    double sum;
+
+};
+
+#endif  // QAMQPLATENCYHISTOGRAM_P_H
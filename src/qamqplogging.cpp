@@ -0,0 +1,19 @@
+#include "qamqpglobal.h"
+
+// QAMQP_DEBUG predates the logging categories and still switches them on
+static QtMsgType defaultLogLevel()
+{
+    return qEnvironmentVariableIsEmpty("QAMQP_DEBUG") ? QtWarningMsg : QtDebugMsg;
+}
+
+const QLoggingCategory &qAmqpLog()
+{
+    static const QLoggingCategory category("qamqp", defaultLogLevel());
+    return category;
+}
+
+const QLoggingCategory &qAmqpProtocolLog()
+{
+    static const QLoggingCategory category("qamqp.protocol", defaultLogLevel());
+    return category;
+}
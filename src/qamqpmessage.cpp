@@ -1,4 +1,5 @@
 #include <QHash>
+#include <QMutex>
 
 #include "qamqpmessage.h"
 #include "qamqpmessage_p.h"
@@ -9,6 +10,58 @@ QAmqpMessagePrivate::QAmqpMessagePrivate()
 {
 }
 
+/*
+ * Every delivery creates a message and most are dropped again soon after,
+ * so released privates are kept on a bounded free list and handed out to
+ * the next delivery instead of going back to the heap. Messages can be
+ * released on any thread, hence the lock.
+ */
+namespace {
+struct FreeMessage
+{
+    FreeMessage *next;
+};
+}
+
+static const int maxFreeMessages = 256;
+static QBasicMutex freeMessagesLock;
+static FreeMessage *freeMessages = 0;
+static int freeMessageCount = 0;
+
+void *QAmqpMessagePrivate::operator new(size_t size)
+{
+    Q_ASSERT(size == sizeof(QAmqpMessagePrivate));
+    {
+        QMutexLocker locker(&freeMessagesLock);
+        if (FreeMessage *message = freeMessages) {
+            freeMessages = message->next;
+            --freeMessageCount;
+            return message;
+        }
+    }
+
+    return ::operator new(size);
+}
+
+void QAmqpMessagePrivate::operator delete(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    {
+        QMutexLocker locker(&freeMessagesLock);
+        if (freeMessageCount < maxFreeMessages) {
+            FreeMessage *message = static_cast<FreeMessage*>(ptr);
+            message->next = freeMessages;
+            freeMessages = message;
+            ++freeMessageCount;
+            return;
+        }
+    }
+
+    ::operator delete(ptr);
+}
+
 //////////////////////////////////////////////////////////////////////////
 
 QAmqpMessage::QAmqpMessage()
@@ -65,10 +118,20 @@ bool QAmqpMessage::isRedelivered() const
 
 QString QAmqpMessage::exchangeName() const
 {
-    return d->exchangeName;
+    return QString::fromUtf8(d->exchangeName);
 }
 
 QString QAmqpMessage::routingKey() const
+{
+    return QString::fromUtf8(d->routingKey);
+}
+
+QByteArray QAmqpMessage::rawExchangeName() const
+{
+    return d->exchangeName;
+}
+
+QByteArray QAmqpMessage::rawRoutingKey() const
 {
     return d->routingKey;
 }
@@ -118,7 +181,7 @@ uint qHash(const QAmqpMessage &message, uint seed)
     Q_UNUSED(seed);
     return qHash(message.deliveryTag()) ^
            qHash(message.isRedelivered()) ^
-           qHash(message.exchangeName()) ^
-           qHash(message.routingKey()) ^
+           qHash(message.rawExchangeName()) ^
+           qHash(message.rawRoutingKey()) ^
            qHash(message.payload());
 }
@@ -74,6 +74,10 @@ public:
     QString routingKey() const;
     QByteArray payload() const;
 
+    /*! the exchange name and routing key as delivered, in UTF-8 */
+    QByteArray rawExchangeName() const;
+    QByteArray rawRoutingKey() const;
+
 private:
     QSharedDataPointer<QAmqpMessagePrivate> d;
     friend class QAmqpQueuePrivate;
@@ -81,6 +85,7 @@ private:
 };
 
 Q_DECLARE_METATYPE(QAmqpMessage::PropertyHash)
+Q_DECLARE_METATYPE(QAmqpMessage)
 Q_DECLARE_SHARED(QAmqpMessage)
 
 // NOTE: needed only for MSVC support, don't depend on this hash
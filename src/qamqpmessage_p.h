@@ -12,10 +12,15 @@ class QAmqpMessagePrivate : public QSharedData
 public:
     QAmqpMessagePrivate();
 
+    // recycled through a small free list, see qamqpmessage.cpp
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
+
     qlonglong deliveryTag;
     bool redelivered;
-    QString exchangeName;
-    QString routingKey;
+    // kept as they came off the wire, decoded only when asked for
+    QByteArray exchangeName;
+    QByteArray routingKey;
     QByteArray payload;
     QHash<QAmqpMessage::Property, QVariant> properties;
     QHash<QString, QVariant> headers;
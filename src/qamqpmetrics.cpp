@@ -0,0 +1,303 @@
+#include <QMutexLocker>
+
+#include "qamqpmetrics.h"
+#include "qamqpmetrics_p.h"
+
+QAmqpMetricsPrivate::QAmqpMetricsPrivate()
+    : timestamp(0),
+      messagesPublished(0),
+      messagesDelivered(0),
+      unconfirmedPublishes(0),
+      unackedDeliveries(0),
+      outgoingBufferSize(0),
+      roundTripTime(-1),
+      reconnectCount(0),
+      readBudgetExhausted(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+QAmqpMetrics::QAmqpMetrics()
+    : d(new QAmqpMetricsPrivate)
+{
+}
+
+QAmqpMetrics::QAmqpMetrics(const QAmqpMetrics &other)
+    : d(other.d)
+{
+}
+
+QAmqpMetrics::~QAmqpMetrics()
+{
+}
+
+QAmqpMetrics &QAmqpMetrics::operator=(const QAmqpMetrics &other)
+{
+    d = other.d;
+    return *this;
+}
+
+qint64 QAmqpMetrics::timestamp() const
+{
+    return d->timestamp;
+}
+
+#define SUM_FRAME_TYPES(field)                                          \
+    if (type != AllFrames)                                              \
+        return d->frameTypes[type].field;                               \
+    quint64 total = 0;                                                  \
+    for (int i = 0; i < AllFrames; ++i)                                 \
+        total += d->frameTypes[i].field;                                \
+    return total;
+
+quint64 QAmqpMetrics::framesReceived(FrameType type) const
+{
+    SUM_FRAME_TYPES(framesReceived)
+}
+
+quint64 QAmqpMetrics::bytesReceived(FrameType type) const
+{
+    SUM_FRAME_TYPES(bytesReceived)
+}
+
+quint64 QAmqpMetrics::framesSent(FrameType type) const
+{
+    SUM_FRAME_TYPES(framesSent)
+}
+
+quint64 QAmqpMetrics::bytesSent(FrameType type) const
+{
+    SUM_FRAME_TYPES(bytesSent)
+}
+
+#undef SUM_FRAME_TYPES
+
+QList<quint16> QAmqpMetrics::channels() const
+{
+    return d->channels.keys();
+}
+
+quint64 QAmqpMetrics::channelFramesReceived(quint16 channel) const
+{
+    return d->channels.value(channel).framesReceived;
+}
+
+quint64 QAmqpMetrics::channelBytesReceived(quint16 channel) const
+{
+    return d->channels.value(channel).bytesReceived;
+}
+
+quint64 QAmqpMetrics::channelFramesSent(quint16 channel) const
+{
+    return d->channels.value(channel).framesSent;
+}
+
+quint64 QAmqpMetrics::channelBytesSent(quint16 channel) const
+{
+    return d->channels.value(channel).bytesSent;
+}
+
+quint64 QAmqpMetrics::messagesPublished() const
+{
+    return d->messagesPublished;
+}
+
+quint64 QAmqpMetrics::messagesDelivered() const
+{
+    return d->messagesDelivered;
+}
+
+static double ratePerSecond(quint64 count, quint64 previousCount, qint64 elapsed)
+{
+    if (elapsed <= 0 || count < previousCount)
+        return 0;
+    return (count - previousCount) * 1000.0 / elapsed;
+}
+
+double QAmqpMetrics::publishRate(const QAmqpMetrics &previous) const
+{
+    return ratePerSecond(d->messagesPublished, previous.d->messagesPublished,
+                         d->timestamp - previous.d->timestamp);
+}
+
+double QAmqpMetrics::deliveryRate(const QAmqpMetrics &previous) const
+{
+    return ratePerSecond(d->messagesDelivered, previous.d->messagesDelivered,
+                         d->timestamp - previous.d->timestamp);
+}
+
+qint64 QAmqpMetrics::unconfirmedPublishes() const
+{
+    return d->unconfirmedPublishes;
+}
+
+qint64 QAmqpMetrics::unackedDeliveries() const
+{
+    return d->unackedDeliveries;
+}
+
+qint64 QAmqpMetrics::outgoingBufferSize() const
+{
+    return d->outgoingBufferSize;
+}
+
+/*!
+ * The latest round trip of a synchronous method (a declare, bind, qos,
+ * ...) and its reply, in milliseconds, or -1 before the first sample.
+ * AMQP heartbeats are not echoed by the peer, so they cannot be timed.
+ */
+qint64 QAmqpMetrics::roundTripTime() const
+{
+    return d->roundTripTime;
+}
+
+quint64 QAmqpMetrics::reconnectCount() const
+{
+    return d->reconnectCount;
+}
+
+/*!
+ * How often the client stopped reading at its read budget and left the
+ * rest of the socket's data for a later event loop iteration.
+ */
+quint64 QAmqpMetrics::readBudgetExhausted() const
+{
+    return d->readBudgetExhausted;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+QAmqpMetricsCounters::QAmqpMetricsCounters()
+    : roundTripTime(-1)
+{
+    clock.start();
+}
+
+QAmqpMetricsCounters::~QAmqpMetricsCounters()
+{
+    qDeleteAll(channels);
+}
+
+QAmqpMetricsCounters::Traffic *QAmqpMetricsCounters::addChannel(quint16 channel)
+{
+    Traffic *traffic = new Traffic;
+    QMutexLocker locker(&channelsLock);
+    channels.insert(channel, traffic);
+    return traffic;
+}
+
+// the reply method id a synchronous request is answered with, 0 when none
+static int replyIdFor(int methodClass, int methodId)
+{
+    switch (methodClass) {
+    case QAmqpFrame::Connection:
+        return (methodId == 40 || methodId == 50) ? methodId + 1 : 0;
+    case QAmqpFrame::Channel:
+        return (methodId == 10 || methodId == 20 || methodId == 40) ? methodId + 1 : 0;
+    case QAmqpFrame::Exchange:
+        if (methodId == 40)
+            return 51;      // exchange.unbind-ok
+        return (methodId == 10 || methodId == 20 || methodId == 30) ? methodId + 1 : 0;
+    case QAmqpFrame::Queue:
+        return (methodId >= 10 && methodId <= 50 && methodId % 10 == 0) ? methodId + 1 : 0;
+    case QAmqpFrame::Basic:
+        switch (methodId) {
+        case 10: case 20: case 30: case 70: case 110:
+            return methodId + 1;
+        }
+        return 0;
+    case QAmqpFrame::Confirm:
+        return methodId == 10 ? 11 : 0;
+    case QAmqpFrame::Tx:
+        return (methodId == 10 || methodId == 20 || methodId == 30) ? methodId + 1 : 0;
+    }
+
+    return 0;
+}
+
+void QAmqpMetricsCounters::requestSent(quint16 channel, int methodClass, int methodId)
+{
+    const int replyId = replyIdFor(methodClass, methodId);
+    if (!replyId)
+        return;
+
+    // one probe per channel at a time, a no-wait request never gets its
+    // reply so an old probe gives way after a while
+    const qint64 now = clock.elapsed();
+    QHash<quint16, RoundTrip>::iterator it = pendingRoundTrips.find(channel);
+    if (it != pendingRoundTrips.end() && now - it->sent < 10000)
+        return;
+
+    RoundTrip roundTrip;
+    roundTrip.methodClass = methodClass;
+    roundTrip.replyId = replyId;
+    roundTrip.sent = now;
+    pendingRoundTrips.insert(channel, roundTrip);
+}
+
+void QAmqpMetricsCounters::replyReceived(quint16 channel, int methodClass, int methodId)
+{
+    // a close from the broker answers nothing that is outstanding
+    if (methodClass == QAmqpFrame::Connection && methodId == 50) {
+        pendingRoundTrips.clear();
+        return;
+    }
+
+    QHash<quint16, RoundTrip>::iterator it = pendingRoundTrips.find(channel);
+    if (it == pendingRoundTrips.end())
+        return;
+
+    if (methodClass == QAmqpFrame::Channel && methodId == 40) {
+        pendingRoundTrips.erase(it);
+        return;
+    }
+
+    const bool getEmpty = it->methodClass == QAmqpFrame::Basic && it->replyId == 71 && methodId == 72;
+    if (it->methodClass != methodClass || (it->replyId != methodId && !getEmpty))
+        return;
+
+    qAmqpStoreRelaxed(roundTripTime, clock.elapsed() - it->sent);
+    pendingRoundTrips.erase(it);
+}
+
+void QAmqpMetricsCounters::clearRoundTrips()
+{
+    pendingRoundTrips.clear();
+}
+
+QAmqpMetrics QAmqpMetricsCounters::snapshot() const
+{
+    QAmqpMetrics metrics;
+    QAmqpMetricsPrivate *d = metrics.d.data();
+    d->timestamp = clock.elapsed();
+
+    for (int i = 0; i < QAmqpMetrics::AllFrames; ++i) {
+        d->frameTypes[i].framesReceived = qAmqpLoadRelaxed(frameTypes[i].frames[Received]);
+        d->frameTypes[i].bytesReceived = qAmqpLoadRelaxed(frameTypes[i].bytes[Received]);
+        d->frameTypes[i].framesSent = qAmqpLoadRelaxed(frameTypes[i].frames[Sent]);
+        d->frameTypes[i].bytesSent = qAmqpLoadRelaxed(frameTypes[i].bytes[Sent]);
+    }
+
+    {
+        QMutexLocker locker(&channelsLock);
+        QHash<quint16, Traffic*>::const_iterator it;
+        for (it = channels.constBegin(); it != channels.constEnd(); ++it) {
+            QAmqpTrafficSnapshot &traffic = d->channels[it.key()];
+            traffic.framesReceived = qAmqpLoadRelaxed(it.value()->frames[Received]);
+            traffic.bytesReceived = qAmqpLoadRelaxed(it.value()->bytes[Received]);
+            traffic.framesSent = qAmqpLoadRelaxed(it.value()->frames[Sent]);
+            traffic.bytesSent = qAmqpLoadRelaxed(it.value()->bytes[Sent]);
+        }
+    }
+
+    d->messagesPublished = qAmqpLoadRelaxed(messagesPublished);
+    d->messagesDelivered = qAmqpLoadRelaxed(messagesDelivered);
+    d->unconfirmedPublishes = qAmqpLoadRelaxed(unconfirmedPublishes);
+    d->unackedDeliveries = qAmqpLoadRelaxed(unackedDeliveries);
+    d->outgoingBufferSize = qAmqpLoadRelaxed(outgoingBufferSize);
+    d->roundTripTime = qAmqpLoadRelaxed(roundTripTime);
+    d->reconnectCount = qAmqpLoadRelaxed(reconnectCount);
+    d->readBudgetExhausted = qAmqpLoadRelaxed(readBudgetExhausted);
+    return metrics;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2012-2014 Alexey Shcherbakov
+ * Copyright (C) 2014-2015 Matt Broadstone
+ * Contact: https://github.com/mbroadst/qamqp
+ *
+ * This file is part of the QAMQP Library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+#ifndef QAMQPMETRICS_H
+#define QAMQPMETRICS_H
+
+#include <QList>
+#include <QSharedDataPointer>
+
+#include "qamqpglobal.h"
+
+/*!
+ * A point in time snapshot of a client's runtime counters and gauges, as
+ * returned by QAmqpClient::metrics(). Counters only ever grow over the
+ * lifetime of the client, rates are derived from two snapshots.
+ */
+class QAmqpMetricsPrivate;
+class QAMQP_EXPORT QAmqpMetrics
+{
+public:
+    enum FrameType {
+        MethodFrame,
+        HeaderFrame,
+        BodyFrame,
+        HeartbeatFrame,
+        AllFrames
+    };
+
+    QAmqpMetrics();
+    QAmqpMetrics(const QAmqpMetrics &other);
+    QAmqpMetrics &operator=(const QAmqpMetrics &other);
+    ~QAmqpMetrics();
+
+    inline void swap(QAmqpMetrics &other) { qSwap(d, other.d); }
+
+    /*! milliseconds on the client's monotonic clock the snapshot was taken at */
+    qint64 timestamp() const;
+
+    // traffic
+    quint64 framesReceived(FrameType type = AllFrames) const;
+    quint64 bytesReceived(FrameType type = AllFrames) const;
+    quint64 framesSent(FrameType type = AllFrames) const;
+    quint64 bytesSent(FrameType type = AllFrames) const;
+
+    QList<quint16> channels() const;
+    quint64 channelFramesReceived(quint16 channel) const;
+    quint64 channelBytesReceived(quint16 channel) const;
+    quint64 channelFramesSent(quint16 channel) const;
+    quint64 channelBytesSent(quint16 channel) const;
+
+    // messages
+    quint64 messagesPublished() const;
+    quint64 messagesDelivered() const;
+    double publishRate(const QAmqpMetrics &previous) const;
+    double deliveryRate(const QAmqpMetrics &previous) const;
+
+    // gauges
+    qint64 unconfirmedPublishes() const;
+    qint64 unackedDeliveries() const;
+    qint64 outgoingBufferSize() const;
+    qint64 roundTripTime() const;
+
+    // connection
+    quint64 reconnectCount() const;
+    quint64 readBudgetExhausted() const;
+
+private:
+    QSharedDataPointer<QAmqpMetricsPrivate> d;
+    friend class QAmqpMetricsCounters;
+
+};
+
+Q_DECLARE_SHARED(QAmqpMetrics)
+
+#endif  // QAMQPMETRICS_H
@@ -0,0 +1,155 @@
+#ifndef QAMQPMETRICS_P_H
+#define QAMQPMETRICS_P_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QSharedData>
+
+#include "qamqpframe_p.h"
+#include "qamqpmetrics.h"
+
+template <typename T>
+inline T qAmqpLoadRelaxed(const QAtomicInteger<T> &value)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
+    return value.loadRelaxed();
+#else
+    return value.load();
+#endif
+}
+
+template <typename T>
+inline void qAmqpStoreRelaxed(QAtomicInteger<T> &value, T newValue)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
+    value.storeRelaxed(newValue);
+#else
+    value.store(newValue);
+#endif
+}
+
+struct QAmqpTrafficSnapshot
+{
+    QAmqpTrafficSnapshot()
+        : framesReceived(0), bytesReceived(0), framesSent(0), bytesSent(0) {}
+
+    quint64 framesReceived;
+    quint64 bytesReceived;
+    quint64 framesSent;
+    quint64 bytesSent;
+};
+
+class QAmqpMetricsPrivate : public QSharedData
+{
+public:
+    QAmqpMetricsPrivate();
+
+    qint64 timestamp;
+    QAmqpTrafficSnapshot frameTypes[QAmqpMetrics::AllFrames];
+    QMap<quint16, QAmqpTrafficSnapshot> channels;
+    quint64 messagesPublished;
+    quint64 messagesDelivered;
+    qint64 unconfirmedPublishes;
+    qint64 unackedDeliveries;
+    qint64 outgoingBufferSize;
+    qint64 roundTripTime;
+    quint64 reconnectCount;
+    quint64 readBudgetExhausted;
+
+};
+
+/*
+ * The live side of QAmqpMetrics, owned by QAmqpClientPrivate. Everything is
+ * written from the client's thread with relaxed atomics so snapshot() can be
+ * taken from any thread without stalling the connection. The per channel
+ * table only takes its lock when a channel is seen for the first time.
+ */
+class QAmqpMetricsCounters
+{
+public:
+    enum Direction {
+        Received,
+        Sent
+    };
+
+    struct Traffic
+    {
+        QAtomicInteger<quint64> frames[2];
+        QAtomicInteger<quint64> bytes[2];
+    };
+
+    QAmqpMetricsCounters();
+    ~QAmqpMetricsCounters();
+
+    inline void countFrame(Direction direction, quint8 frameType, quint16 channel, qint64 size)
+    {
+        const int type = typeIndex(frameType);
+        if (type >= 0) {
+            frameTypes[type].frames[direction].fetchAndAddRelaxed(1);
+            frameTypes[type].bytes[direction].fetchAndAddRelaxed(size);
+        }
+
+        Traffic *traffic = channelTraffic(channel);
+        traffic->frames[direction].fetchAndAddRelaxed(1);
+        traffic->bytes[direction].fetchAndAddRelaxed(size);
+    }
+
+    // round trips of synchronous methods, client thread only
+    void requestSent(quint16 channel, int methodClass, int methodId);
+    void replyReceived(quint16 channel, int methodClass, int methodId);
+    void clearRoundTrips();
+
+    QAmqpMetrics snapshot() const;
+
+    Traffic frameTypes[QAmqpMetrics::AllFrames];
+    QAtomicInteger<quint64> messagesPublished;
+    QAtomicInteger<quint64> messagesDelivered;
+    QAtomicInteger<qint64> unconfirmedPublishes;
+    QAtomicInteger<qint64> unackedDeliveries;
+    QAtomicInteger<qint64> outgoingBufferSize;
+    QAtomicInteger<qint64> roundTripTime;
+    QAtomicInteger<quint64> reconnectCount;
+    QAtomicInteger<quint64> readBudgetExhausted;
+
+private:
+    static inline int typeIndex(quint8 frameType)
+    {
+        switch (frameType) {
+        case QAmqpFrame::Method: return QAmqpMetrics::MethodFrame;
+        case QAmqpFrame::Header: return QAmqpMetrics::HeaderFrame;
+        case QAmqpFrame::Body: return QAmqpMetrics::BodyFrame;
+        case QAmqpFrame::Heartbeat: return QAmqpMetrics::HeartbeatFrame;
+        }
+
+        return -1;
+    }
+
+    inline Traffic *channelTraffic(quint16 channel)
+    {
+        // only the client thread inserts, so it can look up without the lock
+        Traffic *traffic = channels.value(channel);
+        return traffic ? traffic : addChannel(channel);
+    }
+
+    Traffic *addChannel(quint16 channel);
+
+    struct RoundTrip
+    {
+        int methodClass;
+        int replyId;
+        qint64 sent;
+    };
+
+    QElapsedTimer clock;
+    mutable QMutex channelsLock;
+    QHash<quint16, Traffic*> channels;
+    QHash<quint16, RoundTrip> pendingRoundTrips;
+
+    Q_DISABLE_COPY(QAmqpMetricsCounters)
+
+};
+
+#endif  // QAMQPMETRICS_P_H
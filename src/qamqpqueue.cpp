@@ -2,6 +2,10 @@
 #include <QDebug>
 #include <QDataStream>
 #include <QFile>
+#include <QSet>
+#include <QtEndian>
+
+#include <cstring>
 
 #include "qamqpclient.h"
 #include "qamqpclient_p.h"
@@ -16,18 +20,35 @@ QAmqpQueuePrivate::QAmqpQueuePrivate(QAmqpQueue *q)
     : QAmqpChannelPrivate(q),
       delayedDeclare(false),
       declared(false),
+      declareRequested(false),
+      serverNamed(false),
+      recoverConsumer(false),
+      consumeOptions(0),
       recievingMessage(false),
       consuming(false),
       consumeRequested(false),
+      consumeNoAck(false),
+      getNoAck(true),
+      currentNoAck(false),
+      currentIsGet(false),
+      consumerPool(0),
+      shardingKey(QAmqpQueue::NoSharding),
+      deliveryGeneration(0),
+      batchDelivery(false),
+      batchCount(0),
+      trackAckLatency(false),
+      currentArrival(0),
       messageCount(0),
       consumerCount(0)
 {
+    latencyClock.start();
 }
 
 QAmqpQueuePrivate::~QAmqpQueuePrivate()
 {
     if (!client.isNull()) {
         QAmqpClientPrivate *priv = client->d_func();
+        priv->metrics.unackedDeliveries.fetchAndAddRelaxed(-unackedDeliveryTags.size());
         priv->contentHandlerByChannel[channelNumber].removeAll(this);
         priv->bodyHandlersByChannel[channelNumber].removeAll(this);
     }
@@ -42,6 +63,44 @@ void QAmqpQueuePrivate::resetInternalState()
     recievingMessage = false;
     consuming = false;
     consumeRequested = false;
+    forgetDeliveries();
+}
+
+void QAmqpQueuePrivate::recover()
+{
+    Q_Q(QAmqpQueue);
+    QAmqpChannelPrivate::recover();
+    if (declareRequested) {
+        // a server named queue comes back under a new name, the bindings and
+        // consumer below address it as the channel's last declared queue
+        if (serverNamed)
+            setName(QString());
+        declare();
+    }
+
+    typedef QPair<QString, QString> BindingPair;
+    foreach (const BindingPair &binding, bindings) {
+        delayedBindings.removeAll(binding);
+        q->bind(binding.first, binding.second);
+    }
+
+    if (recoverConsumer && !consuming && !consumeRequested)
+        consume(consumeOptions);
+}
+
+void QAmqpQueuePrivate::forgetDeliveries()
+{
+    // delivery tags die with the channel, the broker redelivers anything
+    // the consumer pool has not settled yet. Work still waiting in a lane
+    // is dropped so the redelivered copy is the only one processed, and
+    // per-key ordering starts over from the broker's view
+    deliveryGeneration++;
+    const int unacked = unackedDeliveryTags.size();
+    unackedDeliveryTags.clear();
+    unackedChanged(unacked);
+    deliveryTimes.clear();
+    if (consumerPool)
+        consumerPool->discardStale(deliveryGeneration);
 }
 
 bool QAmqpQueuePrivate::_q_method(const QAmqpMethodFrame &frame)
@@ -97,6 +156,12 @@ bool QAmqpQueuePrivate::_q_method(const QAmqpMethodFrame &frame)
     return false;
 }
 
+// large bodies get their payload reserved up front, up to a limit past
+// which it grows as the bytes come in rather than on the sender's word;
+// smaller ones simply share the buffer of their single body frame
+static const int minReservedPayload = 16384;
+static const int maxReservedPayload = 16 * 1024 * 1024;
+
 void QAmqpQueuePrivate::_q_content(const QAmqpContentFrame &frame)
 {
     Q_Q(QAmqpQueue);
@@ -110,19 +175,23 @@ void QAmqpQueuePrivate::_q_content(const QAmqpContentFrame &frame)
     }
 
     currentMessage.d->leftSize = frame.bodySize();
-    QAmqpMessage::PropertyHash::ConstIterator it;
-    QAmqpMessage::PropertyHash::ConstIterator itEnd = frame.properties_.constEnd();
-    for (it = frame.properties_.constBegin(); it != itEnd; ++it) {
-        QAmqpMessage::Property property = (it.key());
-        if (property == QAmqpMessage::Headers)
-            currentMessage.d->headers = (it.value()).toHash();
-        currentMessage.d->properties[property] = it.value();
-    }
+
+    // a body spread over several frames, or read as it arrives, is appended
+    // to the payload piece by piece
+    if (currentMessage.d->leftSize >= minReservedPayload)
+        currentMessage.d->payload.reserve(qMin(currentMessage.d->leftSize, maxReservedPayload));
+
+    // deliveries mostly carry the same properties as the one before, those
+    // share a single hash instead of each message building its own
+    if (frame.properties_ != lastProperties)
+        lastProperties = frame.properties_;
+    currentMessage.d->properties = lastProperties;
+    if (lastProperties.contains(QAmqpMessage::Headers))
+        currentMessage.d->headers = lastProperties.value(QAmqpMessage::Headers).toHash();
 
     if (currentMessage.d->leftSize == 0) {
         // message with an empty body
-        q->enqueue(currentMessage);
-        Q_EMIT q->messageReceived();
+        dispatchMessage();
     }
 }
 
@@ -140,9 +209,187 @@ void QAmqpQueuePrivate::_q_body(const QAmqpContentBodyFrame &frame)
 
     currentMessage.d->payload.append(frame.body());
     currentMessage.d->leftSize -= frame.body().size();
-    if (currentMessage.d->leftSize == 0) {
-        q->enqueue(currentMessage);
-        Q_EMIT q->messageReceived();
+    if (currentMessage.d->leftSize == 0)
+        dispatchMessage();
+}
+
+QByteArray *QAmqpQueuePrivate::_q_bodyBuffer(quint16 channel)
+{
+    if (channel != channelNumber || !currentMessage.isValid())
+        return 0;
+    return &currentMessage.d->payload;
+}
+
+void QAmqpQueuePrivate::_q_bodyReceived(quint16 channel, qint32 size)
+{
+    if (channel != channelNumber || !currentMessage.isValid())
+        return;
+
+    currentMessage.d->leftSize -= size;
+    if (currentMessage.d->leftSize == 0)
+        dispatchMessage();
+}
+
+void QAmqpQueuePrivate::deliverySettled(qlonglong deliveryTag, bool multiple, bool acked)
+{
+    const int unacked = unackedDeliveryTags.size();
+    if (!multiple) {
+        if (unackedDeliveryTags.removeOne(deliveryTag))
+            recordAckLatency(deliveryTag, acked);
+    } else {
+        // a multiple settle with tag zero covers everything outstanding
+        while (!unackedDeliveryTags.isEmpty() &&
+               (deliveryTag == 0 || unackedDeliveryTags.first() <= deliveryTag))
+            recordAckLatency(unackedDeliveryTags.takeFirst(), acked);
+    }
+
+    unackedChanged(unacked);
+}
+
+void QAmqpQueuePrivate::recordAckLatency(qlonglong deliveryTag, bool acked)
+{
+    if (!trackAckLatency)
+        return;
+
+    QHash<qlonglong, qint64>::iterator it = deliveryTimes.find(deliveryTag);
+    if (it == deliveryTimes.end())
+        return;
+
+    if (acked)
+        ackLatency.record(latencyClock.nsecsElapsed() / 1000 - it.value());
+    deliveryTimes.erase(it);
+}
+
+void QAmqpQueuePrivate::unackedChanged(int previousCount)
+{
+    QAmqpMetricsCounters *counters = metrics();
+    if (counters && previousCount != unackedDeliveryTags.size())
+        counters->unackedDeliveries.fetchAndAddRelaxed(unackedDeliveryTags.size() - previousCount);
+}
+
+void QAmqpQueuePrivate::dispatchMessage()
+{
+    Q_Q(QAmqpQueue);
+    if (QAmqpMetricsCounters *counters = metrics()) {
+        counters->messagesDelivered.fetchAndAddRelaxed(1);
+        if (!currentNoAck)
+            counters->unackedDeliveries.fetchAndAddRelaxed(1);
+    }
+
+    if (!currentNoAck) {
+        unackedDeliveryTags.append(currentMessage.deliveryTag());
+        if (trackAckLatency)
+            deliveryTimes.insert(currentMessage.deliveryTag(), currentArrival);
+    }
+
+    // basic.get results are the caller's, only consumer deliveries go to the pool
+    if (consumerPool && !currentIsGet) {
+        consumerPool->post(currentMessage, deliveryGeneration, currentNoAck);
+        return;
+    }
+
+    if (messageCallback) {
+        messageCallback(currentMessage);
+        return;
+    }
+
+    q->enqueue(currentMessage);
+    if (batchDelivery) {
+        // announced once the client is done with what it has read
+        if (!batchCount++ && client)
+            client->d_func()->pendingBatches.append(q);
+        return;
+    }
+
+    Q_EMIT q->messageReceived();
+}
+
+void QAmqpQueuePrivate::flushBatch()
+{
+    Q_Q(QAmqpQueue);
+    const int count = batchCount;
+    batchCount = 0;
+    if (count)
+        Q_EMIT q->messagesReceived(count);
+}
+
+/*!
+ * Never waits for the workers, a handler may need this thread to finish.
+ * Whatever they had not started is handed back to the broker, what they
+ * are processing is settled by _q_settle() as it completes.
+ */
+void QAmqpQueuePrivate::stopConsumerPool()
+{
+    Q_Q(QAmqpQueue);
+    if (!consumerPool)
+        return;
+
+    foreach (const QAmqpConsumerPool::Task &task, consumerPool->retire()) {
+        if (!task.noAck && task.generation == deliveryGeneration)
+            q->reject(task.message.deliveryTag(), true);
+    }
+
+    retiredPools.append(consumerPool);
+    consumerPool = 0;
+}
+
+void QAmqpQueuePrivate::settle(const QList<QAmqpConsumerPool::Result> &results)
+{
+    Q_Q(QAmqpQueue);
+    QSet<qlonglong> acked;
+    foreach (const QAmqpConsumerPool::Result &result, results) {
+        if (result.noAck || result.generation != deliveryGeneration)
+            continue;
+
+        if (result.disposition == QAmqpQueue::Ack) {
+            acked.insert(result.deliveryTag);
+            continue;
+        }
+
+        // rejections go out before any multiple ack that could cover them
+        q->reject(result.deliveryTag, result.disposition == QAmqpQueue::Requeue);
+    }
+
+    ackCompleted(acked);
+}
+
+/*!
+ * Acks deliveries finished out of order. Everything at the head of the
+ * delivery order is covered by a single multiple ack, anything behind a
+ * message still being processed is acked on its own so it doesn't hold
+ * the prefetch window.
+ */
+void QAmqpQueuePrivate::ackCompleted(QSet<qlonglong> deliveryTags)
+{
+    Q_Q(QAmqpQueue);
+    qlonglong lastContiguous = 0;
+    QList<qlonglong>::const_iterator it = unackedDeliveryTags.constBegin();
+    for (; it != unackedDeliveryTags.constEnd() && deliveryTags.contains(*it); ++it) {
+        lastContiguous = *it;
+        deliveryTags.remove(lastContiguous);
+    }
+
+    if (lastContiguous)
+        q->ack(lastContiguous, true);
+
+    foreach (qlonglong deliveryTag, deliveryTags)
+        q->ack(deliveryTag, false);
+}
+
+void QAmqpQueuePrivate::_q_settle()
+{
+    if (consumerPool)
+        settle(consumerPool->takeResults());
+
+    QMutableListIterator<QAmqpConsumerPool*> it(retiredPools);
+    while (it.hasNext()) {
+        QAmqpConsumerPool *pool = it.next();
+        settle(pool->takeResults());
+        if (pool->hasStopped()) {
+            settle(pool->takeResults());
+            delete pool;
+            it.remove();
+        }
     }
 }
 
@@ -154,12 +401,12 @@ void QAmqpQueuePrivate::declareOk(const QAmqpMethodFrame &frame)
     QByteArray data = frame.arguments();
     QDataStream stream(&data, QIODevice::ReadOnly);
 
-    name = QAmqpFrame::readAmqpField(stream, QAmqpMetaType::ShortString).toString();
+    setName(QAmqpFrame::readAmqpField(stream, QAmqpMetaType::ShortString).toString());
 
     stream >> messageCount >> consumerCount;
 
-    qAmqpDebug("-> queue#declareOk( queue-name=%s, message-count=%d, consumer-count=%d )",
-               qPrintable(name), messageCount, consumerCount);
+    qAmqpProtocolDebug("-> queue#declareOk( queue-name=%s, message-count=%d, consumer-count=%d )",
+                       qPrintable(name), messageCount, consumerCount);
 
     Q_EMIT q->declared();
 }
@@ -173,8 +420,8 @@ void QAmqpQueuePrivate::purgeOk(const QAmqpMethodFrame &frame)
 
     stream >> messageCount;
 
-    qAmqpDebug("-> queue#purgeOk( queue-name=%s, message-count=%d )",
-               qPrintable(name), messageCount);
+    qAmqpProtocolDebug("-> queue#purgeOk( queue-name=%s, message-count=%d )",
+                       qPrintable(name), messageCount);
 
     Q_EMIT q->purged(messageCount);
 }
@@ -183,14 +430,17 @@ void QAmqpQueuePrivate::deleteOk(const QAmqpMethodFrame &frame)
 {
     Q_Q(QAmqpQueue);
     declared = false;
+    declareRequested = false;
+    bindings.clear();
+    recoverConsumer = false;
 
     QByteArray data = frame.arguments();
     QDataStream stream(&data, QIODevice::ReadOnly);
 
     stream >> messageCount;
 
-    qAmqpDebug("-> queue#deleteOk( queue-name=%s, message-count=%d )",
-               qPrintable(name), messageCount);
+    qAmqpProtocolDebug("-> queue#deleteOk( queue-name=%s, message-count=%d )",
+                       qPrintable(name), messageCount);
 
 
     Q_EMIT q->removed();
@@ -200,7 +450,7 @@ void QAmqpQueuePrivate::bindOk(const QAmqpMethodFrame &frame)
 {
     Q_UNUSED(frame)
     Q_Q(QAmqpQueue);
-    qAmqpDebug("-> queue[ %s ]#bindOk()", qPrintable(name));
+    qAmqpProtocolDebug("-> queue[ %s ]#bindOk()", qPrintable(name));
     Q_EMIT q->bound();
 }
 
@@ -208,23 +458,69 @@ void QAmqpQueuePrivate::unbindOk(const QAmqpMethodFrame &frame)
 {
     Q_UNUSED(frame)
     Q_Q(QAmqpQueue);
-    qAmqpDebug("-> queue[ %s ]#unbindOk()", qPrintable(name));
+    qAmqpProtocolDebug("-> queue[ %s ]#unbindOk()", qPrintable(name));
     Q_EMIT q->unbound();
 }
 
-void QAmqpQueuePrivate::getOk(const QAmqpMethodFrame &frame)
+// basic.deliver and basic.get-ok come with every message, their arguments
+// are read in place instead of through a QDataStream and a QBuffer
+static bool takeShortString(const char *&pos, const char *end, const char **data, int *size)
 {
-    qAmqpDebug("-> queue[ %s ]#getOk()", qPrintable(name));
+    if (pos >= end || end - pos - 1 < quint8(*pos))
+        return false;
 
-    QByteArray data = frame.arguments();
-    QDataStream in(&data, QIODevice::ReadOnly);
+    *size = quint8(*pos++);
+    *data = pos;
+    pos += *size;
+    return true;
+}
+
+// consecutive deliveries mostly repeat the exchange and routing key, those
+// share the bytes of the previous one
+static QByteArray interned(QByteArray &last, const char *data, int size)
+{
+    if (last.isNull() || last.size() != size || memcmp(last.constData(), data, size) != 0)
+        last = QByteArray(data, size);
+    return last;
+}
+
+bool QAmqpQueuePrivate::readDelivery(const char *pos, const char *end, QAmqpMessage &message)
+{
+    // delivery-tag, redelivered, exchange and routing-key
+    if (end - pos < 9)
+        return false;
+
+    message.d->deliveryTag = qFromBigEndian<qint64>(reinterpret_cast<const uchar*>(pos));
+    message.d->redelivered = pos[8] != 0;
+    pos += 9;
+
+    const char *exchange, *routingKey;
+    int exchangeSize, routingKeySize;
+    if (!takeShortString(pos, end, &exchange, &exchangeSize) ||
+        !takeShortString(pos, end, &routingKey, &routingKeySize))
+        return false;
+
+    message.d->exchangeName = interned(lastExchangeName, exchange, exchangeSize);
+    message.d->routingKey = interned(lastRoutingKey, routingKey, routingKeySize);
+    return true;
+}
+
+void QAmqpQueuePrivate::getOk(const QAmqpMethodFrame &frame)
+{
+    qAmqpProtocolDebug("-> queue[ %s ]#getOk()", qPrintable(name));
 
+    const QByteArray data = frame.arguments();
     QAmqpMessage message;
-    message.d->deliveryTag = QAmqpFrame::readAmqpField(in, QAmqpMetaType::LongLongUint).toLongLong();
-    message.d->redelivered = QAmqpFrame::readAmqpField(in, QAmqpMetaType::Boolean).toBool();
-    message.d->exchangeName = QAmqpFrame::readAmqpField(in, QAmqpMetaType::ShortString).toString();
-    message.d->routingKey = QAmqpFrame::readAmqpField(in, QAmqpMetaType::ShortString).toString();
+    if (!readDelivery(data.constData(), data.constData() + data.size(), message)) {
+        qAmqpDebug() << Q_FUNC_INFO << "truncated get-ok";
+        return;
+    }
+
     currentMessage = message;
+    currentNoAck = getNoAck;
+    currentIsGet = true;
+    if (trackAckLatency)
+        currentArrival = latencyClock.nsecsElapsed() / 1000;
 }
 
 void QAmqpQueuePrivate::consumeOk(const QAmqpMethodFrame &frame)
@@ -232,11 +528,11 @@ void QAmqpQueuePrivate::consumeOk(const QAmqpMethodFrame &frame)
     Q_Q(QAmqpQueue);
     QByteArray data = frame.arguments();
     QDataStream stream(&data, QIODevice::ReadOnly);
-    consumerTag = QAmqpFrame::readAmqpField(stream, QAmqpMetaType::ShortString).toString();
+    setConsumerTag(QAmqpFrame::readAmqpField(stream, QAmqpMetaType::ShortString).toString());
     consuming = true;
     consumeRequested = false;
 
-    qAmqpDebug("-> queue[ %s ]#consumeOk( consumer-tag=%s )", qPrintable(name), qPrintable(consumerTag));
+    qAmqpProtocolDebug("-> queue[ %s ]#consumeOk( consumer-tag=%s )", qPrintable(name), qPrintable(consumerTag));
 
     Q_EMIT q->consuming(consumerTag);
 }
@@ -244,20 +540,34 @@ void QAmqpQueuePrivate::consumeOk(const QAmqpMethodFrame &frame)
 void QAmqpQueuePrivate::deliver(const QAmqpMethodFrame &frame)
 {
     qAmqpDebug() << Q_FUNC_INFO;
-    QByteArray data = frame.arguments();
-    QDataStream in(&data, QIODevice::ReadOnly);
-    QString consumer = QAmqpFrame::readAmqpField(in, QAmqpMetaType::ShortString).toString();
-    if (consumerTag != consumer) {
-        qAmqpDebug() << Q_FUNC_INFO << "invalid consumer tag: " << consumer;
+    const QByteArray data = frame.arguments();
+    const char *pos = data.constData();
+    const char *end = pos + data.size();
+
+    const char *consumer;
+    int consumerSize;
+    if (!takeShortString(pos, end, &consumer, &consumerSize)) {
+        qAmqpDebug() << Q_FUNC_INFO << "truncated deliver";
+        return;
+    }
+
+    if (consumerSize != consumerTagUtf8.size() ||
+        memcmp(consumer, consumerTagUtf8.constData(), consumerSize) != 0) {
+        qAmqpDebug() << Q_FUNC_INFO << "invalid consumer tag: " << QByteArray(consumer, consumerSize);
         return;
     }
 
     QAmqpMessage message;
-    message.d->deliveryTag = QAmqpFrame::readAmqpField(in, QAmqpMetaType::LongLongUint).toLongLong();
-    message.d->redelivered = QAmqpFrame::readAmqpField(in, QAmqpMetaType::Boolean).toBool();
-    message.d->exchangeName = QAmqpFrame::readAmqpField(in, QAmqpMetaType::ShortString).toString();
-    message.d->routingKey = QAmqpFrame::readAmqpField(in, QAmqpMetaType::ShortString).toString();
+    if (!readDelivery(pos, end, message)) {
+        qAmqpDebug() << Q_FUNC_INFO << "truncated deliver";
+        return;
+    }
+
     currentMessage = message;
+    currentNoAck = consumeNoAck;
+    currentIsGet = false;
+    if (trackAckLatency)
+        currentArrival = latencyClock.nsecsElapsed() / 1000;
 }
 
 void QAmqpQueuePrivate::declare()
@@ -269,14 +579,14 @@ void QAmqpQueuePrivate::declare()
     QDataStream out(&args, QIODevice::WriteOnly);
 
     out << qint16(0);   //reserved 1
-    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, name);
+    QAmqpFrame::writeEncoded(out, encodedName);
     out << qint8(options);
     QAmqpFrame::writeAmqpField(out, QAmqpMetaType::Hash, arguments);
 
-    qAmqpDebug("<- queue#declare( queue=%s, passive=%d, durable=%d, exclusive=%d, auto-delete=%d, no-wait=%d )",
-               qPrintable(name), options & QAmqpQueue::Passive, options & QAmqpQueue::Durable,
-               options & QAmqpQueue::Exclusive, options & QAmqpQueue::AutoDelete,
-               options & QAmqpQueue::NoWait);
+    qAmqpProtocolDebug("<- queue#declare( queue=%s, passive=%d, durable=%d, exclusive=%d, auto-delete=%d, no-wait=%d )",
+                       qPrintable(name), options & QAmqpQueue::Passive, options & QAmqpQueue::Durable,
+                       options & QAmqpQueue::Exclusive, options & QAmqpQueue::AutoDelete,
+                       options & QAmqpQueue::NoWait);
 
     frame.setArguments(args);
     sendFrame(frame);
@@ -285,6 +595,37 @@ void QAmqpQueuePrivate::declare()
         delayedDeclare = false;
 }
 
+void QAmqpQueuePrivate::setConsumerTag(const QString &tag)
+{
+    consumerTag = tag;
+    consumerTagUtf8 = tag.toUtf8();
+}
+
+void QAmqpQueuePrivate::consume(int options)
+{
+    QAmqpMethodFrame frame(QAmqpFrame::Basic, QAmqpQueuePrivate::bmConsume);
+    frame.setChannel(channelNumber);
+
+    QByteArray arguments;
+    QDataStream out(&arguments, QIODevice::WriteOnly);
+
+    out << qint16(0);   //reserved 1
+    QAmqpFrame::writeEncoded(out, encodedName);
+    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, consumerTag);
+
+    out << qint8(options);
+    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::Hash, QAmqpTable());
+
+    qAmqpProtocolDebug("<- basic#consume( queue=%s, consumer-tag=%s, no-local=%d, no-ack=%d, exclusive=%d, no-wait=%d )",
+                       qPrintable(name), qPrintable(consumerTag),
+                       options & QAmqpQueue::coNoLocal, options & QAmqpQueue::coNoAck,
+                       options & QAmqpQueue::coExclusive, options & QAmqpQueue::coNoWait);
+
+    frame.setArguments(arguments);
+    sendFrame(frame);
+    consumeRequested = true;
+}
+
 void QAmqpQueuePrivate::cancelOk(const QAmqpMethodFrame &frame)
 {
     Q_Q(QAmqpQueue);
@@ -297,9 +638,9 @@ void QAmqpQueuePrivate::cancelOk(const QAmqpMethodFrame &frame)
         return;
     }
 
-    qAmqpDebug("-> queue[ %s ]#cancelOk( consumer-tag=%s )", qPrintable(name), qPrintable(consumerTag));
+    qAmqpProtocolDebug("-> queue[ %s ]#cancelOk( consumer-tag=%s )", qPrintable(name), qPrintable(consumerTag));
 
-    consumerTag.clear();
+    setConsumerTag(QString());
     consuming = false;
     consumeRequested = false;
     Q_EMIT q->cancelled(consumer);
@@ -314,8 +655,18 @@ QAmqpQueue::QAmqpQueue(int channelNumber, QAmqpClient *parent)
     d->init(channelNumber, parent);
 }
 
+/*!
+ * Never waits for handlers still running in a consumer pool, they may need
+ * this thread to finish. What the pool had not started yet goes back to the
+ * broker, the pools delete themselves once their workers exit.
+ */
 QAmqpQueue::~QAmqpQueue()
 {
+    Q_D(QAmqpQueue);
+    d->stopConsumerPool();
+    foreach (QAmqpConsumerPool *pool, d->retiredPools)
+        pool->abandon();
+    d->retiredPools.clear();
 }
 
 void QAmqpQueue::channelOpened()
@@ -334,6 +685,8 @@ void QAmqpQueue::channelOpened()
 
 void QAmqpQueue::channelClosed()
 {
+    Q_D(QAmqpQueue);
+    d->forgetDeliveries();
 }
 
 int QAmqpQueue::options() const
@@ -359,6 +712,8 @@ void QAmqpQueue::declare(int options, const QAmqpTable &arguments)
     Q_D(QAmqpQueue);
     d->options = options;
     d->arguments = arguments;
+    d->declareRequested = true;
+    d->serverNamed = d->serverNamed || d->name.isEmpty();
 
     if (!d->opened) {
         d->delayedDeclare = true;
@@ -383,11 +738,11 @@ void QAmqpQueue::remove(int options)
     QDataStream out(&arguments, QIODevice::WriteOnly);
 
     out << qint16(0);   //reserved 1
-    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, d->name);
+    QAmqpFrame::writeEncoded(out, d->encodedName);
     out << qint8(options);
 
-    qAmqpDebug("<- queue#delete( queue=%s, if-unused=%d, if-empty=%d )",
-               qPrintable(d->name), options & QAmqpQueue::roIfUnused, options & QAmqpQueue::roIfEmpty);
+    qAmqpProtocolDebug("<- queue#delete( queue=%s, if-unused=%d, if-empty=%d )",
+                       qPrintable(d->name), options & QAmqpQueue::roIfUnused, options & QAmqpQueue::roIfEmpty);
 
     frame.setArguments(arguments);
     d->sendFrame(frame);
@@ -406,10 +761,10 @@ void QAmqpQueue::purge()
     QByteArray arguments;
     QDataStream out(&arguments, QIODevice::WriteOnly);
     out << qint16(0);   //reserved 1
-    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, d->name);
+    QAmqpFrame::writeEncoded(out, d->encodedName);
     out << qint8(0);    // no-wait
 
-    qAmqpDebug("<- queue#purge( queue=%s, no-wait=%d )", qPrintable(d->name), 0);
+    qAmqpProtocolDebug("<- queue#purge( queue=%s, no-wait=%d )", qPrintable(d->name), 0);
 
     frame.setArguments(arguments);
     d->sendFrame(frame);
@@ -428,8 +783,12 @@ void QAmqpQueue::bind(QAmqpExchange *exchange, const QString &key)
 void QAmqpQueue::bind(const QString &exchangeName, const QString &key)
 {
     Q_D(QAmqpQueue);
+    const QPair<QString, QString> binding(exchangeName, key);
+    if (!d->bindings.contains(binding))
+        d->bindings.append(binding);
+
     if (!d->opened) {
-        d->delayedBindings.append(QPair<QString,QString>(exchangeName, key));
+        d->delayedBindings.append(binding);
         return;
     }
 
@@ -440,16 +799,16 @@ void QAmqpQueue::bind(const QString &exchangeName, const QString &key)
     QDataStream out(&arguments, QIODevice::WriteOnly);
 
     out << qint16(0);   //  reserved 1
-    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, d->name);
+    QAmqpFrame::writeEncoded(out, d->encodedName);
     QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, exchangeName);
     QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, key);
 
     out << qint8(0);    //  no-wait
     QAmqpFrame::writeAmqpField(out, QAmqpMetaType::Hash, QAmqpTable());
 
-    qAmqpDebug("<- queue#bind( queue=%s, exchange=%s, routing-key=%s, no-wait=%d )",
-               qPrintable(d->name), qPrintable(exchangeName), qPrintable(key),
-               0);
+    qAmqpProtocolDebug("<- queue#bind( queue=%s, exchange=%s, routing-key=%s, no-wait=%d )",
+                       qPrintable(d->name), qPrintable(exchangeName), qPrintable(key),
+                       0);
 
     frame.setArguments(arguments);
     d->sendFrame(frame);
@@ -473,19 +832,20 @@ void QAmqpQueue::unbind(const QString &exchangeName, const QString &key)
         return;
     }
 
+    d->bindings.removeAll(QPair<QString, QString>(exchangeName, key));
     QAmqpMethodFrame frame(QAmqpFrame::Queue, QAmqpQueuePrivate::miUnbind);
     frame.setChannel(d->channelNumber);
 
     QByteArray arguments;
     QDataStream out(&arguments, QIODevice::WriteOnly);
     out << qint16(0);   //reserved 1
-    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, d->name);
+    QAmqpFrame::writeEncoded(out, d->encodedName);
     QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, exchangeName);
     QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, key);
     QAmqpFrame::writeAmqpField(out, QAmqpMetaType::Hash, QAmqpTable());
 
-    qAmqpDebug("<- queue#unbind( queue=%s, exchange=%s, routing-key=%s )",
-               qPrintable(d->name), qPrintable(exchangeName), qPrintable(key));
+    qAmqpProtocolDebug("<- queue#unbind( queue=%s, exchange=%s, routing-key=%s )",
+                       qPrintable(d->name), qPrintable(exchangeName), qPrintable(key));
 
     frame.setArguments(arguments);
     d->sendFrame(frame);
@@ -509,34 +869,59 @@ bool QAmqpQueue::consume(int options)
         return false;
     }
 
-    QAmqpMethodFrame frame(QAmqpFrame::Basic, QAmqpQueuePrivate::bmConsume);
-    frame.setChannel(d->channelNumber);
+    // a previous parallel consumer winds down in the background
+    d->stopConsumerPool();
+    d->consumeNoAck = (options & QAmqpQueue::coNoAck);
+    d->consumeOptions = options;
+    d->recoverConsumer = true;
+    d->consume(options);
+    return true;
+}
 
-    QByteArray arguments;
-    QDataStream out(&arguments, QIODevice::WriteOnly);
+bool QAmqpQueue::consume(const MessageHandler &handler, int workerCount, int options)
+{
+    Q_D(QAmqpQueue);
+    if (!handler || workerCount < 1) {
+        qAmqpDebug() << Q_FUNC_INFO << "invalid handler or worker count: " << workerCount;
+        return false;
+    }
 
-    out << qint16(0);   //reserved 1
-    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, d->name);
-    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, d->consumerTag);
+    if (!consume(options))
+        return false;
 
-    out << qint8(options);
-    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::Hash, QAmqpTable());
+    d->consumerPool =
+        new QAmqpConsumerPool(this, handler, workerCount, d->shardingKey, d->shardingHeader);
+    return true;
+}
 
-    qAmqpDebug("<- basic#consume( queue=%s, consumer-tag=%s, no-local=%d, no-ack=%d, exclusive=%d, no-wait=%d )",
-               qPrintable(d->name), qPrintable(d->consumerTag),
-               options & QAmqpQueue::coNoLocal, options & QAmqpQueue::coNoAck,
-               options & QAmqpQueue::coExclusive, options & QAmqpQueue::coNoWait);
+void QAmqpQueue::setSharding(ShardingKey key, const QString &header)
+{
+    Q_D(QAmqpQueue);
+    if (key == ShardByHeader && header.isEmpty()) {
+        qAmqpDebug() << Q_FUNC_INFO << "sharding by header requires a header name";
+        return;
+    }
 
-    frame.setArguments(arguments);
-    d->sendFrame(frame);
-    d->consumeRequested = true;
-    return true;
+    d->shardingKey = key;
+    d->shardingHeader = header;
+}
+
+QAmqpQueue::ShardingKey QAmqpQueue::sharding() const
+{
+    Q_D(const QAmqpQueue);
+    return d->shardingKey;
+}
+
+int QAmqpQueue::workerCount() const
+{
+    Q_D(const QAmqpQueue);
+    return d->consumerPool ? d->consumerPool->workerCount() : 0;
 }
 
 void QAmqpQueue::setConsumerTag(const QString &consumerTag)
 {
     Q_D(QAmqpQueue);
-    d->consumerTag = consumerTag;
+    d->setConsumerTag(consumerTag);
 }
 
 QString QAmqpQueue::consumerTag() const
@@ -572,10 +957,11 @@ void QAmqpQueue::get(bool noAck)
     QDataStream out(&arguments, QIODevice::WriteOnly);
 
     out << qint16(0);   //reserved 1
-    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, d->name);
+    QAmqpFrame::writeEncoded(out, d->encodedName);
     out << qint8(noAck ? 1 : 0); // no-ack
+    d->getNoAck = noAck;
 
-    qAmqpDebug("<- basic#get( queue=%s, no-ack=%d )", qPrintable(d->name), noAck);
+    qAmqpProtocolDebug("<- basic#get( queue=%s, no-ack=%d )", qPrintable(d->name), noAck);
 
     frame.setArguments(arguments);
     d->sendFrame(frame);
@@ -603,10 +989,11 @@ void QAmqpQueue::ack(qlonglong deliveryTag, bool multiple)
     out << deliveryTag;
     out << qint8(multiple ? 1 : 0); // multiple
 
-    qAmqpDebug("<- basic#ack( delivery-tag=%llu, multiple=%d )", deliveryTag, multiple);
+    qAmqpProtocolDebug("<- basic#ack( delivery-tag=%llu, multiple=%d )", deliveryTag, multiple);
 
     frame.setArguments(arguments);
     d->sendFrame(frame);
+    d->deliverySettled(deliveryTag, multiple, true);
 }
 
 void QAmqpQueue::reject(const QAmqpMessage &message, bool requeue)
@@ -631,10 +1018,11 @@ void QAmqpQueue::reject(qlonglong deliveryTag, bool requeue)
     out << deliveryTag;
     out << qint8(requeue ? 1 : 0);
 
-    qAmqpDebug("<- basic#reject( delivery-tag=%llu, requeue=%d )", deliveryTag, requeue);
+    qAmqpProtocolDebug("<- basic#reject( delivery-tag=%llu, requeue=%d )", deliveryTag, requeue);
 
     frame.setArguments(arguments);
     d->sendFrame(frame);
+    d->deliverySettled(deliveryTag, false, false);
 }
 
 bool QAmqpQueue::cancel(bool noWait)
@@ -659,9 +1047,85 @@ bool QAmqpQueue::cancel(bool noWait)
     QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, d->consumerTag);
     out << (noWait ? qint8(0x01) : qint8(0x0));
 
-    qAmqpDebug("<- basic#cancel( consumer-tag=%s, no-wait=%d )", qPrintable(d->consumerTag), noWait);
+    qAmqpProtocolDebug("<- basic#cancel( consumer-tag=%s, no-wait=%d )", qPrintable(d->consumerTag), noWait);
 
     frame.setArguments(arguments);
     d->sendFrame(frame);
+    d->recoverConsumer = false;
     return true;
 }
+
+/*!
+ * Record the time from a deliver frame arriving until the application
+ * acks the message. Rejected messages are not recorded.
+ */
+void QAmqpQueue::setAckLatencyTracking(bool enabled)
+{
+    Q_D(QAmqpQueue);
+    d->trackAckLatency = enabled;
+    if (!enabled)
+        d->deliveryTimes.clear();
+}
+
+bool QAmqpQueue::isAckLatencyTracking() const
+{
+    Q_D(const QAmqpQueue);
+    return d->trackAckLatency;
+}
+
+QAmqpLatencyHistogram QAmqpQueue::ackLatency() const
+{
+    Q_D(const QAmqpQueue);
+    return d->ackLatency;
+}
+
+void QAmqpQueue::resetAckLatency()
+{
+    Q_D(QAmqpQueue);
+    d->ackLatency.reset();
+}
+
+/*!
+ * Hands every delivered message straight to \a callback, called from the
+ * frame parser on the client's thread, instead of enqueueing it and emitting
+ * messageReceived(). Acknowledging is still up to the caller. A consumer
+ * pool started with consume(handler, workerCount) takes precedence, and an
+ * empty callback goes back to the queue.
+ */
+void QAmqpQueue::setMessageCallback(const MessageCallback &callback)
+{
+    Q_D(QAmqpQueue);
+    d->messageCallback = callback;
+}
+
+QAmqpQueue::MessageCallback QAmqpQueue::messageCallback() const
+{
+    Q_D(const QAmqpQueue);
+    return d->messageCallback;
+}
+
+/*!
+ * In batch mode messages completed while the client works through one read
+ * from the socket are all enqueued first, then messagesReceived() reports
+ * how many arrived, in place of a messageReceived() for each of them.
+ */
+void QAmqpQueue::setBatchDelivery(bool enabled)
+{
+    Q_D(QAmqpQueue);
+    d->batchDelivery = enabled;
+}
+
+bool QAmqpQueue::isBatchDelivery() const
+{
+    Q_D(const QAmqpQueue);
+    return d->batchDelivery;
+}
+
+QList<QAmqpMessage> QAmqpQueue::dequeueAll()
+{
+    QList<QAmqpMessage> messages;
+    messages.swap(*this);
+    return messages;
+}
+
+#include "moc_qamqpqueue.cpp"
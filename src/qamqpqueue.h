@@ -18,9 +18,12 @@
 #ifndef QAMQPQUEUE_H
 #define QAMQPQUEUE_H
 
+#include <functional>
+
 #include <QQueue>
 
 #include "qamqpchannel.h"
+#include "qamqplatencyhistogram.h"
 #include "qamqpmessage.h"
 #include "qamqpglobal.h"
 #include "qamqptable.h"
@@ -67,6 +70,24 @@ public:
     Q_DECLARE_FLAGS(RemoveOptions, RemoveOption)
     Q_ENUM(RemoveOption)
 
+    enum MessageDisposition {
+        Ack,
+        Reject,
+        Requeue
+    };
+    Q_ENUM(MessageDisposition)
+
+    enum ShardingKey {
+        NoSharding,
+        ShardByRoutingKey,
+        ShardByHeader,
+        ShardByMessageId
+    };
+    Q_ENUM(ShardingKey)
+
+    typedef std::function<MessageDisposition (const QAmqpMessage &message)> MessageHandler;
+    typedef std::function<void (const QAmqpMessage &message)> MessageCallback;
+
     ~QAmqpQueue();
 
     bool isConsuming() const;
@@ -78,6 +99,28 @@ public:
     qint32 messageCount() const;
     qint32 consumerCount() const;
 
+    // direct consumption, in place of messageReceived() and the queue
+    void setMessageCallback(const MessageCallback &callback);
+    MessageCallback messageCallback() const;
+
+    // parallel consumption
+    bool consume(const MessageHandler &handler, int workerCount, int options = NoOptions);
+    void setSharding(ShardingKey key, const QString &header = QString());
+    ShardingKey sharding() const;
+    int workerCount() const;
+
+    // deliver to application ack latency, off by default
+    void setAckLatencyTracking(bool enabled);
+    bool isAckLatencyTracking() const;
+    QAmqpLatencyHistogram ackLatency() const;
+    void resetAckLatency();
+
+    // batched delivery, one messagesReceived() per read instead of a
+    // messageReceived() per message
+    void setBatchDelivery(bool enabled);
+    bool isBatchDelivery() const;
+    QList<QAmqpMessage> dequeueAll();
+
 Q_SIGNALS:
     void declared();
     void bound();
@@ -86,6 +129,7 @@ Q_SIGNALS:
     void purged(int messageCount);
 
     void messageReceived();
+    void messagesReceived(int count);
     void empty();
     void consuming(const QString &consumerTag);
     void cancelled(const QString &consumerTag);
@@ -119,8 +163,10 @@ private:
 
     Q_DISABLE_COPY(QAmqpQueue)
     Q_DECLARE_PRIVATE(QAmqpQueue)
+    Q_PRIVATE_SLOT(d_func(), void _q_settle())
     friend class QAmqpClient;
     friend class QAmqpClientPrivate;
+    friend class QAmqpRpcServerPrivate;
 
 };
 
@@ -1,10 +1,15 @@
 #ifndef QAMQPQUEUE_P_H
 #define QAMQPQUEUE_P_H
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QQueue>
+#include <QSet>
 #include <QStringList>
 
 #include "qamqpchannel_p.h"
+#include "qamqpconsumerpool_p.h"
+#include "qamqplatencyhistogram.h"
 
 class QAmqpQueuePrivate: public QAmqpChannelPrivate,
                          public QAmqpContentFrameHandler,
@@ -23,8 +28,21 @@ public:
     ~QAmqpQueuePrivate();
 
     virtual void resetInternalState();
+    virtual void recover();
 
     void declare();
+    void consume(int options);
+    void setConsumerTag(const QString &tag);
+    bool readDelivery(const char *pos, const char *end, QAmqpMessage &message);
+    void dispatchMessage();
+    void flushBatch();
+    void stopConsumerPool();
+    void forgetDeliveries();
+    void deliverySettled(qlonglong deliveryTag, bool multiple, bool acked);
+    void recordAckLatency(qlonglong deliveryTag, bool acked);
+    void unackedChanged(int previousCount);
+    void settle(const QList<QAmqpConsumerPool::Result> &results);
+    void ackCompleted(QSet<qlonglong> deliveryTags);
     virtual bool _q_method(const QAmqpMethodFrame &frame);
 
     // AMQP Queue method handlers
@@ -38,21 +56,67 @@ public:
     // AMQP Basic method handlers
     virtual void _q_content(const QAmqpContentFrame &frame);
     virtual void _q_body(const QAmqpContentBodyFrame &frame);
+    virtual QByteArray *_q_bodyBuffer(quint16 channel);
+    virtual void _q_bodyReceived(quint16 channel, qint32 size);
     void deliver(const QAmqpMethodFrame &frame);
     void getOk(const QAmqpMethodFrame &frame);
     void cancelOk(const QAmqpMethodFrame &frame);
 
+    // private slots
+    void _q_settle();
+
     QString type;
     int options;
     bool delayedDeclare;
     bool declared;
     QQueue<QPair<QString, QString> > delayedBindings;
 
+    // replayed by recover()
+    bool declareRequested;
+    bool serverNamed;
+    QList<QPair<QString, QString> > bindings;
+    bool recoverConsumer;
+    int consumeOptions;
+
     QString consumerTag;
+    QByteArray consumerTagUtf8;     // compared against every delivery
     bool recievingMessage;
     QAmqpMessage currentMessage;
+
+    // the previous delivery's, shared with the next one when it repeats them
+    QByteArray lastExchangeName;
+    QByteArray lastRoutingKey;
+    QAmqpMessage::PropertyHash lastProperties;
+
     bool consuming;
     bool consumeRequested;
+    bool consumeNoAck;
+    bool getNoAck;
+    bool currentNoAck;
+    bool currentIsGet;
+
+    QAmqpQueue::MessageCallback messageCallback;
+    QAmqpConsumerPool *consumerPool;
+
+    /*! pools replaced by a new consume(), deleted once their workers exit */
+    QList<QAmqpConsumerPool*> retiredPools;
+    QAmqpQueue::ShardingKey shardingKey;
+    QString shardingHeader;
+    int deliveryGeneration;
+
+    // messages enqueued since the last messagesReceived() in batch mode
+    bool batchDelivery;
+    int batchCount;
+
+    /*! Delivery tags not acked or rejected yet, in delivery order */
+    QList<qlonglong> unackedDeliveryTags;
+
+    /*! deliver frame arrival in microseconds on latencyClock, by delivery tag */
+    bool trackAckLatency;
+    QElapsedTimer latencyClock;
+    qint64 currentArrival;
+    QHash<qlonglong, qint64> deliveryTimes;
+    QAmqpLatencyHistogram ackLatency;
 
     qint32 messageCount;
     qint32 consumerCount;
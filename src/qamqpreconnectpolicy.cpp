@@ -0,0 +1,142 @@
+#include <QtGlobal>
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
+#include <QRandomGenerator>
+#endif
+
+#include "qamqpreconnectpolicy.h"
+#include "qamqpreconnectpolicy_p.h"
+
+QAmqpReconnectPolicyPrivate::QAmqpReconnectPolicyPrivate()
+    : initialDelay(1000),
+      maxDelay(120000),
+      multiplier(5.0),
+      jitter(QAmqpReconnectPolicy::NoJitter),
+      maxAttempts(0)
+{
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+QAmqpReconnectPolicy::QAmqpReconnectPolicy()
+    : d(new QAmqpReconnectPolicyPrivate)
+{
+}
+
+QAmqpReconnectPolicy::QAmqpReconnectPolicy(const QAmqpReconnectPolicy &other)
+    : d(other.d)
+{
+}
+
+QAmqpReconnectPolicy::~QAmqpReconnectPolicy()
+{
+}
+
+QAmqpReconnectPolicy &QAmqpReconnectPolicy::operator=(const QAmqpReconnectPolicy &other)
+{
+    d = other.d;
+    return *this;
+}
+
+QAmqpReconnectPolicy QAmqpReconnectPolicy::fixed(int msecs, int maxAttempts)
+{
+    return exponential(msecs, msecs, 1.0, NoJitter, maxAttempts);
+}
+
+QAmqpReconnectPolicy QAmqpReconnectPolicy::exponential(int initialDelay, int maxDelay,
+                                                       double multiplier, Jitter jitter,
+                                                       int maxAttempts)
+{
+    QAmqpReconnectPolicy policy;
+    policy.setInitialDelay(initialDelay);
+    policy.setMaxDelay(maxDelay);
+    policy.setMultiplier(multiplier);
+    policy.setJitter(jitter);
+    policy.setMaxAttempts(maxAttempts);
+    return policy;
+}
+
+int QAmqpReconnectPolicy::initialDelay() const
+{
+    return d->initialDelay;
+}
+
+void QAmqpReconnectPolicy::setInitialDelay(int msecs)
+{
+    d->initialDelay = qMax(0, msecs);
+}
+
+int QAmqpReconnectPolicy::maxDelay() const
+{
+    return d->maxDelay;
+}
+
+void QAmqpReconnectPolicy::setMaxDelay(int msecs)
+{
+    d->maxDelay = qMax(0, msecs);
+}
+
+double QAmqpReconnectPolicy::multiplier() const
+{
+    return d->multiplier;
+}
+
+void QAmqpReconnectPolicy::setMultiplier(double multiplier)
+{
+    d->multiplier = qMax(1.0, multiplier);
+}
+
+QAmqpReconnectPolicy::Jitter QAmqpReconnectPolicy::jitter() const
+{
+    return d->jitter;
+}
+
+void QAmqpReconnectPolicy::setJitter(Jitter jitter)
+{
+    d->jitter = jitter;
+}
+
+int QAmqpReconnectPolicy::maxAttempts() const
+{
+    return d->maxAttempts;
+}
+
+void QAmqpReconnectPolicy::setMaxAttempts(int attempts)
+{
+    d->maxAttempts = qMax(0, attempts);
+}
+
+bool QAmqpReconnectPolicy::canRetry(int attempt) const
+{
+    return d->maxAttempts <= 0 || attempt <= d->maxAttempts;
+}
+
+int QAmqpReconnectPolicy::baseDelay(int attempt) const
+{
+    double value = d->initialDelay;
+    for (int i = 1; i < attempt && value < d->maxDelay; ++i)
+        value *= d->multiplier;
+    return int(qMin<double>(value, d->maxDelay));
+}
+
+int QAmqpReconnectPolicy::delay(int attempt) const
+{
+    const int base = baseDelay(attempt);
+    if (d->jitter == NoJitter || base <= 0)
+        return base;
+
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
+    return int(QRandomGenerator::global()->bounded(quint32(base) + 1));
+#else
+    return int(qrand() / (double(RAND_MAX) + 1) * (base + 1));
+#endif
+}
+
+bool QAmqpReconnectPolicy::operator==(const QAmqpReconnectPolicy &other) const
+{
+    return d == other.d ||
+           (d->initialDelay == other.d->initialDelay &&
+            d->maxDelay == other.d->maxDelay &&
+            qFuzzyCompare(d->multiplier, other.d->multiplier) &&
+            d->jitter == other.d->jitter &&
+            d->maxAttempts == other.d->maxAttempts);
+}
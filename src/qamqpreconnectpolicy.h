@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2012-2014 Alexey Shcherbakov
+ * Copyright (C) 2014-2015 Matt Broadstone
+ * Contact: https://github.com/mbroadst/qamqp
+ *
+ * This file is part of the QAMQP Library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+#ifndef QAMQPRECONNECTPOLICY_H
+#define QAMQPRECONNECTPOLICY_H
+
+#include <QSharedDataPointer>
+
+#include "qamqpglobal.h"
+
+/*!
+ * How QAmqpClient spaces out its reconnect attempts. The n-th attempt is
+ * delayed by initialDelay * multiplier^(n - 1), capped at maxDelay. With
+ * FullJitter the actual delay is drawn uniformly from [0, that value], so
+ * many clients losing the same broker don't all come back at once.
+ *
+ * The default policy is the client's historical one: one second, then
+ * five times longer on every failure up to two minutes, never giving up.
+ */
+class QAmqpReconnectPolicyPrivate;
+class QAMQP_EXPORT QAmqpReconnectPolicy
+{
+public:
+    enum Jitter {
+        NoJitter,
+        FullJitter
+    };
+
+    QAmqpReconnectPolicy();
+    QAmqpReconnectPolicy(const QAmqpReconnectPolicy &other);
+    QAmqpReconnectPolicy &operator=(const QAmqpReconnectPolicy &other);
+    ~QAmqpReconnectPolicy();
+
+    inline void swap(QAmqpReconnectPolicy &other) { qSwap(d, other.d); }
+
+    static QAmqpReconnectPolicy fixed(int msecs, int maxAttempts = 0);
+    static QAmqpReconnectPolicy exponential(int initialDelay, int maxDelay,
+                                            double multiplier = 2.0,
+                                            Jitter jitter = FullJitter,
+                                            int maxAttempts = 0);
+
+    int initialDelay() const;
+    void setInitialDelay(int msecs);
+
+    int maxDelay() const;
+    void setMaxDelay(int msecs);
+
+    double multiplier() const;
+    void setMultiplier(double multiplier);
+
+    Jitter jitter() const;
+    void setJitter(Jitter jitter);
+
+    /*! 0 keeps trying forever */
+    int maxAttempts() const;
+    void setMaxAttempts(int attempts);
+    bool canRetry(int attempt) const;
+
+    /*! the delay before the given attempt, counted from 1, without jitter */
+    int baseDelay(int attempt) const;
+
+    /*! the delay before the given attempt with the jitter applied */
+    int delay(int attempt) const;
+
+    bool operator==(const QAmqpReconnectPolicy &other) const;
+    inline bool operator!=(const QAmqpReconnectPolicy &other) const { return !(*this == other); }
+
+private:
+    QSharedDataPointer<QAmqpReconnectPolicyPrivate> d;
+
+};
+
+Q_DECLARE_SHARED(QAmqpReconnectPolicy)
+
+#endif  // QAMQPRECONNECTPOLICY_H
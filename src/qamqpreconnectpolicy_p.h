@@ -0,0 +1,21 @@
+#ifndef QAMQPRECONNECTPOLICY_P_H
+#define QAMQPRECONNECTPOLICY_P_H
+
+#include <QSharedData>
+
+#include "qamqpreconnectpolicy.h"
+
+class QAmqpReconnectPolicyPrivate : public QSharedData
+{
+public:
+    QAmqpReconnectPolicyPrivate();
+
+    int initialDelay;
+    int maxDelay;
+    double multiplier;
+    QAmqpReconnectPolicy::Jitter jitter;
+    int maxAttempts;
+
+};
+
+#endif  // QAMQPRECONNECTPOLICY_P_H
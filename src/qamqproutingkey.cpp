@@ -0,0 +1,82 @@
+#include <QSharedData>
+
+#include "qamqpframe_p.h"
+#include "qamqproutingkey.h"
+
+class QAmqpRoutingKeyPrivate : public QSharedData
+{
+public:
+    QByteArray utf8;
+    QByteArray encoded;
+    bool valid;
+
+};
+
+QAmqpRoutingKey::QAmqpRoutingKey()
+    : d(new QAmqpRoutingKeyPrivate)
+{
+    d->encoded = QAmqpFrame::encodeShortString(QString());
+    d->valid = true;
+}
+
+QAmqpRoutingKey::QAmqpRoutingKey(const QString &key)
+    : d(new QAmqpRoutingKeyPrivate)
+{
+    d->utf8 = key.toUtf8();
+    d->encoded = QAmqpFrame::encodeShortString(d->utf8);
+    d->valid = d->utf8.size() <= 255;
+}
+
+QAmqpRoutingKey QAmqpRoutingKey::fromUtf8(const QByteArray &utf8)
+{
+    QAmqpRoutingKey key;
+    key.d->utf8 = utf8;
+    key.d->encoded = QAmqpFrame::encodeShortString(utf8);
+    key.d->valid = utf8.size() <= 255;
+    return key;
+}
+
+QAmqpRoutingKey::QAmqpRoutingKey(const QAmqpRoutingKey &other)
+    : d(other.d)
+{
+}
+
+QAmqpRoutingKey::~QAmqpRoutingKey()
+{
+}
+
+QAmqpRoutingKey &QAmqpRoutingKey::operator=(const QAmqpRoutingKey &other)
+{
+    d = other.d;
+    return *this;
+}
+
+bool QAmqpRoutingKey::isEmpty() const
+{
+    return d->utf8.isEmpty();
+}
+
+bool QAmqpRoutingKey::isValid() const
+{
+    return d->valid;
+}
+
+QString QAmqpRoutingKey::toString() const
+{
+    return QString::fromUtf8(d->utf8);
+}
+
+QByteArray QAmqpRoutingKey::toUtf8() const
+{
+    return d->utf8;
+}
+
+QByteArray QAmqpRoutingKey::encoded() const
+{
+    return d->encoded;
+}
+
+bool QAmqpRoutingKey::operator==(const QAmqpRoutingKey &other) const
+{
+    return d == other.d || d->encoded == other.d->encoded;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2012-2014 Alexey Shcherbakov
+ * Copyright (C) 2014-2015 Matt Broadstone
+ * Contact: https://github.com/mbroadst/qamqp
+ *
+ * This file is part of the QAMQP Library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+#ifndef QAMQPROUTINGKEY_H
+#define QAMQPROUTINGKEY_H
+
+#include <QSharedDataPointer>
+#include <QString>
+
+#include "qamqpglobal.h"
+
+/*!
+ * A routing key encoded for the wire once, for publishers that send to the
+ * same few keys over and over. QAmqpExchange::publish() with a routing key
+ * handle writes it out as is instead of converting the string every time.
+ */
+class QAmqpRoutingKeyPrivate;
+class QAMQP_EXPORT QAmqpRoutingKey
+{
+public:
+    QAmqpRoutingKey();
+    explicit QAmqpRoutingKey(const QString &key);
+    QAmqpRoutingKey(const QAmqpRoutingKey &other);
+    QAmqpRoutingKey &operator=(const QAmqpRoutingKey &other);
+    ~QAmqpRoutingKey();
+
+    /*! a key from bytes already in UTF-8, e.g. QAmqpMessage::rawRoutingKey() */
+    static QAmqpRoutingKey fromUtf8(const QByteArray &utf8);
+
+    inline void swap(QAmqpRoutingKey &other) { qSwap(d, other.d); }
+
+    bool isEmpty() const;
+
+    /*! false when the key is longer than the 255 bytes a shortstr can hold */
+    bool isValid() const;
+
+    QString toString() const;
+    QByteArray toUtf8() const;
+
+    /*! the shortstr as written to the wire, length octet included */
+    QByteArray encoded() const;
+
+    bool operator==(const QAmqpRoutingKey &other) const;
+    inline bool operator!=(const QAmqpRoutingKey &other) const { return !(*this == other); }
+
+private:
+    QSharedDataPointer<QAmqpRoutingKeyPrivate> d;
+
+};
+
+Q_DECLARE_SHARED(QAmqpRoutingKey)
+
+#endif  // QAMQPROUTINGKEY_H
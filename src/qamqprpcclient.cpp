@@ -0,0 +1,273 @@
+#include <QTimer>
+#include <QStringList>
+#include <QDebug>
+
+#include "qamqpclient.h"
+#include "qamqpexchange.h"
+#include "qamqpqueue.h"
+#include "qamqprpcclient.h"
+#include "qamqprpcclient_p.h"
+
+QAmqpRpcClientPrivate::QAmqpRpcClientPrivate(QAmqpRpcClient *q)
+    : ready(false),
+      defaultTimeout(DefaultTimeout),
+      resolution(DefaultResolution),
+      nextCorrelationId(0),
+      processedTick(0),
+      q_ptr(q)
+{
+}
+
+QAmqpRpcClientPrivate::~QAmqpRpcClientPrivate()
+{
+}
+
+void QAmqpRpcClientPrivate::init(QAmqpClient *c)
+{
+    Q_Q(QAmqpRpcClient);
+    client = c;
+    wheel.resize(WheelSize);
+    clock.start();
+    tickTimer = new QTimer(q);
+    QObject::connect(tickTimer, SIGNAL(timeout()), q, SLOT(_q_tick()));
+
+    // direct reply-to requires requests to be published on the same channel
+    // that consumes the replies, so the exchange shares the queue's channel
+    replyQueue = c->createQueue();
+    replyQueue->setName(QLatin1String(AMQP_DIRECT_REPLY_TO));
+    exchange = c->createExchange(QString(), replyQueue->channelNumber());
+
+    QObject::connect(replyQueue, SIGNAL(opened()), q, SLOT(_q_opened()));
+    QObject::connect(replyQueue, SIGNAL(consuming(QString)), q, SLOT(_q_consuming()));
+    QObject::connect(replyQueue, SIGNAL(messageReceived()), q, SLOT(_q_messageReceived()));
+    QObject::connect(c, SIGNAL(disconnected()), q, SLOT(_q_disconnected()));
+
+    if (replyQueue->isOpen())
+        _q_opened();
+}
+
+qint64 QAmqpRpcClientPrivate::currentTick() const
+{
+    return clock.elapsed() / resolution;
+}
+
+void QAmqpRpcClientPrivate::schedule(const QString &correlationId, int timeout)
+{
+    if (!tickTimer->isActive()) {
+        processedTick = currentTick();
+        tickTimer->start(resolution);
+    }
+
+    if (timeout <= 0) {
+        pendingCalls.insert(correlationId, 0);
+        return;
+    }
+
+    qint64 deadline = (clock.elapsed() + timeout + resolution - 1) / resolution;
+    deadline = qMax(deadline, processedTick + 1);
+    pendingCalls.insert(correlationId, deadline);
+    wheel[deadline % WheelSize].append(correlationId);
+}
+
+void QAmqpRpcClientPrivate::clearWheel()
+{
+    for (int i = 0; i < wheel.size(); ++i)
+        wheel[i].clear();
+}
+
+void QAmqpRpcClientPrivate::abortPendingCalls()
+{
+    Q_Q(QAmqpRpcClient);
+    QStringList aborted = pendingCalls.keys();
+    pendingCalls.clear();
+    clearWheel();
+    if (tickTimer)
+        tickTimer->stop();
+
+    foreach (QString correlationId, aborted)
+        Q_EMIT q->callAborted(correlationId);
+}
+
+void QAmqpRpcClientPrivate::_q_opened()
+{
+    if (!replyQueue || replyQueue->isConsuming())
+        return;
+
+    // replies sent to the pseudo-queue must be consumed in no-ack mode
+    replyQueue->consume(QAmqpQueue::coNoAck);
+}
+
+void QAmqpRpcClientPrivate::_q_consuming()
+{
+    Q_Q(QAmqpRpcClient);
+    qAmqpDebug() << "rpc client ready, consumer-tag: " << replyQueue->consumerTag();
+    ready = true;
+    Q_EMIT q->ready();
+}
+
+void QAmqpRpcClientPrivate::_q_messageReceived()
+{
+    Q_Q(QAmqpRpcClient);
+    while (!replyQueue->isEmpty()) {
+        QAmqpMessage reply = replyQueue->dequeue();
+        QString correlationId = reply.property(QAmqpMessage::CorrelationId).toString();
+        if (!pendingCalls.remove(correlationId)) {
+            qAmqpDebug() << Q_FUNC_INFO << "dropping reply for unknown call: " << correlationId;
+            continue;
+        }
+
+        Q_EMIT q->replyReceived(correlationId, reply);
+    }
+
+    if (pendingCalls.isEmpty()) {
+        tickTimer->stop();
+        clearWheel();
+    }
+}
+
+void QAmqpRpcClientPrivate::_q_tick()
+{
+    Q_Q(QAmqpRpcClient);
+    const qint64 now = currentTick();
+    QStringList expired;
+
+    // no need to revisit a slot more than once, even if we fell behind
+    qint64 tick = qMax(processedTick, now - WheelSize);
+    while (tick < now) {
+        ++tick;
+        QVector<QString> &slot = wheel[tick % WheelSize];
+        int kept = 0;
+        for (int i = 0; i < slot.size(); ++i) {
+            const QString correlationId = slot.at(i);
+            QHash<QString, qint64>::iterator it = pendingCalls.find(correlationId);
+            if (it == pendingCalls.end())
+                continue;   // answered or cancelled
+
+            if (it.value() > now) {
+                // due in a later revolution of the wheel
+                slot[kept++] = correlationId;
+                continue;
+            }
+
+            pendingCalls.erase(it);
+            expired.append(correlationId);
+        }
+
+        slot.resize(kept);
+    }
+
+    processedTick = now;
+    if (pendingCalls.isEmpty()) {
+        tickTimer->stop();
+        clearWheel();
+    }
+
+    foreach (QString correlationId, expired)
+        Q_EMIT q->callTimedOut(correlationId);
+}
+
+void QAmqpRpcClientPrivate::_q_disconnected()
+{
+    ready = false;
+    abortPendingCalls();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+QAmqpRpcClient::QAmqpRpcClient(QAmqpClient *client, QObject *parent)
+    : QObject(parent),
+      d_ptr(new QAmqpRpcClientPrivate(this))
+{
+    Q_D(QAmqpRpcClient);
+    d->init(client);
+}
+
+QAmqpRpcClient::~QAmqpRpcClient()
+{
+    Q_D(QAmqpRpcClient);
+    if (d->replyQueue) {
+        if (d->replyQueue->isOpen())
+            d->replyQueue->close();
+        d->replyQueue->deleteLater();
+    }
+
+    if (d->exchange)
+        d->exchange->deleteLater();
+}
+
+bool QAmqpRpcClient::isReady() const
+{
+    Q_D(const QAmqpRpcClient);
+    return d->ready;
+}
+
+int QAmqpRpcClient::pendingCallCount() const
+{
+    Q_D(const QAmqpRpcClient);
+    return d->pendingCalls.size();
+}
+
+int QAmqpRpcClient::defaultTimeout() const
+{
+    Q_D(const QAmqpRpcClient);
+    return d->defaultTimeout;
+}
+
+void QAmqpRpcClient::setDefaultTimeout(int msecs)
+{
+    Q_D(QAmqpRpcClient);
+    d->defaultTimeout = msecs;
+}
+
+int QAmqpRpcClient::timerResolution() const
+{
+    Q_D(const QAmqpRpcClient);
+    return d->resolution;
+}
+
+void QAmqpRpcClient::setTimerResolution(int msecs)
+{
+    Q_D(QAmqpRpcClient);
+    if (!d->pendingCalls.isEmpty()) {
+        qAmqpDebug() << Q_FUNC_INFO << "can't modify value while calls are pending";
+        return;
+    }
+
+    d->resolution = qMax(msecs, 1);
+}
+
+QString QAmqpRpcClient::call(const QString &routingKey, const QByteArray &payload,
+                             const QAmqpMessage::PropertyHash &properties, int timeout)
+{
+    Q_D(QAmqpRpcClient);
+    if (!d->ready || !d->exchange) {
+        qAmqpDebug() << Q_FUNC_INFO << "rpc client is not ready";
+        return QString();
+    }
+
+    QString correlationId = QString::number(++d->nextCorrelationId, 36);
+    QAmqpMessage::PropertyHash callProperties(properties);
+    callProperties.insert(QAmqpMessage::ReplyTo, QString::fromLatin1(AMQP_DIRECT_REPLY_TO));
+    callProperties.insert(QAmqpMessage::CorrelationId, correlationId);
+
+    d->schedule(correlationId, timeout < 0 ? d->defaultTimeout : timeout);
+    d->exchange->publish(payload, routingKey, QLatin1String("application/octet-stream"),
+                         callProperties);
+    return correlationId;
+}
+
+bool QAmqpRpcClient::cancel(const QString &correlationId)
+{
+    Q_D(QAmqpRpcClient);
+    if (!d->pendingCalls.remove(correlationId))
+        return false;
+
+    if (d->pendingCalls.isEmpty()) {
+        d->tickTimer->stop();
+        d->clearWheel();
+    }
+
+    return true;
+}
+
+#include "moc_qamqprpcclient.cpp"
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2012-2014 Alexey Shcherbakov
+ * Copyright (C) 2014-2015 Matt Broadstone
+ * Contact: https://github.com/mbroadst/qamqp
+ *
+ * This file is part of the QAMQP Library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+#ifndef QAMQPRPCCLIENT_H
+#define QAMQPRPCCLIENT_H
+
+#include <QObject>
+
+#include "qamqpglobal.h"
+#include "qamqpmessage.h"
+
+class QAmqpClient;
+class QAmqpRpcClientPrivate;
+class QAMQP_EXPORT QAmqpRpcClient : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool ready READ isReady)
+    Q_PROPERTY(int defaultTimeout READ defaultTimeout WRITE setDefaultTimeout)
+    Q_PROPERTY(int timerResolution READ timerResolution WRITE setTimerResolution)
+
+public:
+    explicit QAmqpRpcClient(QAmqpClient *client, QObject *parent = 0);
+    ~QAmqpRpcClient();
+
+    bool isReady() const;
+    int pendingCallCount() const;
+
+    int defaultTimeout() const;
+    void setDefaultTimeout(int msecs);
+
+    int timerResolution() const;
+    void setTimerResolution(int msecs);
+
+    QString call(const QString &routingKey, const QByteArray &payload,
+                 const QAmqpMessage::PropertyHash &properties = QAmqpMessage::PropertyHash(),
+                 int timeout = -1);
+    bool cancel(const QString &correlationId);
+
+Q_SIGNALS:
+    void ready();
+    void replyReceived(const QString &correlationId, const QAmqpMessage &reply);
+    void callTimedOut(const QString &correlationId);
+    void callAborted(const QString &correlationId);
+
+protected:
+    Q_DISABLE_COPY(QAmqpRpcClient)
+    Q_DECLARE_PRIVATE(QAmqpRpcClient)
+    QScopedPointer<QAmqpRpcClientPrivate> d_ptr;
+
+private:
+    Q_PRIVATE_SLOT(d_func(), void _q_opened())
+    Q_PRIVATE_SLOT(d_func(), void _q_consuming())
+    Q_PRIVATE_SLOT(d_func(), void _q_messageReceived())
+    Q_PRIVATE_SLOT(d_func(), void _q_tick())
+    Q_PRIVATE_SLOT(d_func(), void _q_disconnected())
+
+};
+
+#endif  // QAMQPRPCCLIENT_H
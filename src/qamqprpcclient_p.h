@@ -0,0 +1,62 @@
+#ifndef QAMQPRPCCLIENT_P_H
+#define QAMQPRPCCLIENT_P_H
+
+#include <QHash>
+#include <QVector>
+#include <QPointer>
+#include <QElapsedTimer>
+
+#include "qamqprpcclient.h"
+
+class QTimer;
+class QAmqpClient;
+class QAmqpQueue;
+class QAmqpExchange;
+class QAmqpRpcClientPrivate
+{
+public:
+    enum {
+        WheelSize = 512,
+        DefaultTimeout = 30000,
+        DefaultResolution = 50
+    };
+
+    QAmqpRpcClientPrivate(QAmqpRpcClient *q);
+    virtual ~QAmqpRpcClientPrivate();
+
+    void init(QAmqpClient *client);
+    qint64 currentTick() const;
+    void schedule(const QString &correlationId, int timeout);
+    void clearWheel();
+    void abortPendingCalls();
+
+    // private slots
+    void _q_opened();
+    void _q_consuming();
+    void _q_messageReceived();
+    void _q_tick();
+    void _q_disconnected();
+
+    QPointer<QAmqpClient> client;
+    QPointer<QAmqpQueue> replyQueue;
+    QPointer<QAmqpExchange> exchange;
+    bool ready;
+    int defaultTimeout;
+    int resolution;
+    quint64 nextCorrelationId;
+
+    /*! Pending calls by correlation id, mapped to their deadline tick (0 = none) */
+    QHash<QString, qint64> pendingCalls;
+
+    /*! Timer wheel, each slot holds the correlation ids expiring on that tick */
+    QVector<QVector<QString> > wheel;
+    qint64 processedTick;
+    QElapsedTimer clock;
+    QPointer<QTimer> tickTimer;
+
+    QAmqpRpcClient * const q_ptr;
+    Q_DECLARE_PUBLIC(QAmqpRpcClient)
+
+};
+
+#endif // QAMQPRPCCLIENT_P_H
@@ -0,0 +1,286 @@
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QMutexLocker>
+#include <QDebug>
+
+#include "qamqpclient.h"
+#include "qamqpclient_p.h"
+#include "qamqpexchange.h"
+#include "qamqpqueue.h"
+#include "qamqpqueue_p.h"
+#include "qamqprpcserver.h"
+#include "qamqprpcserver_p.h"
+
+class QAmqpRpcServerTask : public QRunnable
+{
+public:
+    QAmqpRpcServerTask(const QAmqpRpcServer::Handler &handler, const QAmqpMessage &request,
+                       int generation,
+                       const QSharedPointer<QAmqpRpcServerPrivate::Completion> &completion)
+        : handler_(handler),
+          request_(request),
+          generation_(generation),
+          completion_(completion)
+    {
+    }
+
+    void run()
+    {
+        QAmqpRpcServerPrivate::Result result;
+        result.request = request_;
+        result.reply = handler_(request_);
+        result.generation = generation_;
+
+        QMutexLocker locker(&completion_->mutex);
+        completion_->results.append(result);
+
+        // one wakeup drains everything completed until the client thread
+        // gets around to it, so replies are published in batches
+        if (completion_->receiver && !completion_->wakeupPending) {
+            completion_->wakeupPending = true;
+            QMetaObject::invokeMethod(completion_->receiver, "_q_flush", Qt::QueuedConnection);
+        }
+    }
+
+private:
+    QAmqpRpcServer::Handler handler_;
+    QAmqpMessage request_;
+    int generation_;
+    QSharedPointer<QAmqpRpcServerPrivate::Completion> completion_;
+};
+
+//////////////////////////////////////////////////////////////////////////
+
+QAmqpRpcServerPrivate::QAmqpRpcServerPrivate(QAmqpRpcServer *q)
+    : queueOptions(QAmqpQueue::Durable | QAmqpQueue::AutoDelete),
+      prefetchCount(qMax(QThread::idealThreadCount(), 1)),
+      listenRequested(false),
+      listening(false),
+      generation(0),
+      inFlight(0),
+      q_ptr(q)
+{
+}
+
+QAmqpRpcServerPrivate::~QAmqpRpcServerPrivate()
+{
+}
+
+void QAmqpRpcServerPrivate::init(QAmqpClient *client, const QString &queueName)
+{
+    Q_Q(QAmqpRpcServer);
+    completion = QSharedPointer<Completion>(new Completion);
+    completion->receiver = q;
+
+    this->client = client;
+    queue = client->createQueue(queueName);
+    replyExchange = client->createExchange();
+
+    QObject::connect(queue, SIGNAL(opened()), q, SLOT(_q_opened()));
+    QObject::connect(queue, SIGNAL(declared()), q, SLOT(_q_declared()));
+    QObject::connect(queue, SIGNAL(qosDefined()), q, SLOT(_q_qosDefined()));
+    QObject::connect(queue, SIGNAL(consuming(QString)), q, SLOT(_q_consuming()));
+    QObject::connect(queue, SIGNAL(messageReceived()), q, SLOT(_q_messageReceived()));
+    QObject::connect(client, SIGNAL(disconnected()), q, SLOT(_q_disconnected()));
+}
+
+void QAmqpRpcServerPrivate::dispatch()
+{
+    if (!handler)
+        return;
+
+    QThreadPool *pool = threadPool ? threadPool.data() : QThreadPool::globalInstance();
+    while (!backlog.isEmpty() && inFlight < prefetchCount) {
+        ++inFlight;
+        pool->start(new QAmqpRpcServerTask(handler, backlog.dequeue(), generation, completion));
+    }
+}
+
+/*
+ * With topology recovery on, the queue replays its declare, qos and consume
+ * as soon as the channel is open again, the steps below only fill in what
+ * it had not been asked for before.
+ */
+void QAmqpRpcServerPrivate::_q_opened()
+{
+    QAmqpQueuePrivate *qd = queue->d_func();
+    if (!listenRequested || (qd->topologyRecovery() && qd->declareRequested))
+        return;
+
+    queue->declare(queueOptions);
+}
+
+void QAmqpRpcServerPrivate::_q_declared()
+{
+    QAmqpQueuePrivate *qd = queue->d_func();
+    const qint16 count = qint16(quint16(prefetchCount));
+    if (!listenRequested ||
+        (qd->topologyRecovery() && qd->qosRequested && qd->requestedPrefetchCount == count))
+        return;
+
+    queue->qos(count);
+}
+
+void QAmqpRpcServerPrivate::_q_qosDefined()
+{
+    if (listenRequested && !queue->isConsuming() && !queue->d_func()->consumeRequested)
+        queue->consume();
+}
+
+void QAmqpRpcServerPrivate::_q_consuming()
+{
+    Q_Q(QAmqpRpcServer);
+    qAmqpDebug() << "rpc server listening on: " << queue->name();
+    listening = true;
+    Q_EMIT q->listening();
+}
+
+void QAmqpRpcServerPrivate::_q_messageReceived()
+{
+    while (!queue->isEmpty())
+        backlog.enqueue(queue->dequeue());
+
+    dispatch();
+}
+
+void QAmqpRpcServerPrivate::_q_flush()
+{
+    QList<Result> results;
+    {
+        QMutexLocker locker(&completion->mutex);
+        results.swap(completion->results);
+        completion->wakeupPending = false;
+    }
+
+    // every reply and the acks for this flush leave in a single write
+    QAmqpClientPrivate *writer = client ? client->d_func() : 0;
+    if (writer)
+        writer->beginWriteBatch();
+
+    QSet<qlonglong> completedTags;
+    foreach (const Result &result, results) {
+        --inFlight;
+        if (result.generation != generation)
+            continue;   // the channel was lost, the broker redelivers these
+
+        QString replyTo = result.request.property(QAmqpMessage::ReplyTo).toString();
+        if (replyTo.isEmpty()) {
+            qAmqpDebug() << Q_FUNC_INFO << "request without reply-to, dropping reply";
+        } else if (replyExchange) {
+            QAmqpMessage::PropertyHash properties;
+            properties.insert(QAmqpMessage::CorrelationId,
+                              result.request.property(QAmqpMessage::CorrelationId));
+            replyExchange->publish(result.reply, replyTo,
+                                   QLatin1String("application/octet-stream"), properties);
+        }
+
+        completedTags.insert(result.request.deliveryTag());
+    }
+
+    if (!completedTags.isEmpty() && queue && queue->isOpen())
+        queue->d_func()->ackCompleted(completedTags);
+    if (writer)
+        writer->endWriteBatch();
+    dispatch();
+}
+
+void QAmqpRpcServerPrivate::_q_disconnected()
+{
+    listening = false;
+    ++generation;
+    backlog.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+QAmqpRpcServer::QAmqpRpcServer(QAmqpClient *client, const QString &queueName, QObject *parent)
+    : QObject(parent),
+      d_ptr(new QAmqpRpcServerPrivate(this))
+{
+    Q_D(QAmqpRpcServer);
+    d->init(client, queueName);
+}
+
+QAmqpRpcServer::~QAmqpRpcServer()
+{
+    Q_D(QAmqpRpcServer);
+    {
+        QMutexLocker locker(&d->completion->mutex);
+        d->completion->receiver = 0;
+    }
+
+    if (d->queue) {
+        if (d->queue->isOpen())
+            d->queue->close();
+        d->queue->deleteLater();
+    }
+}
+
+QString QAmqpRpcServer::queueName() const
+{
+    Q_D(const QAmqpRpcServer);
+    return d->queue ? d->queue->name() : QString();
+}
+
+QAmqpQueue *QAmqpRpcServer::queue() const
+{
+    Q_D(const QAmqpRpcServer);
+    return d->queue;
+}
+
+void QAmqpRpcServer::setHandler(const Handler &handler)
+{
+    Q_D(QAmqpRpcServer);
+    d->handler = handler;
+    d->dispatch();
+}
+
+QThreadPool *QAmqpRpcServer::threadPool() const
+{
+    Q_D(const QAmqpRpcServer);
+    return d->threadPool ? d->threadPool.data() : QThreadPool::globalInstance();
+}
+
+void QAmqpRpcServer::setThreadPool(QThreadPool *pool)
+{
+    Q_D(QAmqpRpcServer);
+    d->threadPool = pool;
+}
+
+int QAmqpRpcServer::prefetchCount() const
+{
+    Q_D(const QAmqpRpcServer);
+    return d->prefetchCount;
+}
+
+void QAmqpRpcServer::setPrefetchCount(int count)
+{
+    Q_D(QAmqpRpcServer);
+    d->prefetchCount = qBound(1, count, 0xffff);
+    if (d->listening)
+        d->queue->qos(qint16(quint16(d->prefetchCount)));
+}
+
+bool QAmqpRpcServer::isListening() const
+{
+    Q_D(const QAmqpRpcServer);
+    return d->listening;
+}
+
+int QAmqpRpcServer::activeRequestCount() const
+{
+    Q_D(const QAmqpRpcServer);
+    return d->inFlight;
+}
+
+void QAmqpRpcServer::listen(int queueOptions)
+{
+    Q_D(QAmqpRpcServer);
+    d->queueOptions = queueOptions;
+    d->listenRequested = true;
+    if (d->queue && d->queue->isOpen())
+        d->_q_opened();
+}
+
+#include "moc_qamqprpcserver.cpp"
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2012-2014 Alexey Shcherbakov
+ * Copyright (C) 2014-2015 Matt Broadstone
+ * Contact: https://github.com/mbroadst/qamqp
+ *
+ * This file is part of the QAMQP Library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+#ifndef QAMQPRPCSERVER_H
+#define QAMQPRPCSERVER_H
+
+#include <functional>
+
+#include <QObject>
+
+#include "qamqpglobal.h"
+#include "qamqpmessage.h"
+#include "qamqpqueue.h"
+
+class QThreadPool;
+class QAmqpClient;
+class QAmqpRpcServerPrivate;
+class QAMQP_EXPORT QAmqpRpcServer : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString queueName READ queueName CONSTANT)
+    Q_PROPERTY(int prefetchCount READ prefetchCount WRITE setPrefetchCount)
+    Q_PROPERTY(bool listening READ isListening)
+
+public:
+    typedef std::function<QByteArray (const QAmqpMessage &request)> Handler;
+
+    QAmqpRpcServer(QAmqpClient *client, const QString &queueName, QObject *parent = 0);
+    ~QAmqpRpcServer();
+
+    QString queueName() const;
+    QAmqpQueue *queue() const;
+
+    void setHandler(const Handler &handler);
+
+    QThreadPool *threadPool() const;
+    void setThreadPool(QThreadPool *pool);
+
+    int prefetchCount() const;
+    void setPrefetchCount(int count);
+
+    bool isListening() const;
+    int activeRequestCount() const;
+
+public Q_SLOTS:
+    void listen(int queueOptions = QAmqpQueue::Durable | QAmqpQueue::AutoDelete);
+
+Q_SIGNALS:
+    void listening();
+
+protected:
+    Q_DISABLE_COPY(QAmqpRpcServer)
+    Q_DECLARE_PRIVATE(QAmqpRpcServer)
+    QScopedPointer<QAmqpRpcServerPrivate> d_ptr;
+
+private:
+    Q_PRIVATE_SLOT(d_func(), void _q_opened())
+    Q_PRIVATE_SLOT(d_func(), void _q_declared())
+    Q_PRIVATE_SLOT(d_func(), void _q_qosDefined())
+    Q_PRIVATE_SLOT(d_func(), void _q_consuming())
+    Q_PRIVATE_SLOT(d_func(), void _q_messageReceived())
+    Q_PRIVATE_SLOT(d_func(), void _q_flush())
+    Q_PRIVATE_SLOT(d_func(), void _q_disconnected())
+
+};
+
+#endif  // QAMQPRPCSERVER_H
@@ -0,0 +1,73 @@
+#ifndef QAMQPRPCSERVER_P_H
+#define QAMQPRPCSERVER_P_H
+
+#include <QMutex>
+#include <QPointer>
+#include <QQueue>
+#include <QSharedPointer>
+
+#include "qamqprpcserver.h"
+
+class QAmqpClient;
+class QAmqpQueue;
+class QAmqpExchange;
+class QAmqpRpcServerPrivate
+{
+public:
+    struct Result
+    {
+        QAmqpMessage request;
+        QByteArray reply;
+        int generation;
+    };
+
+    /*!
+     * State shared with the handler tasks running on the thread pool, it
+     * outlives the server so late tasks never touch a destroyed object.
+     */
+    struct Completion
+    {
+        Completion() : receiver(0), wakeupPending(false) {}
+
+        QMutex mutex;
+        QObject *receiver;
+        bool wakeupPending;
+        QList<Result> results;
+    };
+
+    QAmqpRpcServerPrivate(QAmqpRpcServer *q);
+    virtual ~QAmqpRpcServerPrivate();
+
+    void init(QAmqpClient *client, const QString &queueName);
+    void dispatch();
+
+    // private slots
+    void _q_opened();
+    void _q_declared();
+    void _q_qosDefined();
+    void _q_consuming();
+    void _q_messageReceived();
+    void _q_flush();
+    void _q_disconnected();
+
+    QPointer<QAmqpClient> client;
+    QPointer<QAmqpQueue> queue;
+    QPointer<QAmqpExchange> replyExchange;
+    QPointer<QThreadPool> threadPool;
+    QAmqpRpcServer::Handler handler;
+    QSharedPointer<Completion> completion;
+
+    int queueOptions;
+    int prefetchCount;
+    bool listenRequested;
+    bool listening;
+    int generation;
+    int inFlight;
+    QQueue<QAmqpMessage> backlog;
+
+    QAmqpRpcServer * const q_ptr;
+    Q_DECLARE_PUBLIC(QAmqpRpcServer)
+
+};
+
+#endif // QAMQPRPCSERVER_P_H
@@ -77,6 +77,77 @@ qint8 valueTypeToOctet(QAmqpMetaType::ValueType type)
     return 'V';
 }
 
+/*
+ * Tables and arrays are prefixed with their encoded length, which is only
+ * known once their fields are written. On a seekable device (the
+ * QByteArray backed streams frames are built in) the length is reserved and
+ * patched in afterwards, so nested tables are written straight into the
+ * final buffer. Anything else goes through a temporary buffer.
+ */
+static bool canPatch(QDataStream &stream)
+{
+    QIODevice *device = stream.device();
+    return device && !device->isSequential();
+}
+
+static qint64 beginSized(QDataStream &stream)
+{
+    const qint64 start = stream.device()->pos();
+    stream << quint32(0);
+    return start;
+}
+
+static void endSized(QDataStream &stream, qint64 start)
+{
+    QIODevice *device = stream.device();
+    const qint64 end = device->pos();
+    device->seek(start);
+    stream << quint32(end - start - sizeof(quint32));
+    device->seek(end);
+}
+
+static void writeTableFields(QDataStream &stream, const QAmqpTable &table)
+{
+    QAmqpTable::ConstIterator it;
+    QAmqpTable::ConstIterator itEnd = table.constEnd();
+    for (it = table.constBegin(); it != itEnd; ++it) {
+        QAmqpTable::writeFieldValue(stream, QAmqpMetaType::ShortString, it.key());
+        QAmqpTable::writeFieldValue(stream, it.value());
+    }
+}
+
+static void writeArrayValues(QDataStream &stream, const QVariantList &array)
+{
+    for (int i = 0; i < array.size(); ++i)
+        QAmqpTable::writeFieldValue(stream, array.at(i));
+}
+
+/*
+ * Returns where a table or array that starts at the stream's position ends,
+ * or -1 when it has to be read into a temporary buffer instead.
+ */
+static qint64 beginSizedRead(QDataStream &stream, quint32 *size)
+{
+    stream >> *size;
+    if (!canPatch(stream) || stream.status() != QDataStream::Ok)
+        return -1;
+    return stream.device()->pos() + *size;
+}
+
+static bool atSizedEnd(QDataStream &stream, qint64 end)
+{
+    return stream.status() != QDataStream::Ok || stream.atEnd() ||
+           stream.device()->pos() >= end;
+}
+
+static void endSizedRead(QDataStream &stream, qint64 end)
+{
+    // a malformed field must not throw off whatever follows the table
+    QIODevice *device = stream.device();
+    if (device->pos() != end && end <= device->size())
+        device->seek(end);
+}
+
 void QAmqpTable::writeFieldValue(QDataStream &stream, const QVariant &value)
 {
     QAmqpMetaType::ValueType type;
@@ -207,17 +278,18 @@ void QAmqpTable::writeFieldValue(QDataStream &stream, QAmqpMetaType::ValueType t
         break;
     case QAmqpMetaType::Array:
     {
+        if (canPatch(stream)) {
+            const qint64 start = beginSized(stream);
+            writeArrayValues(stream, value.toList());
+            endSized(stream, start);
+            break;
+        }
+
         QByteArray buffer;
         QDataStream arrayStream(&buffer, QIODevice::WriteOnly);
-        QVariantList array(value.toList());
-        for (int i = 0; i < array.size(); ++i)
-            writeFieldValue(arrayStream, array.at(i));
-
-        if (buffer.isEmpty()) {
-            stream << qint32(0);
-        } else {
-            stream << buffer;
-        }
+        writeArrayValues(arrayStream, value.toList());
+        stream << quint32(buffer.size());
+        stream.writeRawData(buffer.constData(), buffer.size());
     }
         break;
     case QAmqpMetaType::Bytes:
@@ -301,14 +373,23 @@ QVariant QAmqpTable::readFieldValue(QDataStream &stream, QAmqpMetaType::ValueTyp
     }
     case QAmqpMetaType::Array:
     {
-        QByteArray data;
+        qint8 type = 0;
+        QVariantList result;
         quint32 size = 0;
-        stream >> size;
+        const qint64 end = beginSizedRead(stream, &size);
+        if (end >= 0) {
+            while (!atSizedEnd(stream, end)) {
+                stream >> type;
+                result.append(readFieldValue(stream, valueTypeForOctet(type)));
+            }
+
+            endSizedRead(stream, end);
+            return result;
+        }
+
+        QByteArray data;
         data.resize(size);
         stream.readRawData(data.data(), data.size());
-
-        qint8 type = 0;
-        QVariantList result;
         QDataStream arrayStream(&data, QIODevice::ReadOnly);
         while (!arrayStream.atEnd()) {
             arrayStream >> type;
@@ -337,35 +418,46 @@ QVariant QAmqpTable::readFieldValue(QDataStream &stream, QAmqpMetaType::ValueTyp
 
 QDataStream &operator<<(QDataStream &stream, const QAmqpTable &table)
 {
-    QByteArray data;
-    QDataStream s(&data, QIODevice::WriteOnly);
-    QAmqpTable::ConstIterator it;
-    QAmqpTable::ConstIterator itEnd = table.constEnd();
-    for (it = table.constBegin(); it != itEnd; ++it) {
-        QAmqpTable::writeFieldValue(s, QAmqpMetaType::ShortString, it.key());
-        QAmqpTable::writeFieldValue(s, it.value());
-    }
-
-    if (data.isEmpty()) {
-        stream << qint32(0);
-    } else {
-        stream << data;
+    if (canPatch(stream)) {
+        const qint64 start = beginSized(stream);
+        writeTableFields(stream, table);
+        endSized(stream, start);
+        return stream;
     }
 
+    QByteArray data;
+    QDataStream s(&data, QIODevice::WriteOnly);
+    writeTableFields(s, table);
+    stream << quint32(data.size());
+    stream.writeRawData(data.constData(), data.size());
     return stream;
 }
 
+static void readTableField(QDataStream &stream, QAmqpTable &table)
+{
+    qint8 octet = 0;
+    QString field = QAmqpFrame::readAmqpField(stream, QAmqpMetaType::ShortString).toString();
+    stream >> octet;
+    table[field] = QAmqpTable::readFieldValue(stream, valueTypeForOctet(octet));
+}
+
 QDataStream &operator>>(QDataStream &stream, QAmqpTable &table)
 {
+    quint32 size = 0;
+    const qint64 end = beginSizedRead(stream, &size);
+    if (end >= 0) {
+        while (!atSizedEnd(stream, end))
+            readTableField(stream, table);
+        endSizedRead(stream, end);
+        return stream;
+    }
+
     QByteArray data;
-    stream >> data;
+    data.resize(size);
+    stream.readRawData(data.data(), data.size());
     QDataStream tableStream(&data, QIODevice::ReadOnly);
-    while (!tableStream.atEnd()) {
-        qint8 octet = 0;
-        QString field = QAmqpFrame::readAmqpField(tableStream, QAmqpMetaType::ShortString).toString();
-        tableStream >> octet;
-        table[field] = QAmqpTable::readFieldValue(tableStream, valueTypeForOctet(octet));
-    }
+    while (!tableStream.atEnd())
+        readTableField(tableStream, table);
 
     return stream;
 }
@@ -0,0 +1,13 @@
+#include <chrono>
+
+#include "qamqptracer.h"
+
+QAmqpTracer::~QAmqpTracer()
+{
+}
+
+qint64 QAmqpTracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2012-2014 Alexey Shcherbakov
+ * Copyright (C) 2014-2015 Matt Broadstone
+ * Contact: https://github.com/mbroadst/qamqp
+ *
+ * This file is part of the QAMQP Library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+#ifndef QAMQPTRACER_H
+#define QAMQPTRACER_H
+
+#include "qamqpglobal.h"
+
+/*!
+ * Receives one event per AMQP frame a QAmqpClient sends or receives, see
+ * QAmqpClient::setTracer(). Events are delivered synchronously on the
+ * client's thread, so an implementation should only record them and do
+ * any heavier work elsewhere.
+ */
+class QAMQP_EXPORT QAmqpTracer
+{
+public:
+    enum Direction {
+        Received,
+        Sent
+    };
+
+    // the frame type octet as it appears on the wire
+    enum FrameType {
+        MethodFrame = 1,
+        HeaderFrame = 2,
+        BodyFrame = 3,
+        HeartbeatFrame = 8
+    };
+
+    struct FrameEvent
+    {
+        Direction direction;
+        FrameType frameType;
+        quint16 channel;
+        quint16 classId;        // method and header frames, 0 otherwise
+        quint16 methodId;       // method frames, 0 otherwise
+        qint64 size;            // header, payload and frame end
+        qint64 startTime;       // nanoseconds, see now()
+        qint64 endTime;
+    };
+
+    virtual ~QAmqpTracer();
+
+    /*!
+     * A sent frame spans its serialization into the transport, a received
+     * frame spans its decoding and the dispatch to channels, including the
+     * signals and handlers that run for it. Frames sent from those
+     * handlers nest inside that span and are reported before it.
+     */
+    virtual void frameEvent(const FrameEvent &event) = 0;
+
+    /*!
+     * The monotonic clock events are stamped with, in nanoseconds. On Linux
+     * this is CLOCK_MONOTONIC, the clock perf and most tracers use.
+     */
+    static qint64 now();
+
+};
+
+#endif  // QAMQPTRACER_H
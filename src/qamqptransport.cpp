@@ -0,0 +1,156 @@
+#include <QSslSocket>
+
+#include "qamqptransport.h"
+
+QAmqpTransport::QAmqpTransport(QObject *parent)
+    : QObject(parent)
+{
+}
+
+QAmqpTransport::~QAmqpTransport()
+{
+}
+
+void QAmqpTransport::setSocketBufferSizes(qint64 sendSize, qint64 receiveSize)
+{
+    Q_UNUSED(sendSize)
+    Q_UNUSED(receiveSize)
+}
+
+qint64 QAmqpTransport::sendBufferSize() const
+{
+    return 0;
+}
+
+qint64 QAmqpTransport::receiveBufferSize() const
+{
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+QAmqpSocketTransport::QAmqpSocketTransport(QObject *parent)
+    : QAmqpTransport(parent),
+      socket_(new QSslSocket(this)),
+      sendBufferSize_(0),
+      receiveBufferSize_(0)
+{
+    socket_->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    socket_->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+
+    // buffer sizes need a socket descriptor, they go in ahead of connected()
+    connect(socket_, SIGNAL(connected()), this, SLOT(applySocketBufferSizes()));
+
+    // forwarded signal to signal, the socket stays the device frames go through
+    connect(socket_, SIGNAL(connected()), this, SIGNAL(connected()));
+    connect(socket_, SIGNAL(disconnected()), this, SIGNAL(disconnected()));
+    connect(socket_, SIGNAL(readyRead()), this, SIGNAL(readyRead()));
+#if QT_VERSION >= 0x060000
+    connect(socket_, SIGNAL(errorOccurred(QAbstractSocket::SocketError)),
+            this, SIGNAL(errorOccurred(QAbstractSocket::SocketError)));
+#else
+    connect(socket_, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SIGNAL(errorOccurred(QAbstractSocket::SocketError)));
+#endif
+    connect(socket_, SIGNAL(stateChanged(QAbstractSocket::SocketState)),
+            this, SIGNAL(stateChanged(QAbstractSocket::SocketState)));
+    connect(socket_, SIGNAL(sslErrors(QList<QSslError>)),
+            this, SIGNAL(sslErrors(QList<QSslError>)));
+}
+
+QAmqpSocketTransport::~QAmqpSocketTransport()
+{
+}
+
+QSslSocket *QAmqpSocketTransport::socket() const
+{
+    return socket_;
+}
+
+QSslConfiguration QAmqpSocketTransport::sslConfiguration() const
+{
+    return socket_->sslConfiguration();
+}
+
+void QAmqpSocketTransport::setSslConfiguration(const QSslConfiguration &config)
+{
+    socket_->setSslConfiguration(config);
+}
+
+void QAmqpSocketTransport::ignoreSslErrors(const QList<QSslError> &errors)
+{
+    socket_->ignoreSslErrors(errors);
+}
+
+QIODevice *QAmqpSocketTransport::device() const
+{
+    return socket_;
+}
+
+void QAmqpSocketTransport::connectToHost(const QString &host, quint16 port, bool encrypted)
+{
+    if (encrypted)
+        socket_->connectToHostEncrypted(host, port);
+    else
+        socket_->connectToHost(host, port);
+}
+
+void QAmqpSocketTransport::disconnectFromHost()
+{
+    socket_->disconnectFromHost();
+}
+
+void QAmqpSocketTransport::abort()
+{
+    socket_->abort();
+}
+
+QAbstractSocket::SocketState QAmqpSocketTransport::state() const
+{
+    return socket_->state();
+}
+
+QAbstractSocket::SocketError QAmqpSocketTransport::error() const
+{
+    return socket_->error();
+}
+
+QString QAmqpSocketTransport::errorString() const
+{
+    return socket_->errorString();
+}
+
+void QAmqpSocketTransport::setSocketBufferSizes(qint64 sendSize, qint64 receiveSize)
+{
+    sendBufferSize_ = qMax<qint64>(0, sendSize);
+    receiveBufferSize_ = qMax<qint64>(0, receiveSize);
+    if (socket_->state() == QAbstractSocket::ConnectedState)
+        applySocketBufferSizes();
+}
+
+/*!
+ * What the kernel actually gave the socket, which may be more or less than
+ * was asked for, or 0 while not connected.
+ */
+qint64 QAmqpSocketTransport::sendBufferSize() const
+{
+    if (socket_->state() != QAbstractSocket::ConnectedState)
+        return 0;
+    return socket_->socketOption(QAbstractSocket::SendBufferSizeSocketOption).toLongLong();
+}
+
+qint64 QAmqpSocketTransport::receiveBufferSize() const
+{
+    if (socket_->state() != QAbstractSocket::ConnectedState)
+        return 0;
+    return socket_->socketOption(QAbstractSocket::ReceiveBufferSizeSocketOption).toLongLong();
+}
+
+void QAmqpSocketTransport::applySocketBufferSizes()
+{
+    // 0 leaves the system default alone
+    if (sendBufferSize_)
+        socket_->setSocketOption(QAbstractSocket::SendBufferSizeSocketOption, sendBufferSize_);
+    if (receiveBufferSize_)
+        socket_->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, receiveBufferSize_);
+}
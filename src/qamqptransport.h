@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2012-2014 Alexey Shcherbakov
+ * Copyright (C) 2014-2015 Matt Broadstone
+ * Contact: https://github.com/mbroadst/qamqp
+ *
+ * This file is part of the QAMQP Library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+#ifndef QAMQPTRANSPORT_H
+#define QAMQPTRANSPORT_H
+
+#include <QObject>
+#include <QAbstractSocket>
+#include <QSslConfiguration>
+#include <QSslError>
+
+#include "qamqpglobal.h"
+
+class QIODevice;
+class QSslSocket;
+
+/*!
+ * The byte stream a QAmqpClient talks AMQP over. Frames are written to and
+ * read from device(), the transport owns connection setup and teardown.
+ */
+class QAMQP_EXPORT QAmqpTransport : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QAmqpTransport(QObject *parent = 0);
+    virtual ~QAmqpTransport();
+
+    virtual QIODevice *device() const = 0;
+
+    virtual void connectToHost(const QString &host, quint16 port, bool encrypted) = 0;
+    virtual void disconnectFromHost() = 0;
+    virtual void abort() = 0;
+
+    virtual QAbstractSocket::SocketState state() const = 0;
+    virtual QAbstractSocket::SocketError error() const = 0;
+    virtual QString errorString() const = 0;
+
+    /*!
+     * Kernel send and receive buffer sizes to ask for, in bytes, applied once
+     * the connection is up. A transport without socket buffers can ignore
+     * the request and report 0 for both.
+     */
+    virtual void setSocketBufferSizes(qint64 sendSize, qint64 receiveSize);
+    virtual qint64 sendBufferSize() const;
+    virtual qint64 receiveBufferSize() const;
+
+Q_SIGNALS:
+    void connected();
+    void disconnected();
+    void readyRead();
+    void errorOccurred(QAbstractSocket::SocketError error);
+    void stateChanged(QAbstractSocket::SocketState state);
+
+};
+
+/*!
+ * The default transport, a plain or TLS encrypted TCP connection
+ */
+class QAMQP_EXPORT QAmqpSocketTransport : public QAmqpTransport
+{
+    Q_OBJECT
+public:
+    explicit QAmqpSocketTransport(QObject *parent = 0);
+    virtual ~QAmqpSocketTransport();
+
+    QSslSocket *socket() const;
+
+    QSslConfiguration sslConfiguration() const;
+    void setSslConfiguration(const QSslConfiguration &config);
+    void ignoreSslErrors(const QList<QSslError> &errors);
+
+    virtual QIODevice *device() const;
+
+    virtual void connectToHost(const QString &host, quint16 port, bool encrypted);
+    virtual void disconnectFromHost();
+    virtual void abort();
+
+    virtual QAbstractSocket::SocketState state() const;
+    virtual QAbstractSocket::SocketError error() const;
+    virtual QString errorString() const;
+
+    virtual void setSocketBufferSizes(qint64 sendSize, qint64 receiveSize);
+    virtual qint64 sendBufferSize() const;
+    virtual qint64 receiveBufferSize() const;
+
+Q_SIGNALS:
+    void sslErrors(const QList<QSslError> &errors);
+
+private Q_SLOTS:
+    void applySocketBufferSizes();
+
+private:
+    Q_DISABLE_COPY(QAmqpSocketTransport)
+    QSslSocket *socket_;
+    qint64 sendBufferSize_;
+    qint64 receiveBufferSize_;
+
+};
+
+#endif // QAMQPTRANSPORT_H
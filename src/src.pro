@@ -9,6 +9,9 @@ build_pass:CONFIG(debug, debug|release) {
 QT += core network
 QT -= gui
 DEFINES += QAMQP_BUILD
+
+# CONFIG += qamqp_no_protocol_trace compiles the protocol trace out
+qamqp_no_protocol_trace: DEFINES += QAMQP_NO_PROTOCOL_TRACE
 CONFIG += $${QAMQP_LIBRARY_TYPE}
 VERSION = $${QAMQP_VERSION}
 win32:DESTDIR = $$OUT_PWD
@@ -45,10 +48,16 @@ PRIVATE_HEADERS += \
     qamqpchannel_p.h \
     qamqpchannelhash_p.h \
     qamqpclient_p.h \
+    qamqpconsumerpool_p.h \
     qamqpexchange_p.h \
     qamqpframe_p.h \
+    qamqplatencyhistogram_p.h \
     qamqpmessage_p.h \
-    qamqpqueue_p.h
+    qamqpmetrics_p.h \
+    qamqpqueue_p.h \
+    qamqpreconnectpolicy_p.h \
+    qamqprpcclient_p.h \
+    qamqprpcserver_p.h
 
 INSTALL_HEADERS += \
     qamqpauthenticator.h \
@@ -56,9 +65,17 @@ INSTALL_HEADERS += \
     qamqpclient.h \
     qamqpexchange.h \
     qamqpglobal.h \
+    qamqplatencyhistogram.h \
     qamqpmessage.h \
+    qamqpmetrics.h \
     qamqpqueue.h \
-    qamqptable.h
+    qamqpreconnectpolicy.h \
+    qamqproutingkey.h \
+    qamqprpcclient.h \
+    qamqprpcserver.h \
+    qamqptable.h \
+    qamqptracer.h \
+    qamqptransport.h
 
 HEADERS += \
     $${INSTALL_HEADERS} \
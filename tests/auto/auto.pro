@@ -2,5 +2,15 @@ TEMPLATE = subdirs
 SUBDIRS = \
     qamqpclient \
     qamqpexchange \
+    qamqpfailover \
+    qamqpflowcontrol \
+    qamqplatencyhistogram \
     qamqpqueue \
-    qamqpchannel
+    qamqpchannel \
+    qamqpreconnectpolicy \
+    qamqprecovery \
+    qamqprpc \
+    qamqptable \
+    qamqptestbroker \
+    qamqptracer \
+    qamqptransport
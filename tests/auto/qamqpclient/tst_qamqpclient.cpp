@@ -5,6 +5,7 @@
 #include "qamqptestcase.h"
 #include "qamqpauthenticator.h"
 #include "qamqpexchange.h"
+#include "qamqpmetrics.h"
 #include "qamqpqueue.h"
 #include "qamqpclient_p.h"
 #include "qamqpclient.h"
@@ -24,6 +25,7 @@ private Q_SLOTS:
     void validateUri();
     void issue38();
     void issue38_take2();
+    void metrics();
 
 public Q_SLOTS:     // temporarily disabled
     void autoReconnect();
@@ -327,5 +329,56 @@ void tst_QAMQPClient::issue38_take2()
 }
 
 
+void tst_QAMQPClient::metrics()
+{
+    QAmqpClient client;
+    client.connectToHost();
+    QVERIFY(waitForSignal(&client, SIGNAL(connected())));
+
+    // connection.start, tune and open-ok, the open round trip was timed
+    QAmqpMetrics connected = client.metrics();
+    QVERIFY(connected.framesReceived(QAmqpMetrics::MethodFrame) >= 3);
+    QVERIFY(connected.framesSent(QAmqpMetrics::MethodFrame) >= 3);
+    QVERIFY(connected.bytesReceived() > connected.framesReceived() * 8);
+    QVERIFY(connected.channels().contains(0));
+    QVERIFY(connected.roundTripTime() >= 0);
+    QCOMPARE(connected.reconnectCount(), quint64(0));
+
+    QAmqpQueue *queue = client.createQueue("test-metrics");
+    declareQueueAndVerifyConsuming(queue);
+    QAmqpExchange *defaultExchange = client.createExchange();
+    defaultExchange->enableConfirms();
+    QVERIFY(waitForSignal(defaultExchange, SIGNAL(confirmsEnabled())));
+
+    for (int i = 0; i < 5; ++i)
+        defaultExchange->publish("metrics", "test-metrics");
+    QVERIFY(defaultExchange->waitForConfirms());
+    while (queue->size() < 5)
+        QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+
+    QAmqpMetrics delivered = client.metrics();
+    QCOMPARE(delivered.messagesPublished(), quint64(5));
+    QCOMPARE(delivered.messagesDelivered(), quint64(5));
+    QCOMPARE(delivered.unconfirmedPublishes(), qint64(0));
+    QCOMPARE(delivered.unackedDeliveries(), qint64(5));
+    QCOMPARE(delivered.framesReceived(QAmqpMetrics::HeaderFrame), quint64(5));
+    QCOMPARE(delivered.framesSent(QAmqpMetrics::BodyFrame), quint64(5));
+    QVERIFY(delivered.channelFramesReceived(queue->channelNumber()) >= 15);
+    QVERIFY(delivered.timestamp() >= connected.timestamp());
+    QVERIFY(delivered.deliveryRate(connected) >= 0);
+
+    // a multiple ack settles everything delivered so far
+    qlonglong lastDeliveryTag = 0;
+    while (!queue->isEmpty())
+        lastDeliveryTag = queue->dequeue().deliveryTag();
+    queue->ack(lastDeliveryTag, true);
+    QCOMPARE(client.metrics().unackedDeliveries(), qint64(0));
+
+    queue->remove(QAmqpExchange::roForce);
+    QVERIFY(waitForSignal(queue, SIGNAL(removed())));
+    client.disconnectFromHost();
+    QVERIFY(waitForSignal(&client, SIGNAL(disconnected())));
+}
+
 QTEST_MAIN(tst_QAMQPClient)
 #include "tst_qamqpclient.moc"
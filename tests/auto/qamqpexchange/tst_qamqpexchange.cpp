@@ -6,6 +6,7 @@
 #include "qamqpclient.h"
 #include "qamqpexchange.h"
 #include "qamqpqueue.h"
+#include "qamqproutingkey.h"
 
 class tst_QAMQPExchange : public TestCase
 {
@@ -25,9 +26,13 @@ private Q_SLOTS:
     void invalidImmediateRouting();
     void confirmsSupport();
     void confirmDontLoseMessages();
+    void confirmLatency();
     void passiveDeclareNotFound();
     void cleanupOnDeletion();
     void testQueuedPublish();
+    void routingKey();
+    void publishRoutingKey();
+    void utf8Names();
 
 private:
     QScopedPointer<QAmqpClient> client;
@@ -199,6 +204,27 @@ void tst_QAMQPExchange::confirmDontLoseMessages()
     QVERIFY(defaultExchange->waitForConfirms());
 }
 
+void tst_QAMQPExchange::confirmLatency()
+{
+    QAmqpExchange *defaultExchange = client->createExchange();
+    QVERIFY(!defaultExchange->isConfirmLatencyTracking());
+    defaultExchange->setConfirmLatencyTracking(true);
+    defaultExchange->enableConfirms();
+    QVERIFY(waitForSignal(defaultExchange, SIGNAL(confirmsEnabled())));
+
+    for (int i = 0; i < 100; ++i)
+        defaultExchange->publish("noop", "confirms-test");
+    QVERIFY(defaultExchange->waitForConfirms());
+
+    QAmqpLatencyHistogram latency = defaultExchange->confirmLatency();
+    QCOMPARE(latency.count(), quint64(100));
+    QVERIFY(latency.valueAtPercentile(50) <= latency.valueAtPercentile(99));
+    QCOMPARE(latency.valueAtPercentile(100), latency.max());
+
+    defaultExchange->resetConfirmLatency();
+    QCOMPARE(defaultExchange->confirmLatency().count(), quint64(0));
+}
+
 void tst_QAMQPExchange::passiveDeclareNotFound()
 {
     QAmqpExchange *nonExistentExchange = client->createExchange("this-does-not-exist");
@@ -242,5 +268,56 @@ void tst_QAMQPExchange::testQueuedPublish()
     QVERIFY(defaultExchange->waitForConfirms());
 }
 
+void tst_QAMQPExchange::routingKey()
+{
+    QAmqpRoutingKey empty;
+    QVERIFY(empty.isEmpty());
+    QVERIFY(empty.isValid());
+    QCOMPARE(empty.encoded(), QByteArray(1, '\0'));
+
+    QAmqpRoutingKey key(QString::fromUtf8("caf\xc3\xa9.orders"));
+    QCOMPARE(key.toUtf8(), QByteArray("caf\xc3\xa9.orders"));
+    QCOMPARE(key.encoded(), QByteArray("\x0c" "caf\xc3\xa9.orders"));
+    QCOMPARE(key, QAmqpRoutingKey(key.toString()));
+    QCOMPARE(key, QAmqpRoutingKey::fromUtf8(key.toUtf8()));
+
+    QAmqpRoutingKey tooLong(QString(200, QChar(0xe9)));
+    QVERIFY(!tooLong.isValid());
+    QCOMPARE(tooLong.encoded().size(), 256);
+}
+
+void tst_QAMQPExchange::publishRoutingKey()
+{
+    QAmqpQueue *queue = client->createQueue("test-routing-key-handle");
+    declareQueueAndVerifyConsuming(queue);
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    const QAmqpRoutingKey key(queue->name());
+    for (int i = 0; i < 3; ++i)
+        defaultExchange->publish(QString("message %1").arg(i), key);
+
+    for (int i = 0; i < 3; ++i) {
+        if (queue->isEmpty())
+            QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+        QAmqpMessage message = queue->dequeue();
+        QCOMPARE(message.payload(), QString("message %1").arg(i).toUtf8());
+        QCOMPARE(message.routingKey(), queue->name());
+    }
+}
+
+void tst_QAMQPExchange::utf8Names()
+{
+    // shortstr lengths count bytes, not characters
+    const QString name = QString::fromUtf8("test-\xc3\xbc\xc3\xb1\xc3\xaf\xc3\xa7\xc3\xb8");
+    QAmqpQueue *queue = client->createQueue(name);
+    declareQueueAndVerifyConsuming(queue);
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    defaultExchange->publish("unicode", name);
+    QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+    QAmqpMessage message = queue->dequeue();
+    QCOMPARE(message.routingKey(), name);
+}
+
 QTEST_MAIN(tst_QAMQPExchange)
 #include "tst_qamqpexchange.moc"
@@ -0,0 +1,229 @@
+#include <QElapsedTimer>
+#include <QScopedPointer>
+#include <QTcpServer>
+
+#include <QtTest/QtTest>
+#include "qamqptestcase.h"
+#include "qamqptestbroker.h"
+#include "qamqpfaulttransport.h"
+
+#include "qamqpclient.h"
+#include "qamqpreconnectpolicy.h"
+
+class tst_QAMQPFailover : public TestCase
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void singleHost();
+    void commaSeparated();
+    void explicitList();
+    void skipsDeadBroker();
+    void allDead();
+    void failoverOnReconnect();
+    void randomFailover();
+    void lowestLatency();
+    void connectTimeout();
+
+private:
+    QString endpoint(int broker) const;
+    void connectTo(const QStringList &uris);
+    void disconnectClient();
+
+    QScopedPointer<QAmqpTestBroker> brokers[2];
+    QScopedPointer<QAmqpClient> client;
+    QAmqpFaultTransport *transport;
+
+};
+
+void tst_QAMQPFailover::init()
+{
+    for (int i = 0; i < 2; ++i) {
+        brokers[i].reset(new QAmqpTestBroker);
+        QVERIFY(brokers[i]->listen());
+    }
+
+    client.reset(new QAmqpClient);
+    transport = new QAmqpFaultTransport;
+    client->setTransport(transport);
+}
+
+void tst_QAMQPFailover::cleanup()
+{
+    disconnectClient();
+    client.reset();
+    for (int i = 0; i < 2; ++i)
+        brokers[i].reset();
+}
+
+QString tst_QAMQPFailover::endpoint(int broker) const
+{
+    return QString("amqp://%1:%2").arg(brokers[broker]->address().toString())
+                                  .arg(brokers[broker]->port());
+}
+
+void tst_QAMQPFailover::connectTo(const QStringList &uris)
+{
+    client->connectToHost(uris);
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+}
+
+void tst_QAMQPFailover::disconnectClient()
+{
+    if (client->isConnected()) {
+        client->disconnectFromHost();
+        QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    }
+}
+
+void tst_QAMQPFailover::singleHost()
+{
+    client->connectToHost(brokers[1]->url());
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+    QCOMPARE(client->port(), brokers[1]->port());
+    QCOMPARE(client->virtualHost(), QString("/"));
+}
+
+void tst_QAMQPFailover::commaSeparated()
+{
+    const QString uri = QString("amqp://user:secret@%1:%2, %1:%3/test")
+        .arg(brokers[0]->address().toString())
+        .arg(brokers[0]->port())
+        .arg(brokers[1]->port());
+
+    client->connectToHost(uri);
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+    QCOMPARE(client->port(), brokers[0]->port());
+    QCOMPARE(client->username(), QString("user"));
+    QCOMPARE(client->virtualHost(), QString("test"));
+}
+
+void tst_QAMQPFailover::explicitList()
+{
+    connectTo(QStringList() << endpoint(1) + "/test" << endpoint(0));
+    QCOMPARE(client->port(), brokers[1]->port());
+    QCOMPARE(client->virtualHost(), QString("test"));
+    QCOMPARE(brokers[1]->connectionCount(), 1);
+    QCOMPARE(brokers[0]->connectionCount(), 0);
+}
+
+void tst_QAMQPFailover::skipsDeadBroker()
+{
+    brokers[0]->close();
+
+    QSignalSpy spy(client.data(), SIGNAL(reconnecting(int,int)));
+    QElapsedTimer timer;
+    timer.start();
+    connectTo(QStringList() << endpoint(0) << endpoint(1));
+
+    // straight on to the next broker, without auto reconnect or a backoff
+    QVERIFY(timer.elapsed() < 1000);
+    QCOMPARE(client->port(), brokers[1]->port());
+    QCOMPARE(spy.count(), 0);
+}
+
+void tst_QAMQPFailover::allDead()
+{
+    const QStringList uris = QStringList() << endpoint(0) << endpoint(1);
+    brokers[0]->close();
+    brokers[1]->close();
+
+    // one backoff per round, not per broker
+    client->setAutoReconnect(true);
+    client->setReconnectPolicy(QAmqpReconnectPolicy::fixed(50, 2));
+    qRegisterMetaType<QAbstractSocket::SocketError>();
+    QSignalSpy spy(client.data(), SIGNAL(reconnecting(int,int)));
+    QSignalSpy errors(client.data(), SIGNAL(socketErrorOccurred(QAbstractSocket::SocketError)));
+    client->connectToHost(uris);
+
+    QTRY_COMPARE(spy.count(), 2);
+    QTRY_COMPARE(errors.count(), 6);
+    QTest::qWait(200);
+    QCOMPARE(spy.count(), 2);
+    QVERIFY(!client->isConnected());
+}
+
+void tst_QAMQPFailover::failoverOnReconnect()
+{
+    client->setAutoReconnect(true);
+    client->setReconnectPolicy(QAmqpReconnectPolicy::fixed(10));
+    connectTo(QStringList() << endpoint(0) << endpoint(1));
+    QCOMPARE(client->port(), brokers[0]->port());
+
+    brokers[0]->close();
+    brokers[0]->dropConnections();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+    QCOMPARE(client->port(), brokers[1]->port());
+    QCOMPARE(brokers[1]->connectionCount(), 1);
+}
+
+void tst_QAMQPFailover::randomFailover()
+{
+    const QStringList uris = QStringList() << endpoint(0) << endpoint(1);
+    client->setFailoverStrategy(QAmqpClient::RandomFailover);
+
+    int picked[2] = { 0, 0 };
+    for (int i = 0; i < 20; ++i) {
+        connectTo(uris);
+        ++picked[client->port() == brokers[0]->port() ? 0 : 1];
+        disconnectClient();
+    }
+
+    QVERIFY(picked[0] > 0);
+    QVERIFY(picked[1] > 0);
+}
+
+void tst_QAMQPFailover::lowestLatency()
+{
+    const QStringList uris = QStringList() << endpoint(0) << endpoint(1);
+    const quint16 port = brokers[0]->port();
+
+    // measure the second broker fast and the first one slow
+    brokers[0]->close();
+    connectTo(uris);
+    QCOMPARE(client->port(), brokers[1]->port());
+    disconnectClient();
+
+    QVERIFY(brokers[0]->listen(QHostAddress::LocalHost, port));
+    transport->setLatency(150);
+    client->connectToHost();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+    QCOMPARE(client->port(), port);
+    disconnectClient();
+    transport->setLatency(0);
+
+    // ordered went back to the first one, lowest latency picks the other
+    client->setFailoverStrategy(QAmqpClient::LowestLatencyFailover);
+    client->connectToHost();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+    QCOMPARE(client->port(), brokers[1]->port());
+}
+
+void tst_QAMQPFailover::connectTimeout()
+{
+    // accepts the connection but never says a word
+    QTcpServer silent;
+    QVERIFY(silent.listen(QHostAddress::LocalHost));
+
+    client->setConnectTimeout(200);
+    QString reported;
+    QAmqpClient *c = client.data();
+    connect(c, &QAmqpClient::socketErrorOccurred, [c, &reported]() {
+        reported = c->errorString();
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+    connectTo(QStringList() << QString("amqp://127.0.0.1:%1").arg(silent.serverPort())
+                            << endpoint(1));
+    QVERIFY(timer.elapsed() >= 200);
+    QVERIFY(timer.elapsed() < 2000);
+    QCOMPARE(client->port(), brokers[1]->port());
+    QCOMPARE(reported, QString("connection timed out"));
+}
+
+QTEST_MAIN(tst_QAMQPFailover)
+#include "tst_qamqpfailover.moc"
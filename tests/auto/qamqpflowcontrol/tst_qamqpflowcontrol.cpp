@@ -0,0 +1,172 @@
+#include <QScopedPointer>
+
+#include <QtTest/QtTest>
+#include "qamqptestcase.h"
+#include "qamqptestbroker.h"
+
+#include "qamqpclient.h"
+#include "qamqpexchange.h"
+#include "qamqpmetrics.h"
+#include "qamqpqueue.h"
+
+class tst_QAMQPFlowControl : public TestCase
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void channelFlow();
+    void connectionBlocked();
+    void holdLimit();
+    void holdingDisabled();
+    void disablingReleasesHeld();
+
+private:
+    void receive(QAmqpQueue *queue, int messageCount);
+
+    QScopedPointer<QAmqpTestBroker> broker;
+    QScopedPointer<QAmqpClient> client;
+    QAmqpQueue *queue;
+    QAmqpExchange *exchange;
+
+};
+
+void tst_QAMQPFlowControl::init()
+{
+    broker.reset(new QAmqpTestBroker);
+    QVERIFY(broker->listen());
+
+    client.reset(new QAmqpClient);
+    client->connectToHost(broker->address(), broker->port());
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+
+    queue = client->createQueue("test-flow-control");
+    declareQueueAndVerifyConsuming(queue);
+    exchange = client->createExchange();
+    if (!exchange->isOpen())
+        QVERIFY(waitForSignal(exchange, SIGNAL(opened())));
+}
+
+void tst_QAMQPFlowControl::cleanup()
+{
+    if (client->isConnected()) {
+        client->disconnectFromHost();
+        QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    }
+
+    client.reset();
+    broker.reset();
+}
+
+void tst_QAMQPFlowControl::receive(QAmqpQueue *queue, int messageCount)
+{
+    for (int i = 0; i < messageCount; ++i) {
+        if (queue->isEmpty())
+            QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+        QAmqpMessage message = queue->dequeue();
+        QCOMPARE(message.payload(), QString("message %1").arg(i).toUtf8());
+    }
+}
+
+void tst_QAMQPFlowControl::channelFlow()
+{
+    QSignalSpy backpressure(exchange, SIGNAL(backpressureChanged(bool)));
+    broker->setPublishFlow(false);
+    QVERIFY(waitForSignal(exchange, SIGNAL(paused())));
+    QVERIFY(exchange->hasBackpressure());
+
+    // held here rather than written to the socket
+    const quint64 published = client->metrics().messagesPublished();
+    for (int i = 0; i < 5; ++i)
+        exchange->publish(QString("message %1").arg(i), "test-flow-control");
+    QCOMPARE(exchange->heldPublishes(), 5);
+    QCOMPARE(exchange->heldBytes(), qint64(5 * 9));
+    QCOMPARE(client->metrics().messagesPublished(), published);
+
+    broker->setPublishFlow(true);
+    QVERIFY(waitForSignal(exchange, SIGNAL(resumed())));
+    QCOMPARE(exchange->heldPublishes(), 0);
+    QVERIFY(!exchange->hasBackpressure());
+    receive(queue, 5);
+
+    QCOMPARE(backpressure.size(), 2);
+    QCOMPARE(backpressure.at(0).at(0).toBool(), true);
+    QCOMPARE(backpressure.at(1).at(0).toBool(), false);
+}
+
+void tst_QAMQPFlowControl::connectionBlocked()
+{
+    QSignalSpy blocked(client.data(), SIGNAL(blocked(QString)));
+    broker->blockConnections("low on memory");
+    QVERIFY(waitForSignal(client.data(), SIGNAL(blocked(QString))));
+    QVERIFY(client->isBlocked());
+    QCOMPARE(client->blockedReason(), QString("low on memory"));
+    QCOMPARE(blocked.at(0).at(0).toString(), QString("low on memory"));
+    QVERIFY(exchange->hasBackpressure());
+
+    for (int i = 0; i < 3; ++i)
+        exchange->publish(QString("message %1").arg(i), "test-flow-control");
+    QCOMPARE(exchange->heldPublishes(), 3);
+
+    // a round trip to the broker, nothing held may have gone out meanwhile
+    QTest::qWait(50);
+    QVERIFY(queue->isEmpty());
+
+    broker->unblockConnections();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(unblocked())));
+    QVERIFY(!client->isBlocked());
+    QCOMPARE(exchange->heldPublishes(), 0);
+    QVERIFY(!exchange->hasBackpressure());
+    receive(queue, 3);
+}
+
+void tst_QAMQPFlowControl::holdLimit()
+{
+    exchange->setMaxHeldBytes(20);
+    QCOMPARE(exchange->maxHeldBytes(), qint64(20));
+    broker->blockConnections();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(blocked(QString))));
+
+    QSignalSpy dropped(exchange, SIGNAL(publishDropped()));
+    for (int i = 0; i < 3; ++i)
+        exchange->publish(QString("message %1").arg(i), "test-flow-control");
+    QCOMPARE(exchange->heldPublishes(), 2);
+    QCOMPARE(dropped.size(), 1);
+
+    broker->unblockConnections();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(unblocked())));
+    receive(queue, 2);
+}
+
+void tst_QAMQPFlowControl::holdingDisabled()
+{
+    exchange->setMaxHeldBytes(0);
+    broker->blockConnections();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(blocked(QString))));
+
+    // still told about it, but publishes go straight through
+    QVERIFY(exchange->hasBackpressure());
+    exchange->publish(QString("message 0"), "test-flow-control");
+    QCOMPARE(exchange->heldPublishes(), 0);
+    receive(queue, 1);
+}
+
+void tst_QAMQPFlowControl::disablingReleasesHeld()
+{
+    broker->blockConnections();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(blocked(QString))));
+    for (int i = 0; i < 2; ++i)
+        exchange->publish(QString("message %1").arg(i), "test-flow-control");
+    QCOMPARE(exchange->heldPublishes(), 2);
+
+    // turning holding off lets go of what is held, still in order
+    exchange->setMaxHeldBytes(0);
+    QCOMPARE(exchange->heldPublishes(), 0);
+    QCOMPARE(exchange->heldBytes(), qint64(0));
+    exchange->publish(QString("message 2"), "test-flow-control");
+    receive(queue, 3);
+}
+
+QTEST_MAIN(tst_QAMQPFlowControl)
+#include "tst_qamqpflowcontrol.moc"
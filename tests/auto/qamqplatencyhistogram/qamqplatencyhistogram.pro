@@ -0,0 +1,6 @@
+DEPTH = ../../..
+include($${DEPTH}/qamqp.pri)
+include($${DEPTH}/tests/tests.pri)
+
+TARGET = tst_qamqplatencyhistogram
+SOURCES = tst_qamqplatencyhistogram.cpp
@@ -0,0 +1,121 @@
+#include <QtTest/QtTest>
+
+#include "qamqplatencyhistogram.h"
+
+class tst_QAMQPLatencyHistogram : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void empty();
+    void exactBelow128();
+    void percentiles();
+    void precision_data();
+    void precision();
+    void clampsLargeValues();
+    void addAndReset();
+    void implicitSharing();
+
+};
+
+void tst_QAMQPLatencyHistogram::empty()
+{
+    QAmqpLatencyHistogram histogram;
+    QCOMPARE(histogram.count(), quint64(0));
+    QCOMPARE(histogram.valueAtPercentile(50), qint64(0));
+    QCOMPARE(histogram.mean(), 0.0);
+}
+
+void tst_QAMQPLatencyHistogram::exactBelow128()
+{
+    QAmqpLatencyHistogram histogram;
+    for (int i = 0; i < 128; ++i)
+        histogram.record(i);
+
+    QCOMPARE(histogram.count(), quint64(128));
+    QCOMPARE(histogram.min(), qint64(0));
+    QCOMPARE(histogram.max(), qint64(127));
+    QCOMPARE(histogram.valueAtPercentile(50), qint64(63));
+    QCOMPARE(histogram.valueAtPercentile(100), qint64(127));
+}
+
+void tst_QAMQPLatencyHistogram::percentiles()
+{
+    QAmqpLatencyHistogram histogram;
+    for (int i = 1; i <= 10000; ++i)
+        histogram.record(i);
+
+    QCOMPARE(histogram.mean(), 5000.5);
+    QMap<double, qint64> values = histogram.percentiles();
+    QCOMPARE(values.keys(), QList<double>() << 50 << 90 << 99 << 99.9 << 100);
+    QVERIFY(qAbs(values.value(50) - 5000) <= 5000 / 64);
+    QVERIFY(qAbs(values.value(99) - 9900) <= 9900 / 64);
+    QCOMPARE(values.value(100), qint64(10000));
+    QCOMPARE(histogram.valueAtPercentile(0), qint64(1));
+}
+
+void tst_QAMQPLatencyHistogram::precision_data()
+{
+    QTest::addColumn<qint64>("value");
+    QTest::newRow("128us") << qint64(128);
+    QTest::newRow("1ms") << qint64(1000);
+    QTest::newRow("37ms") << qint64(37123);
+    QTest::newRow("1s") << qint64(1000000);
+    QTest::newRow("10min") << qint64(600) * 1000000;
+}
+
+void tst_QAMQPLatencyHistogram::precision()
+{
+    QFETCH(qint64, value);
+
+    // a single other value keeps max from capping the bucket bound
+    QAmqpLatencyHistogram histogram;
+    histogram.record(value);
+    histogram.record(value * 4);
+
+    const qint64 reported = histogram.valueAtPercentile(50);
+    QVERIFY(reported >= value);
+    QVERIFY(reported - value <= value / 64);
+}
+
+void tst_QAMQPLatencyHistogram::clampsLargeValues()
+{
+    QAmqpLatencyHistogram histogram;
+    histogram.record(qint64(24) * 3600 * 1000000);
+    histogram.record(-5);
+
+    QCOMPARE(histogram.count(), quint64(2));
+    QCOMPARE(histogram.min(), qint64(0));
+    QCOMPARE(histogram.valueAtPercentile(100), histogram.max());
+}
+
+void tst_QAMQPLatencyHistogram::addAndReset()
+{
+    QAmqpLatencyHistogram first;
+    QAmqpLatencyHistogram second;
+    first.record(10);
+    second.record(1000);
+    second.record(20);
+
+    first.add(second);
+    QCOMPARE(first.count(), quint64(3));
+    QCOMPARE(first.min(), qint64(10));
+    QCOMPARE(first.max(), qint64(1000));
+
+    first.reset();
+    QCOMPARE(first.count(), quint64(0));
+    QCOMPARE(second.count(), quint64(2));
+}
+
+void tst_QAMQPLatencyHistogram::implicitSharing()
+{
+    QAmqpLatencyHistogram histogram;
+    histogram.record(10);
+
+    QAmqpLatencyHistogram copy = histogram;
+    histogram.record(20);
+    QCOMPARE(copy.count(), quint64(1));
+    QCOMPARE(histogram.count(), quint64(2));
+}
+
+QTEST_MAIN(tst_QAMQPLatencyHistogram)
+#include "tst_qamqplatencyhistogram.moc"
@@ -1,6 +1,9 @@
 #include <float.h>
 
 #include <QScopedPointer>
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
+#include <QRandomGenerator>
+#endif
 
 #include <QtTest/QtTest>
 #include "qamqptestcase.h"
@@ -49,6 +52,16 @@ private Q_SLOTS:
     void messageProperties();
     void emptyMessage();
     void cleanupOnDeletion();
+    void parallelConsume();
+    void shardedConsumeKeepsOrder_data();
+    void shardedConsumeKeepsOrder();
+    void consumeAgainWhileHandlerBusy();
+    void deleteWhileHandlerBusy();
+    void getBypassesConsumerPool();
+    void ackLatency();
+    void rawNames();
+    void batchDelivery();
+    void messageCallback();
 
 private:
     QScopedPointer<QAmqpClient> client;
@@ -704,5 +717,309 @@ void tst_QAMQPQueue::cleanupOnDeletion()
     QVERIFY(waitForSignal(queue, SIGNAL(closed())));
 }
 
+void tst_QAMQPQueue::parallelConsume()
+{
+    QAmqpQueue *queue = client->createQueue("test-parallel-consume");
+    queue->declare();
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+
+    const int messageCount = 200;
+    QAtomicInt processed;
+    QVERIFY(queue->consume([&processed, messageCount](const QAmqpMessage &) {
+        QThread::msleep(1);
+        if (processed.fetchAndAddOrdered(1) + 1 == messageCount)
+            QMetaObject::invokeMethod(&QTestEventLoop::instance(), "exitLoop", Qt::QueuedConnection);
+        return QAmqpQueue::Ack;
+    }, 4));
+    QVERIFY(waitForSignal(queue, SIGNAL(consuming(QString))));
+    QCOMPARE(queue->workerCount(), 4);
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    for (int i = 0; i < messageCount; ++i)
+        defaultExchange->publish(QByteArray::number(i), "test-parallel-consume");
+
+    QTestEventLoop::instance().enterLoop(10);
+    QVERIFY(!QTestEventLoop::instance().timeout());
+    QCOMPARE(processed.loadAcquire(), messageCount);
+    QVERIFY(queue->isEmpty());
+
+    // everything was acked, so cancelling and purging finds nothing left
+    queue->cancel();
+    QVERIFY(waitForSignal(queue, SIGNAL(cancelled(QString))));
+    queue->purge();
+    QSignalSpy spy(queue, SIGNAL(purged(int)));
+    QVERIFY(waitForSignal(queue, SIGNAL(purged(int))));
+    QCOMPARE(spy.takeFirst().at(0).toInt(), 0);
+}
+
+void tst_QAMQPQueue::shardedConsumeKeepsOrder_data()
+{
+    QTest::addColumn<int>("shardingKey");
+    QTest::newRow("header") << int(QAmqpQueue::ShardByHeader);
+    QTest::newRow("message-id") << int(QAmqpQueue::ShardByMessageId);
+}
+
+void tst_QAMQPQueue::shardedConsumeKeepsOrder()
+{
+    QFETCH(int, shardingKey);
+    QAmqpQueue *queue = client->createQueue("test-sharded-consume");
+    queue->declare();
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+
+    const int entityCount = 8;
+    const int messagesPerEntity = 25;
+    QMutex mutex;
+    QHash<QString, QList<int> > seen;
+    int processed = 0;
+    queue->setSharding(QAmqpQueue::ShardingKey(shardingKey), "entity");
+    QCOMPARE(int(queue->sharding()), shardingKey);
+    QVERIFY(queue->consume([&](const QAmqpMessage &message) {
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
+        QThread::msleep(QRandomGenerator::global()->bounded(3));
+#else
+        QThread::msleep(qrand() % 3);
+#endif
+        QMutexLocker locker(&mutex);
+        seen[message.header("entity").toString()].append(message.payload().toInt());
+        if (++processed == entityCount * messagesPerEntity)
+            QMetaObject::invokeMethod(&QTestEventLoop::instance(), "exitLoop", Qt::QueuedConnection);
+        return QAmqpQueue::Ack;
+    }, 4));
+    QVERIFY(waitForSignal(queue, SIGNAL(consuming(QString))));
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    for (int i = 0; i < messagesPerEntity; ++i) {
+        for (int entity = 0; entity < entityCount; ++entity) {
+            QString entityId = QString("entity-%1").arg(entity);
+            QAmqpTable headers;
+            headers.insert("entity", entityId);
+            QAmqpMessage::PropertyHash properties;
+            properties.insert(QAmqpMessage::MessageId, entityId);
+            defaultExchange->publish(QByteArray::number(i), "test-sharded-consume",
+                                     "text/plain", headers, properties);
+        }
+    }
+
+    QTestEventLoop::instance().enterLoop(10);
+    QVERIFY(!QTestEventLoop::instance().timeout());
+
+    QMutexLocker locker(&mutex);
+    QCOMPARE(seen.size(), entityCount);
+    foreach (const QList<int> &sequence, seen) {
+        QCOMPARE(sequence.size(), messagesPerEntity);
+        for (int i = 0; i < messagesPerEntity; ++i)
+            QCOMPARE(sequence.at(i), i);
+    }
+}
+
+void tst_QAMQPQueue::consumeAgainWhileHandlerBusy()
+{
+    QAmqpQueue *queue = client->createQueue("test-consume-again");
+    queue->declare();
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+
+    QSemaphore started, release;
+    QVERIFY(queue->consume([&](const QAmqpMessage &) {
+        started.release();
+        release.tryAcquire(1, 5000);
+        return QAmqpQueue::Ack;
+    }, 1));
+    QVERIFY(waitForSignal(queue, SIGNAL(consuming(QString))));
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    defaultExchange->publish("0", "test-consume-again");
+    defaultExchange->publish("1", "test-consume-again");
+    QTRY_VERIFY(started.tryAcquire());
+    queue->cancel();
+    QVERIFY(waitForSignal(queue, SIGNAL(cancelled(QString))));
+
+    // the busy handler doesn't hold up the thread, what it hadn't started
+    // comes back to the new consumer
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(queue->consume());
+    QVERIFY(timer.elapsed() < 1000);
+    release.release();
+    if (queue->isEmpty())
+        QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+    QCOMPARE(queue->dequeue().payload(), QByteArray("1"));
+}
+
+void tst_QAMQPQueue::deleteWhileHandlerBusy()
+{
+    QAmqpQueue *queue = client->createQueue("test-delete-while-busy");
+    queue->declare();
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+
+    // shared with the handler, which outlives both the queue and this test
+    QSharedPointer<QSemaphore> started(new QSemaphore), release(new QSemaphore);
+    QVERIFY(queue->consume([started, release](const QAmqpMessage &) {
+        started->release();
+        release->tryAcquire(1, 5000);
+        return QAmqpQueue::Ack;
+    }, 1));
+    QVERIFY(waitForSignal(queue, SIGNAL(consuming(QString))));
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    defaultExchange->publish("busy", "test-delete-while-busy");
+    QTRY_VERIFY(started->tryAcquire());
+
+    // the pool winds down and deletes itself once the handler returns
+    QElapsedTimer timer;
+    timer.start();
+    delete queue;
+    QVERIFY(timer.elapsed() < 1000);
+    release->release();
+}
+
+void tst_QAMQPQueue::getBypassesConsumerPool()
+{
+    QAmqpQueue *queue = client->createQueue("test-get-bypasses-pool");
+    queue->declare();
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+
+    QAtomicInt handled;
+    QVERIFY(queue->consume([&handled](const QAmqpMessage &) {
+        handled.fetchAndAddOrdered(1);
+        return QAmqpQueue::Ack;
+    }, 2));
+    QVERIFY(waitForSignal(queue, SIGNAL(consuming(QString))));
+    queue->cancel();
+    QVERIFY(waitForSignal(queue, SIGNAL(cancelled(QString))));
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    defaultExchange->publish("taken", "test-get-bypasses-pool");
+    QTest::qWait(100);
+    queue->get();
+    QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+    QCOMPARE(queue->dequeue().payload(), QByteArray("taken"));
+    QCOMPARE(handled.loadAcquire(), 0);
+}
+
+void tst_QAMQPQueue::ackLatency()
+{
+    QAmqpQueue *queue = client->createQueue("test-ack-latency");
+    queue->setAckLatencyTracking(true);
+    declareQueueAndVerifyConsuming(queue);
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    for (int i = 0; i < 5; ++i)
+        defaultExchange->publish("noop", "test-ack-latency");
+    while (queue->size() < 5)
+        QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+
+    // held for at least 50ms before the ack, the rejected one isn't recorded
+    QTest::qWait(50);
+    queue->reject(queue->dequeue(), false);
+    queue->ack(queue->dequeue());
+    queue->ack(queue->last().deliveryTag(), true);
+
+    QAmqpLatencyHistogram latency = queue->ackLatency();
+    QCOMPARE(latency.count(), quint64(4));
+    QVERIFY(latency.min() >= 50000);
+    QVERIFY(latency.valueAtPercentile(50) >= 50000);
+
+    queue->resetAckLatency();
+    QCOMPARE(queue->ackLatency().count(), quint64(0));
+}
+
+void tst_QAMQPQueue::rawNames()
+{
+    QAmqpQueue *queue = client->createQueue("test-raw-names");
+    declareQueueAndVerifyConsuming(queue);
+    const QString key = QString::fromUtf8("raw.\xc3\xa9v\xc3\xa9nement");
+    queue->bind("amq.topic", key);
+    QVERIFY(waitForSignal(queue, SIGNAL(bound())));
+
+    QAmqpExchange *topic = client->createExchange("amq.topic");
+    topic->publish("topic", QAmqpRoutingKey::fromUtf8(key.toUtf8()));
+    QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+    QAmqpMessage message = queue->dequeue();
+    verifyStandardMessageHeaders(message, key, "amq.topic");
+    QCOMPARE(message.rawRoutingKey(), key.toUtf8());
+    QCOMPARE(message.rawExchangeName(), QByteArray("amq.topic"));
+
+    // the default exchange has an empty, but present, name
+    QAmqpExchange *defaultExchange = client->createExchange();
+    defaultExchange->publish("default", "test-raw-names");
+    QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+    message = queue->dequeue();
+    QVERIFY(message.isValid());
+    QVERIFY(message.rawExchangeName().isEmpty());
+    QVERIFY(!message.rawExchangeName().isNull());
+    QCOMPARE(message.rawRoutingKey(), QByteArray("test-raw-names"));
+}
+
+void tst_QAMQPQueue::batchDelivery()
+{
+    QAmqpQueue *queue = client->createQueue("test-batch-delivery");
+    QVERIFY(!queue->isBatchDelivery());
+    queue->setBatchDelivery(true);
+    QVERIFY(queue->isBatchDelivery());
+    declareQueueAndVerifyConsuming(queue);
+
+    QSignalSpy single(queue, SIGNAL(messageReceived()));
+    QSignalSpy batches(queue, SIGNAL(messagesReceived(int)));
+    const int messageCount = 100;
+    QAmqpExchange *defaultExchange = client->createExchange();
+    for (int i = 0; i < messageCount; ++i)
+        defaultExchange->publish(QString("message %1").arg(i), "test-batch-delivery");
+
+    int received = 0;
+    QList<QAmqpMessage> messages;
+    while (received < messageCount) {
+        if (batches.isEmpty())
+            QVERIFY(waitForSignal(queue, SIGNAL(messagesReceived(int))));
+
+        int count = 0;
+        while (!batches.isEmpty())
+            count += batches.takeFirst().at(0).toInt();
+        QVERIFY(count > 0);
+        QCOMPARE(queue->size(), count);
+        received += count;
+        messages.append(queue->dequeueAll());
+        QVERIFY(queue->isEmpty());
+    }
+
+    QCOMPARE(received, messageCount);
+    QCOMPARE(single.count(), 0);
+    for (int i = 0; i < messageCount; ++i)
+        QCOMPARE(messages.at(i).payload(), QString("message %1").arg(i).toUtf8());
+}
+
+void tst_QAMQPQueue::messageCallback()
+{
+    QAmqpQueue *queue = client->createQueue("test-message-callback");
+    QVERIFY(!queue->messageCallback());
+    QList<QAmqpMessage> messages;
+    queue->setMessageCallback([&](const QAmqpMessage &message) {
+        messages.append(message);
+        queue->ack(message);
+    });
+    QVERIFY(queue->messageCallback());
+    declareQueueAndVerifyConsuming(queue);
+
+    QSignalSpy spy(queue, SIGNAL(messageReceived()));
+    const int messageCount = 10;
+    QAmqpExchange *defaultExchange = client->createExchange();
+    for (int i = 0; i < messageCount; ++i)
+        defaultExchange->publish(QString("message %1").arg(i), "test-message-callback");
+
+    QTRY_COMPARE(messages.size(), messageCount);
+    QCOMPARE(spy.count(), 0);
+    QVERIFY(queue->isEmpty());
+    for (int i = 0; i < messageCount; ++i) {
+        verifyStandardMessageHeaders(messages.at(i), "test-message-callback");
+        QCOMPARE(messages.at(i).payload(), QString("message %1").arg(i).toUtf8());
+    }
+
+    // without a callback messages are queued again
+    queue->setMessageCallback(QAmqpQueue::MessageCallback());
+    defaultExchange->publish("queued", "test-message-callback");
+    QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+    QCOMPARE(queue->dequeue().payload(), QByteArray("queued"));
+    QCOMPARE(messages.size(), messageCount);
+}
+
 QTEST_MAIN(tst_QAMQPQueue)
 #include "tst_qamqpqueue.moc"
@@ -0,0 +1,108 @@
+#include <QtTest/QtTest>
+
+#include "qamqpreconnectpolicy.h"
+
+class tst_QAMQPReconnectPolicy : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void defaults();
+    void fixed();
+    void exponential_data();
+    void exponential();
+    void fullJitter();
+    void maxAttempts();
+    void implicitSharing();
+
+};
+
+void tst_QAMQPReconnectPolicy::defaults()
+{
+    // the schedule auto reconnect always had
+    QAmqpReconnectPolicy policy;
+    QCOMPARE(policy.jitter(), QAmqpReconnectPolicy::NoJitter);
+    QCOMPARE(policy.maxAttempts(), 0);
+    QCOMPARE(policy.delay(1), 1000);
+    QCOMPARE(policy.delay(2), 5000);
+    QCOMPARE(policy.delay(3), 25000);
+    QCOMPARE(policy.delay(4), 120000);
+    QCOMPARE(policy.delay(1000), 120000);
+    QVERIFY(policy.canRetry(1000));
+}
+
+void tst_QAMQPReconnectPolicy::fixed()
+{
+    QAmqpReconnectPolicy policy = QAmqpReconnectPolicy::fixed(300);
+    for (int attempt = 1; attempt < 10; ++attempt)
+        QCOMPARE(policy.delay(attempt), 300);
+}
+
+void tst_QAMQPReconnectPolicy::exponential_data()
+{
+    QTest::addColumn<int>("attempt");
+    QTest::addColumn<int>("delay");
+
+    QTest::newRow("first") << 1 << 100;
+    QTest::newRow("second") << 2 << 200;
+    QTest::newRow("third") << 3 << 400;
+    QTest::newRow("capped") << 6 << 2000;
+    QTest::newRow("far out") << 100000 << 2000;
+}
+
+void tst_QAMQPReconnectPolicy::exponential()
+{
+    QFETCH(int, attempt);
+    QFETCH(int, delay);
+
+    QAmqpReconnectPolicy policy =
+        QAmqpReconnectPolicy::exponential(100, 2000, 2.0, QAmqpReconnectPolicy::NoJitter);
+    QCOMPARE(policy.baseDelay(attempt), delay);
+    QCOMPARE(policy.delay(attempt), delay);
+}
+
+void tst_QAMQPReconnectPolicy::fullJitter()
+{
+    QAmqpReconnectPolicy policy = QAmqpReconnectPolicy::exponential(1000, 8000);
+    QCOMPARE(policy.jitter(), QAmqpReconnectPolicy::FullJitter);
+
+    // spread over the whole range rather than clustered at the top
+    int below = 0, above = 0;
+    for (int i = 0; i < 1000; ++i) {
+        const int delay = policy.delay(4);
+        QVERIFY(delay >= 0);
+        QVERIFY(delay <= 8000);
+        if (delay < 4000)
+            ++below;
+        else
+            ++above;
+    }
+
+    QVERIFY(below > 300);
+    QVERIFY(above > 300);
+}
+
+void tst_QAMQPReconnectPolicy::maxAttempts()
+{
+    QAmqpReconnectPolicy policy = QAmqpReconnectPolicy::fixed(10, 3);
+    QVERIFY(policy.canRetry(1));
+    QVERIFY(policy.canRetry(3));
+    QVERIFY(!policy.canRetry(4));
+
+    policy.setMaxAttempts(-1);
+    QCOMPARE(policy.maxAttempts(), 0);
+    QVERIFY(policy.canRetry(4));
+}
+
+void tst_QAMQPReconnectPolicy::implicitSharing()
+{
+    QAmqpReconnectPolicy policy = QAmqpReconnectPolicy::fixed(10);
+    QAmqpReconnectPolicy copy = policy;
+    QCOMPARE(copy, policy);
+
+    copy.setMaxDelay(20);
+    QCOMPARE(policy.maxDelay(), 10);
+    QVERIFY(copy != policy);
+}
+
+QTEST_MAIN(tst_QAMQPReconnectPolicy)
+#include "tst_qamqpreconnectpolicy.moc"
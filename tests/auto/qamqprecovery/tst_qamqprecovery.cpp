@@ -0,0 +1,248 @@
+#include <QScopedPointer>
+
+#include <QtTest/QtTest>
+#include "qamqptestcase.h"
+#include "qamqptestbroker.h"
+#include "qamqpfaulttransport.h"
+
+#include "qamqpclient.h"
+#include "qamqpexchange.h"
+#include "qamqpqueue.h"
+
+class tst_QAMQPRecovery : public TestCase
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void defaults();
+    void noRecoveryWhenDisabled();
+    void queueBindingsAndConsumer();
+    void serverNamedQueue();
+    void cancelledConsumer();
+    void unconfirmedNotRepublishedByDefault();
+    void republishUnconfirmed();
+
+private:
+    void connectClient();
+    void dropAndReconnect();
+    QAmqpExchange *declareExchange(const QString &name);
+    QAmqpQueue *consumeBoundQueue(const QString &name, QAmqpExchange *exchange, const QString &key);
+    void publishUnconfirmed(QAmqpExchange *exchange, const QString &routingKey, int count);
+
+    QScopedPointer<QAmqpTestBroker> broker;
+    QScopedPointer<QAmqpClient> client;
+    QAmqpFaultTransport *transport;
+
+};
+
+void tst_QAMQPRecovery::init()
+{
+    broker.reset(new QAmqpTestBroker);
+    QVERIFY(broker->listen());
+
+    client.reset(new QAmqpClient);
+    transport = new QAmqpFaultTransport;
+    client->setTransport(transport);
+    client->setAutoReconnect(true);
+}
+
+void tst_QAMQPRecovery::cleanup()
+{
+    if (client->isConnected()) {
+        client->disconnectFromHost();
+        QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    }
+
+    client.reset();
+    broker.reset();
+}
+
+void tst_QAMQPRecovery::connectClient()
+{
+    client->connectToHost(broker->address(), broker->port());
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+}
+
+void tst_QAMQPRecovery::dropAndReconnect()
+{
+    transport->dropConnection();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+}
+
+QAmqpExchange *tst_QAMQPRecovery::declareExchange(const QString &name)
+{
+    QAmqpExchange *exchange = client->createExchange(name);
+    exchange->declare(QAmqpExchange::Direct);
+    if (!waitForSignal(exchange, SIGNAL(declared())))
+        return 0;
+    return exchange;
+}
+
+QAmqpQueue *tst_QAMQPRecovery::consumeBoundQueue(const QString &name, QAmqpExchange *exchange,
+                                                 const QString &key)
+{
+    QAmqpQueue *queue = client->createQueue(name);
+    queue->declare(QAmqpQueue::Exclusive);
+    if (!waitForSignal(queue, SIGNAL(declared())))
+        return 0;
+    queue->bind(exchange, key);
+    if (!waitForSignal(queue, SIGNAL(bound())))
+        return 0;
+    if (!queue->consume() || !waitForSignal(queue, SIGNAL(consuming(QString))))
+        return 0;
+    return queue;
+}
+
+void tst_QAMQPRecovery::publishUnconfirmed(QAmqpExchange *exchange, const QString &routingKey, int count)
+{
+    // held back by the link so none of them reach the broker before the drop
+    transport->setLatency(500);
+    for (int i = 0; i < count; ++i)
+        exchange->publish(QString("message %1").arg(i), routingKey);
+    transport->dropConnection();
+    transport->setLatency(0);
+    QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+}
+
+void tst_QAMQPRecovery::defaults()
+{
+    QVERIFY(!client->topologyRecovery());
+    QVERIFY(!client->republishUnconfirmed());
+
+    client->setTopologyRecovery(false, true);
+    QVERIFY(!client->republishUnconfirmed());
+
+    client->setTopologyRecovery(true, true);
+    QVERIFY(client->topologyRecovery());
+    QVERIFY(client->republishUnconfirmed());
+}
+
+void tst_QAMQPRecovery::noRecoveryWhenDisabled()
+{
+    connectClient();
+    QAmqpExchange *exchange = declareExchange("test-recovery-disabled");
+    QVERIFY(exchange);
+    QAmqpQueue *queue = consumeBoundQueue("test-recovery-disabled", exchange, "key");
+    QVERIFY(queue);
+
+    dropAndReconnect();
+    QVERIFY(waitForSignal(queue, SIGNAL(opened())));
+    QTest::qWait(100);
+    QVERIFY(!broker->hasQueue("test-recovery-disabled"));
+    QVERIFY(!queue->isConsuming());
+}
+
+void tst_QAMQPRecovery::queueBindingsAndConsumer()
+{
+    client->setTopologyRecovery(true);
+    connectClient();
+    QAmqpExchange *exchange = declareExchange("test-recovery");
+    QVERIFY(exchange);
+    QAmqpQueue *queue = consumeBoundQueue("test-recovery", exchange, "recovered");
+    QVERIFY(queue);
+    queue->qos(5);
+    QVERIFY(waitForSignal(queue, SIGNAL(qosDefined())));
+    const QString consumerTag = queue->consumerTag();
+
+    // the exclusive queue went away with the old connection
+    dropAndReconnect();
+    QVERIFY(waitForSignal(queue, SIGNAL(consuming(QString))));
+    QVERIFY(broker->hasQueue("test-recovery"));
+    QCOMPARE(broker->consumerCount("test-recovery"), 1);
+    QCOMPARE(queue->consumerTag(), consumerTag);
+    QCOMPARE(queue->prefetchCount(), qint16(5));
+
+    exchange->publish("after recovery", "recovered");
+    QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+    QCOMPARE(queue->dequeue().payload(), QByteArray("after recovery"));
+}
+
+void tst_QAMQPRecovery::serverNamedQueue()
+{
+    client->setTopologyRecovery(true);
+    connectClient();
+    QAmqpExchange *exchange = declareExchange("test-recovery-server-named");
+    QVERIFY(exchange);
+    QAmqpQueue *queue = consumeBoundQueue(QString(), exchange, "anonymous");
+    QVERIFY(queue);
+    const QString oldName = queue->name();
+    QVERIFY(!oldName.isEmpty());
+
+    dropAndReconnect();
+    QVERIFY(waitForSignal(queue, SIGNAL(consuming(QString))));
+    QVERIFY(!queue->name().isEmpty());
+    QVERIFY(queue->name() != oldName);
+    QVERIFY(!broker->hasQueue(oldName));
+    QCOMPARE(broker->consumerCount(queue->name()), 1);
+
+    exchange->publish("to the new name", "anonymous");
+    QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+}
+
+void tst_QAMQPRecovery::cancelledConsumer()
+{
+    client->setTopologyRecovery(true);
+    connectClient();
+    QAmqpExchange *exchange = declareExchange("test-recovery-cancelled");
+    QVERIFY(exchange);
+    QAmqpQueue *queue = consumeBoundQueue("test-recovery-cancelled", exchange, "key");
+    QVERIFY(queue);
+    QVERIFY(queue->cancel());
+    QVERIFY(waitForSignal(queue, SIGNAL(cancelled(QString))));
+
+    dropAndReconnect();
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+    QTest::qWait(100);
+    QVERIFY(!queue->isConsuming());
+    QCOMPARE(broker->consumerCount("test-recovery-cancelled"), 0);
+}
+
+void tst_QAMQPRecovery::unconfirmedNotRepublishedByDefault()
+{
+    client->setTopologyRecovery(true);
+    connectClient();
+    QAmqpQueue *queue = client->createQueue("test-recovery-unconfirmed");
+    queue->declare(QAmqpQueue::Durable);
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    defaultExchange->enableConfirms();
+    QVERIFY(waitForSignal(defaultExchange, SIGNAL(confirmsEnabled())));
+    publishUnconfirmed(defaultExchange, "test-recovery-unconfirmed", 3);
+
+    // confirms come back on, the lost messages stay lost
+    QVERIFY(waitForSignal(defaultExchange, SIGNAL(confirmsEnabled())));
+    QVERIFY(defaultExchange->waitForConfirms(200));
+    QCOMPARE(broker->messageCount("test-recovery-unconfirmed"), 0);
+}
+
+void tst_QAMQPRecovery::republishUnconfirmed()
+{
+    client->setTopologyRecovery(true, true);
+    connectClient();
+    QAmqpQueue *queue = client->createQueue("test-recovery-republish");
+    queue->declare(QAmqpQueue::Durable);
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    defaultExchange->enableConfirms();
+    QVERIFY(waitForSignal(defaultExchange, SIGNAL(confirmsEnabled())));
+    publishUnconfirmed(defaultExchange, "test-recovery-republish", 3);
+
+    QVERIFY(waitForSignal(defaultExchange, SIGNAL(allMessagesDelivered())));
+    QCOMPARE(broker->messageCount("test-recovery-republish"), 3);
+
+    QVERIFY(queue->consume(QAmqpQueue::coNoAck));
+    for (int i = 0; i < 3; ++i) {
+        if (queue->isEmpty())
+            QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+        QCOMPARE(queue->dequeue().payload(), QString("message %1").arg(i).toUtf8());
+    }
+}
+
+QTEST_MAIN(tst_QAMQPRecovery)
+#include "tst_qamqprecovery.moc"
@@ -0,0 +1,6 @@
+DEPTH = ../../..
+include($${DEPTH}/qamqp.pri)
+include($${DEPTH}/tests/tests.pri)
+
+TARGET = tst_qamqprpc
+SOURCES = tst_qamqprpc.cpp
@@ -0,0 +1,268 @@
+#include <QScopedPointer>
+
+#include <QtTest/QtTest>
+#include "qamqptestcase.h"
+#include "signalspy.h"
+
+#include "qamqpclient.h"
+#include "qamqpexchange.h"
+#include "qamqpqueue.h"
+#include "qamqprpcclient.h"
+#include "qamqprpcserver.h"
+
+class tst_QAMQPRpc : public TestCase
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void callAndReply();
+    void callTimeout();
+    void cancelCall();
+    void manyInFlightCalls();
+    void abortOnDisconnect();
+    void callAfterReconnect();
+    void serverHandlesRequests();
+    void serverBoundsConcurrency();
+
+private:
+    void startEchoServer(const QString &queueName);
+    QScopedPointer<QAmqpClient> client;
+
+};
+
+void tst_QAMQPRpc::init()
+{
+    client.reset(new QAmqpClient);
+    client->connectToHost();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+}
+
+void tst_QAMQPRpc::cleanup()
+{
+    if (client->isConnected()) {
+        client->disconnectFromHost();
+        QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    }
+}
+
+void tst_QAMQPRpc::startEchoServer(const QString &queueName)
+{
+    QAmqpQueue *queue = client->createQueue(queueName);
+    declareQueueAndVerifyConsuming(queue);
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    connect(queue, &QAmqpQueue::messageReceived, [queue, defaultExchange]() {
+        while (!queue->isEmpty()) {
+            QAmqpMessage request = queue->dequeue();
+            QAmqpMessage::PropertyHash properties;
+            properties.insert(QAmqpMessage::CorrelationId,
+                              request.property(QAmqpMessage::CorrelationId));
+            defaultExchange->publish(request.payload(),
+                                     request.property(QAmqpMessage::ReplyTo).toString(),
+                                     QLatin1String("application/octet-stream"), properties);
+        }
+    });
+}
+
+void tst_QAMQPRpc::callAndReply()
+{
+    startEchoServer("test-rpc-echo");
+
+    QAmqpRpcClient rpcClient(client.data());
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(ready())));
+
+    QSignalSpy spy(&rpcClient, SIGNAL(replyReceived(QString,QAmqpMessage)));
+    QString correlationId = rpcClient.call("test-rpc-echo", "ping");
+    QVERIFY(!correlationId.isEmpty());
+    QCOMPARE(rpcClient.pendingCallCount(), 1);
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(replyReceived(QString,QAmqpMessage))));
+
+    QCOMPARE(spy.count(), 1);
+    QList<QVariant> arguments = spy.takeFirst();
+    QCOMPARE(arguments.at(0).toString(), correlationId);
+    QCOMPARE(arguments.at(1).value<QAmqpMessage>().payload(), QByteArray("ping"));
+    QCOMPARE(rpcClient.pendingCallCount(), 0);
+}
+
+void tst_QAMQPRpc::callTimeout()
+{
+    QAmqpQueue *queue = client->createQueue("test-rpc-timeout");
+    queue->declare();
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+
+    QAmqpRpcClient rpcClient(client.data());
+    rpcClient.setTimerResolution(10);
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(ready())));
+
+    QSignalSpy spy(&rpcClient, SIGNAL(callTimedOut(QString)));
+    QString correlationId = rpcClient.call("test-rpc-timeout", "nobody home", QAmqpMessage::PropertyHash(), 100);
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(callTimedOut(QString))));
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.takeFirst().at(0).toString(), correlationId);
+    QCOMPARE(rpcClient.pendingCallCount(), 0);
+
+    queue->remove(QAmqpQueue::roForce);
+    QVERIFY(waitForSignal(queue, SIGNAL(removed())));
+}
+
+void tst_QAMQPRpc::cancelCall()
+{
+    QAmqpRpcClient rpcClient(client.data());
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(ready())));
+
+    QString correlationId = rpcClient.call("test-rpc-nowhere", "dropped");
+    QCOMPARE(rpcClient.pendingCallCount(), 1);
+    QVERIFY(rpcClient.cancel(correlationId));
+    QVERIFY(!rpcClient.cancel(correlationId));
+    QCOMPARE(rpcClient.pendingCallCount(), 0);
+}
+
+void tst_QAMQPRpc::manyInFlightCalls()
+{
+    startEchoServer("test-rpc-many");
+
+    QAmqpRpcClient rpcClient(client.data());
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(ready())));
+
+    const int callCount = 5000;
+    QSet<QString> outstanding;
+    for (int i = 0; i < callCount; ++i)
+        outstanding.insert(rpcClient.call("test-rpc-many", QByteArray::number(i)));
+    QCOMPARE(outstanding.size(), callCount);
+    QCOMPARE(rpcClient.pendingCallCount(), callCount);
+
+    connect(&rpcClient, &QAmqpRpcClient::replyReceived,
+            [&outstanding](const QString &correlationId, const QAmqpMessage &) {
+        outstanding.remove(correlationId);
+        if (outstanding.isEmpty())
+            QTestEventLoop::instance().exitLoop();
+    });
+
+    QTestEventLoop::instance().enterLoop(30);
+    QVERIFY(!QTestEventLoop::instance().timeout());
+    QVERIFY(outstanding.isEmpty());
+    QCOMPARE(rpcClient.pendingCallCount(), 0);
+}
+
+void tst_QAMQPRpc::abortOnDisconnect()
+{
+    QAmqpRpcClient rpcClient(client.data());
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(ready())));
+
+    QSignalSpy spy(&rpcClient, SIGNAL(callAborted(QString)));
+    QString correlationId = rpcClient.call("test-rpc-nowhere", "lost");
+    client->disconnectFromHost();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.takeFirst().at(0).toString(), correlationId);
+    QVERIFY(!rpcClient.isReady());
+    QCOMPARE(rpcClient.pendingCallCount(), 0);
+}
+
+void tst_QAMQPRpc::callAfterReconnect()
+{
+    QAmqpRpcServer server(client.data(), "test-rpc-reconnect");
+    server.setHandler([](const QAmqpMessage &request) {
+        return request.payload();
+    });
+    server.listen();
+    QVERIFY(waitForSignal(&server, SIGNAL(listening())));
+
+    QAmqpRpcClient rpcClient(client.data());
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(ready())));
+
+    client->disconnectFromHost();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    QVERIFY(!rpcClient.isReady());
+    QVERIFY(!server.isListening());
+
+    // both come back on their own once the connection is up again
+    client->connectToHost();
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(ready())));
+    QVERIFY(rpcClient.isReady());
+    if (!server.isListening())
+        QVERIFY(waitForSignal(&server, SIGNAL(listening())));
+
+    QSignalSpy spy(&rpcClient, SIGNAL(replyReceived(QString,QAmqpMessage)));
+    QString correlationId = rpcClient.call("test-rpc-reconnect", "again");
+    QVERIFY(!correlationId.isEmpty());
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(replyReceived(QString,QAmqpMessage))));
+    QCOMPARE(spy.count(), 1);
+    QList<QVariant> arguments = spy.takeFirst();
+    QCOMPARE(arguments.at(0).toString(), correlationId);
+    QCOMPARE(arguments.at(1).value<QAmqpMessage>().payload(), QByteArray("again"));
+}
+
+void tst_QAMQPRpc::serverHandlesRequests()
+{
+    QAmqpRpcServer server(client.data(), "test-rpc-server");
+    server.setHandler([](const QAmqpMessage &request) {
+        return request.payload().toUpper();
+    });
+    server.listen();
+    QVERIFY(waitForSignal(&server, SIGNAL(listening())));
+    QVERIFY(server.isListening());
+
+    QAmqpRpcClient rpcClient(client.data());
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(ready())));
+
+    QSignalSpy spy(&rpcClient, SIGNAL(replyReceived(QString,QAmqpMessage)));
+    QString correlationId = rpcClient.call("test-rpc-server", "shout");
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(replyReceived(QString,QAmqpMessage))));
+
+    QCOMPARE(spy.count(), 1);
+    QList<QVariant> arguments = spy.takeFirst();
+    QCOMPARE(arguments.at(0).toString(), correlationId);
+    QCOMPARE(arguments.at(1).value<QAmqpMessage>().payload(), QByteArray("SHOUT"));
+}
+
+void tst_QAMQPRpc::serverBoundsConcurrency()
+{
+    QThreadPool pool;
+    pool.setMaxThreadCount(8);
+
+    QAtomicInt running;
+    QAtomicInt maxRunning;
+    QAmqpRpcServer server(client.data(), "test-rpc-server-concurrency");
+    server.setThreadPool(&pool);
+    server.setPrefetchCount(100000);
+    QCOMPARE(server.prefetchCount(), 0xffff);
+    server.setPrefetchCount(3);
+    server.setHandler([&running, &maxRunning](const QAmqpMessage &request) {
+        int now = running.fetchAndAddOrdered(1) + 1;
+        int seen = maxRunning.loadAcquire();
+        while (now > seen && !maxRunning.testAndSetOrdered(seen, now))
+            seen = maxRunning.loadAcquire();
+        QThread::msleep(50);
+        running.fetchAndAddOrdered(-1);
+        return request.payload();
+    });
+    server.listen();
+    QVERIFY(waitForSignal(&server, SIGNAL(listening())));
+
+    QAmqpRpcClient rpcClient(client.data());
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(ready())));
+
+    const int callCount = 12;
+    int replies = 0;
+    connect(&rpcClient, &QAmqpRpcClient::replyReceived, [&replies, callCount]() {
+        if (++replies == callCount)
+            QTestEventLoop::instance().exitLoop();
+    });
+
+    for (int i = 0; i < callCount; ++i)
+        rpcClient.call("test-rpc-server-concurrency", QByteArray::number(i));
+
+    QTestEventLoop::instance().enterLoop(10);
+    QVERIFY(!QTestEventLoop::instance().timeout());
+    QCOMPARE(replies, callCount);
+    QVERIFY(maxRunning.loadAcquire() <= 3);
+    QVERIFY(maxRunning.loadAcquire() > 1);
+    pool.waitForDone();
+}
+
+QTEST_MAIN(tst_QAMQPRpc)
+#include "tst_qamqprpc.moc"
@@ -0,0 +1,216 @@
+#include <QtTest/QtTest>
+
+#include "qamqptable.h"
+
+// a pipe that can't seek, like a socket
+class SequentialBuffer : public QIODevice
+{
+public:
+    SequentialBuffer() { open(QIODevice::ReadWrite); }
+    bool isSequential() const { return true; }
+    qint64 bytesAvailable() const { return data.size() + QIODevice::bytesAvailable(); }
+    QByteArray data;
+
+protected:
+    qint64 readData(char *out, qint64 maxSize)
+    {
+        const qint64 size = qMin<qint64>(maxSize, data.size());
+        memcpy(out, data.constData(), size);
+        data.remove(0, size);
+        return size;
+    }
+
+    qint64 writeData(const char *in, qint64 size)
+    {
+        data.append(in, size);
+        return size;
+    }
+
+};
+
+class tst_QAMQPTable : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void empty();
+    void wireFormat();
+    void roundTrip();
+    void deeplyNested();
+    void nestedArrays();
+    void sequentialDevice();
+    void followingData();
+    void truncatedField();
+
+private:
+    QAmqpTable sample() const;
+    QAmqpTable nest(int depth) const;
+    QByteArray encode(const QAmqpTable &table) const;
+    QAmqpTable decode(const QByteArray &data) const;
+
+};
+
+QAmqpTable tst_QAMQPTable::sample() const
+{
+    QAmqpTable table;
+    table.insert("string", QLatin1String("value"));
+    table.insert("int", qint32(100000));
+    table.insert("long", qlonglong(1) << 40);
+    table.insert("bool", true);
+    table.insert("double", 2.5);
+    table.insert("bytes", QByteArray(16, 'x'));
+    table.insert("timestamp", QDateTime::fromMSecsSinceEpoch(1500000000000));
+    return table;
+}
+
+QAmqpTable tst_QAMQPTable::nest(int depth) const
+{
+    QAmqpTable table = sample();
+    if (depth > 0)
+        table.insert("child", nest(depth - 1));
+    return table;
+}
+
+QByteArray tst_QAMQPTable::encode(const QAmqpTable &table) const
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << table;
+    return data;
+}
+
+QAmqpTable tst_QAMQPTable::decode(const QByteArray &data) const
+{
+    QAmqpTable table;
+    QDataStream stream(data);
+    stream >> table;
+    return table;
+}
+
+void tst_QAMQPTable::empty()
+{
+    QCOMPARE(encode(QAmqpTable()), QByteArray(4, '\0'));
+    QVERIFY(decode(QByteArray(4, '\0')).isEmpty());
+}
+
+void tst_QAMQPTable::wireFormat()
+{
+    QAmqpTable nested;
+    nested.insert("b", QVariantList() << 1);
+    QAmqpTable table;
+    table.insert("a", nested);
+
+    // F, a table of "b" => A, an array of one short short int
+    const char expected[] = {
+        0, 0, 0, 16,
+        1, 'a', 'F', 0, 0, 0, 9,
+        1, 'b', 'A', 0, 0, 0, 2,
+        'b', 1
+    };
+    QCOMPARE(encode(table), QByteArray(expected, sizeof(expected)));
+}
+
+void tst_QAMQPTable::roundTrip()
+{
+    const QAmqpTable table = sample();
+    QAmqpTable decoded = decode(encode(table));
+    QCOMPARE(decoded.size(), table.size());
+    QCOMPARE(decoded.value("string").toString(), QString("value"));
+    QCOMPARE(decoded.value("int").toInt(), 100000);
+    QCOMPARE(decoded.value("long").toLongLong(), qlonglong(1) << 40);
+    QCOMPARE(decoded.value("bool").toBool(), true);
+    QCOMPARE(decoded.value("double").toDouble(), 2.5);
+    QCOMPARE(decoded.value("bytes").toByteArray(), QByteArray(16, 'x'));
+    QCOMPARE(decoded.value("timestamp").toDateTime().toMSecsSinceEpoch(), qint64(1500000000000));
+}
+
+void tst_QAMQPTable::deeplyNested()
+{
+    const int depth = 16;
+    QAmqpTable decoded = decode(encode(nest(depth)));
+    for (int i = 0; i < depth; ++i) {
+        QCOMPARE(decoded.size(), sample().size() + 1);
+        QCOMPARE(decoded.value("string").toString(), QString("value"));
+        decoded = decoded.value("child").toHash();
+    }
+
+    QCOMPARE(decoded.size(), sample().size());
+}
+
+void tst_QAMQPTable::nestedArrays()
+{
+    QVariantList inner;
+    inner << 1 << QLatin1String("two") << QVariant::fromValue<QVariantHash>(sample());
+    QVariantList outer;
+    outer << QVariant(inner) << QVariant(QVariantList()) << 3;
+    QAmqpTable table;
+    table.insert("array", outer);
+    table.insert("after", QLatin1String("array"));
+
+    QAmqpTable decoded = decode(encode(table));
+    QCOMPARE(decoded.value("after").toString(), QString("array"));
+    const QVariantList array = decoded.value("array").toList();
+    QCOMPARE(array.size(), 3);
+    QCOMPARE(array.at(0).toList().size(), 3);
+    QCOMPARE(array.at(0).toList().at(1).toString(), QString("two"));
+    QCOMPARE(array.at(0).toList().at(2).toHash().size(), sample().size());
+    QVERIFY(array.at(1).toList().isEmpty());
+    QCOMPARE(array.at(2).toInt(), 3);
+}
+
+void tst_QAMQPTable::sequentialDevice()
+{
+    const QAmqpTable table = nest(3);
+    SequentialBuffer device;
+    QDataStream out(&device);
+    out << table;
+
+    // same bytes as the patched encoding, and they read back the same way
+    const QByteArray expected = encode(table);
+    QCOMPARE(device.data, expected);
+
+    QDataStream in(&device);
+    QAmqpTable decoded;
+    in >> decoded;
+    QCOMPARE(decoded.size(), table.size());
+    QCOMPARE(decode(expected).value("child").toHash().size(), table.value("child").toHash().size());
+    QVERIFY(device.data.isEmpty());
+}
+
+void tst_QAMQPTable::followingData()
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out << nest(2) << quint32(0xdeadbeef) << sample();
+
+    QDataStream in(data);
+    QAmqpTable first, second;
+    quint32 marker = 0;
+    in >> first >> marker >> second;
+    QCOMPARE(first.size(), sample().size() + 1);
+    QCOMPARE(marker, quint32(0xdeadbeef));
+    QCOMPARE(second.size(), sample().size());
+    QVERIFY(in.atEnd());
+}
+
+void tst_QAMQPTable::truncatedField()
+{
+    // the field claims more than the table holds, what follows stays intact
+    const char table[] = {
+        0, 0, 0, 7,
+        1, 'a', 'S', 0, 0, 0, 100
+    };
+    QByteArray data(table, sizeof(table));
+    QDataStream out(&data, QIODevice::Append);
+    out << quint32(0xdeadbeef);
+
+    QDataStream in(data);
+    QAmqpTable decoded;
+    quint32 marker = 0;
+    in >> decoded;
+    in.resetStatus();
+    in >> marker;
+    QCOMPARE(marker, quint32(0xdeadbeef));
+}
+
+QTEST_MAIN(tst_QAMQPTable)
+#include "tst_qamqptable.moc"
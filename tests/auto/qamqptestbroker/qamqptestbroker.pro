@@ -0,0 +1,8 @@
+DEPTH = ../../..
+include($${DEPTH}/qamqp.pri)
+include($${DEPTH}/tests/tests.pri)
+
+TARGET = tst_qamqptestbroker
+SOURCES = tst_qamqptestbroker.cpp
+
+include($${DEPTH}/tests/common/qamqptestbroker.pri)
@@ -0,0 +1,259 @@
+#include <QScopedPointer>
+
+#include <QtTest/QtTest>
+#include "qamqptestcase.h"
+#include "qamqptestbroker.h"
+#include "signalspy.h"
+
+#include "qamqpclient.h"
+#include "qamqpexchange.h"
+#include "qamqpqueue.h"
+#include "qamqprpcclient.h"
+#include "qamqprpcserver.h"
+
+class tst_QAMQPTestBroker : public TestCase
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void connectAndDisconnect();
+    void defaultExchange();
+    void fanoutRouting();
+    void topicRouting_data();
+    void topicRouting();
+    void passiveDeclareNotFound();
+    void confirms();
+    void qosLimitsUnacked();
+    void rejectAndRequeue();
+    void get();
+    void directReplyTo();
+    void forcedClose();
+
+private:
+    QScopedPointer<QAmqpTestBroker> broker;
+    QScopedPointer<QAmqpClient> client;
+
+};
+
+void tst_QAMQPTestBroker::init()
+{
+    broker.reset(new QAmqpTestBroker);
+    QVERIFY(broker->listen());
+
+    client.reset(new QAmqpClient);
+    client->connectToHost(broker->address(), broker->port());
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+}
+
+void tst_QAMQPTestBroker::cleanup()
+{
+    if (client->isConnected()) {
+        client->disconnectFromHost();
+        QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    }
+
+    client.reset();
+    broker.reset();
+}
+
+void tst_QAMQPTestBroker::connectAndDisconnect()
+{
+    QCOMPARE(broker->connectionCount(), 1);
+    client->disconnectFromHost();
+    QVERIFY(waitForSignal(broker.data(), SIGNAL(clientDisconnected())));
+    QCOMPARE(broker->connectionCount(), 0);
+}
+
+void tst_QAMQPTestBroker::defaultExchange()
+{
+    QAmqpQueue *queue = client->createQueue("test-broker-default");
+    declareQueueAndVerifyConsuming(queue);
+    QVERIFY(broker->hasQueue("test-broker-default"));
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    defaultExchange->publish("first message", "test-broker-default");
+    QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+    QAmqpMessage message = queue->dequeue();
+    verifyStandardMessageHeaders(message, "test-broker-default");
+    QCOMPARE(message.payload(), QByteArray("first message"));
+}
+
+void tst_QAMQPTestBroker::fanoutRouting()
+{
+    QAmqpQueue *first = client->createQueue("test-broker-fanout-1");
+    QAmqpQueue *second = client->createQueue("test-broker-fanout-2");
+    foreach (QAmqpQueue *queue, QList<QAmqpQueue*>() << first << second) {
+        declareQueueAndVerifyConsuming(queue);
+        queue->bind("amq.fanout", "ignored");
+        QVERIFY(waitForSignal(queue, SIGNAL(bound())));
+    }
+
+    QAmqpExchange *exchange = client->createExchange("amq.fanout");
+    exchange->publish("to everyone", "whatever");
+    QVERIFY(waitForSignal(first, SIGNAL(messageReceived())));
+    if (second->isEmpty())
+        QVERIFY(waitForSignal(second, SIGNAL(messageReceived())));
+
+    QCOMPARE(first->dequeue().payload(), QByteArray("to everyone"));
+    QCOMPARE(second->dequeue().payload(), QByteArray("to everyone"));
+}
+
+void tst_QAMQPTestBroker::topicRouting_data()
+{
+    QTest::addColumn<QString>("bindingKey");
+    QTest::addColumn<QString>("routingKey");
+    QTest::addColumn<bool>("routed");
+
+    QTest::newRow("exact") << "stock.usd.nyse" << "stock.usd.nyse" << true;
+    QTest::newRow("star") << "stock.*.nyse" << "stock.eur.nyse" << true;
+    QTest::newRow("star-needs-a-word") << "stock.*.nyse" << "stock.nyse" << false;
+    QTest::newRow("hash-zero-words") << "stock.#" << "stock" << true;
+    QTest::newRow("hash-many-words") << "#.nyse" << "stock.usd.nyse" << true;
+    QTest::newRow("mismatch") << "stock.usd.*" << "bond.usd.nyse" << false;
+}
+
+void tst_QAMQPTestBroker::topicRouting()
+{
+    QFETCH(QString, bindingKey);
+    QFETCH(QString, routingKey);
+    QFETCH(bool, routed);
+
+    QAmqpExchange *exchange = client->createExchange("test-broker-topic");
+    exchange->declare(QAmqpExchange::Topic);
+    QVERIFY(waitForSignal(exchange, SIGNAL(declared())));
+
+    QAmqpQueue *queue = client->createQueue("test-broker-topic-queue");
+    declareQueueAndVerifyConsuming(queue);
+    queue->bind(exchange, bindingKey);
+    QVERIFY(waitForSignal(queue, SIGNAL(bound())));
+
+    exchange->publish("quote", routingKey);
+    QCOMPARE(waitForSignal(queue, SIGNAL(messageReceived()), 1), routed);
+
+    queue->remove(QAmqpQueue::roForce);
+    QVERIFY(waitForSignal(queue, SIGNAL(removed())));
+    exchange->remove(QAmqpExchange::roForce);
+    QVERIFY(waitForSignal(exchange, SIGNAL(removed())));
+}
+
+void tst_QAMQPTestBroker::passiveDeclareNotFound()
+{
+    QAmqpQueue *queue = client->createQueue("test-broker-missing");
+    queue->declare(QAmqpQueue::Passive);
+    QVERIFY(waitForSignal(queue, SIGNAL(error(QAMQP::Error))));
+    QCOMPARE(queue->error(), QAMQP::NotFoundError);
+}
+
+void tst_QAMQPTestBroker::confirms()
+{
+    QAmqpQueue *queue = client->createQueue("test-broker-confirms");
+    queue->declare();
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    defaultExchange->enableConfirms();
+    QVERIFY(waitForSignal(defaultExchange, SIGNAL(confirmsEnabled())));
+
+    for (int i = 0; i < 10; ++i)
+        defaultExchange->publish(QByteArray::number(i), "test-broker-confirms", "text/plain");
+    QVERIFY(defaultExchange->waitForConfirms());
+    QCOMPARE(broker->messageCount("test-broker-confirms"), 10);
+}
+
+void tst_QAMQPTestBroker::qosLimitsUnacked()
+{
+    QAmqpQueue *queue = client->createQueue("test-broker-qos");
+    queue->declare();
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+    queue->qos(2);
+    QVERIFY(waitForSignal(queue, SIGNAL(qosDefined())));
+    QVERIFY(queue->consume());
+    QVERIFY(waitForSignal(queue, SIGNAL(consuming(QString))));
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    for (int i = 0; i < 5; ++i)
+        defaultExchange->publish(QByteArray::number(i), "test-broker-qos", "text/plain");
+
+    QTest::qWait(200);
+    QCOMPARE(queue->size(), 2);
+    QCOMPARE(broker->messageCount("test-broker-qos"), 3);
+
+    queue->ack(queue->last().deliveryTag(), true);
+    queue->clear();
+    QTest::qWait(200);
+    QCOMPARE(queue->size(), 2);
+    QCOMPARE(broker->messageCount("test-broker-qos"), 1);
+}
+
+void tst_QAMQPTestBroker::rejectAndRequeue()
+{
+    QAmqpQueue *queue = client->createQueue("test-broker-requeue");
+    declareQueueAndVerifyConsuming(queue);
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    defaultExchange->publish("try again", "test-broker-requeue");
+    QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+    QAmqpMessage message = queue->dequeue();
+    QVERIFY(!message.isRedelivered());
+
+    queue->reject(message, true);
+    QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+    message = queue->dequeue();
+    QVERIFY(message.isRedelivered());
+    QCOMPARE(message.payload(), QByteArray("try again"));
+    queue->ack(message);
+}
+
+void tst_QAMQPTestBroker::get()
+{
+    QAmqpQueue *queue = client->createQueue("test-broker-get");
+    queue->declare();
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    defaultExchange->publish("fetched", "test-broker-get");
+    QTRY_COMPARE(broker->messageCount("test-broker-get"), 1);
+
+    queue->get(false);
+    QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+    QAmqpMessage message = queue->dequeue();
+    QCOMPARE(message.payload(), QByteArray("fetched"));
+    queue->ack(message);
+
+    queue->get();
+    QVERIFY(waitForSignal(queue, SIGNAL(empty())));
+}
+
+void tst_QAMQPTestBroker::directReplyTo()
+{
+    QAmqpRpcServer server(client.data(), "test-broker-rpc");
+    server.setHandler([](const QAmqpMessage &request) {
+        return request.payload().toUpper();
+    });
+    server.listen();
+    QVERIFY(waitForSignal(&server, SIGNAL(listening())));
+
+    QAmqpRpcClient rpcClient(client.data());
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(ready())));
+
+    QSignalSpy spy(&rpcClient, SIGNAL(replyReceived(QString,QAmqpMessage)));
+    QString correlationId = rpcClient.call("test-broker-rpc", "shout");
+    QVERIFY(waitForSignal(&rpcClient, SIGNAL(replyReceived(QString,QAmqpMessage))));
+    QCOMPARE(spy.count(), 1);
+    QList<QVariant> arguments = spy.takeFirst();
+    QCOMPARE(arguments.at(0).toString(), correlationId);
+    QCOMPARE(arguments.at(1).value<QAmqpMessage>().payload(), QByteArray("SHOUT"));
+}
+
+void tst_QAMQPTestBroker::forcedClose()
+{
+    client->setAutoReconnect(false);
+    broker->closeConnections();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    QCOMPARE(client->error(), QAMQP::ConnectionForcedError);
+}
+
+QTEST_MAIN(tst_QAMQPTestBroker)
+#include "tst_qamqptestbroker.moc"
@@ -0,0 +1,8 @@
+DEPTH = ../../..
+include($${DEPTH}/qamqp.pri)
+include($${DEPTH}/tests/tests.pri)
+
+TARGET = tst_qamqptracer
+SOURCES = tst_qamqptracer.cpp
+
+include($${DEPTH}/tests/common/qamqptestbroker.pri)
@@ -0,0 +1,205 @@
+#include <QScopedPointer>
+
+#include <QtTest/QtTest>
+#include "qamqptestcase.h"
+#include "qamqptestbroker.h"
+
+#include "qamqpclient.h"
+#include "qamqpexchange.h"
+#include "qamqpmetrics.h"
+#include "qamqpqueue.h"
+#include "qamqptracer.h"
+
+class RecordingTracer : public QAmqpTracer
+{
+public:
+    // replies sent from a handler end before the frame that caused them,
+    // keep the list in start order
+    virtual void frameEvent(const FrameEvent &event) {
+        int i = events.size();
+        while (i > 0 && events.at(i - 1).startTime > event.startTime)
+            --i;
+        events.insert(i, event);
+    }
+
+    int indexOf(Direction direction, FrameType type, quint16 classId = 0,
+                quint16 methodId = 0, int from = 0) const
+    {
+        for (int i = from; i < events.size(); ++i) {
+            const FrameEvent &event = events.at(i);
+            if (event.direction == direction && event.frameType == type &&
+                event.classId == classId && event.methodId == methodId)
+                return i;
+        }
+
+        return -1;
+    }
+
+    QList<FrameEvent> events;
+};
+
+class tst_QAMQPTracer : public TestCase
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void noTracerByDefault();
+    void handshake();
+    void publishAndDeliver();
+    void timestamps();
+    void sizesMatchMetrics();
+    void removeTracer();
+
+private:
+    void connectClient();
+
+    QScopedPointer<QAmqpTestBroker> broker;
+    QScopedPointer<QAmqpClient> client;
+    RecordingTracer tracer;
+
+};
+
+void tst_QAMQPTracer::init()
+{
+    broker.reset(new QAmqpTestBroker);
+    QVERIFY(broker->listen());
+
+    tracer.events.clear();
+    client.reset(new QAmqpClient);
+    client->setTracer(&tracer);
+}
+
+void tst_QAMQPTracer::cleanup()
+{
+    if (client->isConnected()) {
+        client->disconnectFromHost();
+        QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    }
+
+    client.reset();
+    broker.reset();
+}
+
+void tst_QAMQPTracer::connectClient()
+{
+    client->connectToHost(broker->address(), broker->port());
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+}
+
+void tst_QAMQPTracer::noTracerByDefault()
+{
+    QAmqpClient plain;
+    QVERIFY(!plain.tracer());
+    QCOMPARE(client->tracer(), static_cast<QAmqpTracer*>(&tracer));
+}
+
+void tst_QAMQPTracer::handshake()
+{
+    connectClient();
+
+    const int start = tracer.indexOf(QAmqpTracer::Received, QAmqpTracer::MethodFrame, 10, 10);
+    const int startOk = tracer.indexOf(QAmqpTracer::Sent, QAmqpTracer::MethodFrame, 10, 11, start);
+    const int tune = tracer.indexOf(QAmqpTracer::Received, QAmqpTracer::MethodFrame, 10, 30, startOk);
+    const int tuneOk = tracer.indexOf(QAmqpTracer::Sent, QAmqpTracer::MethodFrame, 10, 31, tune);
+    const int open = tracer.indexOf(QAmqpTracer::Sent, QAmqpTracer::MethodFrame, 10, 40, tuneOk);
+    const int openOk = tracer.indexOf(QAmqpTracer::Received, QAmqpTracer::MethodFrame, 10, 41, open);
+    QCOMPARE(start, 0);
+    QVERIFY(startOk > start);
+    QVERIFY(tune > startOk);
+    QVERIFY(tuneOk > tune);
+    QVERIFY(open > tuneOk);
+    QVERIFY(openOk > open);
+
+    for (int i = 0; i <= openOk; ++i)
+        QCOMPARE(tracer.events.at(i).channel, quint16(0));
+}
+
+void tst_QAMQPTracer::publishAndDeliver()
+{
+    connectClient();
+    QAmqpQueue *queue = client->createQueue("test-tracer");
+    declareQueueAndVerifyConsuming(queue);
+
+    const QByteArray payload(100, 'x');
+    QAmqpExchange *defaultExchange = client->createExchange();
+    tracer.events.clear();
+    defaultExchange->publish(payload, "test-tracer");
+    QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+
+    // basic.publish, content header and body out, then basic.deliver in
+    const int publish = tracer.indexOf(QAmqpTracer::Sent, QAmqpTracer::MethodFrame, 60, 40);
+    QVERIFY(publish >= 0);
+    const QAmqpTracer::FrameEvent &publishEvent = tracer.events.at(publish);
+    QCOMPARE(publishEvent.channel, quint16(defaultExchange->channelNumber()));
+
+    const int header = tracer.indexOf(QAmqpTracer::Sent, QAmqpTracer::HeaderFrame, 60, 0, publish);
+    const int body = tracer.indexOf(QAmqpTracer::Sent, QAmqpTracer::BodyFrame, 0, 0, header);
+    QCOMPARE(header, publish + 1);
+    QCOMPARE(body, header + 1);
+    QCOMPARE(tracer.events.at(body).size, qint64(payload.size() + 8));
+
+    const int deliver = tracer.indexOf(QAmqpTracer::Received, QAmqpTracer::MethodFrame, 60, 60);
+    QVERIFY(deliver > body);
+    QCOMPARE(tracer.events.at(deliver).channel, quint16(queue->channelNumber()));
+    const int deliveredBody = tracer.indexOf(QAmqpTracer::Received, QAmqpTracer::BodyFrame, 0, 0, deliver);
+    QVERIFY(deliveredBody > deliver);
+    QCOMPARE(tracer.events.at(deliveredBody).size, qint64(payload.size() + 8));
+}
+
+void tst_QAMQPTracer::timestamps()
+{
+    connectClient();
+    QVERIFY(!tracer.events.isEmpty());
+
+    const qint64 now = QAmqpTracer::now();
+    foreach (const QAmqpTracer::FrameEvent &event, tracer.events) {
+        QVERIFY(event.startTime > 0);
+        QVERIFY(event.endTime >= event.startTime);
+        QVERIFY(event.endTime <= now);
+    }
+
+    // tune-ok is sent while tune is dispatched, so its span nests inside
+    const int tune = tracer.indexOf(QAmqpTracer::Received, QAmqpTracer::MethodFrame, 10, 30);
+    const int tuneOk = tracer.indexOf(QAmqpTracer::Sent, QAmqpTracer::MethodFrame, 10, 31);
+    QVERIFY(tune >= 0 && tuneOk > tune);
+    QVERIFY(tracer.events.at(tuneOk).startTime >= tracer.events.at(tune).startTime);
+    QVERIFY(tracer.events.at(tuneOk).endTime <= tracer.events.at(tune).endTime);
+}
+
+void tst_QAMQPTracer::sizesMatchMetrics()
+{
+    connectClient();
+    QAmqpQueue *queue = client->createQueue("test-tracer-sizes");
+    declareQueueAndVerifyConsuming(queue);
+    client->createExchange()->publish(QByteArray(1000, 'y'), "test-tracer-sizes");
+    QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+
+    qint64 received = 0, sent = 0;
+    foreach (const QAmqpTracer::FrameEvent &event, tracer.events) {
+        if (event.direction == QAmqpTracer::Received)
+            received += event.size;
+        else
+            sent += event.size;
+    }
+
+    QAmqpMetrics metrics = client->metrics();
+    QCOMPARE(quint64(received), metrics.bytesReceived());
+    QCOMPARE(quint64(sent), metrics.bytesSent());
+}
+
+void tst_QAMQPTracer::removeTracer()
+{
+    connectClient();
+    client->setTracer(0);
+    QVERIFY(!client->tracer());
+
+    const int eventCount = tracer.events.size();
+    QAmqpQueue *queue = client->createQueue("test-tracer-removed");
+    declareQueueAndVerifyConsuming(queue);
+    QCOMPARE(tracer.events.size(), eventCount);
+}
+
+QTEST_MAIN(tst_QAMQPTracer)
+#include "tst_qamqptracer.moc"
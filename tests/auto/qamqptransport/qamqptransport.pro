@@ -0,0 +1,9 @@
+DEPTH = ../../..
+include($${DEPTH}/qamqp.pri)
+include($${DEPTH}/tests/tests.pri)
+
+TARGET = tst_qamqptransport
+SOURCES = tst_qamqptransport.cpp
+
+include($${DEPTH}/tests/common/qamqptestbroker.pri)
+include($${DEPTH}/tests/common/qamqpfaulttransport.pri)
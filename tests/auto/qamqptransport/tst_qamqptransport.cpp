@@ -0,0 +1,396 @@
+#include <QElapsedTimer>
+#include <QScopedPointer>
+
+#include <QtTest/QtTest>
+#include "qamqptestcase.h"
+#include "qamqptestbroker.h"
+#include "qamqpfaulttransport.h"
+
+#include "qamqpclient.h"
+#include "qamqpexchange.h"
+#include "qamqpmetrics.h"
+#include "qamqpqueue.h"
+#include "qamqpreconnectpolicy.h"
+
+class tst_QAMQPTransport : public TestCase
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void defaultTransport();
+    void replaceWhileConnected();
+    void fragmentedReads_data();
+    void fragmentedReads();
+    void partialWrites();
+    void largeBodiesInPieces_data();
+    void largeBodiesInPieces();
+    void readBudget_data();
+    void readBudget();
+    void autoTuneFrameMax();
+    void latency();
+    void bandwidth();
+    void dropConnection();
+    void disconnectAfterBytes();
+    void heartbeatsWhileIdle();
+    void heartbeatsSuppressedWhenBusy();
+    void missedHeartbeats();
+    void reconnectPolicy();
+    void reconnectGivesUp();
+    void reconnectAttemptsReset();
+
+private:
+    void connectClient();
+    void roundTrip(int messageCount, int payloadSize);
+
+    QScopedPointer<QAmqpTestBroker> broker;
+    QScopedPointer<QAmqpClient> client;
+    QAmqpFaultTransport *transport;
+
+};
+
+void tst_QAMQPTransport::init()
+{
+    broker.reset(new QAmqpTestBroker);
+    QVERIFY(broker->listen());
+
+    client.reset(new QAmqpClient);
+    transport = new QAmqpFaultTransport;
+    QVERIFY(client->setTransport(transport));
+    QCOMPARE(client->transport(), static_cast<QAmqpTransport*>(transport));
+}
+
+void tst_QAMQPTransport::cleanup()
+{
+    if (client->isConnected()) {
+        client->disconnectFromHost();
+        QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    }
+
+    client.reset();
+    broker.reset();
+}
+
+void tst_QAMQPTransport::connectClient()
+{
+    client->connectToHost(broker->address(), broker->port());
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+}
+
+void tst_QAMQPTransport::roundTrip(int messageCount, int payloadSize)
+{
+    QAmqpQueue *queue = client->createQueue("test-transport");
+    declareQueueAndVerifyConsuming(queue);
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    for (int i = 0; i < messageCount; ++i)
+        defaultExchange->publish(QByteArray(payloadSize, 'a' + i % 26), "test-transport");
+
+    for (int i = 0; i < messageCount; ++i) {
+        if (queue->isEmpty())
+            QVERIFY(waitForSignal(queue, SIGNAL(messageReceived())));
+        QAmqpMessage message = queue->dequeue();
+        QCOMPARE(message.payload(), QByteArray(payloadSize, 'a' + i % 26));
+    }
+}
+
+void tst_QAMQPTransport::defaultTransport()
+{
+    QAmqpClient plain;
+    QVERIFY(qobject_cast<QAmqpSocketTransport*>(plain.transport()));
+    QVERIFY(qobject_cast<QAmqpSocketTransport*>(transport->inner()));
+}
+
+void tst_QAMQPTransport::replaceWhileConnected()
+{
+    connectClient();
+    QAmqpFaultTransport other;
+    QTest::ignoreMessage(QtWarningMsg,
+                         "QAmqpClient::setTransport: cannot replace the transport of an open connection");
+    QVERIFY(!client->setTransport(&other));
+    QCOMPARE(client->transport(), static_cast<QAmqpTransport*>(transport));
+}
+
+void tst_QAMQPTransport::fragmentedReads_data()
+{
+    QTest::addColumn<int>("maxReadFragment");
+    QTest::newRow("1 byte") << 1;
+    QTest::newRow("7 bytes") << 7;
+    QTest::newRow("frame header") << 8;
+    QTest::newRow("100 bytes") << 100;
+}
+
+void tst_QAMQPTransport::fragmentedReads()
+{
+    QFETCH(int, maxReadFragment);
+    transport->setMaxReadFragment(maxReadFragment);
+    connectClient();
+    roundTrip(20, 300);
+}
+
+void tst_QAMQPTransport::partialWrites()
+{
+    transport->setMaxWriteChunk(3);
+    connectClient();
+    roundTrip(10, 1000);
+    QVERIFY(transport->bytesSent() > 10 * 1000);
+}
+
+void tst_QAMQPTransport::largeBodiesInPieces_data()
+{
+    QTest::addColumn<int>("maxReadFragment");
+    QTest::addColumn<int>("payloadSize");
+    QTest::newRow("one frame") << 1000 << 100000;
+    QTest::newRow("several frames") << 1000 << 300000;
+    QTest::newRow("odd fragments") << 997 << 300000;
+    QTest::newRow("whole reads") << 0 << 300000;
+}
+
+void tst_QAMQPTransport::largeBodiesInPieces()
+{
+    QFETCH(int, maxReadFragment);
+    QFETCH(int, payloadSize);
+    transport->setMaxReadFragment(maxReadFragment);
+    connectClient();
+
+    // bodies read as they arrive still count as whole frames
+    const quint64 bodyFrames = client->metrics().framesReceived(QAmqpMetrics::BodyFrame);
+    roundTrip(3, payloadSize);
+    const int chunkSize = AMQP_FRAME_MAX - 8;
+    const int framesPerMessage = (payloadSize + chunkSize - 1) / chunkSize;
+    QCOMPARE(client->metrics().framesReceived(QAmqpMetrics::BodyFrame) - bodyFrames,
+             quint64(3 * framesPerMessage));
+}
+
+void tst_QAMQPTransport::readBudget_data()
+{
+    QTest::addColumn<int>("frames");
+    QTest::addColumn<qint64>("bytes");
+    QTest::addColumn<int>("payloadSize");
+    QTest::newRow("one frame") << 1 << qint64(0) << 100;
+    QTest::newRow("few bytes") << 0 << qint64(1) << 100;
+    QTest::newRow("large bodies") << 2 << qint64(0) << 100000;
+}
+
+void tst_QAMQPTransport::readBudget()
+{
+    QFETCH(int, frames);
+    QFETCH(qint64, bytes);
+    QFETCH(int, payloadSize);
+    client->setReadFrameBudget(frames);
+    client->setReadByteBudget(bytes);
+    QCOMPARE(client->readFrameBudget(), frames);
+    QCOMPARE(client->readByteBudget(), bytes);
+    connectClient();
+
+    // everything still arrives, in order, only spread over more iterations
+    roundTrip(50, payloadSize);
+    QVERIFY(client->metrics().readBudgetExhausted() > 0);
+}
+
+void tst_QAMQPTransport::autoTuneFrameMax()
+{
+    broker->setFrameMax(1024 * 1024);
+    client->setAutoTuneFrameMax(true);
+    QVERIFY(client->autoTuneFrameMax());
+    connectClient();
+
+    // nothing seen yet, the default stands even though the broker offers more
+    QCOMPARE(client->frameMax(), qint32(AMQP_FRAME_MAX));
+    QVERIFY(transport->sendBufferSize() > 0);
+    QVERIFY(transport->receiveBufferSize() > 0);
+    roundTrip(5, 300000);
+
+    // the next connection fits those bodies in one frame and no more
+    client->disconnectFromHost();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    connectClient();
+    QCOMPARE(client->frameMax(), qint32(512 * 1024 + 8));
+
+    // and never goes past what the broker offers
+    client->disconnectFromHost();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    broker->setFrameMax(65536);
+    connectClient();
+    QCOMPARE(client->frameMax(), qint32(65536));
+}
+
+void tst_QAMQPTransport::latency()
+{
+    transport->setLatency(100);
+    QElapsedTimer timer;
+    timer.start();
+    connectClient();
+
+    // handshake and connected signal take several trips across the link
+    QVERIFY(timer.elapsed() >= 300);
+    roundTrip(5, 100);
+}
+
+void tst_QAMQPTransport::bandwidth()
+{
+    connectClient();
+    transport->setBandwidth(200 * 1024);
+
+    QElapsedTimer timer;
+    timer.start();
+    roundTrip(10, 10 * 1024);
+
+    // 100KiB each way over a 200KiB/s link
+    QVERIFY(timer.elapsed() >= 400);
+}
+
+void tst_QAMQPTransport::dropConnection()
+{
+    client->setAutoReconnect(true);
+    connectClient();
+
+    transport->dropConnection();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    QCOMPARE(client->socketError(), QAbstractSocket::RemoteHostClosedError);
+    QVERIFY(!client->isConnected());
+
+    // reconnects on its own
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+    QVERIFY(client->isConnected());
+    QCOMPARE(broker->connectionCount(), 1);
+}
+
+void tst_QAMQPTransport::disconnectAfterBytes()
+{
+    client->setAutoReconnect(false);
+    connectClient();
+
+    QAmqpQueue *queue = client->createQueue("test-transport-cut");
+    declareQueueAndVerifyConsuming(queue);
+
+    // cut the link part way into the next delivery
+    transport->setDisconnectAfter(20);
+    client->createExchange()->publish(QByteArray(500, 'x'), "test-transport-cut");
+    QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    QVERIFY(queue->isEmpty());
+}
+
+void tst_QAMQPTransport::heartbeatsWhileIdle()
+{
+    broker->setHeartbeat(1);
+    connectClient();
+    QCOMPARE(int(client->heartbeatDelay()), 1);
+
+    // one heartbeat per interval, and the broker's keep the link alive
+    QTest::qWait(3200);
+    QVERIFY(client->isConnected());
+    const quint64 heartbeats = client->metrics().framesSent(QAmqpMetrics::HeartbeatFrame);
+    QVERIFY(heartbeats >= 2);
+    QVERIFY(heartbeats <= 4);
+}
+
+void tst_QAMQPTransport::heartbeatsSuppressedWhenBusy()
+{
+    broker->setHeartbeat(1);
+    connectClient();
+
+    QAmqpExchange *defaultExchange = client->createExchange();
+    QVERIFY(waitForSignal(defaultExchange, SIGNAL(opened())));
+    QTimer publisher;
+    connect(&publisher, &QTimer::timeout, [defaultExchange]() {
+        defaultExchange->publish("busy", "test-transport-unrouted");
+    });
+    publisher.start(100);
+
+    QTest::qWait(3200);
+    publisher.stop();
+    QVERIFY(client->isConnected());
+    QCOMPARE(client->metrics().framesSent(QAmqpMetrics::HeartbeatFrame), quint64(0));
+}
+
+void tst_QAMQPTransport::missedHeartbeats()
+{
+    broker->setHeartbeat(1);
+    client->setAutoReconnect(true);
+    connectClient();
+
+    qRegisterMetaType<QAbstractSocket::SocketError>();
+    QSignalSpy errorSpy(client.data(), SIGNAL(socketErrorOccurred(QAbstractSocket::SocketError)));
+    QElapsedTimer timer;
+    timer.start();
+    transport->setStalled(true);
+
+    // given up on after two silent intervals, long before tcp keepalive
+    QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    QVERIFY(timer.elapsed() >= 1000);
+    QVERIFY(timer.elapsed() < 4000);
+    QCOMPARE(errorSpy.count(), 1);
+    QCOMPARE(errorSpy.first().at(0).value<QAbstractSocket::SocketError>(),
+             QAbstractSocket::SocketTimeoutError);
+
+    // and reconnects without the error backoff
+    timer.restart();
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+    QVERIFY(timer.elapsed() < 1000);
+    QVERIFY(!transport->isStalled());
+}
+
+void tst_QAMQPTransport::reconnectPolicy()
+{
+    QCOMPARE(client->reconnectPolicy(), QAmqpReconnectPolicy());
+
+    client->setAutoReconnect(true, 250);
+    QCOMPARE(client->reconnectPolicy(), QAmqpReconnectPolicy::fixed(250));
+    client->setAutoReconnect(true);
+    QCOMPARE(client->reconnectPolicy(), QAmqpReconnectPolicy());
+
+    // an explicit policy survives toggling auto reconnect
+    QAmqpReconnectPolicy policy = QAmqpReconnectPolicy::exponential(50, 500);
+    client->setReconnectPolicy(policy);
+    client->setAutoReconnect(false);
+    client->setAutoReconnect(true);
+    QCOMPARE(client->reconnectPolicy(), policy);
+}
+
+void tst_QAMQPTransport::reconnectGivesUp()
+{
+    client->setAutoReconnect(true);
+    client->setReconnectPolicy(QAmqpReconnectPolicy::exponential(20, 60, 2.0,
+                               QAmqpReconnectPolicy::NoJitter, 3));
+    connectClient();
+
+    QSignalSpy spy(client.data(), SIGNAL(reconnecting(int,int)));
+    broker->close();
+    transport->dropConnection();
+
+    // refused every time, spaced 20, 40 and then 60 capped
+    QTRY_COMPARE(spy.count(), 3);
+    QTest::qWait(300);
+    QCOMPARE(spy.count(), 3);
+    for (int i = 0; i < spy.count(); ++i)
+        QCOMPARE(spy.at(i).at(0).toInt(), i + 1);
+    QCOMPARE(spy.at(0).at(1).toInt(), 20);
+    QCOMPARE(spy.at(1).at(1).toInt(), 40);
+    QCOMPARE(spy.at(2).at(1).toInt(), 60);
+    QVERIFY(!client->isConnected());
+}
+
+void tst_QAMQPTransport::reconnectAttemptsReset()
+{
+    client->setAutoReconnect(true);
+    client->setReconnectPolicy(QAmqpReconnectPolicy::exponential(20, 1000, 2.0,
+                               QAmqpReconnectPolicy::NoJitter));
+    connectClient();
+
+    QSignalSpy spy(client.data(), SIGNAL(reconnecting(int,int)));
+    for (int i = 0; i < 2; ++i) {
+        transport->dropConnection();
+        QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+    }
+
+    // each outage starts over at the first attempt
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(spy.at(0).at(0).toInt(), 1);
+    QCOMPARE(spy.at(1).at(0).toInt(), 1);
+    QCOMPARE(spy.at(1).at(1).toInt(), 20);
+}
+
+QTEST_MAIN(tst_QAMQPTransport)
+#include "tst_qamqptransport.moc"
@@ -0,0 +1,8 @@
+include($${DEPTH}/tests/tests.pri)
+
+# benchmarks are run on demand rather than as part of "make check"
+CONFIG -= testcase
+
+# machine readable results, one xml report per suite
+benchmark.commands = ./$(QMAKE_TARGET) -o $(QMAKE_TARGET).xml,xml
+QMAKE_EXTRA_TARGETS += benchmark
@@ -0,0 +1,13 @@
+TEMPLATE = subdirs
+SUBDIRS = \
+    qamqpallocations \
+    qamqpdegraded \
+    qamqpframe \
+    qamqplogging \
+    qamqpparser \
+    qamqprpc \
+    qamqpthroughput
+
+# "make benchmark" runs every suite and leaves QtTest xml results behind
+benchmark.CONFIG = recursive
+QMAKE_EXTRA_TARGETS += benchmark
@@ -0,0 +1,173 @@
+#include <QBuffer>
+
+#include <QtTest/QtTest>
+
+#include "qamqpclient.h"
+#include "qamqpclient_p.h"
+#include "qamqpframe_p.h"
+#include "qamqpmessage.h"
+#include "qamqpqueue.h"
+
+/*
+ * Counts heap allocations by standing in for the C allocator, which both
+ * operator new and Qt's containers end up in. Only glibc exposes the real
+ * allocator under another name, elsewhere the suite skips.
+ */
+#if defined(__GLIBC__)
+#define QAMQP_COUNT_ALLOCATIONS
+
+static QAtomicInteger<quint64> allocations;
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    allocations.fetchAndAddRelaxed(1);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    allocations.fetchAndAddRelaxed(1);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocations.fetchAndAddRelaxed(1);
+    return __libc_realloc(ptr, size);
+}
+}
+#endif
+
+class BenchClient : public QAmqpClient
+{
+public:
+    QAmqpClientPrivate *d() const { return d_ptr.data(); }
+};
+
+class tst_BenchQAMQPAllocations : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+
+    void deliveries_data();
+    void deliveries();
+    void messages();
+
+private:
+    QByteArray deliveries(quint16 channel, int count, int payloadSize, bool properties) const;
+
+};
+
+void tst_BenchQAMQPAllocations::initTestCase()
+{
+#ifndef QAMQP_COUNT_ALLOCATIONS
+    QSKIP("allocations can only be counted with glibc");
+#endif
+    QAmqpFrame::setWriteTimeout(-2);
+}
+
+QByteArray tst_BenchQAMQPAllocations::deliveries(quint16 channel, int count, int payloadSize,
+                                                bool properties) const
+{
+    QByteArray wire;
+    QDataStream out(&wire, QIODevice::WriteOnly);
+    for (int i = 0; i < count; ++i) {
+        QAmqpMethodFrame deliver(QAmqpFrame::Basic, 60);
+        deliver.setChannel(channel);
+        QByteArray arguments;
+        QDataStream args(&arguments, QIODevice::WriteOnly);
+        QAmqpFrame::writeAmqpField(args, QAmqpMetaType::ShortString, QLatin1String("amq.ctag-bench"));
+        args << qlonglong(i + 1);
+        args << qint8(0);
+        QAmqpFrame::writeAmqpField(args, QAmqpMetaType::ShortString, QLatin1String("amq.topic"));
+        QAmqpFrame::writeAmqpField(args, QAmqpMetaType::ShortString, QLatin1String("bench.key"));
+        deliver.setArguments(arguments);
+        out << deliver;
+
+        QAmqpContentFrame header(QAmqpFrame::Basic);
+        header.setChannel(channel);
+        header.setBodySize(payloadSize);
+        if (properties)
+            header.setProperty(QAmqpMessage::DeliveryMode, 2);
+        out << header;
+
+        if (payloadSize) {
+            QAmqpContentBodyFrame body;
+            body.setChannel(channel);
+            body.setBody(QByteArray(payloadSize, 'p'));
+            out << body;
+        }
+    }
+
+    return wire;
+}
+
+void tst_BenchQAMQPAllocations::deliveries_data()
+{
+    QTest::addColumn<int>("payloadSize");
+    QTest::addColumn<bool>("properties");
+    QTest::newRow("empty") << 0 << false;
+    QTest::newRow("16B") << 16 << false;
+    QTest::newRow("16B-properties") << 16 << true;
+    QTest::newRow("1KiB") << 1024 << false;
+    QTest::newRow("64KiB") << 65536 << false;
+}
+
+void tst_BenchQAMQPAllocations::deliveries()
+{
+#ifdef QAMQP_COUNT_ALLOCATIONS
+    QFETCH(int, payloadSize);
+    QFETCH(bool, properties);
+    const int count = 1000;
+
+    BenchClient client;
+    QAmqpQueue *queue = client.createQueue(QLatin1String("bench-queue"));
+    queue->setConsumerTag(QLatin1String("amq.ctag-bench"));
+    QByteArray wire = deliveries(queue->channelNumber(), count, payloadSize, properties);
+
+    // the first pass sizes the connection's buffers, the second is counted
+    quint64 counted = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        QBuffer device(&wire);
+        device.open(QIODevice::ReadOnly);
+
+        const quint64 before = allocations.loadAcquire();
+        client.d()->readFrames(&device);
+        const quint64 after = allocations.loadAcquire();
+        counted = after - before;
+
+        QCOMPARE(queue->size(), count);
+        while (!queue->isEmpty())
+            queue->dequeue();
+    }
+
+    QTest::setBenchmarkResult(qreal(counted) / count, QTest::Events);
+#endif
+}
+
+void tst_BenchQAMQPAllocations::messages()
+{
+#ifdef QAMQP_COUNT_ALLOCATIONS
+    // released privates are handed out again
+    for (int i = 0; i < 10; ++i)
+        QAmqpMessage message;
+
+    const quint64 before = allocations.loadAcquire();
+    for (int i = 0; i < 1000; ++i) {
+        QAmqpMessage message;
+        QAmqpMessage copy = message;
+        Q_UNUSED(copy);
+    }
+
+    QTest::setBenchmarkResult(qreal(allocations.loadAcquire() - before) / 1000, QTest::Events);
+#endif
+}
+
+QTEST_MAIN(tst_BenchQAMQPAllocations)
+#include "tst_bench_qamqpallocations.moc"
@@ -0,0 +1,9 @@
+DEPTH = ../../..
+include($${DEPTH}/qamqp.pri)
+include($${DEPTH}/tests/bench/bench.pri)
+
+TARGET = tst_bench_qamqpdegraded
+SOURCES = tst_bench_qamqpdegraded.cpp
+
+include($${DEPTH}/tests/common/qamqptestbroker.pri)
+include($${DEPTH}/tests/common/qamqpfaulttransport.pri)
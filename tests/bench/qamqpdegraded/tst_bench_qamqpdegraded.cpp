@@ -0,0 +1,136 @@
+#include <QScopedPointer>
+
+#include <QtTest/QtTest>
+#include "qamqptestcase.h"
+#include "qamqptestbroker.h"
+#include "qamqpfaulttransport.h"
+
+#include "qamqpclient.h"
+#include "qamqpexchange.h"
+#include "qamqpqueue.h"
+
+class tst_BenchQAMQPDegraded : public TestCase
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void publishConsume_data();
+    void publishConsume();
+    void reconnectTime_data();
+    void reconnectTime();
+
+private:
+    QAmqpTestBroker broker;
+    QScopedPointer<QAmqpClient> client;
+    QAmqpFaultTransport *transport;
+
+};
+
+void tst_BenchQAMQPDegraded::initTestCase()
+{
+    QVERIFY(broker.listen());
+}
+
+void tst_BenchQAMQPDegraded::init()
+{
+    client.reset(new QAmqpClient);
+    transport = new QAmqpFaultTransport;
+    client->setTransport(transport);
+    client->connectToHost(broker.address(), broker.port());
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+}
+
+void tst_BenchQAMQPDegraded::cleanup()
+{
+    if (client->isConnected()) {
+        client->disconnectFromHost();
+        QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    }
+
+    client.reset();
+}
+
+void tst_BenchQAMQPDegraded::publishConsume_data()
+{
+    QTest::addColumn<int>("latency");
+    QTest::addColumn<int>("bandwidth");
+    QTest::addColumn<int>("maxReadFragment");
+    QTest::addColumn<int>("maxWriteChunk");
+    QTest::newRow("clean") << 0 << 0 << 0 << 0;
+    QTest::newRow("fragmented reads") << 0 << 0 << 16 << 0;
+    QTest::newRow("partial writes") << 0 << 0 << 0 << 64;
+    QTest::newRow("20ms latency") << 20 << 0 << 0 << 0;
+    QTest::newRow("4MiB/s") << 0 << 4 * 1024 * 1024 << 0 << 0;
+}
+
+void tst_BenchQAMQPDegraded::publishConsume()
+{
+    QFETCH(int, latency);
+    QFETCH(int, bandwidth);
+    QFETCH(int, maxReadFragment);
+    QFETCH(int, maxWriteChunk);
+    const int messageCount = 1000;
+    const QByteArray payload(1024, 'p');
+
+    QAmqpQueue *queue = client->createQueue("bench-degraded");
+    queue->declare(QAmqpQueue::Exclusive | QAmqpQueue::AutoDelete);
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+    QVERIFY(queue->consume(QAmqpQueue::coNoAck));
+    QVERIFY(waitForSignal(queue, SIGNAL(consuming(QString))));
+    QAmqpExchange *defaultExchange = client->createExchange();
+
+    transport->setLatency(latency);
+    transport->setBandwidth(bandwidth);
+    transport->setMaxReadFragment(maxReadFragment);
+    transport->setMaxWriteChunk(maxWriteChunk);
+
+    int received = 0;
+    QMetaObject::Connection connection =
+        connect(queue, &QAmqpQueue::messageReceived, [queue, &received, messageCount]() {
+        while (!queue->isEmpty()) {
+            queue->dequeue();
+            ++received;
+        }
+
+        if (received == messageCount)
+            QTestEventLoop::instance().exitLoop();
+    });
+
+    QBENCHMARK {
+        received = 0;
+        for (int i = 0; i < messageCount; ++i)
+            defaultExchange->publish(payload, "bench-degraded");
+
+        QTestEventLoop::instance().enterLoop(60);
+        QVERIFY(!QTestEventLoop::instance().timeout());
+        QCOMPARE(received, messageCount);
+    }
+
+    disconnect(connection);
+}
+
+void tst_BenchQAMQPDegraded::reconnectTime_data()
+{
+    QTest::addColumn<int>("latency");
+    QTest::newRow("0ms") << 0;
+    QTest::newRow("5ms") << 5;
+}
+
+void tst_BenchQAMQPDegraded::reconnectTime()
+{
+    QFETCH(int, latency);
+    client->setAutoReconnect(true, 1);
+    transport->setLatency(latency);
+
+    // from an abrupt drop to a reopened connection
+    QBENCHMARK {
+        transport->dropConnection();
+        QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+    }
+}
+
+QTEST_MAIN(tst_BenchQAMQPDegraded)
+#include "tst_bench_qamqpdegraded.moc"
@@ -0,0 +1,259 @@
+#include <QDateTime>
+
+#include <QtTest/QtTest>
+
+#include "qamqpframe_p.h"
+#include "qamqproutingkey.h"
+#include "qamqptable.h"
+
+class tst_BenchQAMQPFrame : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+
+    void methodFrameSerialise();
+    void methodFrameDeserialise();
+    void publishArguments_data();
+    void publishArguments();
+    void bodyFrameSerialise_data();
+    void bodyFrameSerialise();
+    void tableEncode_data();
+    void tableEncode();
+    void tableDecode_data();
+    void tableDecode();
+    void contentHeaderEncode_data();
+    void contentHeaderEncode();
+
+private:
+    QAmqpMethodFrame publishFrame() const;
+    QAmqpTable table(const QString &shape) const;
+
+};
+
+void tst_BenchQAMQPFrame::initTestCase()
+{
+    // a QBuffer never blocks, skip the waitForBytesWritten call entirely
+    QAmqpFrame::setWriteTimeout(-2);
+}
+
+QAmqpMethodFrame tst_BenchQAMQPFrame::publishFrame() const
+{
+    QAmqpMethodFrame frame(QAmqpFrame::Basic, 40);
+    frame.setChannel(1);
+
+    QByteArray arguments;
+    QDataStream out(&arguments, QIODevice::WriteOnly);
+    out << qint16(0);   //reserved 1
+    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, QLatin1String("bench.exchange"));
+    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, QLatin1String("bench.routing.key"));
+    out << qint8(0);
+    frame.setArguments(arguments);
+    return frame;
+}
+
+QAmqpTable tst_BenchQAMQPFrame::table(const QString &shape) const
+{
+    QAmqpTable table;
+    table.insert("x-message-ttl", qint32(60000));
+    table.insert("x-dead-letter-exchange", QLatin1String("bench.dlx"));
+    table.insert("persistent", true);
+    if (shape == QLatin1String("flat"))
+        return table;
+
+    QAmqpTable nested;
+    nested.insert("publish", true);
+    nested.insert("consumer_cancel_notify", true);
+    nested.insert("connection.blocked", true);
+    table.insert("capabilities", nested);
+
+    QVariantList array;
+    array.append(qint32(1));
+    array.append(QLatin1String("two"));
+    array.append(3.0);
+    table.insert("array", array);
+    table.insert("timestamp", QDateTime::fromMSecsSinceEpoch(1500000000000));
+    table.insert("bytes", QByteArray(64, 'x'));
+    if (shape == QLatin1String("nested"))
+        return table;
+
+    // tracing headers: a span context nested a few levels down
+    QAmqpTable span = table;
+    for (int i = 0; i < 6; ++i) {
+        QAmqpTable parent;
+        parent.insert("span-id", QString::number(i));
+        parent.insert("sampled", true);
+        parent.insert("parent", span);
+        span = parent;
+    }
+
+    table.insert("trace", span);
+    return table;
+}
+
+void tst_BenchQAMQPFrame::methodFrameSerialise()
+{
+    QAmqpMethodFrame frame = publishFrame();
+    QByteArray data;
+    QBENCHMARK {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << frame;
+    }
+
+    QCOMPARE(data.size(), int(QAmqpFrame::HEADER_SIZE + frame.size() + QAmqpFrame::FRAME_END_SIZE));
+}
+
+void tst_BenchQAMQPFrame::publishArguments_data()
+{
+    QTest::addColumn<bool>("preEncoded");
+    QTest::newRow("strings") << false;
+    QTest::newRow("pre-encoded") << true;
+}
+
+void tst_BenchQAMQPFrame::publishArguments()
+{
+    QFETCH(bool, preEncoded);
+    const QString exchange = QLatin1String("bench.exchange");
+    const QString routingKey = QLatin1String("bench.routing.key");
+    const QByteArray encodedExchange = QAmqpFrame::encodeShortString(exchange);
+    const QAmqpRoutingKey key(routingKey);
+
+    QByteArray arguments;
+    QBENCHMARK {
+        arguments.clear();
+        QDataStream out(&arguments, QIODevice::WriteOnly);
+        out << qint16(0);
+        if (preEncoded) {
+            QAmqpFrame::writeEncoded(out, encodedExchange);
+            QAmqpFrame::writeEncoded(out, key.encoded());
+        } else {
+            QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, exchange);
+            QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, routingKey);
+        }
+        out << qint8(0);
+    }
+
+    QCOMPARE(arguments.size(), 2 + 1 + exchange.size() + 1 + routingKey.size() + 1);
+}
+
+void tst_BenchQAMQPFrame::methodFrameDeserialise()
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out << publishFrame();
+
+    QAmqpMethodFrame frame;
+    QBENCHMARK {
+        QDataStream stream(data);
+        stream >> frame;
+    }
+
+    QCOMPARE(frame.methodClass(), QAmqpFrame::Basic);
+    QCOMPARE(frame.id(), qint16(40));
+}
+
+void tst_BenchQAMQPFrame::bodyFrameSerialise_data()
+{
+    QTest::addColumn<int>("payloadSize");
+    QTest::newRow("16B") << 16;
+    QTest::newRow("1KiB") << 1024;
+    QTest::newRow("64KiB") << 65536;
+}
+
+void tst_BenchQAMQPFrame::bodyFrameSerialise()
+{
+    QFETCH(int, payloadSize);
+
+    QAmqpContentBodyFrame frame;
+    frame.setChannel(1);
+    frame.setBody(QByteArray(payloadSize, 'p'));
+
+    QByteArray data;
+    QBENCHMARK {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << frame;
+    }
+
+    QCOMPARE(data.size(), int(QAmqpFrame::HEADER_SIZE + payloadSize + QAmqpFrame::FRAME_END_SIZE));
+}
+
+void tst_BenchQAMQPFrame::tableEncode_data()
+{
+    QTest::addColumn<QString>("shape");
+    QTest::newRow("flat") << QString("flat");
+    QTest::newRow("nested") << QString("nested");
+    QTest::newRow("deep") << QString("deep");
+}
+
+void tst_BenchQAMQPFrame::tableEncode()
+{
+    QFETCH(QString, shape);
+    QAmqpTable source = table(shape);
+
+    QByteArray data;
+    QBENCHMARK {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << source;
+    }
+
+    QVERIFY(!data.isEmpty());
+}
+
+void tst_BenchQAMQPFrame::tableDecode_data()
+{
+    tableEncode_data();
+}
+
+void tst_BenchQAMQPFrame::tableDecode()
+{
+    QFETCH(QString, shape);
+    QAmqpTable source = table(shape);
+
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out << source;
+
+    QAmqpTable decoded;
+    QBENCHMARK {
+        QDataStream stream(data);
+        decoded.clear();
+        stream >> decoded;
+    }
+
+    QCOMPARE(decoded.size(), source.size());
+}
+
+void tst_BenchQAMQPFrame::contentHeaderEncode_data()
+{
+    QTest::addColumn<bool>("withHeaders");
+    QTest::newRow("properties") << false;
+    QTest::newRow("properties+headers") << true;
+}
+
+void tst_BenchQAMQPFrame::contentHeaderEncode()
+{
+    QFETCH(bool, withHeaders);
+
+    QAmqpContentFrame frame(QAmqpFrame::Basic);
+    frame.setChannel(1);
+    frame.setBodySize(1024);
+    frame.setProperty(QAmqpMessage::ContentType, QLatin1String("application/octet-stream"));
+    frame.setProperty(QAmqpMessage::DeliveryMode, 2);
+    frame.setProperty(QAmqpMessage::CorrelationId, QLatin1String("3f2c9a"));
+    frame.setProperty(QAmqpMessage::ReplyTo, QLatin1String("amq.rabbitmq.reply-to"));
+    frame.setProperty(QAmqpMessage::MessageId, QLatin1String("bench-message-0001"));
+    frame.setProperty(QAmqpMessage::Timestamp, QDateTime::fromMSecsSinceEpoch(1500000000000));
+    if (withHeaders)
+        frame.setProperty(QAmqpMessage::Headers, table(QLatin1String("flat")));
+
+    QByteArray data;
+    QBENCHMARK {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << frame;
+    }
+
+    QVERIFY(data.size() > QAmqpFrame::HEADER_SIZE);
+}
+
+QTEST_MAIN(tst_BenchQAMQPFrame)
+#include "tst_bench_qamqpframe.moc"
@@ -0,0 +1,8 @@
+DEPTH = ../../..
+include($${DEPTH}/qamqp.pri)
+include($${DEPTH}/tests/bench/bench.pri)
+
+TARGET = tst_bench_qamqplogging
+SOURCES = tst_bench_qamqplogging.cpp
+
+include($${DEPTH}/tests/common/qamqptestbroker.pri)
@@ -0,0 +1,140 @@
+#include <QScopedPointer>
+
+#include <QtTest/QtTest>
+#include "qamqptestcase.h"
+#include "qamqptestbroker.h"
+
+#include "qamqpclient.h"
+#include "qamqpexchange.h"
+#include "qamqpglobal.h"
+#include "qamqptransport.h"
+
+static int loggedMessages = 0;
+static void countingMessageHandler(QtMsgType, const QMessageLogContext &, const QString &)
+{
+    ++loggedMessages;
+}
+
+static int evaluations = 0;
+static QString expensiveArgument()
+{
+    ++evaluations;
+    return QString(64, QLatin1Char('k'));
+}
+
+class tst_BenchQAMQPLogging : public TestCase
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void cleanup();
+
+    void disabledStatement_data();
+    void disabledStatement();
+    void publish_data();
+    void publish();
+
+private:
+    void drain();
+
+    QAmqpTestBroker broker;
+    QScopedPointer<QAmqpClient> client;
+    QAmqpExchange *defaultExchange;
+    QtMessageHandler previousHandler;
+
+};
+
+void tst_BenchQAMQPLogging::initTestCase()
+{
+    // formatting still happens for enabled categories, output goes nowhere
+    previousHandler = qInstallMessageHandler(countingMessageHandler);
+    QLoggingCategory::setFilterRules(QStringLiteral("qamqp.debug=false\nqamqp.protocol.debug=false"));
+
+    QVERIFY(broker.listen());
+    client.reset(new QAmqpClient);
+    client->connectToHost(broker.address(), broker.port());
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+    defaultExchange = client->createExchange();
+}
+
+void tst_BenchQAMQPLogging::cleanupTestCase()
+{
+    if (client->isConnected()) {
+        client->disconnectFromHost();
+        QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    }
+
+    QLoggingCategory::setFilterRules(QString());
+    qInstallMessageHandler(previousHandler);
+}
+
+void tst_BenchQAMQPLogging::cleanup()
+{
+    QLoggingCategory::setFilterRules(QStringLiteral("qamqp.debug=false\nqamqp.protocol.debug=false"));
+}
+
+void tst_BenchQAMQPLogging::drain()
+{
+    QIODevice *device = client->transport()->device();
+    while (device->bytesToWrite() > 0)
+        QCoreApplication::processEvents();
+}
+
+void tst_BenchQAMQPLogging::disabledStatement_data()
+{
+    QTest::addColumn<int>("statement");
+    QTest::newRow("no statement") << 0;
+    QTest::newRow("qAmqpDebug") << 1;
+    QTest::newRow("qAmqpProtocolDebug") << 2;
+}
+
+void tst_BenchQAMQPLogging::disabledStatement()
+{
+    QFETCH(int, statement);
+    evaluations = 0;
+    loggedMessages = 0;
+
+    // a disabled statement should cost the same as no statement at all
+    QBENCHMARK {
+        for (int i = 0; i < 100000; ++i) {
+            if (statement == 1)
+                qAmqpDebug("<- basic#publish( routing-key=%s )", qPrintable(expensiveArgument()));
+            else if (statement == 2)
+                qAmqpProtocolDebug("<- basic#publish( routing-key=%s )", qPrintable(expensiveArgument()));
+        }
+    }
+
+    QCOMPARE(evaluations, 0);
+    QCOMPARE(loggedMessages, 0);
+}
+
+void tst_BenchQAMQPLogging::publish_data()
+{
+    QTest::addColumn<bool>("protocolTrace");
+    QTest::newRow("protocol trace off") << false;
+    QTest::newRow("protocol trace on") << true;
+}
+
+void tst_BenchQAMQPLogging::publish()
+{
+    QFETCH(bool, protocolTrace);
+    if (protocolTrace)
+        QLoggingCategory::setFilterRules(QStringLiteral("qamqp.debug=false\nqamqp.protocol.debug=true"));
+
+    const QByteArray payload(16, 'p');
+    loggedMessages = 0;
+    QBENCHMARK {
+        for (int i = 0; i < 1000; ++i)
+            defaultExchange->publish(payload, "bench-logging-unrouted");
+        drain();
+    }
+
+    if (protocolTrace)
+        QVERIFY(loggedMessages > 0);
+    else
+        QCOMPARE(loggedMessages, 0);
+}
+
+QTEST_MAIN(tst_BenchQAMQPLogging)
+#include "tst_bench_qamqplogging.moc"
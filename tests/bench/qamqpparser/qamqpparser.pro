@@ -0,0 +1,6 @@
+DEPTH = ../../..
+include($${DEPTH}/qamqp.pri)
+include($${DEPTH}/tests/bench/bench.pri)
+
+TARGET = tst_bench_qamqpparser
+SOURCES = tst_bench_qamqpparser.cpp
@@ -0,0 +1,185 @@
+#include <QBuffer>
+
+#include <QtTest/QtTest>
+
+#include "qamqpclient.h"
+#include "qamqpclient_p.h"
+#include "qamqpframe_p.h"
+#include "qamqpqueue.h"
+
+class BenchClient : public QAmqpClient
+{
+public:
+    QAmqpClientPrivate *d() const { return d_ptr.data(); }
+};
+
+class FrameCounter : public QAmqpMethodFrameHandler,
+                     public QAmqpContentFrameHandler,
+                     public QAmqpContentBodyFrameHandler
+{
+public:
+    FrameCounter() : methods(0), headers(0), bodies(0), bytes(0) {}
+
+    bool _q_method(const QAmqpMethodFrame &) { ++methods; return true; }
+    void _q_content(const QAmqpContentFrame &) { ++headers; }
+    void _q_body(const QAmqpContentBodyFrame &frame) { ++bodies; bytes += frame.body().size(); }
+
+    int methods;
+    int headers;
+    int bodies;
+    qint64 bytes;
+};
+
+class tst_BenchQAMQPParser : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+
+    void readDeliveries_data();
+    void readDeliveries();
+    void readHeartbeats();
+    void consumeDeliveries_data();
+    void consumeDeliveries();
+
+private:
+    QByteArray deliveries(int count, int payloadSize, quint16 channel = 1) const;
+
+};
+
+void tst_BenchQAMQPParser::initTestCase()
+{
+    QAmqpFrame::setWriteTimeout(-2);
+}
+
+QByteArray tst_BenchQAMQPParser::deliveries(int count, int payloadSize, quint16 channel) const
+{
+    QByteArray wire;
+    QDataStream out(&wire, QIODevice::WriteOnly);
+    for (int i = 0; i < count; ++i) {
+        // basic.deliver
+        QAmqpMethodFrame deliver(QAmqpFrame::Basic, 60);
+        deliver.setChannel(channel);
+        QByteArray arguments;
+        QDataStream args(&arguments, QIODevice::WriteOnly);
+        QAmqpFrame::writeAmqpField(args, QAmqpMetaType::ShortString, QLatin1String("amq.ctag-bench"));
+        args << qlonglong(i + 1);
+        args << qint8(0);
+        QAmqpFrame::writeAmqpField(args, QAmqpMetaType::ShortString, QLatin1String(""));
+        QAmqpFrame::writeAmqpField(args, QAmqpMetaType::ShortString, QLatin1String("bench-queue"));
+        deliver.setArguments(arguments);
+        out << deliver;
+
+        QAmqpContentFrame header(QAmqpFrame::Basic);
+        header.setChannel(channel);
+        header.setBodySize(payloadSize);
+        header.setProperty(QAmqpMessage::ContentType, QLatin1String("application/octet-stream"));
+        header.setProperty(QAmqpMessage::DeliveryMode, 2);
+        out << header;
+
+        if (payloadSize) {
+            QAmqpContentBodyFrame body;
+            body.setChannel(channel);
+            body.setBody(QByteArray(payloadSize, 'p'));
+            out << body;
+        }
+    }
+
+    return wire;
+}
+
+void tst_BenchQAMQPParser::readDeliveries_data()
+{
+    QTest::addColumn<int>("payloadSize");
+    QTest::newRow("empty") << 0;
+    QTest::newRow("16B") << 16;
+    QTest::newRow("1KiB") << 1024;
+    QTest::newRow("64KiB") << 65536;
+}
+
+void tst_BenchQAMQPParser::readDeliveries()
+{
+    QFETCH(int, payloadSize);
+    const int count = 1000;
+    QByteArray wire = deliveries(count, payloadSize);
+
+    BenchClient client;
+    FrameCounter counter;
+    client.d()->methodHandlersByChannel[1].append(&counter);
+    client.d()->contentHandlerByChannel[1].append(&counter);
+    client.d()->bodyHandlersByChannel[1].append(&counter);
+
+    QBENCHMARK {
+        QBuffer device(&wire);
+        device.open(QIODevice::ReadOnly);
+        client.d()->readFrames(&device);
+        QCOMPARE(device.bytesAvailable(), qint64(0));
+    }
+
+    QVERIFY(counter.methods > 0);
+    QCOMPARE(counter.methods % count, 0);
+    QCOMPARE(counter.headers, counter.methods);
+    QCOMPARE(counter.bodies, payloadSize ? counter.methods : 0);
+}
+
+void tst_BenchQAMQPParser::readHeartbeats()
+{
+    QByteArray wire;
+    QDataStream out(&wire, QIODevice::WriteOnly);
+    for (int i = 0; i < 1000; ++i)
+        out << QAmqpHeartbeatFrame();
+
+    BenchClient client;
+    QBENCHMARK {
+        QBuffer device(&wire);
+        device.open(QIODevice::ReadOnly);
+        client.d()->readFrames(&device);
+    }
+}
+
+void tst_BenchQAMQPParser::consumeDeliveries_data()
+{
+    QTest::addColumn<QString>("mode");
+    QTest::newRow("signal") << "signal";
+    QTest::newRow("batch") << "batch";
+    QTest::newRow("callback") << "callback";
+}
+
+void tst_BenchQAMQPParser::consumeDeliveries()
+{
+    QFETCH(QString, mode);
+    const int count = 1000;
+
+    BenchClient client;
+    QAmqpQueue *queue = client.createQueue(QLatin1String("bench-queue"));
+    queue->setConsumerTag(QLatin1String("amq.ctag-bench"));
+    QByteArray wire = deliveries(count, 16, queue->channelNumber());
+
+    int received = 0;
+    if (mode == QLatin1String("callback")) {
+        queue->setMessageCallback([&](const QAmqpMessage &) { ++received; });
+    } else if (mode == QLatin1String("batch")) {
+        queue->setBatchDelivery(true);
+        connect(queue, &QAmqpQueue::messagesReceived, [&](int messages) {
+            queue->dequeueAll();
+            received += messages;
+        });
+    } else {
+        connect(queue, &QAmqpQueue::messageReceived, [&]() {
+            queue->dequeue();
+            ++received;
+        });
+    }
+
+    QBENCHMARK {
+        QBuffer device(&wire);
+        device.open(QIODevice::ReadOnly);
+        client.d()->readFrames(&device);
+    }
+
+    QVERIFY(received > 0);
+    QCOMPARE(received % count, 0);
+}
+
+QTEST_MAIN(tst_BenchQAMQPParser)
+#include "tst_bench_qamqpparser.moc"
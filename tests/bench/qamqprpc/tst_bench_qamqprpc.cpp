@@ -0,0 +1,119 @@
+#include <QElapsedTimer>
+#include <QScopedPointer>
+
+#include <algorithm>
+
+#include <QtTest/QtTest>
+#include "qamqptestcase.h"
+#include "qamqptestbroker.h"
+
+#include "qamqpclient.h"
+#include "qamqprpcclient.h"
+#include "qamqprpcserver.h"
+
+class tst_BenchQAMQPRpc : public TestCase
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void callLatency_data();
+    void callLatency();
+    void pipelinedCalls();
+
+private:
+    QAmqpTestBroker broker;
+    QScopedPointer<QAmqpClient> client;
+    QScopedPointer<QAmqpRpcServer> server;
+    QScopedPointer<QAmqpRpcClient> rpcClient;
+
+};
+
+void tst_BenchQAMQPRpc::initTestCase()
+{
+    QVERIFY(broker.listen());
+    client.reset(new QAmqpClient);
+    client->connectToHost(broker.address(), broker.port());
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+
+    server.reset(new QAmqpRpcServer(client.data(), "bench-rpc"));
+    server->setHandler([](const QAmqpMessage &request) { return request.payload(); });
+    server->listen();
+    QVERIFY(waitForSignal(server.data(), SIGNAL(listening())));
+
+    rpcClient.reset(new QAmqpRpcClient(client.data()));
+    QVERIFY(waitForSignal(rpcClient.data(), SIGNAL(ready())));
+}
+
+void tst_BenchQAMQPRpc::cleanupTestCase()
+{
+    rpcClient.reset();
+    server.reset();
+    if (client->isConnected()) {
+        client->disconnectFromHost();
+        QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    }
+}
+
+void tst_BenchQAMQPRpc::callLatency_data()
+{
+    QTest::addColumn<double>("percentile");
+    QTest::newRow("p50") << 0.50;
+    QTest::newRow("p99") << 0.99;
+}
+
+void tst_BenchQAMQPRpc::callLatency()
+{
+    QFETCH(double, percentile);
+    const int callCount = 2000;
+
+    // one call in flight at a time, each timed from call() to its reply
+    QElapsedTimer timer;
+    QVector<qint64> samples;
+    samples.reserve(callCount);
+    QMetaObject::Connection connection =
+        connect(rpcClient.data(), &QAmqpRpcClient::replyReceived, [&]() {
+        samples.append(timer.nsecsElapsed());
+        QTestEventLoop::instance().exitLoop();
+    });
+
+    for (int i = 0; i < callCount; ++i) {
+        timer.start();
+        rpcClient->call("bench-rpc", "ping");
+        QTestEventLoop::instance().enterLoop(5);
+        QVERIFY(!QTestEventLoop::instance().timeout());
+    }
+
+    disconnect(connection);
+    QCOMPARE(samples.size(), callCount);
+
+    std::sort(samples.begin(), samples.end());
+    int index = qMin(callCount - 1, int(percentile * callCount));
+    QTest::setBenchmarkResult(samples.at(index), QTest::WalltimeNanoseconds);
+}
+
+void tst_BenchQAMQPRpc::pipelinedCalls()
+{
+    const int callCount = 5000;
+    int replies = 0;
+    QMetaObject::Connection connection =
+        connect(rpcClient.data(), &QAmqpRpcClient::replyReceived, [&replies, callCount]() {
+        if (++replies == callCount)
+            QTestEventLoop::instance().exitLoop();
+    });
+
+    QBENCHMARK {
+        replies = 0;
+        for (int i = 0; i < callCount; ++i)
+            rpcClient->call("bench-rpc", QByteArray::number(i));
+
+        QTestEventLoop::instance().enterLoop(60);
+        QVERIFY(!QTestEventLoop::instance().timeout());
+    }
+
+    disconnect(connection);
+}
+
+QTEST_MAIN(tst_BenchQAMQPRpc)
+#include "tst_bench_qamqprpc.moc"
@@ -0,0 +1,98 @@
+#include <QScopedPointer>
+
+#include <QtTest/QtTest>
+#include "qamqptestcase.h"
+#include "qamqptestbroker.h"
+
+#include "qamqpclient.h"
+#include "qamqpexchange.h"
+#include "qamqpqueue.h"
+
+class tst_BenchQAMQPThroughput : public TestCase
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void publishConsume_data();
+    void publishConsume();
+
+private:
+    QAmqpTestBroker broker;
+    QScopedPointer<QAmqpClient> client;
+    QAmqpQueue *queue;
+    QAmqpExchange *defaultExchange;
+
+};
+
+void tst_BenchQAMQPThroughput::initTestCase()
+{
+    QVERIFY(broker.listen());
+    client.reset(new QAmqpClient);
+    client->connectToHost(broker.address(), broker.port());
+    QVERIFY(waitForSignal(client.data(), SIGNAL(connected())));
+
+    queue = client->createQueue("bench-throughput");
+    queue->declare(QAmqpQueue::Exclusive | QAmqpQueue::AutoDelete);
+    QVERIFY(waitForSignal(queue, SIGNAL(declared())));
+    QVERIFY(queue->consume());
+    QVERIFY(waitForSignal(queue, SIGNAL(consuming(QString))));
+
+    defaultExchange = client->createExchange();
+}
+
+void tst_BenchQAMQPThroughput::cleanupTestCase()
+{
+    if (client->isConnected()) {
+        client->disconnectFromHost();
+        QVERIFY(waitForSignal(client.data(), SIGNAL(disconnected())));
+    }
+}
+
+void tst_BenchQAMQPThroughput::publishConsume_data()
+{
+    QTest::addColumn<int>("messageCount");
+    QTest::addColumn<int>("payloadSize");
+    QTest::newRow("10000x16B") << 10000 << 16;
+    QTest::newRow("10000x1KiB") << 10000 << 1024;
+    QTest::newRow("1000x64KiB") << 1000 << 65536;
+}
+
+void tst_BenchQAMQPThroughput::publishConsume()
+{
+    QFETCH(int, messageCount);
+    QFETCH(int, payloadSize);
+    const QByteArray payload(payloadSize, 'p');
+
+    int received = 0;
+    QMetaObject::Connection connection =
+        connect(queue, &QAmqpQueue::messageReceived, [this, &received, messageCount]() {
+        qlonglong lastDeliveryTag = 0;
+        while (!queue->isEmpty()) {
+            lastDeliveryTag = queue->dequeue().deliveryTag();
+            ++received;
+        }
+
+        if (lastDeliveryTag)
+            queue->ack(lastDeliveryTag, true);
+        if (received == messageCount)
+            QTestEventLoop::instance().exitLoop();
+    });
+
+    // wall time for a full batch to make the round trip through the broker
+    QBENCHMARK {
+        received = 0;
+        for (int i = 0; i < messageCount; ++i)
+            defaultExchange->publish(payload, "bench-throughput", "application/octet-stream");
+
+        QTestEventLoop::instance().enterLoop(60);
+        QVERIFY(!QTestEventLoop::instance().timeout());
+        QCOMPARE(received, messageCount);
+    }
+
+    disconnect(connection);
+}
+
+QTEST_MAIN(tst_BenchQAMQPThroughput)
+#include "tst_bench_qamqpthroughput.moc"
@@ -0,0 +1,392 @@
+#include <QIODevice>
+
+#include "qamqpfaulttransport.h"
+
+/*
+ * What the client reads from and writes to. Reads are served from bytes the
+ * transport released, writes are handed back to the transport to be delayed
+ * and trickled out to the inner device.
+ */
+class QAmqpFaultDevice : public QIODevice
+{
+public:
+    explicit QAmqpFaultDevice(QAmqpFaultTransport *transport)
+        : QIODevice(transport),
+          transport(transport),
+          offset(0)
+    {
+        open(QIODevice::ReadWrite);
+    }
+
+    bool isSequential() const { return true; }
+
+    qint64 bytesAvailable() const {
+        return pending.size() - offset + QIODevice::bytesAvailable();
+    }
+
+    void deliver(const QByteArray &data) {
+        pending.append(data);
+        Q_EMIT readyRead();
+    }
+
+    void clear() {
+        pending.clear();
+        offset = 0;
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) {
+        const qint64 size = qMin<qint64>(maxSize, pending.size() - offset);
+        memcpy(data, pending.constData() + offset, size);
+        offset += size;
+        if (offset == pending.size())
+            clear();
+        return size;
+    }
+
+    qint64 writeData(const char *data, qint64 size) {
+        if (transport->stalled_)
+            return size;
+
+        transport->bytesSent_ += size;
+        transport->enqueue(&transport->outgoing_, QByteArray(data, size));
+        return size;
+    }
+
+private:
+    QAmqpFaultTransport *transport;
+    QByteArray pending;
+    int offset;
+
+};
+
+QAmqpFaultTransport::QAmqpFaultTransport(QAmqpTransport *inner, QObject *parent)
+    : QAmqpTransport(parent),
+      inner_(inner ? inner : new QAmqpSocketTransport(this)),
+      device_(new QAmqpFaultDevice(this)),
+      lastPump_(0),
+      latency_(0),
+      bandwidth_(0),
+      maxWriteChunk_(0),
+      maxReadFragment_(0),
+      disconnectAfter_(-1),
+      bytesReceived_(0),
+      bytesSent_(0),
+      dropped_(false),
+      stalled_(false),
+      seed_(1)
+{
+    inner_->setParent(this);
+    pumpTimer_.setSingleShot(true);
+    clock_.start();
+
+    connect(&pumpTimer_, &QTimer::timeout, this, &QAmqpFaultTransport::pump);
+    connect(inner_, &QAmqpTransport::connected, this, &QAmqpFaultTransport::innerConnected);
+    connect(inner_, &QAmqpTransport::disconnected, this, &QAmqpFaultTransport::innerDisconnected);
+    connect(inner_, &QAmqpTransport::readyRead, this, &QAmqpFaultTransport::innerReadyRead);
+    connect(inner_, &QAmqpTransport::errorOccurred, this, &QAmqpTransport::errorOccurred);
+    connect(inner_, &QAmqpTransport::stateChanged, this, &QAmqpTransport::stateChanged);
+}
+
+QAmqpFaultTransport::~QAmqpFaultTransport()
+{
+}
+
+QAmqpTransport *QAmqpFaultTransport::inner() const
+{
+    return inner_;
+}
+
+int QAmqpFaultTransport::latency() const
+{
+    return latency_;
+}
+
+void QAmqpFaultTransport::setLatency(int msecs)
+{
+    latency_ = qMax(0, msecs);
+}
+
+qint64 QAmqpFaultTransport::bandwidth() const
+{
+    return bandwidth_;
+}
+
+void QAmqpFaultTransport::setBandwidth(qint64 bytesPerSecond)
+{
+    bandwidth_ = qMax<qint64>(0, bytesPerSecond);
+    incoming_.budget = outgoing_.budget = 0;
+    lastPump_ = clock_.elapsed();
+}
+
+int QAmqpFaultTransport::maxWriteChunk() const
+{
+    return maxWriteChunk_;
+}
+
+void QAmqpFaultTransport::setMaxWriteChunk(int bytes)
+{
+    maxWriteChunk_ = qMax(0, bytes);
+}
+
+int QAmqpFaultTransport::maxReadFragment() const
+{
+    return maxReadFragment_;
+}
+
+void QAmqpFaultTransport::setMaxReadFragment(int bytes)
+{
+    maxReadFragment_ = qMax(0, bytes);
+}
+
+void QAmqpFaultTransport::setDisconnectAfter(qint64 bytes)
+{
+    disconnectAfter_ = bytes < 0 ? -1 : bytesReceived_ + bytes;
+}
+
+bool QAmqpFaultTransport::isStalled() const
+{
+    return stalled_;
+}
+
+void QAmqpFaultTransport::setStalled(bool stalled)
+{
+    stalled_ = stalled;
+}
+
+qint64 QAmqpFaultTransport::bytesReceived() const
+{
+    return bytesReceived_;
+}
+
+qint64 QAmqpFaultTransport::bytesSent() const
+{
+    return bytesSent_;
+}
+
+QIODevice *QAmqpFaultTransport::device() const
+{
+    return device_;
+}
+
+void QAmqpFaultTransport::connectToHost(const QString &host, quint16 port, bool encrypted)
+{
+    reset();
+    dropped_ = false;
+    stalled_ = false;
+    inner_->connectToHost(host, port, encrypted);
+}
+
+void QAmqpFaultTransport::disconnectFromHost()
+{
+    // a graceful close still gets out whatever was written before it
+    if (inner_->state() == QAbstractSocket::ConnectedState) {
+        while (!outgoing_.chunks.isEmpty())
+            inner_->device()->write(outgoing_.chunks.dequeue().data);
+    }
+
+    reset();
+    inner_->disconnectFromHost();
+}
+
+void QAmqpFaultTransport::abort()
+{
+    reset();
+    inner_->abort();
+}
+
+QAbstractSocket::SocketState QAmqpFaultTransport::state() const
+{
+    return inner_->state();
+}
+
+QAbstractSocket::SocketError QAmqpFaultTransport::error() const
+{
+    if (dropped_)
+        return QAbstractSocket::RemoteHostClosedError;
+    return inner_->error();
+}
+
+QString QAmqpFaultTransport::errorString() const
+{
+    if (dropped_)
+        return QLatin1String("connection dropped by fault injection");
+    return inner_->errorString();
+}
+
+void QAmqpFaultTransport::setSocketBufferSizes(qint64 sendSize, qint64 receiveSize)
+{
+    inner_->setSocketBufferSizes(sendSize, receiveSize);
+}
+
+qint64 QAmqpFaultTransport::sendBufferSize() const
+{
+    return inner_->sendBufferSize();
+}
+
+qint64 QAmqpFaultTransport::receiveBufferSize() const
+{
+    return inner_->receiveBufferSize();
+}
+
+void QAmqpFaultTransport::dropConnection()
+{
+    if (inner_->state() == QAbstractSocket::UnconnectedState)
+        return;
+
+    // what a reset by the peer looks like: an error first, then the teardown
+    dropped_ = true;
+    reset();
+    Q_EMIT errorOccurred(QAbstractSocket::RemoteHostClosedError);
+    if (inner_->state() != QAbstractSocket::UnconnectedState)
+        inner_->abort();
+}
+
+void QAmqpFaultTransport::innerConnected()
+{
+    if (!latency_) {
+        Q_EMIT connected();
+        return;
+    }
+
+    QTimer::singleShot(latency_, this, [this]() {
+        if (inner_->state() == QAbstractSocket::ConnectedState)
+            Q_EMIT connected();
+    });
+}
+
+void QAmqpFaultTransport::innerDisconnected()
+{
+    reset();
+    Q_EMIT disconnected();
+}
+
+void QAmqpFaultTransport::innerReadyRead()
+{
+    QByteArray data = inner_->device()->readAll();
+    if (stalled_)
+        return;
+
+    bool drop = false;
+    if (disconnectAfter_ >= 0 && bytesReceived_ + data.size() >= disconnectAfter_) {
+        data.truncate(disconnectAfter_ - bytesReceived_);
+        disconnectAfter_ = -1;
+        drop = true;
+    }
+
+    bytesReceived_ += data.size();
+    if (drop) {
+        dropConnection();
+        return;
+    }
+
+    enqueue(&incoming_, data);
+}
+
+void QAmqpFaultTransport::enqueue(Direction *direction, const QByteArray &data)
+{
+    if (data.isEmpty())
+        return;
+
+    const qint64 now = clock_.elapsed();
+    Chunk chunk;
+    chunk.due = now + latency_;
+    chunk.data = data;
+    direction->chunks.enqueue(chunk);
+    schedule(now);
+}
+
+QByteArray QAmqpFaultTransport::release(Direction *direction, qint64 now, int limit)
+{
+    QByteArray data;
+    while (!direction->chunks.isEmpty() && direction->chunks.head().due <= now) {
+        Chunk &chunk = direction->chunks.head();
+        qint64 size = chunk.data.size();
+        if (limit > 0)
+            size = qMin<qint64>(size, limit - data.size());
+        if (bandwidth_ > 0)
+            size = qMin(size, direction->budget);
+        if (size <= 0)
+            break;
+
+        if (size == chunk.data.size()) {
+            data.append(direction->chunks.dequeue().data);
+        } else {
+            data.append(chunk.data.constData(), size);
+            chunk.data.remove(0, size);
+        }
+
+        if (bandwidth_ > 0)
+            direction->budget -= size;
+    }
+
+    return data;
+}
+
+void QAmqpFaultTransport::pump()
+{
+    const qint64 now = clock_.elapsed();
+    if (bandwidth_ > 0) {
+        // token bucket refilled by elapsed time, bursts capped at 50ms worth
+        const qint64 refill = (now - lastPump_) * bandwidth_ / 1000;
+        if (refill > 0) {
+            const qint64 burst = qMax<qint64>(1, bandwidth_ / 20);
+            incoming_.budget = qMin(incoming_.budget + refill, burst);
+            outgoing_.budget = qMin(outgoing_.budget + refill, burst);
+            lastPump_ = now;
+        }
+    }
+
+    // one fragment per pass, the client gets an event loop turn in between
+    const int fragment = maxReadFragment_ > 0 ? int(nextRandom() % maxReadFragment_) + 1 : 0;
+    const QByteArray read = release(&incoming_, now, fragment);
+    const QByteArray write = release(&outgoing_, now, maxWriteChunk_);
+
+    if (!write.isEmpty() && inner_->state() == QAbstractSocket::ConnectedState)
+        inner_->device()->write(write);
+
+    if (!read.isEmpty()) {
+        device_->deliver(read);
+        Q_EMIT readyRead();
+    }
+
+    schedule(clock_.elapsed());
+}
+
+void QAmqpFaultTransport::schedule(qint64 now)
+{
+    qint64 delay = -1;
+    const Direction *directions[] = { &incoming_, &outgoing_ };
+    for (int i = 0; i < 2; ++i) {
+        if (directions[i]->chunks.isEmpty())
+            continue;
+
+        qint64 wait = qMax<qint64>(0, directions[i]->chunks.head().due - now);
+        if (!wait && bandwidth_ > 0 && directions[i]->budget <= 0)
+            wait = 1;
+        delay = delay < 0 ? wait : qMin(delay, wait);
+    }
+
+    if (delay < 0)
+        return;
+
+    if (!pumpTimer_.isActive() || pumpTimer_.remainingTime() > delay)
+        pumpTimer_.start(int(delay));
+}
+
+void QAmqpFaultTransport::reset()
+{
+    pumpTimer_.stop();
+    incoming_.chunks.clear();
+    outgoing_.chunks.clear();
+    incoming_.budget = outgoing_.budget = 0;
+    lastPump_ = clock_.elapsed();
+    device_->clear();
+}
+
+quint32 QAmqpFaultTransport::nextRandom()
+{
+    // fixed seed so a failing fragmentation pattern reproduces
+    seed_ = seed_ * 1103515245u + 12345u;
+    return (seed_ >> 16) & 0x7fff;
+}
@@ -0,0 +1,124 @@
+#ifndef QAMQPFAULTTRANSPORT_H
+#define QAMQPFAULTTRANSPORT_H
+
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QTimer>
+
+#include "qamqptransport.h"
+
+/*!
+ * A transport wrapping another one (a plain socket transport by default)
+ * that degrades the connection on purpose: one way latency, a bandwidth
+ * cap, writes trickled to the socket in small chunks, reads surfaced in
+ * randomly sized fragments that split frames at arbitrary byte boundaries,
+ * abrupt disconnects and peers that go silent.
+ */
+class QAmqpFaultDevice;
+class QAmqpFaultTransport : public QAmqpTransport
+{
+    Q_OBJECT
+public:
+    explicit QAmqpFaultTransport(QAmqpTransport *inner = 0, QObject *parent = 0);
+    ~QAmqpFaultTransport();
+
+    QAmqpTransport *inner() const;
+
+    /*! delay added to every byte in each direction, in milliseconds */
+    int latency() const;
+    void setLatency(int msecs);
+
+    /*! bytes per second in each direction, 0 means unlimited */
+    qint64 bandwidth() const;
+    void setBandwidth(qint64 bytesPerSecond);
+
+    /*! largest chunk handed to the inner transport at once, 0 means unlimited */
+    int maxWriteChunk() const;
+    void setMaxWriteChunk(int bytes);
+
+    /*! reads surface in fragments of 1 to this many bytes, 0 means unlimited */
+    int maxReadFragment() const;
+    void setMaxReadFragment(int bytes);
+
+    /*! abort the connection once this many bytes were received, -1 disables it */
+    void setDisconnectAfter(qint64 bytes);
+
+    /*!
+     * Silently discard traffic both ways while the connection stays up, the
+     * way a half-open TCP connection behaves. Cleared on the next connect.
+     */
+    bool isStalled() const;
+    void setStalled(bool stalled);
+
+    qint64 bytesReceived() const;
+    qint64 bytesSent() const;
+
+    virtual QIODevice *device() const;
+
+    virtual void connectToHost(const QString &host, quint16 port, bool encrypted);
+    virtual void disconnectFromHost();
+    virtual void abort();
+
+    virtual QAbstractSocket::SocketState state() const;
+    virtual QAbstractSocket::SocketError error() const;
+    virtual QString errorString() const;
+
+    virtual void setSocketBufferSizes(qint64 sendSize, qint64 receiveSize);
+    virtual qint64 sendBufferSize() const;
+    virtual qint64 receiveBufferSize() const;
+
+public Q_SLOTS:
+    /*! Fail the connection right now as if the peer had reset it */
+    void dropConnection();
+
+private:
+    struct Chunk
+    {
+        qint64 due;
+        QByteArray data;
+    };
+
+    struct Direction
+    {
+        Direction() : budget(0) {}
+
+        QQueue<Chunk> chunks;
+        qint64 budget;
+    };
+
+    void innerConnected();
+    void innerDisconnected();
+    void innerReadyRead();
+    void pump();
+    void schedule(qint64 now);
+    void enqueue(Direction *direction, const QByteArray &data);
+    QByteArray release(Direction *direction, qint64 now, int limit);
+    void reset();
+    quint32 nextRandom();
+
+    Q_DISABLE_COPY(QAmqpFaultTransport)
+    friend class QAmqpFaultDevice;
+
+    QAmqpTransport *inner_;
+    QAmqpFaultDevice *device_;
+    QTimer pumpTimer_;
+    QElapsedTimer clock_;
+    qint64 lastPump_;
+
+    int latency_;
+    qint64 bandwidth_;
+    int maxWriteChunk_;
+    int maxReadFragment_;
+    qint64 disconnectAfter_;
+    qint64 bytesReceived_;
+    qint64 bytesSent_;
+    bool dropped_;
+    bool stalled_;
+    quint32 seed_;
+
+    Direction incoming_;
+    Direction outgoing_;
+
+};
+
+#endif  // QAMQPFAULTTRANSPORT_H
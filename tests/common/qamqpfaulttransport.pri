@@ -0,0 +1,3 @@
+# network fault injecting transport, include after SOURCES has been set
+HEADERS += $${PWD}/qamqpfaulttransport.h
+SOURCES += $${PWD}/qamqpfaulttransport.cpp
@@ -0,0 +1,1473 @@
+#include <QDataStream>
+#include <QHash>
+#include <QMap>
+#include <QQueue>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QtEndian>
+
+#include "qamqpframe_p.h"
+#include "qamqpglobal.h"
+#include "qamqptable.h"
+#include "qamqptestbroker.h"
+
+namespace {
+
+enum ReplyCode {
+    NoRoute = 312,
+    ConnectionForced = 320,
+    AccessRefused = 403,
+    NotFound = 404,
+    ResourceLocked = 405,
+    PreconditionFailed = 406,
+    CommandInvalid = 503,
+    NotImplemented = 540
+};
+
+struct Message
+{
+    Message() : redelivered(false) {}
+
+    QString exchange;
+    QString routingKey;
+    QAmqpContentFrame header;
+    QByteArray body;
+    bool redelivered;
+};
+
+struct Binding
+{
+    QString queue;
+    QString routingKey;
+};
+
+struct Exchange
+{
+    QString name;
+    QString type;
+    QList<Binding> bindings;
+};
+
+struct Connection;
+struct Consumer
+{
+    QString tag;
+    QString queue;
+    Connection *connection;
+    quint16 channel;
+    bool noAck;
+};
+
+struct Queue
+{
+    Queue() : exclusive(false), autoDelete(false), owner(0), nextConsumer(0) {}
+
+    QString name;
+    bool exclusive;
+    bool autoDelete;
+    Connection *owner;
+    QQueue<Message> messages;
+    QList<Consumer*> consumers;
+    int nextConsumer;
+};
+
+struct Unacked
+{
+    QString queue;
+    Message message;
+};
+
+struct Channel
+{
+    Channel()
+        : closing(false), flowActive(true), confirming(false), prefetchCount(0),
+          publishSeq(0), nextDeliveryTag(0), publishing(false), mandatory(false), remaining(0)
+    {}
+
+    bool closing;
+    bool flowActive;
+    bool confirming;
+    int prefetchCount;
+    qlonglong publishSeq;
+    qlonglong nextDeliveryTag;
+    QMap<qlonglong, Unacked> unacked;
+    QString replyToTag;
+    QString lastQueue;
+
+    // content of the basic.publish currently being received
+    bool publishing;
+    bool mandatory;
+    Message incoming;
+    qlonglong remaining;
+};
+
+struct Connection
+{
+    Connection() : socket(0), id(0), handshake(false), closing(false), blockable(false) {}
+
+    QTcpSocket *socket;
+    int id;
+    bool handshake;
+    bool closing;
+    bool blockable;
+    QHash<quint16, Channel*> channels;
+    QByteArray out;
+};
+
+QString readShortString(QDataStream &in)
+{
+    return QAmqpFrame::readAmqpField(in, QAmqpMetaType::ShortString).toString();
+}
+
+void writeShortString(QDataStream &out, const QString &value)
+{
+    QAmqpFrame::writeAmqpField(out, QAmqpMetaType::ShortString, value);
+}
+
+// '*' matches exactly one word, '#' matches zero or more words
+bool topicMatches(const QStringList &pattern, int p, const QStringList &words, int w)
+{
+    if (p == pattern.size())
+        return w == words.size();
+
+    if (pattern.at(p) == QLatin1String("#")) {
+        for (int skip = w; skip <= words.size(); ++skip) {
+            if (topicMatches(pattern, p + 1, words, skip))
+                return true;
+        }
+        return false;
+    }
+
+    if (w == words.size())
+        return false;
+    if (pattern.at(p) != QLatin1String("*") && pattern.at(p) != words.at(w))
+        return false;
+    return topicMatches(pattern, p + 1, words, w + 1);
+}
+
+}   // namespace
+
+class QAmqpTestBrokerPrivate
+{
+public:
+    QAmqpTestBrokerPrivate(QAmqpTestBroker *q);
+    ~QAmqpTestBrokerPrivate();
+
+    void newConnection();
+    void readyRead(Connection *connection);
+    void disconnected(Connection *connection);
+    void heartbeat();
+    void flush();
+
+    // outgoing
+    void sendMethod(Connection *connection, quint16 channel, QAmqpFrame::MethodClass methodClass,
+                    qint16 id, const QByteArray &arguments = QByteArray());
+    void sendContent(Connection *connection, quint16 channel, const Message &message);
+    void channelError(Connection *connection, quint16 channel, int code, const QString &text,
+                      int classId, int methodId);
+    void connectionError(Connection *connection, int code, const QString &text,
+                         int classId = 0, int methodId = 0);
+
+    // incoming
+    void handleMethod(Connection *connection, const QAmqpMethodFrame &frame);
+    void handleConnection(Connection *connection, const QAmqpMethodFrame &frame);
+    void handleChannel(Connection *connection, Channel *channel, const QAmqpMethodFrame &frame);
+    void handleExchange(Connection *connection, Channel *channel, const QAmqpMethodFrame &frame);
+    void handleQueue(Connection *connection, Channel *channel, const QAmqpMethodFrame &frame);
+    void handleBasic(Connection *connection, Channel *channel, const QAmqpMethodFrame &frame);
+    void handleHeader(Connection *connection, const QAmqpContentFrame &frame);
+    void handleBody(Connection *connection, const QAmqpContentBodyFrame &frame);
+
+    // broker state
+    QStringList route(const QString &exchange, const QString &routingKey) const;
+    void completePublish(Connection *connection, quint16 channelNumber, Channel *channel);
+    void dispatch(Queue *queue);
+    void dispatchAll();
+    void deliver(Consumer *consumer, Channel *channel, const Message &message);
+    void settle(Channel *channel, qlonglong deliveryTag, bool multiple, bool ack, bool requeue);
+    void requeue(const QList<Unacked> &messages);
+    void cancelConsumer(Consumer *consumer);
+    void closeChannel(Connection *connection, quint16 channelNumber);
+    void deleteQueue(const QString &name);
+    QString replyToAddress(Connection *connection, quint16 channel) const;
+
+    QTcpServer server;
+    QTimer heartbeatTimer;
+    int heartbeatSeconds;
+    int frameMax;
+    int nextId;
+
+    QList<Connection*> connections;
+    QHash<QString, Exchange> exchanges;
+    QHash<QString, Queue*> queues;
+
+    QAmqpTestBroker * const q;
+};
+
+QAmqpTestBrokerPrivate::QAmqpTestBrokerPrivate(QAmqpTestBroker *broker)
+    : heartbeatSeconds(0),
+      frameMax(AMQP_FRAME_MAX),
+      nextId(0),
+      q(broker)
+{
+    const char *standard[][2] = {
+        { "", "direct" },
+        { "amq.direct", "direct" },
+        { "amq.fanout", "fanout" },
+        { "amq.topic", "topic" }
+    };
+
+    for (uint i = 0; i < sizeof(standard) / sizeof(standard[0]); ++i) {
+        Exchange exchange;
+        exchange.name = QLatin1String(standard[i][0]);
+        exchange.type = QLatin1String(standard[i][1]);
+        exchanges.insert(exchange.name, exchange);
+    }
+}
+
+QAmqpTestBrokerPrivate::~QAmqpTestBrokerPrivate()
+{
+    foreach (Connection *connection, connections) {
+        connection->socket->disconnect();
+        connection->socket->abort();
+        connection->socket->deleteLater();
+        qDeleteAll(connection->channels);
+        delete connection;
+    }
+
+    foreach (Queue *queue, queues) {
+        qDeleteAll(queue->consumers);
+        delete queue;
+    }
+}
+
+void QAmqpTestBrokerPrivate::newConnection()
+{
+    while (server.hasPendingConnections()) {
+        Connection *connection = new Connection;
+        connection->socket = server.nextPendingConnection();
+        connection->socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        connection->id = ++nextId;
+        connections.append(connection);
+
+        QObject::connect(connection->socket, &QTcpSocket::readyRead,
+                         q, [this, connection]() { readyRead(connection); });
+        QObject::connect(connection->socket, &QTcpSocket::disconnected,
+                         q, [this, connection]() { disconnected(connection); });
+        Q_EMIT q->clientConnected();
+    }
+}
+
+void QAmqpTestBrokerPrivate::readyRead(Connection *connection)
+{
+    QTcpSocket *socket = connection->socket;
+    if (!connection->handshake) {
+        if (socket->bytesAvailable() < 8)
+            return;
+
+        QByteArray protocolHeader = socket->read(8);
+        if (!protocolHeader.startsWith("AMQP")) {
+            socket->write(QByteArray("AMQP\x00\x00\x09\x01", 8));
+            socket->disconnectFromHost();
+            return;
+        }
+
+        connection->handshake = true;
+
+        QAmqpTable capabilities;
+        capabilities.insert(QLatin1String("publisher_confirms"), true);
+        capabilities.insert(QLatin1String("basic.nack"), true);
+        capabilities.insert(QLatin1String("direct_reply_to"), true);
+        QAmqpTable serverProperties;
+        serverProperties.insert(QLatin1String("product"), QLatin1String("QAmqpTestBroker"));
+        serverProperties.insert(QLatin1String("capabilities"), capabilities);
+
+        QByteArray arguments;
+        QDataStream out(&arguments, QIODevice::WriteOnly);
+        out << quint8(0) << quint8(9);
+        out << serverProperties;
+        QAmqpFrame::writeAmqpField(out, QAmqpMetaType::LongString, QLatin1String("AMQPLAIN PLAIN"));
+        QAmqpFrame::writeAmqpField(out, QAmqpMetaType::LongString, QLatin1String("en_US"));
+        sendMethod(connection, 0, QAmqpFrame::Connection, 10, arguments);
+    }
+
+    QByteArray buffer;
+    while (connections.contains(connection) &&
+           socket->bytesAvailable() >= QAmqpFrame::HEADER_SIZE) {
+        unsigned char headerData[QAmqpFrame::HEADER_SIZE];
+        socket->peek((char*)headerData, QAmqpFrame::HEADER_SIZE);
+        const quint32 payloadSize = qFromBigEndian<quint32>(headerData + 3);
+        const qint64 readSize = QAmqpFrame::HEADER_SIZE + payloadSize + QAmqpFrame::FRAME_END_SIZE;
+        if (socket->bytesAvailable() < readSize)
+            break;
+
+        buffer.resize(readSize);
+        socket->read(buffer.data(), readSize);
+        if (quint8(buffer.at(readSize - 1)) != QAmqpFrame::FRAME_END) {
+            connectionError(connection, 501, QLatin1String("FRAME_ERROR - wrong end of frame"));
+            break;
+        }
+
+        QDataStream stream(buffer);
+        switch (headerData[0]) {
+        case QAmqpFrame::Method:
+        {
+            QAmqpMethodFrame frame;
+            stream >> frame;
+            handleMethod(connection, frame);
+        }
+            break;
+        case QAmqpFrame::Header:
+        {
+            QAmqpContentFrame frame;
+            stream >> frame;
+            handleHeader(connection, frame);
+        }
+            break;
+        case QAmqpFrame::Body:
+        {
+            QAmqpContentBodyFrame frame;
+            stream >> frame;
+            handleBody(connection, frame);
+        }
+            break;
+        case QAmqpFrame::Heartbeat:
+            break;
+        default:
+            connectionError(connection, 501, QLatin1String("FRAME_ERROR - unknown frame type"));
+            break;
+        }
+    }
+
+    flush();
+}
+
+void QAmqpTestBrokerPrivate::disconnected(Connection *connection)
+{
+    if (!connections.removeOne(connection))
+        return;
+
+    foreach (quint16 channelNumber, connection->channels.keys())
+        closeChannel(connection, channelNumber);
+
+    foreach (Queue *queue, queues) {
+        if (queue->exclusive && queue->owner == connection)
+            deleteQueue(queue->name);
+    }
+
+    connection->socket->deleteLater();
+    delete connection;
+    dispatchAll();
+    flush();
+    Q_EMIT q->clientDisconnected();
+}
+
+void QAmqpTestBrokerPrivate::heartbeat()
+{
+    foreach (Connection *connection, connections) {
+        if (!connection->handshake)
+            continue;
+
+        QAmqpHeartbeatFrame frame;
+        QDataStream stream(&connection->out, QIODevice::WriteOnly | QIODevice::Append);
+        stream << frame;
+    }
+
+    flush();
+}
+
+void QAmqpTestBrokerPrivate::flush()
+{
+    foreach (Connection *connection, connections) {
+        if (connection->out.isEmpty())
+            continue;
+
+        connection->socket->write(connection->out);
+        connection->out.clear();
+        if (connection->closing)
+            connection->socket->disconnectFromHost();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void QAmqpTestBrokerPrivate::sendMethod(Connection *connection, quint16 channel,
+                                        QAmqpFrame::MethodClass methodClass, qint16 id,
+                                        const QByteArray &arguments)
+{
+    QAmqpMethodFrame frame(methodClass, id);
+    frame.setChannel(channel);
+    frame.setArguments(arguments);
+
+    // frames are batched into the connection's buffer and written in one go
+    // when the current read pass is over
+    QDataStream stream(&connection->out, QIODevice::WriteOnly | QIODevice::Append);
+    stream << frame;
+}
+
+void QAmqpTestBrokerPrivate::sendContent(Connection *connection, quint16 channel,
+                                         const Message &message)
+{
+    QDataStream stream(&connection->out, QIODevice::WriteOnly | QIODevice::Append);
+    QAmqpContentFrame header = message.header;
+    header.setChannel(channel);
+    header.setBodySize(message.body.size());
+    stream << header;
+
+    const int chunkSize = frameMax - int(QAmqpFrame::HEADER_SIZE + QAmqpFrame::FRAME_END_SIZE);
+    for (int sent = 0; sent < message.body.size(); sent += chunkSize) {
+        QAmqpContentBodyFrame body;
+        body.setChannel(channel);
+        body.setBody(message.body.mid(sent, chunkSize));
+        stream << body;
+    }
+}
+
+void QAmqpTestBrokerPrivate::channelError(Connection *connection, quint16 channelNumber, int code,
+                                          const QString &text, int classId, int methodId)
+{
+    Channel *channel = connection->channels.value(channelNumber);
+    if (!channel || channel->closing)
+        return;
+
+    closeChannel(connection, channelNumber);
+    channel = new Channel;
+    channel->closing = true;
+    connection->channels.insert(channelNumber, channel);
+
+    QByteArray arguments;
+    QDataStream out(&arguments, QIODevice::WriteOnly);
+    out << qint16(code);
+    writeShortString(out, text);
+    out << qint16(classId) << qint16(methodId);
+    sendMethod(connection, channelNumber, QAmqpFrame::Channel, 40, arguments);
+}
+
+void QAmqpTestBrokerPrivate::connectionError(Connection *connection, int code, const QString &text,
+                                             int classId, int methodId)
+{
+    if (connection->closing)
+        return;
+
+    QByteArray arguments;
+    QDataStream out(&arguments, QIODevice::WriteOnly);
+    out << qint16(code);
+    writeShortString(out, text);
+    out << qint16(classId) << qint16(methodId);
+    sendMethod(connection, 0, QAmqpFrame::Connection, 50, arguments);
+    connection->closing = true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void QAmqpTestBrokerPrivate::handleMethod(Connection *connection, const QAmqpMethodFrame &frame)
+{
+    if (connection->closing)
+        return;
+
+    if (frame.methodClass() == QAmqpFrame::Connection) {
+        handleConnection(connection, frame);
+        return;
+    }
+
+    quint16 channelNumber = frame.channel();
+    Channel *channel = connection->channels.value(channelNumber);
+    if (frame.methodClass() == QAmqpFrame::Channel) {
+        handleChannel(connection, channel, frame);
+        return;
+    }
+
+    if (!channel) {
+        connectionError(connection, 504, QLatin1String("CHANNEL_ERROR - expected 'channel.open'"),
+                        frame.methodClass(), frame.id());
+        return;
+    }
+
+    // everything but the close handshake is discarded on a closing channel
+    if (channel->closing)
+        return;
+
+    switch (frame.methodClass()) {
+    case QAmqpFrame::Exchange:
+        handleExchange(connection, channel, frame);
+        break;
+    case QAmqpFrame::Queue:
+        handleQueue(connection, channel, frame);
+        break;
+    case QAmqpFrame::Basic:
+        handleBasic(connection, channel, frame);
+        break;
+    case QAmqpFrame::Confirm:
+        if (frame.id() == 10) {
+            QByteArray arguments = frame.arguments();
+            QDataStream in(arguments);
+            qint8 noWait = 0;
+            in >> noWait;
+            channel->confirming = true;
+            if (!noWait)
+                sendMethod(connection, channelNumber, QAmqpFrame::Confirm, 11);
+        }
+        break;
+    default:
+        channelError(connection, channelNumber, NotImplemented,
+                     QLatin1String("NOT_IMPLEMENTED - not supported by the test broker"),
+                     frame.methodClass(), frame.id());
+        break;
+    }
+}
+
+void QAmqpTestBrokerPrivate::handleConnection(Connection *connection, const QAmqpMethodFrame &frame)
+{
+    switch (frame.id()) {
+    case 11:    // start-ok, any credentials are accepted
+    {
+        // connection.blocked only goes to clients that announce they know it
+        QByteArray startOk = frame.arguments();
+        QDataStream in(startOk);
+        QAmqpTable clientProperties;
+        in >> clientProperties;
+        const QAmqpTable capabilities = clientProperties.value(QLatin1String("capabilities")).value<QAmqpTable>();
+        connection->blockable = capabilities.value(QLatin1String("connection.blocked")).toBool();
+
+        QByteArray arguments;
+        QDataStream out(&arguments, QIODevice::WriteOnly);
+        out << qint16(2047) << qint32(frameMax) << qint16(heartbeatSeconds);
+        sendMethod(connection, 0, QAmqpFrame::Connection, 30, arguments);
+    }
+        break;
+    case 31:    // tune-ok
+        break;
+    case 40:    // open
+    {
+        QByteArray arguments;
+        QDataStream out(&arguments, QIODevice::WriteOnly);
+        writeShortString(out, QString());
+        sendMethod(connection, 0, QAmqpFrame::Connection, 41, arguments);
+    }
+        break;
+    case 50:    // close
+        sendMethod(connection, 0, QAmqpFrame::Connection, 51);
+        connection->closing = true;
+        break;
+    case 51:    // close-ok
+        connection->socket->disconnectFromHost();
+        break;
+    default:
+        break;
+    }
+}
+
+void QAmqpTestBrokerPrivate::handleChannel(Connection *connection, Channel *channel,
+                                           const QAmqpMethodFrame &frame)
+{
+    quint16 channelNumber = frame.channel();
+    QByteArray arguments = frame.arguments();
+    QDataStream in(arguments);
+
+    switch (frame.id()) {
+    case 10:    // open
+    {
+        if (channel) {
+            connectionError(connection, 504, QLatin1String("CHANNEL_ERROR - second 'channel.open'"),
+                            QAmqpFrame::Channel, 10);
+            return;
+        }
+
+        connection->channels.insert(channelNumber, new Channel);
+        QByteArray reply;
+        QDataStream out(&reply, QIODevice::WriteOnly);
+        out << qint32(0);
+        sendMethod(connection, channelNumber, QAmqpFrame::Channel, 11, reply);
+    }
+        break;
+    case 20:    // flow
+    {
+        if (!channel)
+            return;
+
+        qint8 active = 0;
+        in >> active;
+        channel->flowActive = active;
+        QByteArray reply;
+        QDataStream out(&reply, QIODevice::WriteOnly);
+        out << active;
+        sendMethod(connection, channelNumber, QAmqpFrame::Channel, 21, reply);
+        if (active)
+            dispatchAll();
+    }
+        break;
+    case 40:    // close
+        closeChannel(connection, channelNumber);
+        sendMethod(connection, channelNumber, QAmqpFrame::Channel, 41);
+        dispatchAll();
+        break;
+    case 41:    // close-ok, the server initiated close is complete
+        closeChannel(connection, channelNumber);
+        break;
+    default:
+        break;
+    }
+}
+
+void QAmqpTestBrokerPrivate::handleExchange(Connection *connection, Channel *channel,
+                                            const QAmqpMethodFrame &frame)
+{
+    Q_UNUSED(channel)
+    quint16 channelNumber = frame.channel();
+    QByteArray arguments = frame.arguments();
+    QDataStream in(arguments);
+    qint16 reserved = 0;
+    in >> reserved;
+
+    switch (frame.id()) {
+    case 10:    // declare
+    {
+        QString name = readShortString(in);
+        QString type = readShortString(in);
+        qint8 options = 0;
+        in >> options;
+        bool passive = options & 0x01;
+        bool noWait = options & 0x10;
+
+        if (exchanges.contains(name)) {
+            if (!passive && exchanges.value(name).type != type) {
+                channelError(connection, channelNumber, PreconditionFailed,
+                             QString("PRECONDITION_FAILED - inequivalent arg 'type' for exchange '%1'").arg(name),
+                             QAmqpFrame::Exchange, 10);
+                return;
+            }
+        } else if (passive) {
+            channelError(connection, channelNumber, NotFound,
+                         QString("NOT_FOUND - no exchange '%1'").arg(name), QAmqpFrame::Exchange, 10);
+            return;
+        } else if (name.startsWith(QLatin1String("amq."))) {
+            channelError(connection, channelNumber, AccessRefused,
+                         QString("ACCESS_REFUSED - exchange name '%1' contains reserved prefix 'amq.*'").arg(name),
+                         QAmqpFrame::Exchange, 10);
+            return;
+        } else if (type != QLatin1String("direct") && type != QLatin1String("fanout") &&
+                   type != QLatin1String("topic")) {
+            connectionError(connection, CommandInvalid,
+                            QString("COMMAND_INVALID - unknown exchange type '%1'").arg(type),
+                            QAmqpFrame::Exchange, 10);
+            return;
+        } else {
+            Exchange exchange;
+            exchange.name = name;
+            exchange.type = type;
+            exchanges.insert(name, exchange);
+        }
+
+        if (!noWait)
+            sendMethod(connection, channelNumber, QAmqpFrame::Exchange, 11);
+    }
+        break;
+    case 20:    // delete
+    {
+        QString name = readShortString(in);
+        qint8 options = 0;
+        in >> options;
+        bool ifUnused = options & 0x01;
+        bool noWait = options & 0x02;
+
+        if (exchanges.contains(name)) {
+            if (ifUnused && !exchanges.value(name).bindings.isEmpty()) {
+                channelError(connection, channelNumber, PreconditionFailed,
+                             QString("PRECONDITION_FAILED - exchange '%1' in use").arg(name),
+                             QAmqpFrame::Exchange, 20);
+                return;
+            }
+
+            exchanges.remove(name);
+        }
+
+        if (!noWait)
+            sendMethod(connection, channelNumber, QAmqpFrame::Exchange, 21);
+    }
+        break;
+    default:
+        channelError(connection, channelNumber, NotImplemented,
+                     QLatin1String("NOT_IMPLEMENTED - exchange to exchange bindings"),
+                     QAmqpFrame::Exchange, frame.id());
+        break;
+    }
+}
+
+void QAmqpTestBrokerPrivate::handleQueue(Connection *connection, Channel *channel,
+                                         const QAmqpMethodFrame &frame)
+{
+    quint16 channelNumber = frame.channel();
+    QByteArray arguments = frame.arguments();
+    QDataStream in(arguments);
+    qint16 reserved = 0;
+    in >> reserved;
+    QString name = readShortString(in);
+
+    // an empty name refers to the queue last declared on the channel
+    if (name.isEmpty() && frame.id() != 10)
+        name = channel->lastQueue;
+
+    if (frame.id() != 10 && !queues.contains(name)) {
+        channelError(connection, channelNumber, NotFound,
+                     QString("NOT_FOUND - no queue '%1'").arg(name), QAmqpFrame::Queue, frame.id());
+        return;
+    }
+
+    switch (frame.id()) {
+    case 10:    // declare
+    {
+        qint8 options = 0;
+        in >> options;
+        bool passive = options & 0x01;
+        bool exclusive = options & 0x04;
+        bool autoDelete = options & 0x08;
+        bool noWait = options & 0x10;
+
+        if (name.isEmpty())
+            name = QString("amq.gen-%1").arg(++nextId);
+
+        Queue *queue = queues.value(name);
+        if (!queue && passive) {
+            channelError(connection, channelNumber, NotFound,
+                         QString("NOT_FOUND - no queue '%1'").arg(name), QAmqpFrame::Queue, 10);
+            return;
+        } else if (queue && queue->exclusive && queue->owner != connection) {
+            channelError(connection, channelNumber, ResourceLocked,
+                         QString("RESOURCE_LOCKED - cannot obtain exclusive access to locked queue '%1'").arg(name),
+                         QAmqpFrame::Queue, 10);
+            return;
+        } else if (!queue) {
+            queue = new Queue;
+            queue->name = name;
+            queue->exclusive = exclusive;
+            queue->autoDelete = autoDelete;
+            queue->owner = connection;
+            queues.insert(name, queue);
+        }
+
+        channel->lastQueue = name;
+        if (!noWait) {
+            QByteArray reply;
+            QDataStream out(&reply, QIODevice::WriteOnly);
+            writeShortString(out, name);
+            out << qint32(queue->messages.size()) << qint32(queue->consumers.size());
+            sendMethod(connection, channelNumber, QAmqpFrame::Queue, 11, reply);
+        }
+    }
+        break;
+    case 20:    // bind
+    case 50:    // unbind
+    {
+        QString exchangeName = readShortString(in);
+        QString routingKey = readShortString(in);
+        qint8 noWait = 0;
+        if (frame.id() == 20)
+            in >> noWait;
+
+        if (exchangeName.isEmpty()) {
+            channelError(connection, channelNumber, AccessRefused,
+                         QLatin1String("ACCESS_REFUSED - operation not permitted on the default exchange"),
+                         QAmqpFrame::Queue, frame.id());
+            return;
+        } else if (!exchanges.contains(exchangeName)) {
+            channelError(connection, channelNumber, NotFound,
+                         QString("NOT_FOUND - no exchange '%1'").arg(exchangeName),
+                         QAmqpFrame::Queue, frame.id());
+            return;
+        }
+
+        QList<Binding> &bindings = exchanges[exchangeName].bindings;
+        for (int i = 0; i < bindings.size(); ++i) {
+            if (bindings.at(i).queue == name && bindings.at(i).routingKey == routingKey) {
+                bindings.removeAt(i);
+                break;
+            }
+        }
+
+        if (frame.id() == 20) {
+            Binding binding;
+            binding.queue = name;
+            binding.routingKey = routingKey;
+            bindings.append(binding);
+        }
+
+        if (!noWait)
+            sendMethod(connection, channelNumber, QAmqpFrame::Queue, frame.id() + 1);
+    }
+        break;
+    case 30:    // purge
+    {
+        qint8 noWait = 0;
+        in >> noWait;
+
+        Queue *queue = queues.value(name);
+        int count = queue->messages.size();
+        queue->messages.clear();
+        if (!noWait) {
+            QByteArray reply;
+            QDataStream out(&reply, QIODevice::WriteOnly);
+            out << qint32(count);
+            sendMethod(connection, channelNumber, QAmqpFrame::Queue, 31, reply);
+        }
+    }
+        break;
+    case 40:    // delete
+    {
+        qint8 options = 0;
+        in >> options;
+        bool ifUnused = options & 0x01;
+        bool ifEmpty = options & 0x02;
+        bool noWait = options & 0x04;
+
+        Queue *queue = queues.value(name);
+        if ((ifUnused && !queue->consumers.isEmpty()) || (ifEmpty && !queue->messages.isEmpty())) {
+            channelError(connection, channelNumber, PreconditionFailed,
+                         QString("PRECONDITION_FAILED - queue '%1' in use").arg(name),
+                         QAmqpFrame::Queue, 40);
+            return;
+        }
+
+        int count = queue->messages.size();
+        deleteQueue(name);
+        if (!noWait) {
+            QByteArray reply;
+            QDataStream out(&reply, QIODevice::WriteOnly);
+            out << qint32(count);
+            sendMethod(connection, channelNumber, QAmqpFrame::Queue, 41, reply);
+        }
+    }
+        break;
+    default:
+        break;
+    }
+}
+
+void QAmqpTestBrokerPrivate::handleBasic(Connection *connection, Channel *channel,
+                                         const QAmqpMethodFrame &frame)
+{
+    quint16 channelNumber = frame.channel();
+    QByteArray arguments = frame.arguments();
+    QDataStream in(arguments);
+
+    switch (frame.id()) {
+    case 10:    // qos
+    {
+        qint32 prefetchSize = 0;
+        qint16 prefetchCount = 0;
+        qint8 global = 0;
+        in >> prefetchSize >> prefetchCount >> global;
+        channel->prefetchCount = quint16(prefetchCount);
+        sendMethod(connection, channelNumber, QAmqpFrame::Basic, 11);
+        dispatchAll();
+    }
+        break;
+    case 20:    // consume
+    {
+        qint16 reserved = 0;
+        in >> reserved;
+        QString queueName = readShortString(in);
+        QString tag = readShortString(in);
+        qint8 options = 0;
+        in >> options;
+        bool noAck = options & 0x02;
+        if (queueName.isEmpty())
+            queueName = channel->lastQueue;
+        bool noWait = options & 0x08;
+
+        if (tag.isEmpty())
+            tag = QString("amq.ctag-%1").arg(++nextId);
+
+        if (queueName == QLatin1String(AMQP_DIRECT_REPLY_TO)) {
+            if (!noAck) {
+                channelError(connection, channelNumber, PreconditionFailed,
+                             QLatin1String("PRECONDITION_FAILED - reply consumer cannot acknowledge"),
+                             QAmqpFrame::Basic, 20);
+                return;
+            }
+
+            channel->replyToTag = tag;
+        } else {
+            Queue *queue = queues.value(queueName);
+            if (!queue) {
+                channelError(connection, channelNumber, NotFound,
+                             QString("NOT_FOUND - no queue '%1'").arg(queueName), QAmqpFrame::Basic, 20);
+                return;
+            }
+
+            Consumer *consumer = new Consumer;
+            consumer->tag = tag;
+            consumer->queue = queueName;
+            consumer->connection = connection;
+            consumer->channel = channelNumber;
+            consumer->noAck = noAck;
+            queue->consumers.append(consumer);
+        }
+
+        if (!noWait) {
+            QByteArray reply;
+            QDataStream out(&reply, QIODevice::WriteOnly);
+            writeShortString(out, tag);
+            sendMethod(connection, channelNumber, QAmqpFrame::Basic, 21, reply);
+        }
+
+        if (queues.contains(queueName))
+            dispatch(queues.value(queueName));
+    }
+        break;
+    case 30:    // cancel
+    {
+        QString tag = readShortString(in);
+        qint8 noWait = 0;
+        in >> noWait;
+
+        if (channel->replyToTag == tag) {
+            channel->replyToTag.clear();
+        } else {
+            Consumer *cancelled = 0;
+            foreach (Queue *queue, queues) {
+                foreach (Consumer *consumer, queue->consumers) {
+                    if (consumer->connection == connection && consumer->channel == channelNumber &&
+                        consumer->tag == tag)
+                        cancelled = consumer;
+                }
+            }
+
+            if (cancelled)
+                cancelConsumer(cancelled);
+        }
+
+        if (!noWait) {
+            QByteArray reply;
+            QDataStream out(&reply, QIODevice::WriteOnly);
+            writeShortString(out, tag);
+            sendMethod(connection, channelNumber, QAmqpFrame::Basic, 31, reply);
+        }
+    }
+        break;
+    case 40:    // publish
+    {
+        qint16 reserved = 0;
+        in >> reserved;
+        QString exchangeName = readShortString(in);
+        QString routingKey = readShortString(in);
+        qint8 options = 0;
+        in >> options;
+
+        if (!exchanges.contains(exchangeName)) {
+            channelError(connection, channelNumber, NotFound,
+                         QString("NOT_FOUND - no exchange '%1'").arg(exchangeName), QAmqpFrame::Basic, 40);
+            return;
+        }
+
+        channel->publishing = true;
+        channel->mandatory = options & 0x01;
+        channel->incoming = Message();
+        channel->incoming.exchange = exchangeName;
+        channel->incoming.routingKey = routingKey;
+        channel->remaining = -1;
+    }
+        break;
+    case 70:    // get
+    {
+        qint16 reserved = 0;
+        in >> reserved;
+        QString queueName = readShortString(in);
+        qint8 noAck = 0;
+        in >> noAck;
+
+        Queue *queue = queues.value(queueName);
+        if (!queue) {
+            channelError(connection, channelNumber, NotFound,
+                         QString("NOT_FOUND - no queue '%1'").arg(queueName), QAmqpFrame::Basic, 70);
+            return;
+        }
+
+        if (queue->messages.isEmpty()) {
+            QByteArray reply;
+            QDataStream out(&reply, QIODevice::WriteOnly);
+            writeShortString(out, QString());
+            sendMethod(connection, channelNumber, QAmqpFrame::Basic, 72, reply);
+            return;
+        }
+
+        Message message = queue->messages.dequeue();
+        qlonglong deliveryTag = ++channel->nextDeliveryTag;
+        if (!noAck) {
+            Unacked unacked;
+            unacked.queue = queueName;
+            unacked.message = message;
+            channel->unacked.insert(deliveryTag, unacked);
+        }
+
+        QByteArray reply;
+        QDataStream out(&reply, QIODevice::WriteOnly);
+        out << deliveryTag;
+        out << qint8(message.redelivered ? 1 : 0);
+        writeShortString(out, message.exchange);
+        writeShortString(out, message.routingKey);
+        out << qint32(queue->messages.size());
+        sendMethod(connection, channelNumber, QAmqpFrame::Basic, 71, reply);
+        sendContent(connection, channelNumber, message);
+    }
+        break;
+    case 80:    // ack
+    {
+        qlonglong deliveryTag = 0;
+        qint8 multiple = 0;
+        in >> deliveryTag >> multiple;
+        settle(channel, deliveryTag, multiple, true, false);
+    }
+        break;
+    case 90:    // reject
+    {
+        qlonglong deliveryTag = 0;
+        qint8 requeue = 0;
+        in >> deliveryTag >> requeue;
+        settle(channel, deliveryTag, false, false, requeue);
+    }
+        break;
+    case 110:   // recover
+    {
+        QList<Unacked> unacked = channel->unacked.values();
+        channel->unacked.clear();
+        requeue(unacked);
+        sendMethod(connection, channelNumber, QAmqpFrame::Basic, 111);
+        dispatchAll();
+    }
+        break;
+    case 120:   // nack
+    {
+        qlonglong deliveryTag = 0;
+        qint8 options = 0;
+        in >> deliveryTag >> options;
+        settle(channel, deliveryTag, options & 0x01, false, options & 0x02);
+    }
+        break;
+    default:
+        channelError(connection, channelNumber, NotImplemented,
+                     QLatin1String("NOT_IMPLEMENTED - not supported by the test broker"),
+                     QAmqpFrame::Basic, frame.id());
+        break;
+    }
+}
+
+void QAmqpTestBrokerPrivate::handleHeader(Connection *connection, const QAmqpContentFrame &frame)
+{
+    Channel *channel = connection->channels.value(frame.channel());
+    if (!channel || channel->closing)
+        return;
+
+    if (!channel->publishing || channel->remaining != -1) {
+        connectionError(connection, 505, QLatin1String("UNEXPECTED_FRAME - content header"),
+                        QAmqpFrame::Basic, 40);
+        return;
+    }
+
+    channel->incoming.header = frame;
+    channel->remaining = frame.bodySize();
+    channel->incoming.body.reserve(int(channel->remaining));
+    if (channel->remaining == 0)
+        completePublish(connection, frame.channel(), channel);
+}
+
+void QAmqpTestBrokerPrivate::handleBody(Connection *connection, const QAmqpContentBodyFrame &frame)
+{
+    Channel *channel = connection->channels.value(frame.channel());
+    if (!channel || channel->closing)
+        return;
+
+    if (!channel->publishing || channel->remaining <= 0) {
+        connectionError(connection, 505, QLatin1String("UNEXPECTED_FRAME - content body"),
+                        QAmqpFrame::Basic, 40);
+        return;
+    }
+
+    QByteArray body = frame.body();
+    channel->incoming.body.append(body);
+    channel->remaining -= body.size();
+    if (channel->remaining <= 0)
+        completePublish(connection, frame.channel(), channel);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+QStringList QAmqpTestBrokerPrivate::route(const QString &exchangeName, const QString &routingKey) const
+{
+    QStringList targets;
+    if (exchangeName.isEmpty()) {
+        if (queues.contains(routingKey))
+            targets.append(routingKey);
+        return targets;
+    }
+
+    const Exchange exchange = exchanges.value(exchangeName);
+    const QStringList words = routingKey.split(QLatin1Char('.'));
+    foreach (const Binding &binding, exchange.bindings) {
+        bool matches = false;
+        if (exchange.type == QLatin1String("fanout"))
+            matches = true;
+        else if (exchange.type == QLatin1String("topic"))
+            matches = topicMatches(binding.routingKey.split(QLatin1Char('.')), 0, words, 0);
+        else
+            matches = (binding.routingKey == routingKey);
+
+        if (matches && !targets.contains(binding.queue) && queues.contains(binding.queue))
+            targets.append(binding.queue);
+    }
+
+    return targets;
+}
+
+QString QAmqpTestBrokerPrivate::replyToAddress(Connection *connection, quint16 channel) const
+{
+    return QString("%1.%2.%3").arg(QLatin1String(AMQP_DIRECT_REPLY_TO))
+                              .arg(connection->id).arg(channel);
+}
+
+void QAmqpTestBrokerPrivate::completePublish(Connection *connection, quint16 channelNumber,
+                                             Channel *channel)
+{
+    Message message = channel->incoming;
+    channel->incoming = Message();
+    channel->publishing = false;
+
+    // direct reply-to: requests name the pseudo-queue, replies are routed
+    // straight back to the requesting channel's reply consumer
+    const QString replyToPrefix = QLatin1String(AMQP_DIRECT_REPLY_TO ".");
+    if (!channel->replyToTag.isEmpty() &&
+        message.header.property(QAmqpMessage::ReplyTo).toString() == QLatin1String(AMQP_DIRECT_REPLY_TO))
+        message.header.setProperty(QAmqpMessage::ReplyTo, replyToAddress(connection, channelNumber));
+
+    bool routed = false;
+    if (message.exchange.isEmpty() && message.routingKey.startsWith(replyToPrefix)) {
+        foreach (Connection *target, connections) {
+            foreach (quint16 targetNumber, target->channels.keys()) {
+                Channel *targetChannel = target->channels.value(targetNumber);
+                if (targetChannel->replyToTag.isEmpty() || targetChannel->closing ||
+                    replyToAddress(target, targetNumber) != message.routingKey)
+                    continue;
+
+                Consumer consumer;
+                consumer.tag = targetChannel->replyToTag;
+                consumer.connection = target;
+                consumer.channel = targetNumber;
+                consumer.noAck = true;
+                deliver(&consumer, targetChannel, message);
+                routed = true;
+            }
+        }
+    } else {
+        foreach (const QString &queueName, route(message.exchange, message.routingKey)) {
+            Queue *queue = queues.value(queueName);
+            queue->messages.enqueue(message);
+            dispatch(queue);
+            routed = true;
+        }
+    }
+
+    if (!routed && channel->mandatory) {
+        QByteArray arguments;
+        QDataStream out(&arguments, QIODevice::WriteOnly);
+        out << qint16(NoRoute);
+        writeShortString(out, QLatin1String("NO_ROUTE"));
+        writeShortString(out, message.exchange);
+        writeShortString(out, message.routingKey);
+        sendMethod(connection, channelNumber, QAmqpFrame::Basic, 50, arguments);
+        sendContent(connection, channelNumber, message);
+    }
+
+    if (channel->confirming) {
+        QByteArray arguments;
+        QDataStream out(&arguments, QIODevice::WriteOnly);
+        out << qlonglong(++channel->publishSeq) << qint8(0);
+        sendMethod(connection, channelNumber, QAmqpFrame::Basic, 80, arguments);
+    }
+}
+
+void QAmqpTestBrokerPrivate::dispatch(Queue *queue)
+{
+    while (!queue->messages.isEmpty() && !queue->consumers.isEmpty()) {
+        Consumer *target = 0;
+        Channel *targetChannel = 0;
+        const int count = queue->consumers.size();
+        for (int i = 0; i < count; ++i) {
+            int index = (queue->nextConsumer + i) % count;
+            Consumer *consumer = queue->consumers.at(index);
+            Channel *channel = consumer->connection->channels.value(consumer->channel);
+            if (!channel || channel->closing || !channel->flowActive)
+                continue;
+            if (!consumer->noAck && channel->prefetchCount &&
+                channel->unacked.size() >= channel->prefetchCount)
+                continue;
+
+            target = consumer;
+            targetChannel = channel;
+            queue->nextConsumer = (index + 1) % count;
+            break;
+        }
+
+        if (!target)
+            return;
+        deliver(target, targetChannel, queue->messages.dequeue());
+    }
+}
+
+void QAmqpTestBrokerPrivate::dispatchAll()
+{
+    foreach (Queue *queue, queues)
+        dispatch(queue);
+}
+
+void QAmqpTestBrokerPrivate::deliver(Consumer *consumer, Channel *channel, const Message &message)
+{
+    qlonglong deliveryTag = ++channel->nextDeliveryTag;
+    if (!consumer->noAck) {
+        Unacked unacked;
+        unacked.queue = consumer->queue;
+        unacked.message = message;
+        channel->unacked.insert(deliveryTag, unacked);
+    }
+
+    QByteArray arguments;
+    QDataStream out(&arguments, QIODevice::WriteOnly);
+    writeShortString(out, consumer->tag);
+    out << deliveryTag;
+    out << qint8(message.redelivered ? 1 : 0);
+    writeShortString(out, message.exchange);
+    writeShortString(out, message.routingKey);
+    sendMethod(consumer->connection, consumer->channel, QAmqpFrame::Basic, 60, arguments);
+    sendContent(consumer->connection, consumer->channel, message);
+}
+
+void QAmqpTestBrokerPrivate::settle(Channel *channel, qlonglong deliveryTag, bool multiple,
+                                    bool ack, bool requeueMessages)
+{
+    QList<Unacked> settled;
+    if (multiple) {
+        QMap<qlonglong, Unacked>::iterator it = channel->unacked.begin();
+        while (it != channel->unacked.end() && (deliveryTag == 0 || it.key() <= deliveryTag)) {
+            settled.append(it.value());
+            it = channel->unacked.erase(it);
+        }
+    } else if (channel->unacked.contains(deliveryTag)) {
+        settled.append(channel->unacked.take(deliveryTag));
+    }
+
+    if (!ack && requeueMessages)
+        requeue(settled);
+
+    if (!settled.isEmpty())
+        dispatchAll();
+}
+
+void QAmqpTestBrokerPrivate::requeue(const QList<Unacked> &messages)
+{
+    // put them back at the head in their original order
+    for (int i = messages.size() - 1; i >= 0; --i) {
+        Queue *queue = queues.value(messages.at(i).queue);
+        if (!queue)
+            continue;
+
+        Message message = messages.at(i).message;
+        message.redelivered = true;
+        queue->messages.prepend(message);
+    }
+}
+
+void QAmqpTestBrokerPrivate::cancelConsumer(Consumer *consumer)
+{
+    Queue *queue = queues.value(consumer->queue);
+    if (queue) {
+        queue->consumers.removeOne(consumer);
+        queue->nextConsumer = 0;
+        if (queue->autoDelete && queue->consumers.isEmpty())
+            deleteQueue(queue->name);
+    }
+
+    delete consumer;
+}
+
+void QAmqpTestBrokerPrivate::closeChannel(Connection *connection, quint16 channelNumber)
+{
+    Channel *channel = connection->channels.take(channelNumber);
+    if (!channel)
+        return;
+
+    // collected up front, cancelling may delete an auto-delete queue
+    QList<Consumer*> cancelled;
+    foreach (Queue *queue, queues) {
+        foreach (Consumer *consumer, queue->consumers) {
+            if (consumer->connection == connection && consumer->channel == channelNumber)
+                cancelled.append(consumer);
+        }
+    }
+
+    foreach (Consumer *consumer, cancelled)
+        cancelConsumer(consumer);
+    requeue(channel->unacked.values());
+    delete channel;
+}
+
+void QAmqpTestBrokerPrivate::deleteQueue(const QString &name)
+{
+    Queue *queue = queues.take(name);
+    if (!queue)
+        return;
+
+    for (QHash<QString, Exchange>::iterator it = exchanges.begin(); it != exchanges.end(); ++it) {
+        QList<Binding> &bindings = it.value().bindings;
+        for (int i = bindings.size() - 1; i >= 0; --i) {
+            if (bindings.at(i).queue == name)
+                bindings.removeAt(i);
+        }
+    }
+
+    qDeleteAll(queue->consumers);
+    delete queue;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+QAmqpTestBroker::QAmqpTestBroker(QObject *parent)
+    : QObject(parent),
+      d(new QAmqpTestBrokerPrivate(this))
+{
+    connect(&d->server, &QTcpServer::newConnection, this, [this]() { d->newConnection(); });
+    connect(&d->heartbeatTimer, &QTimer::timeout, this, [this]() { d->heartbeat(); });
+}
+
+QAmqpTestBroker::~QAmqpTestBroker()
+{
+}
+
+bool QAmqpTestBroker::listen(const QHostAddress &address, quint16 port)
+{
+    return d->server.listen(address, port);
+}
+
+bool QAmqpTestBroker::isListening() const
+{
+    return d->server.isListening();
+}
+
+void QAmqpTestBroker::close()
+{
+    d->server.close();
+}
+
+QHostAddress QAmqpTestBroker::address() const
+{
+    return d->server.serverAddress();
+}
+
+quint16 QAmqpTestBroker::port() const
+{
+    return d->server.serverPort();
+}
+
+QString QAmqpTestBroker::url() const
+{
+    return QString("amqp://guest:guest@%1:%2/").arg(address().toString()).arg(port());
+}
+
+int QAmqpTestBroker::heartbeat() const
+{
+    return d->heartbeatSeconds;
+}
+
+void QAmqpTestBroker::setHeartbeat(int seconds)
+{
+    d->heartbeatSeconds = seconds;
+    if (seconds > 0)
+        d->heartbeatTimer.start(seconds * 1000);
+    else
+        d->heartbeatTimer.stop();
+}
+
+int QAmqpTestBroker::frameMax() const
+{
+    return d->frameMax;
+}
+
+void QAmqpTestBroker::setFrameMax(int frameMax)
+{
+    d->frameMax = frameMax;
+}
+
+int QAmqpTestBroker::connectionCount() const
+{
+    return d->connections.size();
+}
+
+bool QAmqpTestBroker::hasExchange(const QString &name) const
+{
+    return d->exchanges.contains(name);
+}
+
+bool QAmqpTestBroker::hasQueue(const QString &name) const
+{
+    return d->queues.contains(name);
+}
+
+int QAmqpTestBroker::messageCount(const QString &queueName) const
+{
+    Queue *queue = d->queues.value(queueName);
+    return queue ? queue->messages.size() : -1;
+}
+
+int QAmqpTestBroker::consumerCount(const QString &queueName) const
+{
+    Queue *queue = d->queues.value(queueName);
+    return queue ? queue->consumers.size() : -1;
+}
+
+void QAmqpTestBroker::closeConnections(int code, const QString &text)
+{
+    foreach (Connection *connection, d->connections)
+        d->connectionError(connection, code, text);
+    d->flush();
+}
+
+void QAmqpTestBroker::setPublishFlow(bool active)
+{
+    QByteArray arguments;
+    QDataStream out(&arguments, QIODevice::WriteOnly);
+    out << qint8(active ? 1 : 0);
+
+    foreach (Connection *connection, d->connections) {
+        QHash<quint16, Channel*>::const_iterator it;
+        for (it = connection->channels.constBegin(); it != connection->channels.constEnd(); ++it)
+            d->sendMethod(connection, it.key(), QAmqpFrame::Channel, 20, arguments);
+    }
+    d->flush();
+}
+
+void QAmqpTestBroker::blockConnections(const QString &reason)
+{
+    QByteArray arguments;
+    QDataStream out(&arguments, QIODevice::WriteOnly);
+    writeShortString(out, reason);
+
+    foreach (Connection *connection, d->connections) {
+        if (connection->blockable)
+            d->sendMethod(connection, 0, QAmqpFrame::Connection, 60, arguments);
+    }
+    d->flush();
+}
+
+void QAmqpTestBroker::unblockConnections()
+{
+    foreach (Connection *connection, d->connections) {
+        if (connection->blockable)
+            d->sendMethod(connection, 0, QAmqpFrame::Connection, 61);
+    }
+    d->flush();
+}
+
+void QAmqpTestBroker::dropConnections()
+{
+    foreach (Connection *connection, d->connections)
+        connection->socket->abort();
+}
@@ -0,0 +1,76 @@
+#ifndef QAMQPTESTBROKER_H
+#define QAMQPTESTBROKER_H
+
+#include <QHostAddress>
+#include <QObject>
+#include <QScopedPointer>
+
+/*!
+ * A minimal in-process AMQP 0-9-1 broker for hermetic tests and benchmarks.
+ *
+ * It speaks enough of the protocol for the client library: connection and
+ * channel negotiation, exchange and queue declaration, direct, fanout and
+ * topic routing, publish, consume, get, ack/nack/reject, qos, publisher
+ * confirms and direct reply-to. Nothing is persisted and every connection
+ * is accepted regardless of credentials or virtual host.
+ */
+class QAmqpTestBrokerPrivate;
+class QAmqpTestBroker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QAmqpTestBroker(QObject *parent = 0);
+    ~QAmqpTestBroker();
+
+    bool listen(const QHostAddress &address = QHostAddress::LocalHost, quint16 port = 0);
+    bool isListening() const;
+    void close();
+
+    QHostAddress address() const;
+    quint16 port() const;
+    QString url() const;
+
+    /*! heartbeat interval in seconds proposed in connection.tune, 0 disables it */
+    int heartbeat() const;
+    void setHeartbeat(int seconds);
+
+    int frameMax() const;
+    void setFrameMax(int frameMax);
+
+    int connectionCount() const;
+    bool hasExchange(const QString &name) const;
+    bool hasQueue(const QString &name) const;
+    int messageCount(const QString &queueName) const;
+    int consumerCount(const QString &queueName) const;
+
+public Q_SLOTS:
+    /*! Close every client connection with connection.close */
+    void closeConnections(int code = 320,
+                          const QString &text = QLatin1String("CONNECTION_FORCED - broker forced connection closure"));
+
+    /*! Abort every client connection without a closing handshake */
+    void dropConnections();
+
+    /*! Send channel.flow to every open channel */
+    void setPublishFlow(bool active);
+
+    /*!
+     * Send connection.blocked, or connection.unblocked, to every client that
+     * announced the capability. Publishes are still accepted meanwhile, so
+     * a test can tell whether the client held them back.
+     */
+    void blockConnections(const QString &reason = QLatin1String("low on memory"));
+    void unblockConnections();
+
+Q_SIGNALS:
+    void clientConnected();
+    void clientDisconnected();
+
+private:
+    Q_DISABLE_COPY(QAmqpTestBroker)
+    QScopedPointer<QAmqpTestBrokerPrivate> d;
+    friend class QAmqpTestBrokerPrivate;
+
+};
+
+#endif  // QAMQPTESTBROKER_H
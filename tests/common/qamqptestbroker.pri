@@ -0,0 +1,3 @@
+# in-process broker stand-in, include after SOURCES has been set
+HEADERS += $${PWD}/qamqptestbroker.h
+SOURCES += $${PWD}/qamqptestbroker.cpp
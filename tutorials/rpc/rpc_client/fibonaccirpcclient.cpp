@@ -1,21 +1,22 @@
 #include <QCoreApplication>
 #include <QEventLoop>
-#include <QUuid>
 
 #include "qamqpclient.h"
-#include "qamqpexchange.h"
-#include "qamqpqueue.h"
+#include "qamqprpcclient.h"
 
 #include "fibonaccirpcclient.h"
 
 FibonacciRpcClient::FibonacciRpcClient(QObject *parent)
     : QObject(parent),
       m_client(0),
-      m_responseQueue(0),
-      m_defaultExchange(0)
+      m_rpcClient(0)
 {
     m_client = new QAmqpClient(this);
-    connect(m_client, SIGNAL(connected()), this, SLOT(clientConnected()));
+    m_rpcClient = new QAmqpRpcClient(m_client, this);
+    connect(m_rpcClient, SIGNAL(ready()), this, SIGNAL(connected()));
+    connect(m_rpcClient, SIGNAL(replyReceived(QString,QAmqpMessage)),
+            this, SLOT(responseReceived(QString,QAmqpMessage)));
+    connect(m_rpcClient, SIGNAL(callTimedOut(QString)), this, SLOT(callTimedOut(QString)));
 }
 
 FibonacciRpcClient::~FibonacciRpcClient()
@@ -29,44 +30,25 @@ bool FibonacciRpcClient::connectToServer()
     m_client->connectToHost();
     loop.exec();
 
-    return m_client->isConnected();
+    return m_rpcClient->isReady();
 }
 
 void FibonacciRpcClient::call(int number)
 {
     qDebug() << " [x] Requesting fib(" << number << ")";
-    m_correlationId = QUuid::createUuid().toString();
-    QAmqpMessage::PropertyHash properties;
-    properties.insert(QAmqpMessage::ReplyTo, m_responseQueue->name());
-    properties.insert(QAmqpMessage::CorrelationId, m_correlationId);
-
-    m_defaultExchange->publish(QByteArray::number(number), "rpc_queue", properties);
-}
-
-void FibonacciRpcClient::clientConnected()
-{
-    m_responseQueue = m_client->createQueue();
-    connect(m_responseQueue, SIGNAL(declared()), this, SLOT(queueDeclared()));
-    connect(m_responseQueue, SIGNAL(messageReceived()), this, SLOT(responseReceived()));
-    m_responseQueue->declare(QAmqpQueue::Exclusive | QAmqpQueue::AutoDelete);
-    m_defaultExchange = m_client->createExchange();
+    m_rpcClient->call("rpc_queue", QByteArray::number(number));
 }
 
-void FibonacciRpcClient::queueDeclared()
+void FibonacciRpcClient::responseReceived(const QString &correlationId, const QAmqpMessage &reply)
 {
-    m_responseQueue->consume();
-    Q_EMIT connected();
+    Q_UNUSED(correlationId)
+    qDebug() << " [.] Got " << reply.payload();
+    qApp->quit();
 }
 
-void FibonacciRpcClient::responseReceived()
+void FibonacciRpcClient::callTimedOut(const QString &correlationId)
 {
-    QAmqpMessage message = m_responseQueue->dequeue();
-    if (message.property(QAmqpMessage::CorrelationId).toString() != m_correlationId) {
-        // requeue message, it wasn't meant for us
-        m_responseQueue->reject(message, true);
-        return;
-    }
-
-    qDebug() << " [.] Got " << message.payload();
+    Q_UNUSED(correlationId)
+    qDebug() << " [!] Request timed out";
     qApp->quit();
 }
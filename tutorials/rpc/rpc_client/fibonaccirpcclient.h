@@ -3,9 +3,10 @@
 
 #include <QObject>
 
-class QAmqpQueue;
-class QAmqpExchange;
+#include "qamqpmessage.h"
+
 class QAmqpClient;
+class QAmqpRpcClient;
 class FibonacciRpcClient : public QObject
 {
     Q_OBJECT
@@ -21,15 +22,12 @@ public Q_SLOTS:
     void call(int number);
 
 private Q_SLOTS:
-    void clientConnected();
-    void queueDeclared();
-    void responseReceived();
+    void responseReceived(const QString &correlationId, const QAmqpMessage &reply);
+    void callTimedOut(const QString &correlationId);
 
 private:
     QAmqpClient *m_client;
-    QAmqpQueue *m_responseQueue;
-    QAmqpExchange *m_defaultExchange;
-    QString m_correlationId;
+    QAmqpRpcClient *m_rpcClient;
 
 };
 
@@ -1,17 +1,21 @@
+#include <QDebug>
+
 #include "qamqpclient.h"
-#include "qamqpqueue.h"
-#include "qamqpexchange.h"
+#include "qamqprpcserver.h"
 
 #include "server.h"
 
 Server::Server(QObject *parent)
     : QObject(parent),
       m_client(0),
-      m_rpcQueue(0),
-      m_defaultExchange(0)
+      m_rpcServer(0)
 {
     m_client = new QAmqpClient(this);
-    connect(m_client, SIGNAL(connected()), this, SLOT(clientConnected()));
+    m_rpcServer = new QAmqpRpcServer(m_client, "rpc_queue", this);
+    m_rpcServer->setHandler([](const QAmqpMessage &request) {
+        return QByteArray::number(Server::fib(request.payload().toInt()));
+    });
+    connect(m_rpcServer, SIGNAL(listening()), this, SLOT(serverListening()));
 }
 
 Server::~Server()
@@ -20,6 +24,7 @@ Server::~Server()
 
 void Server::listen()
 {
+    m_rpcServer->listen();
     m_client->connectToHost();
 }
 
@@ -34,38 +39,7 @@ int Server::fib(int n)
     return fib(n - 1) + fib(n - 2);
 }
 
-void Server::clientConnected()
+void Server::serverListening()
 {
-    m_rpcQueue = m_client->createQueue("rpc_queue");
-    connect(m_rpcQueue, SIGNAL(declared()), this, SLOT(queueDeclared()));
-    connect(m_rpcQueue, SIGNAL(qosDefined()), this, SLOT(qosDefined()));
-    connect(m_rpcQueue, SIGNAL(messageReceived()), this, SLOT(processRpcMessage()));
-    m_rpcQueue->declare();
-
-    m_defaultExchange = m_client->createExchange();
-}
-
-void Server::queueDeclared()
-{
-    m_rpcQueue->qos(1);
-}
-
-void Server::qosDefined()
-{
-    m_rpcQueue->consume();
     qDebug() << " [x] Awaiting RPC requests";
 }
-
-void Server::processRpcMessage()
-{
-    QAmqpMessage rpcMessage = m_rpcQueue->dequeue();
-    int n = rpcMessage.payload().toInt();
-
-    int response = fib(n);
-    m_rpcQueue->ack(rpcMessage);
-
-    QString replyTo = rpcMessage.property(QAmqpMessage::ReplyTo).toString();
-    QAmqpMessage::PropertyHash properties;
-    properties.insert(QAmqpMessage::CorrelationId, rpcMessage.property(QAmqpMessage::CorrelationId));
-    m_defaultExchange->publish(QByteArray::number(response), replyTo, properties);
-}
@@ -3,9 +3,8 @@
 
 #include <QObject>
 
-class QAmqpQueue;
-class QAmqpExchange;
 class QAmqpClient;
+class QAmqpRpcServer;
 class Server : public QObject
 {
     Q_OBJECT
@@ -13,20 +12,17 @@ public:
     explicit Server(QObject *parent = 0);
     ~Server();
 
+    static int fib(int n);
+
 public Q_SLOTS:
     void listen();
-    int fib(int n);
 
 private Q_SLOTS:
-    void clientConnected();
-    void queueDeclared();
-    void qosDefined();
-    void processRpcMessage();
+    void serverListening();
 
 private:
     QAmqpClient *m_client;
-    QAmqpQueue *m_rpcQueue;
-    QAmqpExchange *m_defaultExchange;
+    QAmqpRpcServer *m_rpcServer;
 
 };
 